@@ -46,51 +46,12 @@
 #include "intel_io.h"
 #include "ioctl_wrappers.h"
 
-enum {
-	ADD_BO = 0,
-	DEL_BO,
-	ADD_CTX,
-	DEL_CTX,
-	EXEC,
-	WAIT,
-};
-
-struct trace_add_bo {
-	uint32_t handle;
-	uint64_t size;
-} __attribute__((packed));
-
-struct trace_del_bo {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_add_ctx {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_del_ctx {
-	uint32_t handle;
-} __attribute__((packed));
-
-struct trace_exec {
-	uint32_t object_count;
-	uint64_t flags;
-	uint32_t context;
-}__attribute__((packed));
-
-struct trace_exec_object {
-	uint32_t handle;
-	uint32_t relocation_count;
-	uint64_t alignment;
-	uint64_t offset;
-	uint64_t flags;
-	uint64_t rsvd1;
-	uint64_t rsvd2;
-}__attribute__((packed));
-
-struct trace_wait {
-	uint32_t handle;
-} __attribute__((packed));
+#include "gem_exec_trace.h"
+
+/* Window of execbufs to replay, and whether to keep their timing */
+static uint64_t first_exec;
+static uint64_t max_execs;
+static bool timing;
 
 static uint32_t hars_petruska_f54_1_random(void)
 {
@@ -113,57 +74,63 @@ static uint32_t __gem_context_create_local(int fd)
 	return arg.ctx_id;
 }
 
+static void wait_until(const struct timespec *start, uint64_t offset)
+{
+	struct timespec ts = *start;
+
+	offset += ts.tv_nsec;
+	ts.tv_sec += offset / NSEC_PER_SEC;
+	ts.tv_nsec = offset % NSEC_PER_SEC;
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
 static double replay(const char *filename, long nop, long range)
 {
 	struct timespec t_start, t_end;
 	struct drm_i915_gem_execbuffer2 eb = {};
-	const struct trace_version {
-		uint32_t magic;
-		uint32_t version;
-	} *tv;
 	const uint32_t bbe = 0xa << 23;
 	struct drm_i915_gem_exec_object2 *exec_objects = NULL;
+	struct trace_reader tr;
 	uint32_t *bo, *ctx;
+	uint64_t *bo_size;
+	bool *ctx_live;
 	int num_bo, num_ctx;
 	int max_objects = 0;
-	struct stat st;
-	uint8_t *ptr, *end;
+	uint64_t exec, last_exec, t0 = 0;
+	bool started = false, timed = timing;
+	size_t buf_size = 0;
+	void *buf = NULL;
+	unsigned int n;
 	int fd;
 
-	fd = open(filename, O_RDONLY);
-	if (fd < 0)
+	if (trace_open(&tr, filename))
 		return -1;
 
-	if (fstat(fd, &st) < 0) {
-		close(fd);
+	if (trace_find_exec(&tr, first_exec) == tr.nr_chunks) {
+		fprintf(stderr, "%s: only %"PRIu64" execbufs\n",
+			filename, tr.nr_execs);
+		trace_close(&tr);
 		return -1;
 	}
 
-	ptr = mmap(0, st.st_size, PROT_WRITE, MAP_PRIVATE, fd, 0);
-	close(fd);
-
-	if (ptr == MAP_FAILED)
-		return -1;
-
-	madvise(ptr, st.st_size, MADV_SEQUENTIAL);
-	end = ptr + st.st_size;
-
-	tv = (struct trace_version *)ptr;
-	if (tv->magic != 0xdeadbeef) {
-		fprintf(stderr, "%s: invalid magic\n", filename);
-		return -1;
-	}
-	if (tv->version != 1) {
-		fprintf(stderr, "%s: unhandled version %d\n",
-			filename, tv->version);
-		return -1;
+	if (timed && tr.header.version.version < 2) {
+		fprintf(stderr, "%s: no timestamps, replaying as fast as possible\n",
+			filename);
+		timed = false;
 	}
-	ptr = (void *)(tv + 1);
+
+	last_exec = tr.nr_execs;
+	if (max_execs && first_exec + max_execs < last_exec)
+		last_exec = first_exec + max_execs;
 
 	ctx = calloc(1024, sizeof(*ctx));
+	ctx_live = calloc(1024, sizeof(*ctx_live));
 	num_ctx = 1024;
 
 	bo = calloc(4096, sizeof(*bo));
+	bo_size = calloc(4096, sizeof(*bo_size));
 	num_bo = 4096;
 
 	fd = drm_open_driver(DRIVER_INTEL);
@@ -178,130 +145,186 @@ static double replay(const char *filename, long nop, long range)
 		gem_write(fd, bo[0], 0, &bbe, sizeof(bbe));
 	}
 
+	/*
+	 * Up to the window, only the objects and contexts are tracked. Those
+	 * still open when the window starts are then created all at once.
+	 */
 	clock_gettime(CLOCK_MONOTONIC, &t_start);
-	do switch (*ptr++) {
-	case ADD_BO:
-		{
-			struct trace_add_bo *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			if (t->handle >= num_bo) {
-				int new_bo = ALIGN(t->handle, 4096);
-				bo = realloc(bo, sizeof(*bo)*new_bo);
-				memset(bo + num_bo, 0, sizeof(*bo)*(new_bo - num_bo));
-				num_bo = new_bo;
-			}
+	for (n = 0; n < tr.nr_chunks; n++) {
+		const struct trace_chunk *chunk = trace_chunk(&tr, n);
+		struct trace_record *rec;
 
-			bo[t->handle] = gem_create(fd, t->size);
+		if (chunk->first_exec >= last_exec)
 			break;
-		}
-	case DEL_BO:
-		{
-			struct trace_del_bo *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			assert(t->handle && t->handle < num_bo && bo[t->handle]);
-			gem_close(fd, bo[t->handle]);
-			bo[t->handle] = 0;
-			break;
-		}
-	case ADD_CTX:
-		{
-			struct trace_add_ctx *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			if (t->handle >= num_ctx) {
-				int new_ctx = ALIGN(t->handle, 1024);
-				ctx = realloc(ctx, sizeof(*ctx)*new_ctx);
-				memset(ctx + num_ctx, 0, sizeof(*ctx)*(new_ctx - num_ctx));
-				num_ctx = new_ctx;
-			}
 
-			ctx[t->handle] = __gem_context_create_local(fd);
-			break;
-		}
-	case DEL_CTX:
-		{
-			struct trace_del_ctx *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			assert(t->handle < num_ctx && ctx[t->handle]);
-			gem_context_destroy(fd, ctx[t->handle]);
-			ctx[t->handle] = 0;
+		rec = trace_chunk_records(&tr, n, &buf, &buf_size);
+		if (!rec) {
+			fprintf(stderr, "%s: corrupt chunk %u\n", filename, n);
 			break;
 		}
-	case EXEC:
-		{
-			struct trace_exec *t = (void *)ptr;
-			ptr = (void *)(t + 1);
 
-			eb.buffer_count = t->object_count;
-			eb.flags = t->flags;
-			eb.rsvd1 = ctx[t->context];
+		exec = chunk->first_exec;
+		for (uint32_t r = 0; r < chunk->nr_records;
+		     r++, rec = trace_next_record(rec)) {
+			bool in_window = exec >= first_exec && exec < last_exec;
 
-			if (eb.buffer_count >= max_objects) {
-				free(exec_objects);
-
-				max_objects = ALIGN(eb.buffer_count + 1, 4096);
+			if (in_window && !started &&
+			    (rec->cmd == EXEC || rec->cmd == WAIT)) {
+				for (int h = 1; h < num_bo; h++) {
+					if (bo_size[h] && !bo[h])
+						bo[h] = gem_create(fd, bo_size[h]);
+				}
+				for (int h = 0; h < num_ctx; h++) {
+					if (ctx_live[h] && !ctx[h])
+						ctx[h] = __gem_context_create_local(fd);
+				}
 
-				exec_objects = malloc(max_objects*sizeof(*exec_objects));
-				eb.buffers_ptr = (uintptr_t)exec_objects;
+				started = true;
+				t0 = trace_record_time(chunk, rec);
+				clock_gettime(CLOCK_MONOTONIC, &t_start);
 			}
 
-			for (uint32_t i = 0; i < eb.buffer_count; i++) {
-				struct trace_exec_object *to = (void *)ptr;
-				ptr = (void *)(to + 1);
-
-				exec_objects[i].handle = bo[to->handle];
-				exec_objects[i].alignment = to->alignment;
-				exec_objects[i].offset = to->offset;
-				exec_objects[i].flags = to->flags;
-				exec_objects[i].rsvd1 = to->rsvd1;
-				exec_objects[i].rsvd2 = to->rsvd2;
-
-				exec_objects[i].relocation_count = to->relocation_count;
-				exec_objects[i].relocs_ptr = (uintptr_t)ptr;
-
-				if (!(eb.flags & I915_EXEC_HANDLE_LUT)) {
-					struct drm_i915_gem_relocation_entry *relocs =
-						(struct drm_i915_gem_relocation_entry *)ptr;
-					for (uint32_t j = 0; j < to->relocation_count; j++)
-						relocs[j].target_handle = bo[relocs[j].target_handle];
+			if (in_window && timed &&
+			    (rec->cmd == EXEC || rec->cmd == WAIT))
+				wait_until(&t_start,
+					   trace_record_time(chunk, rec) - t0);
+
+			switch (rec->cmd) {
+			case ADD_BO:
+				{
+					struct trace_add_bo *t = (void *)rec;
+
+					if (t->handle >= num_bo) {
+						int new_bo = ALIGN(t->handle + 1, 4096);
+						bo = realloc(bo, sizeof(*bo)*new_bo);
+						memset(bo + num_bo, 0, sizeof(*bo)*(new_bo - num_bo));
+						bo_size = realloc(bo_size, sizeof(*bo_size)*new_bo);
+						memset(bo_size + num_bo, 0, sizeof(*bo_size)*(new_bo - num_bo));
+						num_bo = new_bo;
+					}
+
+					bo_size[t->handle] = t->size ?: 4096;
+					bo[t->handle] = started ? gem_create(fd, bo_size[t->handle]) : 0;
+					break;
+				}
+			case DEL_BO:
+				{
+					struct trace_handle *t = (void *)rec;
+
+					assert(t->handle && t->handle < num_bo && bo_size[t->handle]);
+					if (bo[t->handle])
+						gem_close(fd, bo[t->handle]);
+					bo[t->handle] = 0;
+					bo_size[t->handle] = 0;
+					break;
+				}
+			case ADD_CTX:
+				{
+					struct trace_handle *t = (void *)rec;
+
+					if (t->handle >= num_ctx) {
+						int new_ctx = ALIGN(t->handle + 1, 1024);
+						ctx = realloc(ctx, sizeof(*ctx)*new_ctx);
+						memset(ctx + num_ctx, 0, sizeof(*ctx)*(new_ctx - num_ctx));
+						ctx_live = realloc(ctx_live, sizeof(*ctx_live)*new_ctx);
+						memset(ctx_live + num_ctx, 0, sizeof(*ctx_live)*(new_ctx - num_ctx));
+						num_ctx = new_ctx;
+					}
+
+					ctx_live[t->handle] = true;
+					ctx[t->handle] = started ? __gem_context_create_local(fd) : 0;
+					break;
+				}
+			case DEL_CTX:
+				{
+					struct trace_handle *t = (void *)rec;
+
+					assert(t->handle < num_ctx && ctx_live[t->handle]);
+					if (ctx[t->handle])
+						gem_context_destroy(fd, ctx[t->handle]);
+					ctx[t->handle] = 0;
+					ctx_live[t->handle] = false;
+					break;
+				}
+			case EXEC:
+				{
+					struct trace_exec *t = (void *)rec;
+					uint8_t *ptr = (void *)(t + 1);
+
+					exec++;
+					if (!in_window)
+						break;
+
+					eb.buffer_count = t->object_count;
+					eb.flags = t->flags;
+					eb.rsvd1 = t->context < num_ctx ? ctx[t->context] : 0;
+
+					if (eb.buffer_count >= max_objects) {
+						free(exec_objects);
+
+						max_objects = ALIGN(eb.buffer_count + 1, 4096);
+
+						exec_objects = malloc(max_objects*sizeof(*exec_objects));
+						eb.buffers_ptr = (uintptr_t)exec_objects;
+					}
+
+					for (uint32_t i = 0; i < eb.buffer_count; i++) {
+						struct trace_exec_object *to = (void *)ptr;
+						ptr = (void *)(to + 1);
+
+						exec_objects[i].handle = bo[to->handle];
+						exec_objects[i].alignment = to->alignment;
+						exec_objects[i].offset = to->offset;
+						exec_objects[i].flags = to->flags;
+						exec_objects[i].rsvd1 = to->rsvd1;
+						exec_objects[i].rsvd2 = to->rsvd2;
+
+						exec_objects[i].relocation_count = to->relocation_count;
+						exec_objects[i].relocs_ptr = (uintptr_t)ptr;
+
+						if (!(eb.flags & I915_EXEC_HANDLE_LUT)) {
+							struct drm_i915_gem_relocation_entry *relocs =
+								(struct drm_i915_gem_relocation_entry *)ptr;
+							for (uint32_t j = 0; j < to->relocation_count; j++)
+								relocs[j].target_handle = bo[relocs[j].target_handle];
+						}
+
+						ptr += sizeof(struct drm_i915_gem_relocation_entry) * to->relocation_count;
+					}
+
+					((struct drm_i915_gem_exec_object2 *)
+					 memset(&exec_objects[eb.buffer_count++], 0,
+						sizeof(*exec_objects)))->handle = bo[0];
+
+					if (nop > 0) {
+						eb.batch_start_offset = hars_petruska_f54_1_random();
+						eb.batch_start_offset =
+							((uint64_t)eb.batch_start_offset * range) >> 32;
+						eb.batch_start_offset = ALIGN(eb.batch_start_offset, 64);
+					}
+					gem_execbuf(fd, &eb);
+					break;
 				}
 
-				ptr += sizeof(struct drm_i915_gem_relocation_entry) * to->relocation_count;
-			}
+			case WAIT:
+				{
+					struct trace_handle *t = (void *)rec;
 
-			((struct drm_i915_gem_exec_object2 *)
-			 memset(&exec_objects[eb.buffer_count++], 0,
-				sizeof(*exec_objects)))->handle = bo[0];
+					if (!in_window)
+						break;
 
-			if (nop > 0) {
-				eb.batch_start_offset = hars_petruska_f54_1_random();
-				eb.batch_start_offset =
-					((uint64_t)eb.batch_start_offset * range) >> 32;
-				eb.batch_start_offset = ALIGN(eb.batch_start_offset, 64);
+					assert(t->handle && t->handle < num_bo && bo[t->handle]);
+					gem_wait(fd, bo[t->handle], NULL);
+					break;
+				}
 			}
-			gem_execbuf(fd, &eb);
-			break;
 		}
-
-	case WAIT:
-		{
-			struct trace_wait *t = (void *)ptr;
-			ptr = (void *)(t + 1);
-
-			assert(t->handle && t->handle < num_bo && bo[t->handle]);
-			gem_wait(fd, bo[t->handle], NULL);
-			break;
-		}
-
-	default:
-		fprintf(stderr, "Unknown cmd: %x\n", *ptr);
-		return -1;
-	} while (ptr < end);
+	}
 	clock_gettime(CLOCK_MONOTONIC, &t_end);
 
+	free(buf);
+	trace_close(&tr);
+
 	return elapsed(&t_start, &t_end);
 }
 
@@ -375,7 +398,7 @@ int main(int argc, char **argv)
 	results = mmap(NULL, ALIGN(argc*sizeof(double), 4096),
 		       PROT_WRITE, MAP_SHARED | MAP_ANON, -1, 0);
 
-	while ((c = getopt(argc, argv, "d:n:r:")) != -1) {
+	while ((c = getopt(argc, argv, "d:n:r:s:c:t")) != -1) {
 		switch (c) {
 		case 'd':
 			delay = atoi(optarg);
@@ -390,6 +413,15 @@ int main(int argc, char **argv)
 			if (range > 0)
 				range = ALIGN(range, 4096);
 			break;
+		case 's':
+			first_exec = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			max_execs = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			timing = true;
+			break;
 		default:
 			break;
 		}
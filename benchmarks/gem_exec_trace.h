@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef GEM_EXEC_TRACE_H
+#define GEM_EXEC_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Trace format written by the gem_exec_tracer preload library.
+ *
+ * A trace starts with a struct trace_header, followed by chunks of records.
+ * Each chunk is a struct trace_chunk followed by its records, optionally
+ * deflated with zlib, and padded to 8 bytes. Uncompressed records are 8 byte
+ * aligned, so they can be used straight from a mapping of the file.
+ *
+ * Every record starts with a struct trace_record, carrying the command, the
+ * size of the whole record, the thread which issued the ioctl and the time
+ * since the start of its chunk. A chunk never spans more than 2^32ns.
+ *
+ * When the trace is closed an index of all chunks is appended, followed by a
+ * struct trace_index at the very end of the file. Traces cut short lack the
+ * index, but it can be rebuilt by walking the chunk headers.
+ *
+ * Version 1 traces were a bare struct trace_version followed by packed,
+ * unaligned records without timestamps. The reader converts them on load.
+ */
+
+#define TRACE_MAGIC 0xdeadbeef
+#define TRACE_VERSION 2
+
+#define TRACE_CHUNK_MAGIC 0x6b6e6863 /* "chnk" */
+#define TRACE_INDEX_MAGIC 0x78646e69 /* "indx" */
+
+enum {
+	ADD_BO = 0,
+	DEL_BO,
+	ADD_CTX,
+	DEL_CTX,
+	EXEC,
+	WAIT,
+	NUM_TRACE_CMDS
+};
+
+struct trace_version {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct trace_header {
+	struct trace_version version;
+	uint32_t pid;
+	uint32_t flags;
+	uint64_t timestamp;	/* CLOCK_MONOTONIC at the start, in ns */
+};
+
+#define TRACE_CHUNK_COMPRESSED (1 << 0)
+
+struct trace_chunk {
+	uint32_t magic;
+	uint32_t flags;
+	uint32_t size;		/* bytes stored after the header */
+	uint32_t raw_size;	/* bytes of records */
+	uint64_t timestamp;	/* of the first record, in ns */
+	uint64_t last_timestamp;
+	uint64_t first_exec;	/* execbufs in all the previous chunks */
+	uint32_t nr_records;
+	uint32_t nr_execs;
+};
+
+struct trace_record {
+	uint8_t cmd;
+	uint8_t rsvd[3];
+	uint32_t size;		/* of the whole record, a multiple of 8 */
+	uint32_t tid;
+	uint32_t delta;		/* ns since the chunk timestamp */
+};
+
+/* ADD_BO */
+struct trace_add_bo {
+	struct trace_record hdr;
+	uint32_t handle;
+	uint32_t pad;
+	uint64_t size;
+};
+
+/* DEL_BO, ADD_CTX, DEL_CTX and WAIT */
+struct trace_handle {
+	struct trace_record hdr;
+	uint32_t handle;
+	uint32_t pad;
+};
+
+/*
+ * EXEC, followed by object_count struct trace_exec_object, each followed by
+ * its relocation_count struct drm_i915_gem_relocation_entry.
+ */
+struct trace_exec {
+	struct trace_record hdr;
+	uint32_t object_count;
+	uint32_t context;
+	uint64_t flags;
+};
+
+struct trace_exec_object {
+	uint32_t handle;
+	uint32_t relocation_count;
+	uint64_t alignment;
+	uint64_t offset;
+	uint64_t flags;
+	uint64_t rsvd1;
+	uint64_t rsvd2;
+};
+
+struct trace_index_entry {
+	uint64_t offset;	/* of the chunk header in the file */
+	uint64_t timestamp;
+	uint64_t first_exec;
+};
+
+struct trace_index {
+	uint32_t magic;
+	uint32_t count;
+	uint64_t offset;	/* of the first struct trace_index_entry */
+};
+
+static inline uint64_t
+trace_record_time(const struct trace_chunk *chunk,
+		  const struct trace_record *rec)
+{
+	return chunk->timestamp + rec->delta;
+}
+
+static inline void *trace_next_record(const struct trace_record *rec)
+{
+	return (char *)rec + rec->size;
+}
+
+struct trace_reader {
+	struct trace_header header;
+
+	void *data;
+	size_t size;
+	bool mapped;
+
+	struct trace_index_entry *index;
+	unsigned int nr_chunks;
+	uint64_t nr_execs;
+};
+
+int trace_open(struct trace_reader *tr, const char *filename);
+void trace_close(struct trace_reader *tr);
+
+const struct trace_chunk *
+trace_chunk(const struct trace_reader *tr, unsigned int n);
+void *trace_chunk_records(const struct trace_reader *tr, unsigned int n,
+			  void **buf, size_t *buf_size);
+
+unsigned int trace_find_exec(const struct trace_reader *tr, uint64_t exec);
+
+#endif /* GEM_EXEC_TRACE_H */
@@ -0,0 +1,603 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "i915_drm.h"
+
+#include "gem_exec_trace.h"
+
+/* Version 1 records, each following a one byte command */
+
+struct trace_v1_add_bo {
+	uint32_t handle;
+	uint64_t size;
+} __attribute__((packed));
+
+struct trace_v1_handle {
+	uint32_t handle;
+} __attribute__((packed));
+
+struct trace_v1_exec {
+	uint32_t object_count;
+	uint64_t flags;
+	uint32_t context;
+} __attribute__((packed));
+
+#define TRACE_V1_CHUNK (1 << 20)
+
+struct trace_v1 {
+	uint8_t *data;
+	size_t size;
+	size_t max;
+
+	size_t chunk;	/* offset of the chunk being filled */
+
+	struct trace_index_entry *index;
+	unsigned int nr_chunks;
+	uint64_t nr_execs;
+};
+
+static size_t align8(size_t x)
+{
+	return (x + 7) & ~(size_t)7;
+}
+
+static void *v1_reserve(struct trace_v1 *v1, size_t len)
+{
+	void *ptr;
+
+	if (v1->size + len > v1->max) {
+		v1->max = align8(2 * (v1->size + len));
+		v1->data = realloc(v1->data, v1->max);
+		if (!v1->data)
+			return NULL;
+	}
+
+	ptr = v1->data + v1->size;
+	memset(ptr, 0, len);
+	v1->size += len;
+
+	return ptr;
+}
+
+static struct trace_chunk *v1_chunk(struct trace_v1 *v1)
+{
+	return (struct trace_chunk *)(v1->data + v1->chunk);
+}
+
+static struct trace_record *
+v1_record(struct trace_v1 *v1, uint8_t cmd, size_t len)
+{
+	struct trace_record *rec;
+	struct trace_chunk *chunk;
+
+	if (!v1->chunk || v1_chunk(v1)->raw_size > TRACE_V1_CHUNK) {
+		struct trace_index_entry *index;
+		size_t offset = v1->size;
+
+		if (!v1_reserve(v1, sizeof(*chunk)))
+			return NULL;
+
+		index = realloc(v1->index,
+				(v1->nr_chunks + 1) * sizeof(*index));
+		if (!index)
+			return NULL;
+
+		v1->index = index;
+		index += v1->nr_chunks++;
+		index->offset = offset;
+		index->timestamp = 0;
+		index->first_exec = v1->nr_execs;
+
+		v1->chunk = offset;
+		chunk = v1_chunk(v1);
+		chunk->magic = TRACE_CHUNK_MAGIC;
+		chunk->first_exec = v1->nr_execs;
+	}
+
+	len = align8(len);
+	rec = v1_reserve(v1, len);
+	if (!rec)
+		return NULL;
+
+	rec->cmd = cmd;
+	rec->size = len;
+
+	chunk = v1_chunk(v1);
+	chunk->size += len;
+	chunk->raw_size += len;
+	chunk->nr_records++;
+	if (cmd == EXEC) {
+		chunk->nr_execs++;
+		v1->nr_execs++;
+	}
+
+	return rec;
+}
+
+static int convert_v1(struct trace_reader *tr, const uint8_t *ptr, size_t size)
+{
+	const uint8_t *end = ptr + size;
+	struct trace_v1 v1 = {};
+	struct trace_header *header;
+
+	ptr += sizeof(struct trace_version);
+
+	header = v1_reserve(&v1, sizeof(*header));
+	if (!header)
+		goto err;
+
+	header->version.magic = TRACE_MAGIC;
+	header->version.version = 1;
+
+	while (ptr < end) {
+		uint8_t cmd = *ptr++;
+
+		switch (cmd) {
+		case ADD_BO: {
+			struct trace_v1_add_bo t;
+			struct trace_add_bo *rec;
+
+			if (end - ptr < sizeof(t))
+				goto err;
+			memcpy(&t, ptr, sizeof(t));
+			ptr += sizeof(t);
+
+			rec = (void *)v1_record(&v1, cmd, sizeof(*rec));
+			if (!rec)
+				goto err;
+
+			rec->handle = t.handle;
+			rec->size = t.size;
+			break;
+		}
+		case DEL_BO:
+		case ADD_CTX:
+		case DEL_CTX:
+		case WAIT: {
+			struct trace_v1_handle t;
+			struct trace_handle *rec;
+
+			if (end - ptr < sizeof(t))
+				goto err;
+			memcpy(&t, ptr, sizeof(t));
+			ptr += sizeof(t);
+
+			rec = (void *)v1_record(&v1, cmd, sizeof(*rec));
+			if (!rec)
+				goto err;
+
+			rec->handle = t.handle;
+			break;
+		}
+		case EXEC: {
+			const uint8_t *objects;
+			struct trace_v1_exec t;
+			struct trace_exec *rec;
+			size_t len;
+
+			if (end - ptr < sizeof(t))
+				goto err;
+			memcpy(&t, ptr, sizeof(t));
+			ptr += sizeof(t);
+
+			/* The objects and relocations keep their layout. */
+			objects = ptr;
+			for (uint32_t i = 0; i < t.object_count; i++) {
+				struct trace_exec_object obj;
+
+				if (end - ptr < sizeof(obj))
+					goto err;
+				memcpy(&obj, ptr, sizeof(obj));
+				ptr += sizeof(obj);
+
+				if ((end - ptr) / sizeof(struct drm_i915_gem_relocation_entry) <
+				    obj.relocation_count)
+					goto err;
+				ptr += obj.relocation_count *
+				       sizeof(struct drm_i915_gem_relocation_entry);
+			}
+			len = ptr - objects;
+
+			rec = (void *)v1_record(&v1, cmd, sizeof(*rec) + len);
+			if (!rec)
+				goto err;
+
+			rec->object_count = t.object_count;
+			rec->context = t.context;
+			rec->flags = t.flags;
+			memcpy(rec + 1, objects, len);
+			break;
+		}
+		default:
+			fprintf(stderr, "Unknown cmd: %x\n", cmd);
+			goto err;
+		}
+	}
+
+	tr->header = *(struct trace_header *)v1.data;
+	tr->data = v1.data;
+	tr->size = v1.size;
+	tr->index = v1.index;
+	tr->nr_chunks = v1.nr_chunks;
+	tr->nr_execs = v1.nr_execs;
+
+	return 0;
+
+err:
+	free(v1.index);
+	free(v1.data);
+	return -1;
+}
+
+static bool valid_chunk(const struct trace_reader *tr, uint64_t offset)
+{
+	const struct trace_chunk *chunk;
+
+	if (offset % 8 || offset < sizeof(struct trace_header) ||
+	    offset + sizeof(*chunk) > tr->size)
+		return false;
+
+	chunk = (const void *)((const uint8_t *)tr->data + offset);
+
+	return chunk->magic == TRACE_CHUNK_MAGIC &&
+		chunk->size <= tr->size - offset - sizeof(*chunk);
+}
+
+static int load_index(struct trace_reader *tr)
+{
+	const uint8_t *data = tr->data;
+	const struct trace_index *idx;
+	unsigned int count = 0;
+	uint64_t offset;
+
+	idx = (const void *)(data + tr->size - sizeof(*idx));
+	if (tr->size >= sizeof(struct trace_header) + sizeof(*idx) &&
+	    tr->size % 8 == 0 && idx->magic == TRACE_INDEX_MAGIC &&
+	    idx->offset % 8 == 0 &&
+	    idx->offset + (uint64_t)idx->count * sizeof(*tr->index) ==
+	    tr->size - sizeof(*idx)) {
+		const struct trace_index_entry *e = (const void *)(data + idx->offset);
+		unsigned int i;
+
+		for (i = 0; i < idx->count; i++) {
+			if (!valid_chunk(tr, e[i].offset))
+				break;
+		}
+
+		if (i == idx->count) {
+			tr->index = malloc((idx->count ?: 1) * sizeof(*tr->index));
+			if (!tr->index)
+				return -1;
+
+			memcpy(tr->index, e, idx->count * sizeof(*tr->index));
+			tr->nr_chunks = idx->count;
+			goto out;
+		}
+	}
+
+	/* No usable index, most likely the traced process never exited. */
+	offset = sizeof(struct trace_header);
+	while (valid_chunk(tr, offset)) {
+		const struct trace_chunk *chunk =
+			(const void *)(data + offset);
+
+		if (count % 1024 == 0) {
+			struct trace_index_entry *index;
+
+			index = realloc(tr->index,
+					(count + 1024) * sizeof(*index));
+			if (!index)
+				return -1;
+
+			tr->index = index;
+		}
+
+		tr->index[count].offset = offset;
+		tr->index[count].timestamp = chunk->timestamp;
+		tr->index[count].first_exec = chunk->first_exec;
+		count++;
+
+		offset += sizeof(*chunk) + align8(chunk->size);
+	}
+	tr->nr_chunks = count;
+
+out:
+	if (tr->nr_chunks) {
+		const struct trace_chunk *last = trace_chunk(tr, tr->nr_chunks - 1);
+
+		tr->nr_execs = last->first_exec + last->nr_execs;
+	}
+
+	return 0;
+}
+
+/**
+ * trace_open:
+ * @tr: reader to initialise
+ * @filename: trace to open
+ *
+ * Maps a trace written by gem_exec_tracer and loads its chunk index,
+ * rebuilding it if the trace was not closed properly. Version 1 traces are
+ * converted into the current format in memory, without timestamps.
+ *
+ * Returns: 0 on success, -1 otherwise.
+ */
+int trace_open(struct trace_reader *tr, const char *filename)
+{
+	const struct trace_version *tv;
+	struct stat st;
+	void *map;
+	int fd, ret;
+
+	memset(tr, 0, sizeof(*tr));
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	if (st.st_size < (off_t)sizeof(*tv)) {
+		fprintf(stderr, "%s: truncated trace\n", filename);
+		close(fd);
+		return -1;
+	}
+
+	/* Private and writable, so that users can patch records in place */
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	tv = map;
+	if (tv->magic != TRACE_MAGIC) {
+		fprintf(stderr, "%s: invalid magic\n", filename);
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	switch (tv->version) {
+	case 1:
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		ret = convert_v1(tr, map, st.st_size);
+		munmap(map, st.st_size);
+		if (ret)
+			fprintf(stderr, "%s: corrupt trace\n", filename);
+		return ret;
+
+	case TRACE_VERSION:
+		if (st.st_size < (off_t)sizeof(tr->header))
+			break;
+
+		tr->data = map;
+		tr->size = st.st_size;
+		tr->mapped = true;
+		memcpy(&tr->header, map, sizeof(tr->header));
+
+		if (load_index(tr)) {
+			trace_close(tr);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	fprintf(stderr, "%s: unhandled version %d\n", filename, tv->version);
+	munmap(map, st.st_size);
+	return -1;
+}
+
+/**
+ * trace_close:
+ * @tr: reader to release
+ *
+ * Releases everything trace_open() set up.
+ */
+void trace_close(struct trace_reader *tr)
+{
+	if (tr->mapped)
+		munmap(tr->data, tr->size);
+	else
+		free(tr->data);
+
+	free(tr->index);
+	memset(tr, 0, sizeof(*tr));
+}
+
+/**
+ * trace_chunk:
+ * @tr: an open trace
+ * @n: index of the chunk
+ *
+ * Returns: the header of chunk @n.
+ */
+const struct trace_chunk *
+trace_chunk(const struct trace_reader *tr, unsigned int n)
+{
+	return (const void *)((const uint8_t *)tr->data + tr->index[n].offset);
+}
+
+static bool valid_exec(const struct trace_exec *t)
+{
+	const uint8_t *end = trace_next_record(&t->hdr);
+	const uint8_t *ptr = (const void *)(t + 1);
+
+	if (t->hdr.size < sizeof(*t))
+		return false;
+
+	for (uint32_t i = 0; i < t->object_count; i++) {
+		const struct trace_exec_object *obj = (const void *)ptr;
+
+		if (end - ptr < sizeof(*obj))
+			return false;
+		ptr += sizeof(*obj);
+
+		if ((end - ptr) / sizeof(struct drm_i915_gem_relocation_entry) <
+		    obj->relocation_count)
+			return false;
+		ptr += obj->relocation_count *
+		       sizeof(struct drm_i915_gem_relocation_entry);
+	}
+
+	return true;
+}
+
+static bool valid_records(const struct trace_chunk *chunk, const void *records)
+{
+	const uint8_t *ptr = records, *end = ptr + chunk->raw_size;
+	uint32_t i;
+
+	for (i = 0; i < chunk->nr_records; i++) {
+		const struct trace_record *rec = (const void *)ptr;
+		size_t min;
+
+		if (end - ptr < sizeof(*rec) ||
+		    rec->size % 8 || rec->size > end - ptr)
+			return false;
+
+		switch (rec->cmd) {
+		case ADD_BO:
+			min = sizeof(struct trace_add_bo);
+			break;
+		case DEL_BO:
+		case ADD_CTX:
+		case DEL_CTX:
+		case WAIT:
+			min = sizeof(struct trace_handle);
+			break;
+		case EXEC:
+			if (!valid_exec((const void *)rec))
+				return false;
+			min = sizeof(struct trace_exec);
+			break;
+		default:
+			return false;
+		}
+
+		if (rec->size < min)
+			return false;
+
+		ptr += rec->size;
+	}
+
+	return ptr == end;
+}
+
+/**
+ * trace_chunk_records:
+ * @tr: an open trace
+ * @n: index of the chunk
+ * @buf: scratch buffer, grown as required
+ * @buf_size: size of @buf
+ *
+ * Looks up the records of chunk @n, inflating them into @buf if the chunk
+ * is compressed. The records are checked to be well formed, so that they can
+ * be walked with trace_next_record() for the chunk's nr_records. They are
+ * writable, but changes may or may not persist between calls.
+ *
+ * Different threads may look up chunks at the same time using their own
+ * scratch buffers.
+ *
+ * Returns: the first record of the chunk, or NULL if it is corrupt.
+ */
+void *trace_chunk_records(const struct trace_reader *tr, unsigned int n,
+			  void **buf, size_t *buf_size)
+{
+	const struct trace_chunk *chunk = trace_chunk(tr, n);
+	void *records = (void *)(chunk + 1);
+
+	if (chunk->flags & TRACE_CHUNK_COMPRESSED) {
+		uLongf len = chunk->raw_size;
+
+		if (*buf_size < chunk->raw_size) {
+			free(*buf);
+			*buf_size = align8(chunk->raw_size);
+			*buf = malloc(*buf_size);
+			if (!*buf) {
+				*buf_size = 0;
+				return NULL;
+			}
+		}
+
+		if (uncompress(*buf, &len, records, chunk->size) != Z_OK ||
+		    len != chunk->raw_size)
+			return NULL;
+
+		records = *buf;
+	} else if (chunk->raw_size != chunk->size) {
+		return NULL;
+	}
+
+	if (!valid_records(chunk, records))
+		return NULL;
+
+	return records;
+}
+
+/**
+ * trace_find_exec:
+ * @tr: an open trace
+ * @exec: index of an execbuf in the trace
+ *
+ * Returns: the chunk holding execbuf @exec, or the number of chunks if
+ * there are not as many execbufs in the trace.
+ */
+unsigned int trace_find_exec(const struct trace_reader *tr, uint64_t exec)
+{
+	unsigned int lo = 0, hi = tr->nr_chunks;
+
+	if (exec >= tr->nr_execs)
+		return tr->nr_chunks;
+
+	/* Last chunk starting at or before exec */
+	while (hi - lo > 1) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (tr->index[mid].first_exec <= exec)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	/* Skip over any chunks without execbufs */
+	while (lo < tr->nr_chunks &&
+	       trace_chunk(tr, lo)->first_exec + trace_chunk(tr, lo)->nr_execs <= exec)
+		lo++;
+
+	return lo;
+}
@@ -0,0 +1,544 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Summarises traces recorded with the gem_exec_tracer preload library.
+ *
+ * Chunks are independent of each other, so they are spread over worker
+ * threads, each keeping its own statistics which are merged at the end.
+ * Only the submission intervals which straddle two chunks need stitching
+ * together afterwards.
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "drm.h"
+#include "i915_drm.h"
+
+#include "gem_exec_trace.h"
+
+static const char *cmd_str[NUM_TRACE_CMDS] = {
+	[ADD_BO] = "ADD_BO",
+	[DEL_BO] = "DEL_BO",
+	[ADD_CTX] = "ADD_CTX",
+	[DEL_CTX] = "DEL_CTX",
+	[EXEC] = "EXEC",
+	[WAIT] = "WAIT",
+};
+
+enum ring {
+	RING_RENDER = 0,
+	RING_BSD,
+	RING_BSD1,
+	RING_BSD2,
+	RING_BLT,
+	RING_VEBOX,
+	NUM_RINGS
+};
+
+static const char *ring_str[NUM_RINGS] = {
+	[RING_RENDER] = "render",
+	[RING_BSD] = "bsd",
+	[RING_BSD1] = "bsd1",
+	[RING_BSD2] = "bsd2",
+	[RING_BLT] = "blt",
+	[RING_VEBOX] = "vebox",
+};
+
+/* Submission intervals in ns, with 8 buckets per power of two */
+#define GAP_SUB_BITS 3
+#define GAP_SUB (1 << GAP_SUB_BITS)
+#define GAP_BUCKETS (64 * GAP_SUB)
+
+struct counter_entry {
+	uint32_t key;
+	bool used;
+	uint64_t count;
+};
+
+struct counter {
+	struct counter_entry *entries;
+	unsigned int size;	/* a power of two */
+	unsigned int used;
+};
+
+struct stats {
+	uint64_t records[NUM_TRACE_CMDS];
+	uint64_t bo_bytes;
+	uint64_t objects;
+	uint64_t relocs;
+	uint64_t rings[NUM_RINGS];
+
+	struct counter contexts;
+	struct counter tids;
+
+	uint64_t gaps[GAP_BUCKETS];
+	uint64_t nr_gaps;
+	uint64_t max_gap;
+};
+
+/* First and last submission of every chunk, to fill in the gaps between */
+struct chunk_execs {
+	uint64_t first;
+	uint64_t last;
+};
+
+struct shared {
+	const struct trace_reader *tr;
+	struct chunk_execs *execs;
+	unsigned int next;	/* chunk for the next worker to pick up */
+};
+
+struct work {
+	struct shared *shared;
+	struct stats stats;
+	bool corrupt;
+};
+
+static void counter_add(struct counter *c, uint32_t key, uint64_t count)
+{
+	unsigned int i;
+
+	if (2 * (c->used + 1) > c->size) {
+		struct counter old = *c;
+
+		c->size = c->size ? 2 * c->size : 64;
+		c->entries = calloc(c->size, sizeof(*c->entries));
+		if (!c->entries) {
+			fprintf(stderr, "Out of memory!\n");
+			exit(1);
+		}
+		c->used = 0;
+
+		for (i = 0; i < old.size; i++) {
+			if (old.entries[i].used)
+				counter_add(c, old.entries[i].key,
+					    old.entries[i].count);
+		}
+		free(old.entries);
+	}
+
+	for (i = key * 2654435761u & (c->size - 1);
+	     c->entries[i].used;
+	     i = (i + 1) & (c->size - 1)) {
+		if (c->entries[i].key == key) {
+			c->entries[i].count += count;
+			return;
+		}
+	}
+
+	c->entries[i].key = key;
+	c->entries[i].used = true;
+	c->entries[i].count = count;
+	c->used++;
+}
+
+static unsigned int gap_bucket(uint64_t ns)
+{
+	int msb;
+
+	if (ns < GAP_SUB)
+		return ns;
+
+	msb = 63 - __builtin_clzll(ns);
+	return (msb - GAP_SUB_BITS + 1) * GAP_SUB +
+		((ns >> (msb - GAP_SUB_BITS)) & (GAP_SUB - 1));
+}
+
+/* Largest interval which falls into the bucket */
+static uint64_t gap_bucket_value(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < GAP_SUB)
+		return bucket;
+
+	shift = bucket / GAP_SUB - 1;
+	return ((uint64_t)(GAP_SUB + bucket % GAP_SUB + 1) << shift) - 1;
+}
+
+static void add_gap(struct stats *s, uint64_t ns)
+{
+	s->gaps[gap_bucket(ns)]++;
+	s->nr_gaps++;
+	if (ns > s->max_gap)
+		s->max_gap = ns;
+}
+
+static enum ring exec_ring(uint64_t flags)
+{
+	switch (flags & I915_EXEC_RING_MASK) {
+	case I915_EXEC_BSD:
+		switch (flags & I915_EXEC_BSD_MASK) {
+		case I915_EXEC_BSD_RING1:
+			return RING_BSD1;
+		case I915_EXEC_BSD_RING2:
+			return RING_BSD2;
+		default:
+			return RING_BSD;
+		}
+	case I915_EXEC_BLT:
+		return RING_BLT;
+	case I915_EXEC_VEBOX:
+		return RING_VEBOX;
+	default:
+		return RING_RENDER;
+	}
+}
+
+static void add_exec(struct stats *s, const struct trace_exec *t)
+{
+	const uint8_t *ptr = (const void *)(t + 1);
+
+	s->objects += t->object_count;
+	for (uint32_t i = 0; i < t->object_count; i++) {
+		const struct trace_exec_object *obj = (const void *)ptr;
+
+		s->relocs += obj->relocation_count;
+		ptr += sizeof(*obj) + obj->relocation_count *
+		       sizeof(struct drm_i915_gem_relocation_entry);
+	}
+
+	s->rings[exec_ring(t->flags)]++;
+	counter_add(&s->contexts, t->context, 1);
+	counter_add(&s->tids, t->hdr.tid, 1);
+}
+
+static bool add_chunk(struct stats *s, const struct trace_reader *tr,
+		      unsigned int n, struct chunk_execs *execs,
+		      void **buf, size_t *buf_size)
+{
+	const struct trace_chunk *chunk = trace_chunk(tr, n);
+	const struct trace_record *rec;
+	uint64_t last = 0;
+
+	rec = trace_chunk_records(tr, n, buf, buf_size);
+	if (!rec)
+		return false;
+
+	for (uint32_t i = 0; i < chunk->nr_records;
+	     i++, rec = trace_next_record(rec)) {
+		uint64_t ts = trace_record_time(chunk, rec);
+
+		s->records[rec->cmd]++;
+
+		switch (rec->cmd) {
+		case ADD_BO:
+			s->bo_bytes += ((const struct trace_add_bo *)rec)->size;
+			break;
+		case EXEC:
+			add_exec(s, (const void *)rec);
+
+			if (last)
+				add_gap(s, ts - last);
+			else
+				execs->first = ts;
+			execs->last = last = ts;
+			break;
+		}
+	}
+
+	return true;
+}
+
+static void *worker(void *arg)
+{
+	struct work *w = arg;
+	struct shared *shared = w->shared;
+	size_t buf_size = 0;
+	void *buf = NULL;
+	unsigned int n;
+
+	while ((n = __atomic_fetch_add(&shared->next, 1, __ATOMIC_RELAXED)) <
+	       shared->tr->nr_chunks) {
+		if (!add_chunk(&w->stats, shared->tr, n, &shared->execs[n],
+			       &buf, &buf_size))
+			w->corrupt = true;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void merge_stats(struct stats *dst, const struct stats *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_TRACE_CMDS; i++)
+		dst->records[i] += src->records[i];
+	for (i = 0; i < NUM_RINGS; i++)
+		dst->rings[i] += src->rings[i];
+	for (i = 0; i < GAP_BUCKETS; i++)
+		dst->gaps[i] += src->gaps[i];
+
+	dst->bo_bytes += src->bo_bytes;
+	dst->objects += src->objects;
+	dst->relocs += src->relocs;
+	dst->nr_gaps += src->nr_gaps;
+	if (src->max_gap > dst->max_gap)
+		dst->max_gap = src->max_gap;
+
+	for (i = 0; i < src->contexts.size; i++) {
+		if (src->contexts.entries[i].used)
+			counter_add(&dst->contexts,
+				    src->contexts.entries[i].key,
+				    src->contexts.entries[i].count);
+	}
+	for (i = 0; i < src->tids.size; i++) {
+		if (src->tids.entries[i].used)
+			counter_add(&dst->tids,
+				    src->tids.entries[i].key,
+				    src->tids.entries[i].count);
+	}
+}
+
+static void free_stats(struct stats *s)
+{
+	free(s->contexts.entries);
+	free(s->tids.entries);
+}
+
+static uint64_t gap_percentile(const struct stats *s, double pct)
+{
+	uint64_t target = s->nr_gaps * pct / 100, sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < GAP_BUCKETS; i++) {
+		sum += s->gaps[i];
+		if (sum > target)
+			return gap_bucket_value(i);
+	}
+
+	return s->max_gap;
+}
+
+static int cmp_entry(const void *A, const void *B)
+{
+	const struct counter_entry *a = A, *b = B;
+
+	if (a->count != b->count)
+		return a->count < b->count ? 1 : -1;
+
+	return a->key < b->key ? -1 : a->key > b->key;
+}
+
+static void print_threads(const struct counter *tids)
+{
+	struct counter_entry *e;
+	unsigned int i, n = 0;
+
+	e = malloc((tids->used ?: 1) * sizeof(*e));
+	if (!e)
+		return;
+
+	for (i = 0; i < tids->size; i++) {
+		if (tids->entries[i].used)
+			e[n++] = tids->entries[i];
+	}
+	qsort(e, n, sizeof(*e), cmp_entry);
+
+	for (i = 0; i < n && i < 8; i++)
+		printf("    tid %u: %"PRIu64" execbufs\n", e[i].key, e[i].count);
+	if (n > i)
+		printf("    ... and %u more threads\n", n - i);
+
+	free(e);
+}
+
+static void print_stats(const char *filename, const struct trace_reader *tr,
+			const struct stats *s, uint64_t stored, uint64_t raw)
+{
+	uint64_t execs = s->records[EXEC], total = 0;
+	double duration = 0;
+	unsigned int i;
+
+	printf("%s: version %u, pid %u, %u chunks\n", filename,
+	       tr->header.version.version, tr->header.pid, tr->nr_chunks);
+	printf("  %.1f MiB of records", raw / 1048576.);
+	if (stored && stored != raw)
+		printf(", %.1f MiB stored (%.1fx)",
+		       stored / 1048576., (double)raw / stored);
+	printf("\n");
+
+	if (tr->header.version.version >= 2 && tr->nr_chunks) {
+		const struct trace_chunk *last =
+			trace_chunk(tr, tr->nr_chunks - 1);
+
+		duration = (last->last_timestamp - tr->header.timestamp) * 1e-9;
+		printf("  %.3fs traced\n", duration);
+	}
+
+	for (i = 0; i < NUM_TRACE_CMDS; i++)
+		total += s->records[i];
+	printf("  %"PRIu64" records\n", total);
+	for (i = 0; i < NUM_TRACE_CMDS; i++) {
+		printf("    %-8s %"PRIu64, cmd_str[i], s->records[i]);
+		if (i == ADD_BO && s->records[i])
+			printf(" (%.1f MiB)", s->bo_bytes / 1048576.);
+		printf("\n");
+	}
+
+	if (!execs)
+		return;
+
+	printf("  %"PRIu64" execbufs", execs);
+	if (duration > 0)
+		printf(", %.1f/s", execs / duration);
+	printf(", %.1f objects and %.1f relocations each\n",
+	       (double)s->objects / execs, (double)s->relocs / execs);
+	for (i = 0; i < NUM_RINGS; i++) {
+		if (s->rings[i])
+			printf("    %-8s %"PRIu64" (%.1f%%)\n", ring_str[i],
+			       s->rings[i], 100. * s->rings[i] / execs);
+	}
+
+	printf("  %u contexts\n", s->contexts.used);
+	printf("  %u threads\n", s->tids.used);
+	if (tr->header.version.version >= 2)
+		print_threads(&s->tids);
+
+	if (s->nr_gaps)
+		printf("  submission intervals: p50 %.1fus, p90 %.1fus, p99 %.1fus, p99.9 %.1fus, max %.1fus\n",
+		       gap_percentile(s, 50) * 1e-3,
+		       gap_percentile(s, 90) * 1e-3,
+		       gap_percentile(s, 99) * 1e-3,
+		       gap_percentile(s, 99.9) * 1e-3,
+		       s->max_gap * 1e-3);
+}
+
+static int trace_stats(const char *filename, unsigned int nr_threads)
+{
+	struct shared shared = {};
+	struct stats total = {};
+	struct trace_reader tr;
+	uint64_t stored = 0, raw = 0, prev = 0;
+	pthread_t *threads;
+	struct work *work;
+	bool corrupt = false;
+	unsigned int n, i;
+
+	if (trace_open(&tr, filename))
+		return -1;
+
+	if (nr_threads > tr.nr_chunks)
+		nr_threads = tr.nr_chunks ?: 1;
+
+	shared.tr = &tr;
+	shared.execs = calloc(tr.nr_chunks ?: 1, sizeof(*shared.execs));
+	work = calloc(nr_threads, sizeof(*work));
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!shared.execs || !work || !threads) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		work[i].shared = &shared;
+		pthread_create(&threads[i], NULL, worker, &work[i]);
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+
+		merge_stats(&total, &work[i].stats);
+		free_stats(&work[i].stats);
+		corrupt |= work[i].corrupt;
+	}
+
+	/* Stitch the chunks back together */
+	for (n = 0; n < tr.nr_chunks; n++) {
+		const struct trace_chunk *chunk = trace_chunk(&tr, n);
+		const struct chunk_execs *e = &shared.execs[n];
+
+		stored += sizeof(*chunk) + chunk->size;
+		raw += chunk->raw_size;
+
+		if (!e->first)
+			continue;
+
+		if (prev)
+			add_gap(&total, e->first - prev);
+		prev = e->last;
+	}
+
+	if (corrupt)
+		fprintf(stderr, "%s: corrupt chunks skipped\n", filename);
+	print_stats(filename, &tr, &total, stored, raw);
+
+	free_stats(&total);
+	free(threads);
+	free(work);
+	free(shared.execs);
+	trace_close(&tr);
+
+	return corrupt ? -1 : 0;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [options] <trace>...\n"
+	       "  -j <n>  Worker threads (default: number of CPUs)\n",
+	       argv0);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int ret = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "j:h")) != -1) {
+		switch (c) {
+		case 'j':
+			nr_threads = atoi(optarg);
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind == argc || !nr_threads) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (; optind < argc; optind++) {
+		if (trace_stats(argv[optind], nr_threads))
+			ret = 1;
+	}
+
+	return ret;
+}
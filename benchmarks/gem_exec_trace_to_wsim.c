@@ -0,0 +1,761 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Converts a trace recorded with the gem_exec_tracer preload library into a
+ * gem_wsim workload descriptor.
+ *
+ * Every execbuf becomes a batch step on the engine and context it was
+ * submitted to. The objects it used, less the batch buffer itself, become
+ * reads and writes of a local working set holding every object seen in the
+ * trace. Where a batch has to wait for a batch on another context or engine,
+ * because of an object they share, the dependency is also spelled out as a
+ * step dependency on the most recent such batch of that timeline. Waits on
+ * objects become sync steps on the batches still using them, and optionally
+ * long enough gaps between submissions become delays.
+ *
+ * No device is needed.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drm.h"
+#include "i915_drm.h"
+
+#include "gem_exec_trace.h"
+
+enum engine {
+	RCS = 0,
+	BCS,
+	VCS,
+	VCS1,
+	VCS2,
+	VECS,
+	NUM_ENGINES
+};
+
+static const char *engine_str[NUM_ENGINES] = {
+	[RCS] = "RCS",
+	[BCS] = "BCS",
+	[VCS] = "VCS",
+	[VCS1] = "VCS1",
+	[VCS2] = "VCS2",
+	[VECS] = "VECS",
+};
+
+struct object {
+	uint64_t size;
+	int id;			/* working set index, -1 until first used */
+	int writer;		/* last batch writing to the object */
+	int *readers;		/* batches reading since, one per timeline */
+	unsigned int nr_readers;
+	unsigned long mark;	/* exec the slot below belongs to */
+	unsigned int slot;
+};
+
+struct timeline {
+	unsigned int ctx;
+	enum engine engine;
+	int synced;		/* last batch known to have completed */
+};
+
+struct step_object {
+	int id;
+	bool write;
+};
+
+struct step {
+	int sync;		/* batch waited upon, -1 for a batch step */
+	unsigned int delay;	/* in us, for a delay step */
+	unsigned int timeline;
+	struct step_object *objects;
+	unsigned int nr_objects;
+	int *edges;
+	unsigned int nr_edges;
+};
+
+struct convert {
+	struct object *objects;
+	unsigned int nr_objects;
+
+	unsigned int *handles;	/* object index + 1 by handle */
+	unsigned int nr_handles;
+
+	unsigned int *contexts;	/* wsim context id by handle */
+	unsigned int nr_contexts;
+	unsigned int num_contexts;
+
+	struct timeline *timelines;
+	unsigned int nr_timelines;
+
+	struct step *steps;
+	unsigned int nr_steps;
+
+	uint64_t *sizes;	/* by working set index */
+	unsigned int max_ids;
+	unsigned int nr_ids;
+
+	unsigned long nr_execs;
+	unsigned long skip;
+	unsigned long count;
+
+	uint64_t min_gap;	/* ns, 0 to ignore the timing */
+	uint64_t last_exec;	/* timestamp of the previous batch */
+
+	unsigned long nr_batches[NUM_ENGINES];
+	unsigned long nr_edges;
+	unsigned long nr_syncs;
+};
+
+static void *grow(void *ptr, unsigned int *nr, unsigned int want, size_t sz)
+{
+	unsigned int old = *nr;
+
+	if (want < old)
+		return ptr;
+
+	*nr = (want + 1024) & ~1023;
+	ptr = realloc(ptr, *nr * sz);
+	if (!ptr) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+	memset((char *)ptr + old * sz, 0, (*nr - old) * sz);
+
+	return ptr;
+}
+
+static struct object *new_object(struct convert *c, uint32_t handle,
+				 uint64_t size)
+{
+	struct object *o;
+
+	if (c->nr_objects % 1024 == 0) {
+		c->objects = realloc(c->objects,
+				     (c->nr_objects + 1024) * sizeof(*o));
+		if (!c->objects) {
+			fprintf(stderr, "Out of memory!\n");
+			exit(1);
+		}
+	}
+
+	o = &c->objects[c->nr_objects++];
+	memset(o, 0, sizeof(*o));
+	o->size = size;
+	o->id = -1;
+	o->writer = -1;
+
+	c->handles = grow(c->handles, &c->nr_handles, handle,
+			  sizeof(*c->handles));
+	c->handles[handle] = c->nr_objects;
+
+	return o;
+}
+
+static struct object *lookup_object(struct convert *c, uint32_t handle)
+{
+	if (handle < c->nr_handles && c->handles[handle])
+		return &c->objects[c->handles[handle] - 1];
+
+	/* Created before tracing started, or by an untraced ioctl. */
+	return new_object(c, handle, 0);
+}
+
+static unsigned int lookup_context(struct convert *c, uint32_t handle)
+{
+	c->contexts = grow(c->contexts, &c->nr_contexts, handle,
+			   sizeof(*c->contexts));
+	if (!c->contexts[handle])
+		c->contexts[handle] = ++c->num_contexts;
+
+	return c->contexts[handle];
+}
+
+static enum engine exec_engine(uint64_t flags)
+{
+	switch (flags & I915_EXEC_RING_MASK) {
+	case I915_EXEC_BSD:
+		switch (flags & I915_EXEC_BSD_MASK) {
+		case I915_EXEC_BSD_RING1:
+			return VCS1;
+		case I915_EXEC_BSD_RING2:
+			return VCS2;
+		default:
+			return VCS;
+		}
+	case I915_EXEC_BLT:
+		return BCS;
+	case I915_EXEC_VEBOX:
+		return VECS;
+	case I915_EXEC_DEFAULT:
+	case I915_EXEC_RENDER:
+	default:
+		return RCS;
+	}
+}
+
+static unsigned int
+lookup_timeline(struct convert *c, unsigned int ctx, enum engine engine)
+{
+	struct timeline *tl;
+	unsigned int i;
+
+	for (i = 0; i < c->nr_timelines; i++) {
+		if (c->timelines[i].ctx == ctx &&
+		    c->timelines[i].engine == engine)
+			return i;
+	}
+
+	c->timelines = realloc(c->timelines,
+			       (c->nr_timelines + 1) * sizeof(*tl));
+	if (!c->timelines) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+
+	tl = &c->timelines[c->nr_timelines];
+	tl->ctx = ctx;
+	tl->engine = engine;
+	tl->synced = -1;
+
+	return c->nr_timelines++;
+}
+
+static struct step *new_step(struct convert *c)
+{
+	struct step *s;
+
+	if (c->nr_steps % 1024 == 0) {
+		c->steps = realloc(c->steps,
+				   (c->nr_steps + 1024) * sizeof(*s));
+		if (!c->steps) {
+			fprintf(stderr, "Out of memory!\n");
+			exit(1);
+		}
+	}
+
+	s = &c->steps[c->nr_steps++];
+	memset(s, 0, sizeof(*s));
+	s->sync = -1;
+
+	return s;
+}
+
+/*
+ * Batches on a timeline execute in order, so only the most recent batch of
+ * every other timeline needs to be waited upon, and none of our own.
+ */
+static void add_edge(struct convert *c, struct step *s, int target)
+{
+	unsigned int tl, i;
+
+	if (target < 0)
+		return;
+
+	tl = c->steps[target].timeline;
+	if (tl == s->timeline || c->timelines[tl].synced >= target)
+		return;
+
+	for (i = 0; i < s->nr_edges; i++) {
+		if (c->steps[s->edges[i]].timeline == tl) {
+			if (s->edges[i] < target)
+				s->edges[i] = target;
+			return;
+		}
+	}
+
+	s->edges = realloc(s->edges, (s->nr_edges + 1) * sizeof(*s->edges));
+	if (!s->edges) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+	s->edges[s->nr_edges++] = target;
+}
+
+static void add_reader(struct convert *c, struct object *o, int idx)
+{
+	unsigned int tl = c->steps[idx].timeline;
+	unsigned int i;
+
+	for (i = 0; i < o->nr_readers; i++) {
+		if (c->steps[o->readers[i]].timeline == tl) {
+			o->readers[i] = idx;
+			return;
+		}
+	}
+
+	o->readers = realloc(o->readers,
+			     (o->nr_readers + 1) * sizeof(*o->readers));
+	if (!o->readers) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+	o->readers[o->nr_readers++] = idx;
+}
+
+static void use_object(struct convert *c, struct object *o, bool write)
+{
+	int idx = c->nr_steps - 1;
+	struct step *s = &c->steps[idx];
+	unsigned int i;
+
+	if (o->id < 0) {
+		o->id = c->nr_ids++;
+		c->sizes = grow(c->sizes, &c->max_ids, o->id,
+				sizeof(*c->sizes));
+		c->sizes[o->id] = o->size;
+	}
+
+	s->objects[s->nr_objects].id = o->id;
+	s->objects[s->nr_objects].write = write;
+	s->nr_objects++;
+
+	add_edge(c, s, o->writer);
+	if (write) {
+		for (i = 0; i < o->nr_readers; i++)
+			add_edge(c, s, o->readers[i]);
+
+		o->writer = idx;
+		o->nr_readers = 0;
+	} else {
+		add_reader(c, o, idx);
+	}
+}
+
+static void add_delay(struct convert *c, uint64_t ts)
+{
+	uint64_t gap = ts - c->last_exec;
+	struct step *s;
+
+	if (!c->min_gap || !c->last_exec || gap < c->min_gap)
+		return;
+
+	s = new_step(c);
+	s->delay = gap / 1000;
+}
+
+static void add_exec(struct convert *c, const struct trace_exec *t,
+		     uint64_t ts)
+{
+	const uint8_t *ptr = (const void *)(t + 1);
+	const struct trace_exec_object **eo;
+	unsigned long seq = ++c->nr_execs;
+	unsigned int batch, i, j;
+	struct step *s;
+	bool *write;
+
+	eo = calloc(t->object_count, sizeof(*eo));
+	write = calloc(t->object_count, sizeof(*write));
+	if (!eo || !write) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+
+	for (i = 0; i < t->object_count; i++) {
+		eo[i] = (const void *)ptr;
+		ptr += sizeof(*eo[i]) +
+		       eo[i]->relocation_count *
+		       sizeof(struct drm_i915_gem_relocation_entry);
+	}
+
+	if (seq <= c->skip || (c->count && seq > c->skip + c->count) ||
+	    !t->object_count)
+		goto out;
+
+	batch = t->flags & I915_EXEC_BATCH_FIRST ? 0 : t->object_count - 1;
+
+	add_delay(c, ts);
+	c->last_exec = ts;
+
+	s = new_step(c);
+	s->timeline = lookup_timeline(c, lookup_context(c, t->context),
+				      exec_engine(t->flags));
+	s->objects = calloc(t->object_count, sizeof(*s->objects));
+	if (!s->objects) {
+		fprintf(stderr, "Out of memory!\n");
+		exit(1);
+	}
+
+	for (i = 0; i < t->object_count; i++) {
+		struct object *o = lookup_object(c, eo[i]->handle);
+
+		o->mark = seq;
+		o->slot = i;
+		write[i] = eo[i]->flags & EXEC_OBJECT_WRITE;
+	}
+
+	/* Older userspace only marks writes through the relocations. */
+	for (i = 0; i < t->object_count; i++) {
+		const struct drm_i915_gem_relocation_entry *reloc =
+			(const void *)(eo[i] + 1);
+
+		for (j = 0; j < eo[i]->relocation_count; j++) {
+			uint32_t target = reloc[j].target_handle;
+			struct object *o;
+
+			if (!reloc[j].write_domain)
+				continue;
+
+			if (t->flags & I915_EXEC_HANDLE_LUT) {
+				if (target < t->object_count)
+					write[target] = true;
+				continue;
+			}
+
+			if (target >= c->nr_handles || !c->handles[target])
+				continue;
+
+			o = &c->objects[c->handles[target] - 1];
+			if (o->mark == seq)
+				write[o->slot] = true;
+		}
+	}
+
+	for (i = 0; i < t->object_count; i++) {
+		if (i != batch)
+			use_object(c, lookup_object(c, eo[i]->handle),
+				   write[i]);
+	}
+
+	c->nr_batches[c->timelines[s->timeline].engine]++;
+	c->nr_edges += s->nr_edges;
+
+out:
+	free(write);
+	free(eo);
+}
+
+static void add_sync(struct convert *c, int target)
+{
+	struct timeline *tl;
+	struct step *s;
+
+	if (target < 0)
+		return;
+
+	tl = &c->timelines[c->steps[target].timeline];
+	if (tl->synced >= target)
+		return;
+
+	tl->synced = target;
+
+	s = new_step(c);
+	s->sync = target;
+	c->nr_syncs++;
+}
+
+static void add_wait(struct convert *c, uint32_t handle)
+{
+	struct object *o;
+	unsigned int i;
+
+	if (handle >= c->nr_handles || !c->handles[handle])
+		return;
+
+	o = &c->objects[c->handles[handle] - 1];
+	add_sync(c, o->writer);
+	for (i = 0; i < o->nr_readers; i++)
+		add_sync(c, o->readers[i]);
+}
+
+static int parse_trace(struct convert *c, const char *filename)
+{
+	struct trace_reader tr;
+	size_t buf_size = 0;
+	void *buf = NULL;
+	unsigned int n;
+	int ret = 0;
+
+	if (trace_open(&tr, filename))
+		return -1;
+
+	if (c->min_gap && tr.header.version.version < 2)
+		fprintf(stderr, "%s: no timestamps in trace, ignoring gaps\n",
+			filename);
+
+	for (n = 0; n < tr.nr_chunks; n++) {
+		const struct trace_chunk *chunk = trace_chunk(&tr, n);
+		const struct trace_record *rec;
+		uint32_t i;
+
+		if (c->count && chunk->first_exec >= c->skip + c->count)
+			break;
+
+		rec = trace_chunk_records(&tr, n, &buf, &buf_size);
+		if (!rec) {
+			fprintf(stderr, "%s: corrupt chunk %u\n", filename, n);
+			ret = -1;
+			break;
+		}
+
+		for (i = 0; i < chunk->nr_records; i++, rec = trace_next_record(rec)) {
+			const struct trace_handle *h = (const void *)rec;
+
+			switch (rec->cmd) {
+			case ADD_BO:
+				new_object(c, h->handle,
+					   ((const struct trace_add_bo *)rec)->size);
+				break;
+			case DEL_BO:
+				if (h->handle < c->nr_handles)
+					c->handles[h->handle] = 0;
+				break;
+			case ADD_CTX:
+			case DEL_CTX:
+				/* Handles may be reused, for a brand new context. */
+				if (h->handle < c->nr_contexts)
+					c->contexts[h->handle] = 0;
+				break;
+			case EXEC:
+				add_exec(c, (const void *)rec,
+					 trace_record_time(chunk, rec));
+				break;
+			case WAIT:
+				add_wait(c, h->handle);
+				break;
+			}
+		}
+	}
+
+	free(buf);
+	trace_close(&tr);
+
+	return ret;
+}
+
+static void print_size(FILE *out, uint64_t size)
+{
+	if (!size)
+		size = 4096;
+
+	if (size % (1 << 20) == 0)
+		fprintf(out, "%" PRIu64 "m", size >> 20);
+	else if (size % 1024 == 0)
+		fprintf(out, "%" PRIu64 "k", size >> 10);
+	else
+		fprintf(out, "%" PRIu64, size);
+}
+
+static void print_working_set(const struct convert *c, FILE *out)
+{
+	unsigned int i, n;
+
+	fprintf(out, "w.1.");
+	for (i = 0; i < c->nr_ids; i += n) {
+		for (n = 1; i + n < c->nr_ids; n++) {
+			if (c->sizes[i + n] != c->sizes[i])
+				break;
+		}
+
+		if (i)
+			fputc('/', out);
+		if (n > 1)
+			fprintf(out, "%un", n);
+		print_size(out, c->sizes[i]);
+	}
+	fputc('\n', out);
+}
+
+static int cmp_object(const void *A, const void *B)
+{
+	const struct step_object *a = A, *b = B;
+
+	if (a->write != b->write)
+		return a->write - b->write;
+
+	return a->id - b->id;
+}
+
+static void
+print_batch(const struct convert *c, FILE *out, const struct step *s,
+	    int idx, const char *duration, bool working_set)
+{
+	const struct timeline *tl = &c->timelines[s->timeline];
+	bool first = true;
+	unsigned int i, n;
+
+	fprintf(out, "%u.%s.%s.", tl->ctx, engine_str[tl->engine], duration);
+
+	for (i = 0; i < s->nr_edges; i++) {
+		fprintf(out, "%s%d", first ? "" : "/", s->edges[i] - idx);
+		first = false;
+	}
+
+	if (working_set) {
+		qsort(s->objects, s->nr_objects, sizeof(*s->objects),
+		      cmp_object);
+
+		for (i = 0; i < s->nr_objects; i += n) {
+			const struct step_object *obj = &s->objects[i];
+
+			for (n = 1; i + n < s->nr_objects; n++) {
+				if (obj[n].write != obj->write ||
+				    obj[n].id != obj->id + n)
+					break;
+			}
+
+			fprintf(out, "%s%c1-%d", first ? "" : "/",
+				obj->write ? 'w' : 'r', obj->id);
+			if (n > 1)
+				fprintf(out, "-%d", obj->id + n - 1);
+			first = false;
+		}
+	}
+
+	fprintf(out, "%s.0\n", first ? "0" : "");
+}
+
+static void print_workload(const struct convert *c, FILE *out,
+			   const char *duration, bool working_set)
+{
+	unsigned int i;
+
+	if (working_set && c->nr_ids)
+		print_working_set(c, out);
+	else
+		working_set = false;
+
+	for (i = 0; i < c->nr_steps; i++) {
+		const struct step *s = &c->steps[i];
+
+		if (s->sync >= 0)
+			fprintf(out, "s.%d\n", s->sync - (int)i);
+		else if (s->delay)
+			fprintf(out, "d.%u\n", s->delay);
+		else
+			print_batch(c, out, s, i, duration, working_set);
+	}
+}
+
+static void print_summary(const struct convert *c)
+{
+	unsigned long nr_batches = 0;
+	uint64_t total = 0;
+	unsigned int i;
+
+	for (i = 0; i < c->nr_ids; i++)
+		total += c->sizes[i] ?: 4096;
+
+	for (i = 0; i < NUM_ENGINES; i++)
+		nr_batches += c->nr_batches[i];
+
+	fprintf(stderr, "%lu batches, %u contexts, %u timelines, %lu dependencies, %lu syncs\n",
+		nr_batches, c->num_contexts,
+		c->nr_timelines, c->nr_edges, c->nr_syncs);
+	fprintf(stderr, "%u objects, %.1f MiB\n", c->nr_ids, total / 1048576.);
+	for (i = 0; i < NUM_ENGINES; i++) {
+		if (c->nr_batches[i])
+			fprintf(stderr, "%s: %lu batches\n",
+				engine_str[i], c->nr_batches[i]);
+	}
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [options] <trace>\n"
+	       "  -o <file>      Write the workload to a file instead of stdout\n"
+	       "  -d <duration>  Batch duration in us, or a <min>-<max> range\n"
+	       "                 (default: 1000)\n"
+	       "  -s <n>         Skip the first n execbufs\n"
+	       "  -n <n>         Convert at most n execbufs\n"
+	       "  -g <us>        Turn gaps of at least this long between execbufs\n"
+	       "                 into delays\n"
+	       "  -W             No working set, only dependencies between batches\n",
+	       argv0);
+}
+
+int main(int argc, char **argv)
+{
+	struct convert c = {};
+	const char *duration = "1000";
+	const char *output = NULL;
+	bool working_set = true;
+	FILE *out = stdout;
+	int ret;
+
+	while ((ret = getopt(argc, argv, "o:d:s:n:g:Wh")) != -1) {
+		switch (ret) {
+		case 'o':
+			output = optarg;
+			break;
+		case 'd':
+			duration = optarg;
+			if (!*duration ||
+			    strspn(duration, "0123456789-") != strlen(duration)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 's':
+			c.skip = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			c.count = strtoul(optarg, NULL, 0);
+			break;
+		case 'g':
+			c.min_gap = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'W':
+			working_set = false;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (optind + 1 != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (parse_trace(&c, argv[optind]))
+		return 1;
+
+	if (output) {
+		out = fopen(output, "w");
+		if (!out) {
+			fprintf(stderr, "%s: %s\n", output, strerror(errno));
+			return 1;
+		}
+	}
+
+	print_workload(&c, out, duration, working_set);
+	print_summary(&c);
+
+	if (out != stdout)
+		fclose(out);
+
+	return 0;
+}
@@ -34,93 +34,50 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <dlfcn.h>
 #include <i915_drm.h>
 #include <pthread.h>
+#include <time.h>
+#include <zlib.h>
 
 #include "intel_aub.h"
 #include "intel_chipset.h"
 
+#include "gem_exec_trace.h"
+
 static int (*libc_close)(int fd);
 static int (*libc_ioctl)(int fd, unsigned long request, void *argp);
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static size_t chunk_size = 256 << 10;
+static int compress_level;
+
 struct trace {
 	int fd;
 	FILE *file;
+	pthread_mutex_t lock;
+
+	/* The chunk being filled */
+	struct trace_chunk chunk;
+	uint8_t *records;
+	size_t max_records;
+
+	uint8_t *deflated;
+	size_t max_deflated;
+
+	struct trace_index_entry *index;
+	unsigned int nr_index;
+	unsigned int max_index;
+
+	uint64_t nr_execs;
+
 	struct trace *next;
 } *traces;
 
 #define DRM_MAJOR 226
 
-enum {
-	ADD_BO = 0,
-	DEL_BO,
-	ADD_CTX,
-	DEL_CTX,
-	EXEC,
-	WAIT,
-};
-
-static struct trace_verion {
-	uint32_t magic;
-	uint32_t version;
-} version = {
-	.magic = 0xdeadbeef,
-	.version = 1
-};
-
-struct trace_add_bo {
-	uint8_t cmd;
-	uint32_t handle;
-	uint64_t size;
-} __attribute__((packed));
-struct trace_del_bo {
-	uint8_t cmd;
-	uint32_t handle;
-}__attribute__((packed));
-
-struct trace_add_ctx {
-	uint8_t cmd;
-	uint32_t handle;
-} __attribute__((packed));
-struct trace_del_ctx {
-	uint8_t cmd;
-	uint32_t handle;
-}__attribute__((packed));
-
-struct trace_exec {
-	uint8_t cmd;
-	uint32_t object_count;
-	uint64_t flags;
-	uint32_t context;
-}__attribute__((packed));
-
-struct trace_exec_object {
-	uint32_t handle;
-	uint32_t relocation_count;
-	uint64_t alignment;
-	uint64_t offset;
-	uint64_t flags;
-	uint64_t rsvd1;
-	uint64_t rsvd2;
-}__attribute__((packed));
-
-struct trace_exec_relocation {
-	uint32_t target_handle;
-	uint32_t delta;
-	uint64_t offset;
-	uint64_t presumed_offset;
-	uint32_t read_domains;
-	uint32_t write_domain;
-}__attribute__((packed));
-
-struct trace_wait {
-	uint8_t cmd;
-	uint32_t handle;
-} __attribute__((packed));
-
 static void __attribute__ ((format(__printf__, 2, 3)))
 fail_if(int cond, const char *format, ...)
 {
@@ -136,6 +93,125 @@ fail_if(int cond, const char *format, ...)
 	abort();
 }
 
+static uint64_t
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+flush_chunk(struct trace *trace)
+{
+	static const uint8_t pad[8];
+	struct trace_chunk *chunk = &trace->chunk;
+	const void *data = trace->records;
+	struct trace_index_entry *entry;
+
+	if (!chunk->nr_records)
+		return;
+
+	chunk->magic = TRACE_CHUNK_MAGIC;
+	chunk->size = chunk->raw_size;
+
+	if (compress_level) {
+		uLongf len = compressBound(chunk->raw_size);
+
+		if (len > trace->max_deflated) {
+			trace->max_deflated = len;
+			trace->deflated = realloc(trace->deflated, len);
+			fail_if(!trace->deflated, "out of memory\n");
+		}
+
+		/* Only keep what actually got smaller */
+		if (compress2(trace->deflated, &len,
+			      trace->records, chunk->raw_size,
+			      compress_level) == Z_OK &&
+		    len < chunk->raw_size) {
+			chunk->flags |= TRACE_CHUNK_COMPRESSED;
+			chunk->size = len;
+			data = trace->deflated;
+		}
+	}
+
+	if (trace->nr_index == trace->max_index) {
+		trace->max_index = trace->max_index ? 2 * trace->max_index : 64;
+		trace->index = realloc(trace->index,
+				       trace->max_index * sizeof(*trace->index));
+		fail_if(!trace->index, "out of memory\n");
+	}
+
+	entry = &trace->index[trace->nr_index++];
+	entry->offset = ftell(trace->file);
+	entry->timestamp = chunk->timestamp;
+	entry->first_exec = chunk->first_exec;
+
+	fwrite(chunk, sizeof(*chunk), 1, trace->file);
+	fwrite(data, chunk->size, 1, trace->file);
+	fwrite(pad, -chunk->size & 7, 1, trace->file);
+	fflush(trace->file);
+
+	memset(chunk, 0, sizeof(*chunk));
+}
+
+/*
+ * Reserves a record of size bytes in the current chunk, with the trace
+ * locked until the matching trace_end().
+ */
+static void *
+trace_begin(struct trace *trace, uint8_t cmd, size_t size)
+{
+	struct trace_chunk *chunk = &trace->chunk;
+	struct trace_record *rec;
+	uint64_t ts;
+
+	pthread_mutex_lock(&trace->lock);
+
+	ts = now();
+	if (chunk->nr_records &&
+	    (chunk->raw_size + size > chunk_size ||
+	     ts - chunk->timestamp > UINT32_MAX))
+		flush_chunk(trace);
+
+	if (!chunk->nr_records) {
+		chunk->timestamp = ts;
+		chunk->first_exec = trace->nr_execs;
+	}
+
+	if (chunk->raw_size + size > trace->max_records) {
+		trace->max_records = chunk->raw_size + size;
+		if (trace->max_records < chunk_size)
+			trace->max_records = chunk_size;
+		trace->records = realloc(trace->records, trace->max_records);
+		fail_if(!trace->records, "out of memory\n");
+	}
+
+	rec = (void *)(trace->records + chunk->raw_size);
+	memset(rec, 0, size);
+	rec->cmd = cmd;
+	rec->size = size;
+	rec->tid = syscall(SYS_gettid);
+	rec->delta = ts - chunk->timestamp;
+
+	chunk->raw_size += size;
+	chunk->last_timestamp = ts;
+	chunk->nr_records++;
+	if (cmd == EXEC) {
+		chunk->nr_execs++;
+		trace->nr_execs++;
+	}
+
+	return rec;
+}
+
+static void
+trace_end(struct trace *trace)
+{
+	pthread_mutex_unlock(&trace->lock);
+}
+
 static void
 trace_exec(struct trace *trace,
 	   const struct drm_i915_gem_execbuffer2 *execbuffer2)
@@ -143,79 +219,146 @@ trace_exec(struct trace *trace,
 #define to_ptr(T, x) ((T *)(uintptr_t)(x))
 	const struct drm_i915_gem_exec_object2 *exec_objects =
 		to_ptr(typeof(*exec_objects), execbuffer2->buffers_ptr);
+	struct trace_exec *t;
+	size_t size = sizeof(*t);
+	uint8_t *ptr;
 
 	fail_if(execbuffer2->flags & (I915_EXEC_FENCE_IN | I915_EXEC_FENCE_OUT),
 		"fences not supported yet\n");
 
-	flockfile(trace->file);
-	{
-		struct trace_exec t = {
-			EXEC,
-			execbuffer2->buffer_count,
-			execbuffer2->flags,
-			execbuffer2->rsvd1,
-		};
-		fwrite(&t, sizeof(t), 1, trace->file);
-	}
+	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++)
+		size += sizeof(struct trace_exec_object) +
+			exec_objects[i].relocation_count *
+			sizeof(struct drm_i915_gem_relocation_entry);
 
+	t = trace_begin(trace, EXEC, size);
+	t->object_count = execbuffer2->buffer_count;
+	t->context = execbuffer2->rsvd1;
+	t->flags = execbuffer2->flags;
+
+	ptr = (uint8_t *)(t + 1);
 	for (uint32_t i = 0; i < execbuffer2->buffer_count; i++) {
 		const struct drm_i915_gem_exec_object2 *obj = &exec_objects[i];
 		const struct drm_i915_gem_relocation_entry *relocs =
 			to_ptr(typeof(*relocs), obj->relocs_ptr);
-		{
-			struct trace_exec_object t = {
-				obj->handle,
-				obj->relocation_count,
-				obj->alignment,
-				obj->offset,
-				obj->flags,
-				obj->rsvd1,
-				obj->rsvd2
-			};
-			fwrite(&t, sizeof(t), 1, trace->file);
+		struct trace_exec_object *o = (void *)ptr;
+
+		o->handle = obj->handle;
+		o->relocation_count = obj->relocation_count;
+		o->alignment = obj->alignment;
+		o->offset = obj->offset;
+		o->flags = obj->flags;
+		o->rsvd1 = obj->rsvd1;
+		o->rsvd2 = obj->rsvd2;
+		ptr = (uint8_t *)(o + 1);
+
+		if (obj->relocation_count) {
+			memcpy(ptr, relocs,
+			       obj->relocation_count * sizeof(*relocs));
+			ptr += obj->relocation_count * sizeof(*relocs);
 		}
-		fwrite(relocs, sizeof(*relocs), obj->relocation_count,
-		       trace->file);
 	}
 
-	fflush(trace->file);
-	funlockfile(trace->file);
+	trace_end(trace);
 #undef to_ptr
 }
 
+static void
+trace_handle(struct trace *trace, uint8_t cmd, uint32_t handle)
+{
+	struct trace_handle *t = trace_begin(trace, cmd, sizeof(*t));
+
+	t->handle = handle;
+	trace_end(trace);
+}
+
 static void
 trace_wait(struct trace *trace, uint32_t handle)
 {
-	struct trace_wait t = { WAIT, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	trace_handle(trace, WAIT, handle);
 }
 
 static void
 trace_add(struct trace *trace, uint32_t handle, uint64_t size)
 {
-	struct trace_add_bo t = { ADD_BO, handle, size };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	struct trace_add_bo *t = trace_begin(trace, ADD_BO, sizeof(*t));
+
+	t->handle = handle;
+	t->size = size;
+	trace_end(trace);
 }
 
 static void
 trace_del(struct trace *trace, uint32_t handle)
 {
-	struct trace_del_bo t = { DEL_BO, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	trace_handle(trace, DEL_BO, handle);
 }
 
 static void
 trace_add_context(struct trace *trace, uint32_t handle)
 {
-	struct trace_add_ctx t = { ADD_CTX, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	trace_handle(trace, ADD_CTX, handle);
 }
 
 static void
 trace_del_context(struct trace *trace, uint32_t handle)
 {
-	struct trace_del_ctx t = { DEL_CTX, handle };
-	fwrite(&t, sizeof(t), 1, trace->file);
+	trace_handle(trace, DEL_CTX, handle);
+}
+
+static struct trace *
+trace_create(int fd)
+{
+	struct trace_header header = {
+		.version = { TRACE_MAGIC, TRACE_VERSION },
+		.pid = getpid(),
+		.timestamp = now(),
+	};
+	char filename[80];
+	struct trace *t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	sprintf(filename, "/tmp/trace-%d.%d", getpid(), fd);
+	t->file = fopen(filename, "w+");
+	t->fd = fd;
+	pthread_mutex_init(&t->lock, NULL);
+
+	if (!t->file ||
+	    !fwrite(&header, sizeof(header), 1, t->file) ||
+	    fflush(t->file)) {
+		if (t->file)
+			fclose(t->file);
+		free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+/* Writes out the last chunk and the index behind all the chunks. */
+static void
+trace_finish(struct trace *t)
+{
+	struct trace_index idx = {
+		.magic = TRACE_INDEX_MAGIC,
+	};
+
+	flush_chunk(t);
+
+	idx.count = t->nr_index;
+	idx.offset = ftell(t->file);
+	fwrite(t->index, sizeof(*t->index), t->nr_index, t->file);
+	fwrite(&idx, sizeof(idx), 1, t->file);
+	fclose(t->file);
+
+	pthread_mutex_destroy(&t->lock);
+	free(t->index);
+	free(t->deflated);
+	free(t->records);
+	free(t);
 }
 
 int
@@ -227,8 +370,7 @@ close(int fd)
 	for (p = &traces; (t = *p); p = &t->next) {
 		if (t->fd == fd) {
 			*p = t->next;
-			fclose(t->file);
-			free(t);
+			trace_finish(t);
 			break;
 		}
 	}
@@ -296,30 +438,17 @@ ioctl(int fd, unsigned long request, ...)
 		}
 	}
 	if (!t) {
-		char filename[80];
-
 		if (!is_i915(fd)) {
 			pthread_mutex_unlock(&mutex);
 			goto untraced;
 		}
 
-		t = malloc(sizeof(*t));
+		t = trace_create(fd);
 		if (!t) {
 			pthread_mutex_unlock(&mutex);
 			return -ENOMEM;
 		}
 
-		sprintf(filename, "/tmp/trace-%d.%d", getpid(), fd);
-		t->file = fopen(filename, "w+");
-		t->fd = fd;
-
-		if (!fwrite(&version, sizeof(version), 1, t->file)) {
-			pthread_mutex_unlock(&mutex);
-			fclose(t->file);
-			free(t);
-			return -ENOMEM;
-		}
-
 		t->next = traces;
 		traces = t;
 	}
@@ -406,11 +535,46 @@ untraced:
 	return libc_ioctl(fd, request, argp);
 }
 
+/*
+ * A forked child must not write out the chunks its parent is still filling,
+ * nor the index when it exits.
+ */
+static void
+forget_traces(void)
+{
+	traces = NULL;
+}
+
 static void __attribute__ ((constructor))
 init(void)
 {
+	const char *env;
+
 	libc_close = dlsym(RTLD_NEXT, "close");
 	libc_ioctl = dlsym(RTLD_NEXT, "ioctl");
 	fail_if(libc_close == NULL || libc_ioctl == NULL,
 		"failed to get libc ioctl or close\n");
+
+	env = getenv("IGT_TRACE_CHUNK");
+	if (env && atoi(env) > 0)
+		chunk_size = (size_t)atoi(env) << 10;
+
+	env = getenv("IGT_TRACE_COMPRESS");
+	if (env)
+		compress_level = atoi(env) < 0 ? 0 : atoi(env) > 9 ? 9 : atoi(env);
+
+	pthread_atfork(NULL, NULL, forget_traces);
+}
+
+static void __attribute__ ((destructor))
+fini(void)
+{
+	struct trace *t;
+
+	pthread_mutex_lock(&mutex);
+	while ((t = traces)) {
+		traces = t->next;
+		trace_finish(t);
+	}
+	pthread_mutex_unlock(&mutex);
 }
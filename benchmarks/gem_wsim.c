@@ -39,6 +39,7 @@
 #include <sys/wait.h>
 #include <time.h>
 #include <assert.h>
+#include <getopt.h>
 #include <limits.h>
 #include <pthread.h>
 #include <math.h>
@@ -134,7 +135,20 @@ struct working_set {
 	struct work_buffer_size *sizes;
 };
 
+/* Latency histograms, see latency_bucket(). */
+#define LAT_SUB_BITS	5
+#define LAT_SUB		(1 << LAT_SUB_BITS)
+#define LAT_BUCKETS	(40 * LAT_SUB)
+
+struct latency {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min, max;
+	unsigned int buckets[LAT_BUCKETS];
+};
+
 struct workload;
+struct sim_request;
 
 struct w_step
 {
@@ -181,6 +195,9 @@ struct w_step
 	struct drm_i915_gem_relocation_entry reloc[3];
 	uint32_t bb_handle;
 	uint32_t *bb_duration;
+
+	struct latency *latency;
+	struct sim_request *sim_rq;
 };
 
 struct ctx {
@@ -192,6 +209,8 @@ struct ctx {
 	struct bond *bonds;
 	bool load_balance;
 	uint64_t sseu;
+
+	struct sim_request *sim_timeline[NUM_ENGINES];
 };
 
 struct workload
@@ -226,16 +245,40 @@ struct workload
 
 	struct igt_list_head requests[NUM_ENGINES];
 	unsigned int nrequest[NUM_ENGINES];
+
+	struct latency *latency[NUM_ENGINES];
+	unsigned int nr_lat_fences, max_lat_fences;
+	struct latency_fence {
+		struct w_step *w;
+		uint64_t submit;
+		int fence;
+	} *lat_fences;
 };
 
 static unsigned int master_prng;
 
 static int verbose = 1;
 static int fd;
+static bool simulate;
+static bool latency_stats;
+static bool print_latency;
+static FILE *trace_file;
+static uint64_t trace_epoch;
+static unsigned long trace_events;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
 static struct drm_i915_gem_context_param_sseu device_sseu = {
 	.slice_mask = -1 /* Force read on first use. */
 };
 
+#define OPT_SIMULATE	0x100
+#define OPT_LATENCY	0x101
+#define OPT_LATENCY_JSON 0x102
+#define OPT_LATENCY_CSV	0x103
+#define OPT_TRACE	0x104
+
+/* Most batch out fences kept open per workload for latency tracking. */
+#define LAT_MAX_FENCES	256
+
 #define SYNCEDCLIENTS	(1<<1)
 #define DEPSYNC		(1<<2)
 #define SSEU		(1<<3)
@@ -540,7 +583,21 @@ static void query_engines(void)
 
 	__engines_queried = true;
 
-	if (!has_engine_query(fd)) {
+	if (simulate) {
+		/* Simulated GPU has one of each engine and two VCS. */
+		num = 5;
+
+		engines = calloc(num,
+				 sizeof(struct i915_engine_class_instance));
+		igt_assert(engines);
+
+		engines[0].engine_class = I915_ENGINE_CLASS_RENDER;
+		engines[1].engine_class = I915_ENGINE_CLASS_COPY;
+		engines[2].engine_class = I915_ENGINE_CLASS_VIDEO;
+		engines[3].engine_class = I915_ENGINE_CLASS_VIDEO;
+		engines[3].engine_instance = 1;
+		engines[4].engine_class = I915_ENGINE_CLASS_VIDEO_ENHANCE;
+	} else if (!has_engine_query(fd)) {
 		unsigned int num_bsd = gem_has_bsd(fd) + gem_has_bsd2(fd);
 		unsigned int i = 0;
 
@@ -1158,7 +1215,8 @@ parse_workload(struct w_arg *arg, unsigned int flags, double scale_dur,
 			fstart = NULL;
 
 			if (field[0] == '*') {
-				check_arg(intel_gen(intel_get_drm_devid(fd)) < 8,
+				check_arg(!simulate &&
+					  intel_gen(intel_get_drm_devid(fd)) < 8,
 					  "Infinite batch at step %u needs Gen8+!\n",
 					  nr_steps);
 				step.unbound_duration = true;
@@ -1366,7 +1424,7 @@ clone_workload(struct workload *_wrk)
 
 	/* Check if we need a sw sync timeline. */
 	for (i = 0; i < wrk->nr_steps; i++) {
-		if (wrk->steps[i].type == SW_FENCE) {
+		if (wrk->steps[i].type == SW_FENCE && !simulate) {
 			wrk->sync_timeline = sw_sync_timeline_create();
 			igt_assert(wrk->sync_timeline >= 0);
 			break;
@@ -1579,8 +1637,109 @@ get_ctxid(struct workload *wrk, struct w_step *w)
 	return wrk->ctx_list[w->context].id;
 }
 
+/*
+ * With --simulate no batches are submitted. Instead the workload steps are
+ * run through a discrete event model of the engines in virtual time, with
+ * all times in microseconds.
+ */
+#define SIM_NEVER UINT64_MAX
+
+/* Cost of reconfiguring the render engine for a different slice mask. */
+#define SIM_SSEU_SWITCH_US 50
+
+/* Roughly as many requests as fit in a context ring. */
+#define SIM_MAX_INFLIGHT 128
+
+struct sim_client;
+
+struct sim_dep {
+	struct sim_request *rq;
+	bool submit;
+};
+
+struct sim_request {
+	unsigned int refcount;
+	uint64_t seqno;
+
+	struct sim_client *client;
+	struct ctx *ctx;
+	struct w_step *w;
+
+	int prio;
+	uint64_t engines; /* mask of engines this can execute on */
+	enum intel_engine_id engine; /* engine it last executed on */
+	struct sim_request *bond_master;
+
+	uint64_t submit, start, end;
+	uint64_t remaining; /* SIM_NEVER while unbound */
+	unsigned int preempt_us;
+	uint64_t sseu;
+
+	unsigned int nr_deps, max_deps;
+	struct sim_dep *deps;
+
+	struct igt_list_head link;
+};
+
+struct sim_engine {
+	struct sim_request *active;
+	uint64_t slice_start;
+	uint64_t busy;
+	uint64_t sseu;
+};
+
+struct sim_buffer {
+	struct sim_request *writer;
+	unsigned int nr_readers, max_readers;
+	struct sim_request **readers;
+};
+
+struct sim_client {
+	struct workload *wrk;
+
+	uint64_t time;
+	uint64_t repeat_start;
+	uint64_t end;
+	struct sim_request *wait;
+	bool ring_full;
+	bool submitted;
+	bool draining;
+	bool done;
+
+	unsigned int step;
+	unsigned int count;
+	unsigned int inflight;
+	int throttle;
+	int qd_throttle;
+
+	unsigned long time_tot, time_min, time_max;
+	unsigned int missed;
+};
+
+static struct {
+	uint64_t now;
+	uint64_t seqno;
+	struct igt_list_head pending;
+	struct sim_engine engines[NUM_ENGINES];
+	unsigned int nr_buffers;
+	struct sim_buffer *buffers; /* indexed by handle */
+} sim;
+
+static uint32_t sim_alloc_bo(void)
+{
+	sim.buffers = realloc(sim.buffers,
+			      (sim.nr_buffers + 2) * sizeof(*sim.buffers));
+	igt_assert(sim.buffers);
+	memset(&sim.buffers[++sim.nr_buffers], 0, sizeof(*sim.buffers));
+
+	return sim.nr_buffers;
+}
+
 static uint32_t alloc_bo(int i915, unsigned long size)
 {
+	if (simulate)
+		return sim_alloc_bo();
+
 	return gem_create(i915, size);
 }
 
@@ -1633,6 +1792,12 @@ alloc_step_batch(struct workload *wrk, struct w_step *w)
 		igt_assert(j < nr_obj);
 	}
 
+	/* Simulator only needs the object list for implicit dependencies. */
+	if (simulate) {
+		w->eb.buffer_count = j;
+		return;
+	}
+
 	w->bb_handle = w->obj[j].handle = gem_create(fd, 4096);
 	w->obj[j].relocation_count = create_bb(w, j);
 	igt_assert(w->obj[j].relocation_count <= ARRAY_SIZE(w->reloc));
@@ -1877,6 +2042,195 @@ static void measure_active_set(struct workload *wrk)
 	       wrk->id, total, nr, batch_sizes);
 }
 
+/*
+ * Log-linear latency histogram: values below 2 * LAT_SUB nanoseconds get a
+ * bucket each, above that every power of two is split into LAT_SUB buckets,
+ * giving a relative precision of 1 / LAT_SUB.
+ */
+static unsigned int latency_bucket(uint64_t ns)
+{
+	unsigned int shift, idx;
+
+	if (ns < 2 * LAT_SUB)
+		return ns;
+
+	shift = 63 - __builtin_clzll(ns) - LAT_SUB_BITS;
+	idx = LAT_SUB * shift + (ns >> shift);
+
+	return min(idx, LAT_BUCKETS - 1);
+}
+
+/* Highest value which falls into the bucket. */
+static uint64_t latency_bucket_value(unsigned int idx)
+{
+	unsigned int shift = idx < 2 * LAT_SUB ? 0 : idx / LAT_SUB - 1;
+	uint64_t m = idx - LAT_SUB * shift;
+
+	return ((m + 1) << shift) - 1;
+}
+
+static void latency_add(struct latency *lat, uint64_t ns)
+{
+	if (!lat->count || ns < lat->min)
+		lat->min = ns;
+	if (ns > lat->max)
+		lat->max = ns;
+	lat->count++;
+	lat->sum += ns;
+	lat->buckets[latency_bucket(ns)]++;
+}
+
+static void latency_merge(struct latency *dst, const struct latency *src)
+{
+	unsigned int i;
+
+	if (!src || !src->count)
+		return;
+
+	if (!dst->count || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count += src->count;
+	dst->sum += src->sum;
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+}
+
+static uint64_t latency_percentile(const struct latency *lat, double pct)
+{
+	uint64_t rank = ceil(lat->count * pct / 100.0), seen = 0;
+	unsigned int i;
+
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += lat->buckets[i];
+		if (seen >= rank)
+			return min(latency_bucket_value(i), lat->max);
+	}
+
+	return lat->max;
+}
+
+static struct latency *latency_create(void)
+{
+	struct latency *lat = calloc(1, sizeof(*lat));
+
+	igt_assert(lat);
+
+	return lat;
+}
+
+static void trace_event(unsigned int pid, unsigned int tid, struct w_step *w,
+			uint64_t submit, uint64_t start, uint64_t end)
+{
+	pthread_mutex_lock(&trace_lock);
+	fprintf(trace_file,
+		"%s{\"name\":\"%u.%s\",\"cat\":\"batch\",\"ph\":\"X\","
+		"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u,"
+		"\"args\":{\"step\":%u,\"ctx\":%u,\"latency_us\":%.3f}}",
+		trace_events++ ? ",\n" : "[\n",
+		w->idx, ring_str_map[w->engine],
+		(start - trace_epoch) / 1e3, (end - start) / 1e3, pid, tid,
+		w->idx, w->context, (end - submit) / 1e3);
+	pthread_mutex_unlock(&trace_lock);
+}
+
+/*
+ * Account one completed batch. @start is when it started executing if
+ * known, otherwise the submission time, all in nanoseconds. Latency is the
+ * full submission to completion time. In the trace events are grouped by
+ * the engine they executed on, @tid.
+ */
+static void
+record_latency(struct workload *wrk, struct w_step *w, unsigned int tid,
+	       uint64_t submit, uint64_t start, uint64_t end)
+{
+	if (!wrk->latency[w->engine])
+		wrk->latency[w->engine] = latency_create();
+
+	latency_add(w->latency, end - submit);
+	latency_add(wrk->latency[w->engine], end - submit);
+
+	if (trace_file)
+		trace_event(wrk->id, tid, w, submit, start, end);
+}
+
+static uint64_t gettime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/*
+ * Out fences of the batches are kept until signalled and their signal
+ * timestamps give the completion times.
+ */
+static bool retire_latency_fences(struct workload *wrk, bool wait)
+{
+	unsigned int i, j;
+	bool retired = false;
+
+	for (i = 0, j = 0; i < wrk->nr_lat_fences; i++) {
+		struct latency_fence *f = &wrk->lat_fences[i];
+		int status;
+
+		if (wait)
+			sync_fence_wait(f->fence, -1);
+
+		status = sync_fence_status(f->fence);
+		if (status == 0) {
+			wrk->lat_fences[j++] = *f;
+			continue;
+		}
+
+		if (status > 0)
+			record_latency(wrk, f->w, f->w->engine, f->submit,
+				       f->submit, sync_fence_timestamp(f->fence));
+
+		close(f->fence);
+		retired = true;
+	}
+	wrk->nr_lat_fences = j;
+
+	return retired;
+}
+
+static void
+track_latency_fence(struct workload *wrk, struct w_step *w, uint64_t submit,
+		    int fence)
+{
+	/* Bound the number of open fences by waiting for the oldest. */
+	if (wrk->nr_lat_fences == LAT_MAX_FENCES &&
+	    !retire_latency_fences(wrk, false)) {
+		struct latency_fence *f = &wrk->lat_fences[0];
+
+		sync_fence_wait(f->fence, -1);
+		retire_latency_fences(wrk, false);
+	}
+
+	if (wrk->nr_lat_fences == wrk->max_lat_fences) {
+		wrk->max_lat_fences = wrk->max_lat_fences ?
+				      2 * wrk->max_lat_fences : 64;
+		wrk->lat_fences = realloc(wrk->lat_fences,
+					  wrk->max_lat_fences *
+					  sizeof(*wrk->lat_fences));
+		igt_assert(wrk->lat_fences);
+	}
+
+	wrk->lat_fences[wrk->nr_lat_fences++] = (struct latency_fence) {
+		.w = w,
+		.submit = submit,
+		.fence = fence,
+	};
+}
+
 #define alloca0(sz) ({ size_t sz__ = (sz); memset(alloca(sz__), 0, sz__); })
 
 static int prepare_workload(unsigned int id, struct workload *wrk)
@@ -1934,7 +2288,8 @@ static int prepare_workload(unsigned int id, struct workload *wrk)
 					wsim_err("Load balancing needs an engine map!\n");
 					return 1;
 				}
-				if (intel_gen(intel_get_drm_devid(fd)) < 11) {
+				if (!simulate &&
+				    intel_gen(intel_get_drm_devid(fd)) < 11) {
 					wsim_err("Load balancing needs relative mmio support, gen11+!\n");
 					return 1;
 				}
@@ -1971,6 +2326,13 @@ static int prepare_workload(unsigned int id, struct workload *wrk)
 
 		igt_assert(!ctx->id);
 
+		if (simulate) {
+			ctx->id = i + 1;
+			ctx->priority = wrk->prio;
+			ctx->sseu = wrk->sseu ? 1 : -1;
+			continue;
+		}
+
 		/* Find existing context to share ppgtt with. */
 		for (j = 0; !share_vm && j < wrk->nr_ctxs; j++) {
 			struct drm_i915_gem_context_param param = {
@@ -2116,7 +2478,7 @@ static int prepare_workload(unsigned int id, struct workload *wrk)
 	 * Scan for SSEU control steps.
 	 */
 	for (i = 0, w = wrk->steps; i < wrk->nr_steps; i++, w++) {
-		if (w->type == SSEU) {
+		if (w->type == SSEU && !simulate) {
 			get_device_sseu();
 			break;
 		}
@@ -2178,6 +2540,9 @@ static int prepare_workload(unsigned int id, struct workload *wrk)
 			continue;
 
 		alloc_step_batch(wrk, w);
+
+		if (latency_stats)
+			w->latency = latency_create();
 	}
 
 	measure_active_set(wrk);
@@ -2230,11 +2595,17 @@ static void w_sync_to(struct workload *wrk, struct w_step *w, int target)
 static void
 do_eb(struct workload *wrk, struct w_step *w, enum intel_engine_id engine)
 {
+	bool emit_fence;
+	uint64_t submit;
 	unsigned int i;
 
 	eb_update_flags(wrk, w, engine);
 	update_bb_start(wrk, w);
 
+	emit_fence = w->eb.flags & I915_EXEC_FENCE_OUT;
+	if (latency_stats)
+		w->eb.flags |= I915_EXEC_FENCE_OUT;
+
 	for (i = 0; i < w->fence_deps.nr; i++) {
 		int tgt = w->idx + w->fence_deps.list[i].target;
 
@@ -2251,14 +2622,26 @@ do_eb(struct workload *wrk, struct w_step *w, enum intel_engine_id engine)
 		w->eb.rsvd2 = wrk->steps[tgt].emit_fence;
 	}
 
+	submit = gettime_ns();
+
 	if (w->eb.flags & I915_EXEC_FENCE_OUT)
 		gem_execbuf_wr(fd, &w->eb);
 	else
 		gem_execbuf(fd, &w->eb);
 
 	if (w->eb.flags & I915_EXEC_FENCE_OUT) {
-		w->emit_fence = w->eb.rsvd2 >> 32;
-		igt_assert(w->emit_fence > 0);
+		int fence = w->eb.rsvd2 >> 32;
+
+		igt_assert(fence > 0);
+
+		if (emit_fence) {
+			w->emit_fence = fence;
+			if (latency_stats)
+				fence = dup(fence);
+		}
+
+		if (latency_stats)
+			track_latency_fence(wrk, w, submit, fence);
 	}
 }
 
@@ -2287,6 +2670,35 @@ static void sync_deps(struct workload *wrk, struct w_step *w)
 	}
 }
 
+static void
+print_workload_stats(struct workload *wrk, double t, int count,
+		     unsigned long time_tot, unsigned long time_min,
+		     unsigned long time_max, unsigned int missed)
+{
+	unsigned int e;
+
+	printf("%c%u: %.3fs elapsed (%d cycles, %.3f workloads/s).",
+	       wrk->background ? ' ' : '*', wrk->id, t, count, count / t);
+	if (time_tot)
+		printf(" Time avg/min/max=%lu/%lu/%luus; %u missed.",
+		       time_tot / count, time_min, time_max, missed);
+	putchar('\n');
+
+	for (e = 0; print_latency && e < NUM_ENGINES; e++) {
+		const struct latency *lat = wrk->latency[e];
+
+		if (!lat)
+			continue;
+
+		printf("  %s: %"PRIu64" batches, latency p50/p99/p99.9=%.1f/%.1f/%.1fus, max %.1fus\n",
+		       ring_str_map[e], lat->count,
+		       latency_percentile(lat, 50) / 1e3,
+		       latency_percentile(lat, 99) / 1e3,
+		       latency_percentile(lat, 99.9) / 1e3,
+		       lat->max / 1e3);
+	}
+}
+
 static void *run_workload(void *data)
 {
 	struct workload *wrk = (struct workload *)data;
@@ -2462,6 +2874,8 @@ static void *run_workload(void *data)
 				w->emit_fence = -1;
 			}
 		}
+
+		retire_latency_fences(wrk, false);
 	}
 
 	for (i = 0; i < NUM_ENGINES; i++) {
@@ -2472,134 +2886,1041 @@ static void *run_workload(void *data)
 		gem_sync(fd, w->obj[0].handle);
 	}
 
-	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	retire_latency_fences(wrk, true);
 
-	if (wrk->print_stats) {
-		double t = elapsed(&t_start, &t_end);
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
 
-		printf("%c%u: %.3fs elapsed (%d cycles, %.3f workloads/s).",
-		       wrk->background ? ' ' : '*', wrk->id,
-		       t, count, count / t);
-		if (time_tot)
-			printf(" Time avg/min/max=%lu/%lu/%luus; %u missed.",
-			       time_tot / count, time_min, time_max, missed);
-		putchar('\n');
-	}
+	if (wrk->print_stats)
+		print_workload_stats(wrk, elapsed(&t_start, &t_end), count,
+				     time_tot, time_min, time_max, missed);
 
 	return NULL;
 }
 
-static void fini_workload(struct workload *wrk)
+static struct sim_request *sim_request_get(struct sim_request *rq)
 {
-	free(wrk->steps);
-	free(wrk);
+	if (rq)
+		rq->refcount++;
+
+	return rq;
 }
 
-static void print_help(void)
+static void sim_request_put(struct sim_request *rq)
 {
-	puts(
-"Usage: gem_wsim [OPTIONS]\n"
-"\n"
-"Runs a simulated workload on the GPU.\n"
-"Options:\n"
-"  -h                This text.\n"
-"  -q                Be quiet - do not output anything to stdout.\n"
-"  -I <n>            Initial randomness seed.\n"
-"  -p <n>            Context priority to use for the following workload on the\n"
-"                    command line.\n"
-"  -w <desc|path>    Filename or a workload descriptor.\n"
-"                    Can be given multiple times.\n"
-"  -W <desc|path>    Filename or a master workload descriptor.\n"
-"                    Only one master workload can be optinally specified in which\n"
-"                    case all other workloads become background ones and run as\n"
-"                    long as the master.\n"
-"  -a <desc|path>    Append a workload to all other workloads.\n"
-"  -r <n>            How many times to emit the workload.\n"
-"  -c <n>            Fork N clients emitting the workload simultaneously.\n"
-"  -s                Turn on small SSEU config for the next workload on the\n"
-"                    command line. Subsequent -s switches it off.\n"
-"  -S                Synchronize the sequence of random batch durations between\n"
-"                    clients.\n"
-"  -d                Sync between data dependencies in userspace.\n"
-"  -f <scale>        Scale factor for batch durations.\n"
-"  -F <scale>        Scale factor for delays.\n"
-"  -L                List GPUs.\n"
-"  -D <gpu>          One of the GPUs from -L.\n"
-	);
+	unsigned int i;
+
+	if (!rq || --rq->refcount)
+		return;
+
+	for (i = 0; i < rq->nr_deps; i++)
+		sim_request_put(rq->deps[i].rq);
+	sim_request_put(rq->bond_master);
+	free(rq->deps);
+	free(rq);
 }
 
-static char *load_workload_descriptor(char *filename)
+static struct sim_request *
+sim_request_create(struct sim_client *c, struct w_step *w)
 {
-	struct stat sbuf;
-	char *buf;
-	int infd, ret, i;
-	ssize_t len;
-
-	ret = stat(filename, &sbuf);
-	if (ret || !S_ISREG(sbuf.st_mode))
-		return filename;
+	struct sim_request *rq = calloc(1, sizeof(*rq));
+
+	igt_assert(rq);
+	rq->refcount = 1;
+	rq->seqno = ++sim.seqno;
+	rq->client = c;
+	rq->ctx = __get_ctx(c->wrk, w);
+	rq->w = w;
+	rq->start = SIM_NEVER;
+	rq->end = SIM_NEVER;
+
+	return rq;
+}
 
-	igt_assert(sbuf.st_size < 1024 * 1024); /* Just so. */
-	buf = malloc(sbuf.st_size);
-	igt_assert(buf);
+static bool sim_signaled(const struct sim_request *rq, bool submit)
+{
+	return (submit ? rq->start : rq->end) <= sim.now;
+}
 
-	infd = open(filename, O_RDONLY);
-	igt_assert(infd >= 0);
-	len = read(infd, buf, sbuf.st_size);
-	igt_assert(len == sbuf.st_size);
-	close(infd);
+static void
+sim_request_await(struct sim_request *rq, struct sim_request *signal,
+		  bool submit)
+{
+	if (!signal || signal == rq || sim_signaled(signal, submit))
+		return;
 
-	for (i = 0; i < len; i++) {
-		if (buf[i] == '\n')
-			buf[i] = ',';
+	if (rq->nr_deps == rq->max_deps) {
+		rq->max_deps = rq->max_deps ? 2 * rq->max_deps : 4;
+		rq->deps = realloc(rq->deps, rq->max_deps * sizeof(*rq->deps));
+		igt_assert(rq->deps);
 	}
 
-	len--;
-	while (buf[len] == ',')
-		buf[len--] = 0;
-
-	return buf;
+	rq->deps[rq->nr_deps].rq = sim_request_get(signal);
+	rq->deps[rq->nr_deps].submit = submit;
+	rq->nr_deps++;
 }
 
-static struct w_arg *
-add_workload_arg(struct w_arg *w_args, unsigned int nr_args, char *w_arg,
-		 int prio, bool sseu)
+static bool sim_request_ready(struct sim_request *rq)
 {
-	w_args = realloc(w_args, sizeof(*w_args) * nr_args);
-	igt_assert(w_args);
-	w_args[nr_args - 1] = (struct w_arg) { w_arg, NULL, prio, sseu };
+	while (rq->nr_deps) {
+		struct sim_dep *dep = &rq->deps[rq->nr_deps - 1];
 
-	return w_args;
+		if (!sim_signaled(dep->rq, dep->submit))
+			return false;
+
+		sim_request_put(dep->rq);
+		rq->nr_deps--;
+	}
+
+	return true;
 }
 
-int main(int argc, char **argv)
+/*
+ * Implicit synchronisation as execbuf does it: writers wait for everyone
+ * who used the buffer before them, readers only for the last writer.
+ */
+static void
+sim_request_use(struct sim_request *rq, uint32_t handle, bool write)
 {
-	struct igt_device_card card = { };
-	bool list_devices_arg = false;
-	unsigned int repeat = 1;
-	unsigned int clients = 1;
-	unsigned int flags = 0;
-	struct timespec t_start, t_end;
-	struct workload **w, **wrk = NULL;
-	struct workload *app_w = NULL;
-	unsigned int nr_w_args = 0;
-	int master_workload = -1;
-	char *append_workload_arg = NULL;
-	struct w_arg *w_args = NULL;
-	int exitcode = EXIT_FAILURE;
-	char *device_arg = NULL;
-	double scale_time = 1.0f;
-	double scale_dur = 1.0f;
-	int prio = 0;
-	double t;
-	int i, c, ret;
-	char *drm_dev;
+	struct sim_buffer *bo;
+	unsigned int i, j;
 
-	master_prng = time(NULL);
+	igt_assert(handle && handle <= sim.nr_buffers);
+	bo = &sim.buffers[handle];
 
-	while ((c = getopt(argc, argv,
-			   "LhqvsSdc:r:w:W:a:p:I:f:F:D:")) != -1) {
-		switch (c) {
+	sim_request_await(rq, bo->writer, false);
+
+	if (write) {
+		for (i = 0; i < bo->nr_readers; i++) {
+			sim_request_await(rq, bo->readers[i], false);
+			sim_request_put(bo->readers[i]);
+		}
+		bo->nr_readers = 0;
+
+		sim_request_put(bo->writer);
+		bo->writer = sim_request_get(rq);
+		return;
+	}
+
+	for (i = 0, j = 0; i < bo->nr_readers; i++) {
+		if (sim_signaled(bo->readers[i], false))
+			sim_request_put(bo->readers[i]);
+		else
+			bo->readers[j++] = bo->readers[i];
+	}
+	bo->nr_readers = j;
+
+	if (bo->nr_readers == bo->max_readers) {
+		bo->max_readers = bo->max_readers ? 2 * bo->max_readers : 4;
+		bo->readers = realloc(bo->readers,
+				      bo->max_readers * sizeof(*bo->readers));
+		igt_assert(bo->readers);
+	}
+
+	bo->readers[bo->nr_readers++] = sim_request_get(rq);
+}
+
+static void sim_submit(struct sim_client *c, struct w_step *w)
+{
+	struct workload *wrk = c->wrk;
+	struct sim_request *rq = sim_request_create(c, w);
+	enum intel_engine_id engine = w->engine;
+	struct ctx *ctx = rq->ctx;
+	unsigned int i;
+
+	rq->submit = sim.now;
+	rq->prio = ctx->priority;
+	rq->preempt_us = w->preempt_us;
+	rq->sseu = ctx->sseu;
+	rq->remaining = w->unbound_duration ? SIM_NEVER : get_duration(wrk, w);
+
+	if (ctx->engine_map && !find_engine_in_map(ctx, engine)) {
+		/* Virtual engine, one timeline shared by all siblings. */
+		for (i = 0; i < ctx->engine_map_count; i++)
+			rq->engines |= 1ull << ctx->engine_map[i];
+		engine = DEFAULT;
+	} else {
+		/* Legacy BSD selection sticks to the first ring per file. */
+		if (engine == DEFAULT)
+			engine = RCS;
+		else if (engine == VCS)
+			engine = VCS1;
+		rq->engines = 1ull << engine;
+	}
+
+	sim_request_await(rq, ctx->sim_timeline[engine], false);
+	sim_request_put(ctx->sim_timeline[engine]);
+	ctx->sim_timeline[engine] = sim_request_get(rq);
+
+	for (i = 0; i < w->eb.buffer_count; i++)
+		sim_request_use(rq, w->obj[i].handle,
+				w->obj[i].flags & EXEC_OBJECT_WRITE);
+
+	for (i = 0; i < w->fence_deps.nr; i++) {
+		int tgt = w->idx + w->fence_deps.list[i].target;
+		struct w_step *s = &wrk->steps[tgt];
+
+		igt_assert(tgt >= 0 && tgt < w->idx);
+		igt_assert(s->sim_rq);
+
+		if (w->fence_deps.submit_fence && s->type == BATCH) {
+			sim_request_await(rq, s->sim_rq, true);
+			if (ctx->bond_count)
+				rq->bond_master = sim_request_get(s->sim_rq);
+		} else {
+			sim_request_await(rq, s->sim_rq, false);
+		}
+	}
+
+	/* Reference owned by the scheduler until the request completes. */
+	igt_list_add_tail(&sim_request_get(rq)->link, &sim.pending);
+	c->inflight++;
+
+	sim_request_put(w->sim_rq);
+	w->sim_rq = rq;
+}
+
+static bool
+sim_request_allowed(struct sim_request *rq, enum intel_engine_id engine)
+{
+	struct sim_request *master = rq->bond_master;
+	uint64_t mask = rq->engines;
+
+	if (master && master->start != SIM_NEVER) {
+		uint64_t bonded = 0;
+		unsigned int i;
+
+		for (i = 0; i < rq->ctx->bond_count; i++) {
+			if (rq->ctx->bonds[i].master == master->engine)
+				bonded |= rq->ctx->bonds[i].mask;
+		}
+
+		if (bonded)
+			mask &= bonded;
+	}
+
+	return mask & (1ull << engine);
+}
+
+/*
+ * Find the highest priority runnable request for the engine, oldest first
+ * among equals, as long as it is more important than @prio.
+ */
+static struct sim_request *
+sim_find_next(enum intel_engine_id engine, int prio)
+{
+	struct sim_request *rq, *best = NULL;
+
+	igt_list_for_each_entry(rq, &sim.pending, link) {
+		if (rq->prio <= prio)
+			continue;
+
+		if (best && (rq->prio < best->prio ||
+			     (rq->prio == best->prio && rq->seqno > best->seqno)))
+			continue;
+
+		if (!sim_request_allowed(rq, engine) || !sim_request_ready(rq))
+			continue;
+
+		best = rq;
+	}
+
+	return best;
+}
+
+static bool sim_engine_dispatch(enum intel_engine_id id)
+{
+	struct sim_engine *engine = &sim.engines[id];
+	struct sim_request *rq;
+
+	if (engine->active)
+		return false;
+
+	rq = sim_find_next(id, INT_MIN);
+	if (!rq)
+		return false;
+
+	igt_list_del(&rq->link);
+
+	if (id == RCS && rq->sseu != engine->sseu) {
+		if (rq->remaining != SIM_NEVER)
+			rq->remaining += SIM_SSEU_SWITCH_US;
+		engine->sseu = rq->sseu;
+	}
+
+	rq->engine = id;
+	if (rq->start == SIM_NEVER)
+		rq->start = sim.now;
+
+	engine->slice_start = sim.now;
+	engine->active = rq;
+
+	return true;
+}
+
+static uint64_t sim_engine_next(enum intel_engine_id id)
+{
+	struct sim_engine *engine = &sim.engines[id];
+	struct sim_request *rq = engine->active;
+	uint64_t next;
+
+	if (!rq)
+		return SIM_NEVER;
+
+	next = rq->remaining;
+	if (next != SIM_NEVER)
+		next += engine->slice_start;
+
+	/* Preemption takes effect at the next arbitration point. */
+	if (rq->preempt_us && sim_find_next(id, rq->prio)) {
+		uint64_t arb = DIV_ROUND_UP(sim.now - engine->slice_start,
+					    rq->preempt_us);
+
+		arb = engine->slice_start + arb * rq->preempt_us;
+		next = min(next, arb);
+	}
+
+	return next;
+}
+
+static void sim_engine_advance(enum intel_engine_id id)
+{
+	struct sim_engine *engine = &sim.engines[id];
+	struct sim_request *rq = engine->active;
+	uint64_t ran;
+
+	if (!rq)
+		return;
+
+	ran = sim.now - engine->slice_start;
+
+	if (rq->remaining != SIM_NEVER && ran >= rq->remaining) {
+		engine->busy += rq->remaining;
+		engine->active = NULL;
+
+		rq->end = sim.now;
+		rq->client->inflight--;
+
+		if (latency_stats)
+			record_latency(rq->client->wrk, rq->w, id,
+				       rq->submit * 1000, rq->start * 1000,
+				       rq->end * 1000);
+
+		sim_request_put(rq);
+	} else if (rq->preempt_us && ran % rq->preempt_us == 0 &&
+		   sim_find_next(id, rq->prio)) {
+		engine->busy += ran;
+		engine->active = NULL;
+
+		if (rq->remaining != SIM_NEVER)
+			rq->remaining -= ran;
+		igt_list_add_tail(&rq->link, &sim.pending);
+	}
+}
+
+static void sim_terminate(struct sim_request *rq)
+{
+	struct sim_engine *engine;
+
+	if (!rq || rq->remaining != SIM_NEVER)
+		return;
+
+	engine = &sim.engines[rq->engine];
+	rq->remaining = engine->active == rq ?
+			sim.now - engine->slice_start : 0;
+}
+
+static void sim_signal_fences(struct workload *wrk, unsigned int last)
+{
+	unsigned int i;
+
+	for (i = 0; i <= last && i < wrk->nr_steps; i++) {
+		struct sim_request *fence = wrk->steps[i].sim_rq;
+
+		if (wrk->steps[i].type == SW_FENCE && fence &&
+		    fence->end == SIM_NEVER)
+			fence->start = fence->end = sim.now;
+	}
+}
+
+static bool sim_client_wait(struct sim_client *c, struct sim_request *rq)
+{
+	if (!rq || sim_signaled(rq, false))
+		return false;
+
+	c->wait = sim_request_get(rq);
+	return true;
+}
+
+static struct sim_request *sim_sync_target(struct workload *wrk, int target)
+{
+	if (target < 0)
+		target = wrk->nr_steps + target;
+
+	igt_assert(target < wrk->nr_steps);
+
+	while (wrk->steps[target].type != BATCH) {
+		if (--target < 0)
+			target = wrk->nr_steps + target;
+	}
+
+	return wrk->steps[target].sim_rq;
+}
+
+static void sim_client_batch(struct sim_client *c, struct w_step *w)
+{
+	struct workload *wrk = c->wrk;
+	enum intel_engine_id engine = w->engine;
+	int i;
+
+	/* Blocked clients come back here and re-check what they waited on. */
+	if (!c->submitted) {
+		for (i = 0; (wrk->flags & DEPSYNC) && i < w->data_deps.nr; i++) {
+			struct dep_entry *entry = &w->data_deps.list[i];
+
+			if (entry->working_set != -1 || !entry->target)
+				continue;
+
+			if (sim_client_wait(c, wrk->steps[w->idx + entry->target].sim_rq))
+				return;
+		}
+
+		if (c->throttle > 0 &&
+		    sim_client_wait(c, sim_sync_target(wrk, w->idx - c->throttle)))
+			return;
+
+		if (c->inflight >= SIM_MAX_INFLIGHT) {
+			c->ring_full = true;
+			return;
+		}
+
+		sim_submit(c, w);
+		c->submitted = true;
+
+		if (w->request != -1) {
+			igt_list_del(&w->rq_link);
+			wrk->nrequest[w->request]--;
+		}
+		w->request = engine;
+		igt_list_add_tail(&w->rq_link, &wrk->requests[engine]);
+		wrk->nrequest[engine]++;
+	}
+
+	if (wrk->run) {
+		if (w->sync && sim_client_wait(c, w->sim_rq))
+			return;
+
+		while (c->qd_throttle > 0 &&
+		       wrk->nrequest[engine] > c->qd_throttle) {
+			struct w_step *s;
+
+			s = igt_list_first_entry(&wrk->requests[engine],
+						 s, rq_link);
+
+			if (sim_client_wait(c, s->sim_rq))
+				return;
+
+			s->request = -1;
+			igt_list_del(&s->rq_link);
+			wrk->nrequest[engine]--;
+		}
+	}
+
+	c->submitted = false;
+	c->step++;
+}
+
+static void sim_client_step(struct sim_client *c)
+{
+	struct workload *wrk = c->wrk;
+	struct w_step *w = &wrk->steps[c->step];
+	unsigned long elapsed;
+
+	switch (w->type) {
+	case BATCH:
+		sim_client_batch(c, w);
+		return;
+	case DELAY:
+		c->time += w->delay;
+		break;
+	case PERIOD:
+		elapsed = c->time - c->repeat_start;
+		c->time_tot += elapsed;
+		if (elapsed < c->time_min)
+			c->time_min = elapsed;
+		if (elapsed > c->time_max)
+			c->time_max = elapsed;
+		if (elapsed > w->period) {
+			c->missed++;
+			if (verbose > 2)
+				printf("%u: Dropped period @ %u/%u (%ldus late)!\n",
+				       wrk->id, c->count, c->step,
+				       (long)w->period - (long)elapsed);
+		} else {
+			c->time = c->repeat_start + w->period;
+		}
+		break;
+	case SYNC:
+		if (sim_client_wait(c, wrk->steps[c->step + w->target].sim_rq))
+			return;
+		break;
+	case THROTTLE:
+		c->throttle = w->throttle;
+		break;
+	case QD_THROTTLE:
+		c->qd_throttle = w->throttle;
+		break;
+	case SW_FENCE:
+		sim_request_put(w->sim_rq);
+		w->sim_rq = sim_request_create(c, w);
+		break;
+	case SW_FENCE_SIGNAL:
+		sim_signal_fences(wrk, w->idx + w->target);
+		break;
+	case CTX_PRIORITY:
+		wrk->ctx_list[w->context].priority = w->priority;
+		break;
+	case TERMINATE:
+		sim_terminate(wrk->steps[w->idx + w->target].sim_rq);
+		break;
+	default:
+		/* No action for these at execution time. */
+		break;
+	}
+
+	c->step++;
+}
+
+static void sim_client_run(struct sim_client *c)
+{
+	struct workload *wrk = c->wrk;
+
+	while (!c->done && !c->wait && !c->ring_full && c->time <= sim.now) {
+		if (c->draining) {
+			if (c->inflight)
+				return;
+
+			c->done = true;
+			c->end = sim.now;
+			return;
+		}
+
+		if (wrk->run && c->step < wrk->nr_steps) {
+			sim_client_step(c);
+			continue;
+		}
+
+		/* End of one iteration signals all remaining fences. */
+		sim_signal_fences(wrk, wrk->nr_steps);
+		c->step = 0;
+		c->count++;
+
+		if (wrk->run && (wrk->background || c->count < wrk->repeat))
+			c->repeat_start = c->time;
+		else
+			c->draining = true;
+	}
+}
+
+static const enum intel_engine_id sim_engines[] = {
+	RCS, BCS, VCS1, VCS2, VECS
+};
+
+static void sim_fini(struct workload **w, unsigned int clients)
+{
+	unsigned int i, j;
+
+	for (i = 0; i < clients; i++) {
+		struct workload *wrk = w[i];
+
+		for (j = 0; j < wrk->nr_steps; j++) {
+			sim_request_put(wrk->steps[j].sim_rq);
+			wrk->steps[j].sim_rq = NULL;
+		}
+
+		for (j = 0; j < wrk->nr_ctxs; j++) {
+			struct ctx *ctx = &wrk->ctx_list[j];
+			unsigned int e;
+
+			for (e = 0; e < NUM_ENGINES; e++) {
+				sim_request_put(ctx->sim_timeline[e]);
+				ctx->sim_timeline[e] = NULL;
+			}
+		}
+	}
+
+	for (i = 1; i <= sim.nr_buffers; i++) {
+		struct sim_buffer *bo = &sim.buffers[i];
+
+		sim_request_put(bo->writer);
+		for (j = 0; j < bo->nr_readers; j++)
+			sim_request_put(bo->readers[j]);
+		free(bo->readers);
+	}
+
+	free(sim.buffers);
+	sim.buffers = NULL;
+	sim.nr_buffers = 0;
+}
+
+/*
+ * Runs all clients to completion in virtual time and returns the simulated
+ * duration in seconds, or a negative value if the workloads deadlocked.
+ */
+static double
+simulate_workloads(struct workload **w, unsigned int clients, int master)
+{
+	struct sim_client *c;
+	unsigned int i, done;
+	double t = -1;
+
+	c = calloc(clients, sizeof(*c));
+	igt_assert(c);
+
+	IGT_INIT_LIST_HEAD(&sim.pending);
+	for (i = 0; i < NUM_ENGINES; i++)
+		sim.engines[i].sseu = -1;
+
+	for (i = 0; i < clients; i++) {
+		c[i].wrk = w[i];
+		c[i].throttle = -1;
+		c[i].qd_throttle = -1;
+		c[i].time_min = ULONG_MAX;
+		c[i].draining = !w[i]->background && !w[i]->repeat;
+	}
+
+	for (;;) {
+		uint64_t next = SIM_NEVER;
+		bool dispatched;
+
+		for (i = 0, done = 0; i < clients; i++) {
+			struct sim_client *client = &c[i];
+
+			if (client->wait && sim_signaled(client->wait, false)) {
+				sim_request_put(client->wait);
+				client->wait = NULL;
+				client->time = sim.now;
+			}
+
+			if (client->ring_full &&
+			    client->inflight < SIM_MAX_INFLIGHT) {
+				client->ring_full = false;
+				client->time = sim.now;
+			}
+
+			sim_client_run(client);
+			done += client->done;
+		}
+
+		if (done == clients)
+			break;
+
+		/* Background workloads run only as long as the master. */
+		if (master >= 0 && c[master].done) {
+			for (i = 0; i < clients; i++)
+				w[i]->run = false;
+		}
+
+		do {
+			dispatched = false;
+			for (i = 0; i < ARRAY_SIZE(sim_engines); i++)
+				dispatched |= sim_engine_dispatch(sim_engines[i]);
+		} while (dispatched);
+
+		for (i = 0; i < ARRAY_SIZE(sim_engines); i++)
+			next = min(next, sim_engine_next(sim_engines[i]));
+
+		for (i = 0; i < clients; i++) {
+			if (!c[i].done && !c[i].wait && !c[i].ring_full &&
+			    !c[i].draining)
+				next = min(next, c[i].time);
+		}
+
+		if (next == SIM_NEVER) {
+			wsim_err("Simulation deadlocked at %.3fs!\n",
+				 sim.now / 1e6);
+			goto out;
+		}
+
+		sim.now = next;
+
+		for (i = 0; i < ARRAY_SIZE(sim_engines); i++)
+			sim_engine_advance(sim_engines[i]);
+	}
+
+	t = sim.now / 1e6;
+
+	for (i = 0; i < clients; i++) {
+		if (w[i]->print_stats)
+			print_workload_stats(w[i], c[i].end / 1e6, c[i].count,
+					     c[i].time_tot, c[i].time_min,
+					     c[i].time_max, c[i].missed);
+	}
+
+	for (i = 0; verbose && i < ARRAY_SIZE(sim_engines); i++) {
+		enum intel_engine_id e = sim_engines[i];
+
+		printf("%s: %.2f%% busy\n", ring_str_map[e],
+		       sim.now ? 100.0 * sim.engines[e].busy / sim.now : 0.0);
+	}
+
+out:
+	for (i = 0; i < clients; i++)
+		sim_request_put(c[i].wait);
+	free(c);
+
+	sim_fini(w, clients);
+
+	return t;
+}
+
+static void json_latency(FILE *f, const struct latency *lat)
+{
+	unsigned int i;
+	bool first = true;
+
+	fprintf(f, "\"count\": %"PRIu64", \"min\": %.3f, \"mean\": %.3f, \"max\": %.3f",
+		lat->count, lat->min / 1e3,
+		lat->count ? lat->sum / 1e3 / lat->count : 0.0, lat->max / 1e3);
+
+	fprintf(f, ", \"p50\": %.3f, \"p99\": %.3f, \"p99.9\": %.3f",
+		latency_percentile(lat, 50) / 1e3,
+		latency_percentile(lat, 99) / 1e3,
+		latency_percentile(lat, 99.9) / 1e3);
+
+	/* Non-empty buckets as [upper bound, count] pairs. */
+	fprintf(f, ", \"buckets\": [");
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		if (!lat->buckets[i])
+			continue;
+
+		fprintf(f, "%s[%.3f, %u]", first ? "" : ", ",
+			latency_bucket_value(i) / 1e3, lat->buckets[i]);
+		first = false;
+	}
+	fprintf(f, "]");
+}
+
+static void csv_latency(FILE *f, const struct latency *lat)
+{
+	fprintf(f, ",%"PRIu64",%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+		lat->count, lat->min / 1e3,
+		lat->count ? lat->sum / 1e3 / lat->count : 0.0,
+		latency_percentile(lat, 50) / 1e3,
+		latency_percentile(lat, 99) / 1e3,
+		latency_percentile(lat, 99.9) / 1e3,
+		lat->max / 1e3);
+}
+
+static void
+engine_totals(struct workload **w, unsigned int clients,
+	      struct latency *total)
+{
+	unsigned int i, e;
+
+	for (i = 0; i < clients; i++) {
+		for (e = 0; e < NUM_ENGINES; e++)
+			latency_merge(&total[e], w[i]->latency[e]);
+	}
+}
+
+/*
+ * Latencies are written in microseconds, per workload for each batch step
+ * and engine, followed by the engine totals over all workloads.
+ */
+static int
+write_latency_json(const char *name, struct workload **w, unsigned int clients)
+{
+	struct latency *total = calloc(NUM_ENGINES, sizeof(*total));
+	unsigned int i, j, e;
+	FILE *f;
+
+	igt_assert(total);
+
+	f = fopen(name, "w");
+	if (!f) {
+		free(total);
+		return -errno;
+	}
+
+	fprintf(f, "{\n  \"unit\": \"us\",\n  \"workloads\": [");
+	for (i = 0; i < clients; i++) {
+		struct workload *wrk = w[i];
+		bool first = true;
+
+		fprintf(f, "%s\n    {\n      \"id\": %u,\n      \"background\": %s,\n      \"steps\": [",
+			i ? "," : "", wrk->id, wrk->background ? "true" : "false");
+
+		for (j = 0; j < wrk->nr_steps; j++) {
+			struct w_step *s = &wrk->steps[j];
+
+			if (!s->latency || !s->latency->count)
+				continue;
+
+			fprintf(f, "%s\n        { \"step\": %u, \"context\": %u, \"engine\": \"%s\", ",
+				first ? "" : ",", s->idx, s->context,
+				ring_str_map[s->engine]);
+			json_latency(f, s->latency);
+			fprintf(f, " }");
+			first = false;
+		}
+
+		fprintf(f, "\n      ],\n      \"engines\": [");
+		for (e = 0, first = true; e < NUM_ENGINES; e++) {
+			if (!wrk->latency[e])
+				continue;
+
+			fprintf(f, "%s\n        { \"engine\": \"%s\", ",
+				first ? "" : ",", ring_str_map[e]);
+			json_latency(f, wrk->latency[e]);
+			fprintf(f, " }");
+			first = false;
+		}
+		fprintf(f, "\n      ]\n    }");
+	}
+
+	engine_totals(w, clients, total);
+
+	fprintf(f, "\n  ],\n  \"engines\": [");
+	for (e = 0, j = 0; e < NUM_ENGINES; e++) {
+		if (!total[e].count)
+			continue;
+
+		fprintf(f, "%s\n    { \"engine\": \"%s\", ",
+			j++ ? "," : "", ring_str_map[e]);
+		json_latency(f, &total[e]);
+		fprintf(f, " }");
+	}
+	fprintf(f, "\n  ]\n}\n");
+
+	free(total);
+
+	return fclose(f) ? -errno : 0;
+}
+
+static int
+write_latency_csv(const char *name, struct workload **w, unsigned int clients)
+{
+	struct latency *total = calloc(NUM_ENGINES, sizeof(*total));
+	unsigned int i, j, e;
+	FILE *f;
+
+	igt_assert(total);
+
+	f = fopen(name, "w");
+	if (!f) {
+		free(total);
+		return -errno;
+	}
+
+	fprintf(f, "workload,step,context,engine,count,min_us,mean_us,p50_us,p99_us,p99.9_us,max_us\n");
+
+	for (i = 0; i < clients; i++) {
+		struct workload *wrk = w[i];
+
+		for (j = 0; j < wrk->nr_steps; j++) {
+			struct w_step *s = &wrk->steps[j];
+
+			if (!s->latency || !s->latency->count)
+				continue;
+
+			fprintf(f, "%u,%u,%u,%s", wrk->id, s->idx, s->context,
+				ring_str_map[s->engine]);
+			csv_latency(f, s->latency);
+		}
+
+		for (e = 0; e < NUM_ENGINES; e++) {
+			if (!wrk->latency[e])
+				continue;
+
+			fprintf(f, "%u,,,%s", wrk->id, ring_str_map[e]);
+			csv_latency(f, wrk->latency[e]);
+		}
+	}
+
+	engine_totals(w, clients, total);
+
+	for (e = 0; e < NUM_ENGINES; e++) {
+		if (!total[e].count)
+			continue;
+
+		fprintf(f, ",,,%s", ring_str_map[e]);
+		csv_latency(f, &total[e]);
+	}
+
+	free(total);
+
+	return fclose(f) ? -errno : 0;
+}
+
+/* Names the trace processes and threads after workloads and engines. */
+static int close_trace(unsigned int clients)
+{
+	unsigned int i, e;
+
+	for (i = 0; i < clients; i++) {
+		fprintf(trace_file,
+			"%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+			"\"args\":{\"name\":\"workload %u\"}}",
+			trace_events++ ? ",\n" : "[\n", i, i);
+
+		for (e = 0; e < NUM_ENGINES; e++)
+			fprintf(trace_file,
+				",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,"
+				"\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+				i, e, ring_str_map[e]);
+	}
+	fprintf(trace_file, "\n]\n");
+
+	return fclose(trace_file) ? -errno : 0;
+}
+
+static void fini_workload(struct workload *wrk)
+{
+	free(wrk->steps);
+	free(wrk);
+}
+
+static void print_help(void)
+{
+	puts(
+"Usage: gem_wsim [OPTIONS]\n"
+"\n"
+"Runs a simulated workload on the GPU.\n"
+"Options:\n"
+"  -h                This text.\n"
+"  -q                Be quiet - do not output anything to stdout.\n"
+"  -I <n>            Initial randomness seed.\n"
+"  -p <n>            Context priority to use for the following workload on the\n"
+"                    command line.\n"
+"  -w <desc|path>    Filename or a workload descriptor.\n"
+"                    Can be given multiple times.\n"
+"  -W <desc|path>    Filename or a master workload descriptor.\n"
+"                    Only one master workload can be optinally specified in which\n"
+"                    case all other workloads become background ones and run as\n"
+"                    long as the master.\n"
+"  -a <desc|path>    Append a workload to all other workloads.\n"
+"  -r <n>            How many times to emit the workload.\n"
+"  -c <n>            Fork N clients emitting the workload simultaneously.\n"
+"  -s                Turn on small SSEU config for the next workload on the\n"
+"                    command line. Subsequent -s switches it off.\n"
+"  -S                Synchronize the sequence of random batch durations between\n"
+"                    clients.\n"
+"  -d                Sync between data dependencies in userspace.\n"
+"  -f <scale>        Scale factor for batch durations.\n"
+"  -F <scale>        Scale factor for delays.\n"
+"  -L                List GPUs.\n"
+"  -D <gpu>          One of the GPUs from -L.\n"
+"  --simulate        Run the workloads through a model of the GPU in virtual\n"
+"                    time instead of on a device.\n"
+"  --latency         Print batch latency percentiles per engine.\n"
+"  --latency-json <file>\n"
+"                    Write per step and engine batch latency histograms as JSON.\n"
+"  --latency-csv <file>\n"
+"                    Write per step and engine batch latency summaries as CSV.\n"
+"  --trace <file>    Write a timeline of all batches in the Chrome trace event\n"
+"                    format.\n"
+	);
+}
+
+static char *load_workload_descriptor(char *filename)
+{
+	struct stat sbuf;
+	char *buf;
+	int infd, ret, i;
+	ssize_t len;
+
+	ret = stat(filename, &sbuf);
+	if (ret || !S_ISREG(sbuf.st_mode))
+		return filename;
+
+	igt_assert(sbuf.st_size < 1024 * 1024); /* Just so. */
+	buf = malloc(sbuf.st_size);
+	igt_assert(buf);
+
+	infd = open(filename, O_RDONLY);
+	igt_assert(infd >= 0);
+	len = read(infd, buf, sbuf.st_size);
+	igt_assert(len == sbuf.st_size);
+	close(infd);
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] == '\n')
+			buf[i] = ',';
+	}
+
+	len--;
+	while (buf[len] == ',')
+		buf[len--] = 0;
+
+	return buf;
+}
+
+static struct w_arg *
+add_workload_arg(struct w_arg *w_args, unsigned int nr_args, char *w_arg,
+		 int prio, bool sseu)
+{
+	w_args = realloc(w_args, sizeof(*w_args) * nr_args);
+	igt_assert(w_args);
+	w_args[nr_args - 1] = (struct w_arg) { w_arg, NULL, prio, sseu };
+
+	return w_args;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{ "simulate", no_argument, NULL, OPT_SIMULATE },
+		{ "latency", no_argument, NULL, OPT_LATENCY },
+		{ "latency-json", required_argument, NULL, OPT_LATENCY_JSON },
+		{ "latency-csv", required_argument, NULL, OPT_LATENCY_CSV },
+		{ "trace", required_argument, NULL, OPT_TRACE },
+		{ 0, 0, 0, 0 },
+	};
+	struct igt_device_card card = { };
+	bool list_devices_arg = false;
+	unsigned int repeat = 1;
+	unsigned int clients = 1;
+	unsigned int flags = 0;
+	struct timespec t_start, t_end;
+	struct workload **w, **wrk = NULL;
+	struct workload *app_w = NULL;
+	unsigned int nr_w_args = 0;
+	int master_workload = -1;
+	char *append_workload_arg = NULL;
+	struct w_arg *w_args = NULL;
+	int exitcode = EXIT_FAILURE;
+	char *device_arg = NULL;
+	char *latency_json = NULL, *latency_csv = NULL, *trace_name = NULL;
+	double scale_time = 1.0f;
+	double scale_dur = 1.0f;
+	int prio = 0;
+	double t;
+	int i, c, ret;
+	char *drm_dev;
+
+	master_prng = time(NULL);
+
+	while ((c = getopt_long(argc, argv, "LhqvsSdc:r:w:W:a:p:I:f:F:D:",
+				long_options, NULL)) != -1) {
+		switch (c) {
+		case OPT_SIMULATE:
+			simulate = true;
+			break;
+		case OPT_LATENCY:
+			latency_stats = print_latency = true;
+			break;
+		case OPT_LATENCY_JSON:
+			latency_stats = true;
+			latency_json = optarg;
+			break;
+		case OPT_LATENCY_CSV:
+			latency_stats = true;
+			latency_csv = optarg;
+			break;
+		case OPT_TRACE:
+			latency_stats = true;
+			trace_name = optarg;
+			break;
 		case 'L':
 			list_devices_arg = true;
 			break;
@@ -2666,18 +3987,26 @@ int main(int argc, char **argv)
 		}
 	}
 
-	igt_devices_scan(false);
-
 	if (list_devices_arg) {
 		struct igt_devices_print_format fmt = {
 			.type = IGT_PRINT_USER,
 			.option = IGT_PRINT_DRM,
 		};
 
+		igt_devices_scan(false);
 		igt_devices_print(&fmt);
 		return EXIT_SUCCESS;
 	}
 
+	if (simulate) {
+		free(device_arg);
+		if (verbose > 1)
+			printf("Simulating the GPU\n");
+		goto workloads;
+	}
+
+	igt_devices_scan(false);
+
 	if (device_arg) {
 		ret = igt_device_card_match(device_arg, &card);
 		if (!ret) {
@@ -2715,6 +4044,7 @@ int main(int argc, char **argv)
 	if (verbose > 1)
 		printf("Using device %s\n", drm_dev);
 
+workloads:
 	if (!nr_w_args) {
 		wsim_err("No workload descriptor(s)!\n");
 		goto err;
@@ -2794,7 +4124,24 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (trace_name) {
+		trace_file = fopen(trace_name, "w");
+		if (!trace_file) {
+			wsim_err("Failed to open '%s'! (%s)\n",
+				 trace_name, strerror(errno));
+			goto err;
+		}
+	}
+
+	if (simulate) {
+		t = simulate_workloads(w, clients, master_workload);
+		if (t < 0)
+			goto err;
+		goto report;
+	}
+
 	clock_gettime(CLOCK_MONOTONIC, &t_start);
+	trace_epoch = t_start.tv_sec * NSEC_PER_SEC + t_start.tv_nsec;
 
 	for (i = 0; i < clients; i++) {
 		ret = pthread_create(&w[i]->thread, NULL, run_workload, w[i]);
@@ -2819,10 +4166,20 @@ int main(int argc, char **argv)
 	clock_gettime(CLOCK_MONOTONIC, &t_end);
 
 	t = elapsed(&t_start, &t_end);
+report:
 	if (verbose)
 		printf("%.3fs elapsed (%.3f workloads/s)\n",
 		       t, clients * repeat / t);
 
+	if (latency_json && write_latency_json(latency_json, w, clients))
+		wsim_err("Failed to write '%s'!\n", latency_json);
+
+	if (latency_csv && write_latency_csv(latency_csv, w, clients))
+		wsim_err("Failed to write '%s'!\n", latency_csv);
+
+	if (trace_file && close_trace(clients))
+		wsim_err("Failed to write '%s'!\n", trace_name);
+
 	for (i = 0; i < clients; i++)
 		fini_workload(w[i]);
 	free(w);
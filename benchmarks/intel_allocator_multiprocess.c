@@ -0,0 +1,148 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the throughput of the allocator in multiprocess mode, where
+ * forked children send their requests to the allocator thread of the
+ * parent. No device is needed, the allocators are opened for an
+ * explicit range under a made up fd. Every run repeatedly forks a
+ * number of children each allocating and freeing its own objects, with
+ * the message queue and the shared memory channels, one object per
+ * request and in batches.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "intel_allocator.h"
+
+/* The allocator never touches the device when opened for a range */
+#define FAKE_FD 1000
+#define BATCH 16
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static void child_work(int child, unsigned int count, bool batch)
+{
+	uint32_t handles[BATCH];
+	uint64_t sizes[BATCH], offsets[BATCH];
+	uint64_t ahnd;
+
+	ahnd = intel_allocator_open_full(FAKE_FD, 0, 0, 1ull << 48,
+					 INTEL_ALLOCATOR_SIMPLE,
+					 ALLOC_STRATEGY_HIGH_TO_LOW);
+
+	for (unsigned int i = 0; i < count; i += BATCH) {
+		unsigned int n = min(count - i, BATCH);
+
+		for (unsigned int j = 0; j < n; j++) {
+			handles[j] = 1 + child * count + i + j;
+			sizes[j] = 4096;
+		}
+
+		if (batch)
+			intel_allocator_alloc_batch(ahnd, n, handles, sizes,
+						    0, offsets);
+		else
+			for (unsigned int j = 0; j < n; j++)
+				intel_allocator_alloc(ahnd, handles[j],
+						      sizes[j], 0);
+
+		for (unsigned int j = 0; j < n; j++)
+			igt_assert(intel_allocator_free(ahnd, handles[j]));
+	}
+
+	intel_allocator_close(ahnd);
+}
+
+static void run(const char *channel, bool batch, int rounds,
+		int children, unsigned int count)
+{
+	struct timespec start, end;
+	double t;
+
+	setenv("IGT_ALLOCATOR_CHANNEL", channel, 1);
+	intel_allocator_multiprocess_start();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int r = 0; r < rounds; r++) {
+		igt_fork(child, children)
+			child_work(child, count, batch);
+		igt_waitchildren();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	intel_allocator_multiprocess_stop();
+
+	t = elapsed(&start, &end);
+	printf("%-9s %-7s %10.3fs %12.0f\n", channel, batch ? "batch" : "single",
+	       t, 2.0 * rounds * children * count / t);
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = 10, children = 8;
+	unsigned int count = 4096;
+	int c;
+
+	while ((c = getopt(argc, argv, "r:c:n:")) != -1) {
+		switch (c) {
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+		case 'c':
+			children = atoi(optarg);
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-r rounds] [-c children] [-n objects per child]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (rounds <= 0 || children <= 0 || !count)
+		return 1;
+
+	printf("%d rounds of %d children, %u objects each\n",
+	       rounds, children, count);
+	printf("%-9s %-7s %11s %12s\n", "channel", "allocs", "time", "ops/s");
+
+	run("msgqueue", false, rounds, children, count);
+	run("msgqueue", true, rounds, children, count);
+	run("shm", false, rounds, children, count);
+	run("shm", true, rounds, children, count);
+
+	return 0;
+}
@@ -0,0 +1,526 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the simple allocator alone, without a device. Objects of
+ * varying size are allocated, every other one is freed to fragment the
+ * address space into as many holes as there are objects left, and then
+ * the freed objects are allocated again, with alignment, and everything
+ * is freed.
+ *
+ * The same is run on a copy of the heap the simple allocator used before
+ * its holes were indexed by a tree, a list walked from one end on every
+ * alloc and free, and validated as a whole each time, for comparison.
+ * Unless asked for with -n, the list is left out of the largest count.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "drmtest.h"
+#include "igt_list.h"
+#include "igt_map.h"
+#include "intel_allocator.h"
+
+struct intel_allocator *
+intel_allocator_simple_create(int fd, uint64_t start, uint64_t end,
+			      enum allocator_strategy strategy);
+
+/* The list heap, as it was in lib/intel_allocator_simple.c */
+struct list_heap {
+	struct igt_list_head holes;
+	enum allocator_strategy strategy;
+};
+
+struct list_hole {
+	struct igt_list_head link;
+	uint64_t offset;
+	uint64_t size;
+};
+
+#define list_foreach_hole(_hole, _heap) \
+	igt_list_for_each_entry(_hole, &(_heap)->holes, link)
+
+#define list_foreach_hole_safe(_hole, _heap, _tmp) \
+	igt_list_for_each_entry_safe(_hole, _tmp,  &(_heap)->holes, link)
+
+#define list_foreach_hole_safe_rev(_hole, _heap, _tmp) \
+	igt_list_for_each_entry_safe_reverse(_hole, _tmp,  &(_heap)->holes, link)
+
+static void list_heap_validate(struct list_heap *heap)
+{
+	uint64_t prev_offset = 0;
+	struct list_hole *hole;
+
+	list_foreach_hole(hole, heap) {
+		igt_assert(hole->size > 0);
+
+		if (&hole->link == heap->holes.next) {
+			/*
+			 * This must be the top-most hole.  Assert that,
+			 * if it overflows, it overflows to 0, i.e. 2^64.
+			 */
+			igt_assert(hole->size + hole->offset == 0 ||
+				   hole->size + hole->offset > hole->offset);
+		} else {
+			/*
+			 * This is not the top-most hole so it must not overflow and,
+			 * in fact, must be strictly lower than the top-most hole.  If
+			 * hole->size + hole->offset == prev_offset, then we failed to
+			 * join holes during a list_heap_free.
+			 */
+			igt_assert(hole->size + hole->offset > hole->offset &&
+				   hole->size + hole->offset < prev_offset);
+		}
+		prev_offset = hole->offset;
+	}
+}
+
+static void list_heap_free(struct list_heap *heap,
+			   uint64_t offset, uint64_t size)
+{
+	struct list_hole *high_hole = NULL, *low_hole = NULL, *hole;
+	bool high_adjacent, low_adjacent;
+
+	/* Freeing something with a size of 0 is not valid. */
+	igt_assert(size > 0);
+
+	/*
+	 * It's possible for offset + size to wrap around if we touch the top of
+	 * the 64-bit address space, but we cannot go any higher than 2^64.
+	 */
+	igt_assert(offset + size == 0 || offset + size > offset);
+
+	list_heap_validate(heap);
+
+	/* Find immediately higher and lower holes if they exist. */
+	list_foreach_hole(hole, heap) {
+		if (hole->offset <= offset) {
+			low_hole = hole;
+			break;
+		}
+		high_hole = hole;
+	}
+
+	if (high_hole)
+		igt_assert(offset + size <= high_hole->offset);
+	high_adjacent = high_hole && offset + size == high_hole->offset;
+
+	if (low_hole) {
+		igt_assert(low_hole->offset + low_hole->size > low_hole->offset);
+		igt_assert(low_hole->offset + low_hole->size <= offset);
+	}
+	low_adjacent = low_hole && low_hole->offset + low_hole->size == offset;
+
+	if (low_adjacent && high_adjacent) {
+		/* Merge the two holes */
+		low_hole->size += size + high_hole->size;
+		igt_list_del(&high_hole->link);
+		free(high_hole);
+	} else if (low_adjacent) {
+		/* Merge into the low hole */
+		low_hole->size += size;
+	} else if (high_adjacent) {
+		/* Merge into the high hole */
+		high_hole->offset = offset;
+		high_hole->size += size;
+	} else {
+		/* Neither hole is adjacent; make a new one */
+		hole = calloc(1, sizeof(*hole));
+		igt_assert(hole);
+
+		hole->offset = offset;
+		hole->size = size;
+		/*
+		 * Add it after the high hole so we maintain high-to-low
+		 * ordering
+		 */
+		if (high_hole)
+			igt_list_add(&hole->link, &high_hole->link);
+		else
+			igt_list_add(&hole->link, &heap->holes);
+	}
+
+	list_heap_validate(heap);
+}
+
+static void list_heap_init(struct list_heap *heap,
+			   uint64_t start, uint64_t size,
+			   enum allocator_strategy strategy)
+{
+	IGT_INIT_LIST_HEAD(&heap->holes);
+	list_heap_free(heap, start, size);
+
+	/* Use LOW_TO_HIGH or HIGH_TO_LOW strategy only */
+	if (strategy == ALLOC_STRATEGY_LOW_TO_HIGH)
+		heap->strategy = strategy;
+	else
+		heap->strategy = ALLOC_STRATEGY_HIGH_TO_LOW;
+}
+
+static void list_heap_finish(struct list_heap *heap)
+{
+	struct list_hole *hole, *tmp;
+
+	list_foreach_hole_safe(hole, heap, tmp)
+		free(hole);
+}
+
+static void list_hole_alloc(struct list_hole *hole,
+			    uint64_t offset, uint64_t size)
+{
+	struct list_hole *high_hole;
+	uint64_t waste;
+
+	igt_assert(hole->offset <= offset);
+	igt_assert(hole->size >= offset - hole->offset + size);
+
+	if (offset == hole->offset && size == hole->size) {
+		/* Just get rid of the hole. */
+		igt_list_del(&hole->link);
+		free(hole);
+		return;
+	}
+
+	igt_assert(offset - hole->offset <= hole->size - size);
+	waste = (hole->size - size) - (offset - hole->offset);
+	if (waste == 0) {
+		/* We allocated at the top->  Shrink the hole down. */
+		hole->size -= size;
+		return;
+	}
+
+	if (offset == hole->offset) {
+		/* We allocated at the bottom. Shrink the hole up-> */
+		hole->offset += size;
+		hole->size -= size;
+		return;
+	}
+
+	/*
+	 * We allocated in the middle.  We need to split the old hole into two
+	 * holes, one high and one low.
+	 */
+	high_hole = calloc(1, sizeof(*hole));
+	igt_assert(high_hole);
+
+	high_hole->offset = offset + size;
+	high_hole->size = waste;
+
+	/*
+	 * Adjust the hole to be the amount of space left at he bottom of the
+	 * original hole.
+	 */
+	hole->size = offset - hole->offset;
+
+	/*
+	 * Place the new hole before the old hole so that the list is in order
+	 * from high to low.
+	 */
+	igt_list_add_tail(&high_hole->link, &hole->link);
+}
+
+static bool list_heap_alloc(struct list_heap *heap,
+			    uint64_t *offset, uint64_t size,
+			    uint64_t alignment,
+			    enum allocator_strategy strategy)
+{
+	struct list_hole *hole, *tmp;
+	uint64_t misalign;
+
+	/* The caller is expected to reject zero-size allocations */
+	igt_assert(size > 0);
+	igt_assert(alignment > 0);
+
+	list_heap_validate(heap);
+
+	/* Ensure we support only NONE/LOW_TO_HIGH/HIGH_TO_LOW strategies */
+	igt_assert(strategy == ALLOC_STRATEGY_NONE ||
+		   strategy == ALLOC_STRATEGY_LOW_TO_HIGH ||
+		   strategy == ALLOC_STRATEGY_HIGH_TO_LOW);
+
+	/* Use default strategy chosen on open */
+	if (strategy == ALLOC_STRATEGY_NONE)
+		strategy = heap->strategy;
+
+	if (strategy == ALLOC_STRATEGY_HIGH_TO_LOW) {
+		list_foreach_hole_safe(hole, heap, tmp) {
+			if (size > hole->size)
+				continue;
+			/*
+			 * Compute the offset as the highest address where a chunk of the
+			 * given size can be without going over the top of the hole.
+			 *
+			 * This calculation is known to not overflow because we know that
+			 * hole->size + hole->offset can only overflow to 0 and size > 0.
+			 */
+			*offset = (hole->size - size) + hole->offset;
+
+			/*
+			 * Align the offset.  We align down and not up because we are
+			 *
+			 * allocating from the top of the hole and not the bottom.
+			 */
+			*offset = (*offset / alignment) * alignment;
+
+			if (*offset < hole->offset)
+				continue;
+
+			list_hole_alloc(hole, *offset, size);
+			list_heap_validate(heap);
+			return true;
+		}
+	} else {
+		list_foreach_hole_safe_rev(hole, heap, tmp) {
+			if (size > hole->size)
+				continue;
+
+			*offset = hole->offset;
+
+			/* Align the offset */
+			misalign = *offset % alignment;
+			if (misalign) {
+				uint64_t pad = alignment - misalign;
+
+				if (pad > hole->size - size)
+					continue;
+
+				*offset += pad;
+			}
+
+			list_hole_alloc(hole, *offset, size);
+			list_heap_validate(heap);
+			return true;
+		}
+	}
+
+	/* Failed to allocate */
+	return false;
+}
+
+struct list_allocator {
+	struct igt_map *objects;
+	struct list_heap heap;
+	uint64_t allocated_objects;
+};
+
+struct list_record {
+	uint32_t handle;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static uint32_t hash_handles(const void *val)
+{
+	return *(uint32_t *) val * 0x9e370001UL;
+}
+
+static int equal_handles(const void *a, const void *b)
+{
+	return *(uint32_t *) a == *(uint32_t *) b;
+}
+
+static void map_entry_free_func(struct igt_map_entry *entry)
+{
+	free(entry->data);
+}
+
+/* Only what the benchmark uses, bookkept like the simple allocator */
+static uint64_t list_allocator_alloc(struct intel_allocator *ial,
+				     uint32_t handle, uint64_t size,
+				     uint64_t alignment,
+				     enum allocator_strategy strategy)
+{
+	struct list_allocator *ials = ial->priv;
+	struct list_record *rec;
+	uint64_t offset;
+
+	rec = igt_map_search(ials->objects, &handle);
+	if (rec)
+		return rec->offset;
+
+	if (!list_heap_alloc(&ials->heap, &offset, size, alignment, strategy))
+		return ALLOC_INVALID_ADDRESS;
+
+	rec = malloc(sizeof(*rec));
+	rec->handle = handle;
+	rec->offset = offset;
+	rec->size = size;
+
+	igt_map_insert(ials->objects, &rec->handle, rec);
+	ials->allocated_objects++;
+
+	return offset;
+}
+
+static bool list_allocator_free(struct intel_allocator *ial, uint32_t handle)
+{
+	struct list_allocator *ials = ial->priv;
+	struct igt_map_entry *entry;
+	struct list_record *rec;
+
+	entry = igt_map_search_entry(ials->objects, &handle);
+	if (!entry)
+		return false;
+
+	rec = entry->data;
+	igt_map_remove_entry(ials->objects, entry);
+	list_heap_free(&ials->heap, rec->offset, rec->size);
+	ials->allocated_objects--;
+	free(rec);
+
+	return true;
+}
+
+static bool list_allocator_is_empty(struct intel_allocator *ial)
+{
+	struct list_allocator *ials = ial->priv;
+
+	return !ials->allocated_objects;
+}
+
+static void list_allocator_destroy(struct intel_allocator *ial)
+{
+	struct list_allocator *ials = ial->priv;
+
+	list_heap_finish(&ials->heap);
+	igt_map_destroy(ials->objects, map_entry_free_func);
+	free(ials);
+	free(ial);
+}
+
+static struct intel_allocator *
+list_allocator_create(int fd, uint64_t start, uint64_t end,
+		      enum allocator_strategy strategy)
+{
+	struct intel_allocator *ial;
+	struct list_allocator *ials;
+
+	ial = calloc(1, sizeof(*ial));
+	igt_assert(ial);
+
+	ial->fd = fd;
+	ial->alloc = list_allocator_alloc;
+	ial->free = list_allocator_free;
+	ial->is_empty = list_allocator_is_empty;
+	ial->destroy = list_allocator_destroy;
+	ials = ial->priv = calloc(1, sizeof(*ials));
+	igt_assert(ials);
+
+	ials->objects = igt_map_create(hash_handles, equal_handles);
+	igt_assert(ials->objects);
+	list_heap_init(&ials->heap, start, end - start, strategy);
+
+	return ial;
+}
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static uint64_t object_size(uint32_t handle)
+{
+	return (1 + (handle * 2654435761u) % 16) * 4096;
+}
+
+static void run(unsigned int count, enum allocator_strategy strategy,
+		const char *name, bool list)
+{
+	struct intel_allocator *ial;
+	struct timespec ts[5];
+	uint32_t handle;
+
+	if (list)
+		ial = list_allocator_create(-1, 0, 1ull << 48, strategy);
+	else
+		ial = intel_allocator_simple_create(-1, 0, 1ull << 48, strategy);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+	for (handle = 1; handle <= count; handle++)
+		igt_assert(ial->alloc(ial, handle, object_size(handle), 4096,
+				      ALLOC_STRATEGY_NONE) != ALLOC_INVALID_ADDRESS);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+	for (handle = 1; handle <= count; handle += 2)
+		igt_assert(ial->free(ial, handle));
+
+	clock_gettime(CLOCK_MONOTONIC, &ts[2]);
+	for (handle = 1; handle <= count; handle += 2)
+		igt_assert(ial->alloc(ial, handle, object_size(handle), 65536,
+				      ALLOC_STRATEGY_NONE) != ALLOC_INVALID_ADDRESS);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts[3]);
+	for (handle = 1; handle <= count; handle++)
+		igt_assert(ial->free(ial, handle));
+
+	clock_gettime(CLOCK_MONOTONIC, &ts[4]);
+	igt_assert(ial->is_empty(ial));
+	ial->destroy(ial);
+
+	printf("%-8u %-12s %-6s %10.1fms %10.1fms %10.1fms %10.1fms\n",
+	       count, name, list ? "list" : "tree",
+	       elapsed(&ts[0], &ts[1]) * 1e3, elapsed(&ts[1], &ts[2]) * 1e3,
+	       elapsed(&ts[2], &ts[3]) * 1e3, elapsed(&ts[3], &ts[4]) * 1e3);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int counts[] = { 1000, 10000, 100000 };
+	int num_counts = ARRAY_SIZE(counts);
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			counts[0] = atoi(optarg);
+			num_counts = 1;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n objects]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("%-8s %-12s %-6s %12s %12s %12s %12s\n", "objects", "strategy",
+	       "heap", "alloc", "free half", "realloc", "free all");
+
+	for (int i = 0; i < num_counts; i++) {
+		for (int list = 1; list >= 0; list--) {
+			/* Minutes for the list with the largest default count */
+			if (list && num_counts > 1 && counts[i] > 10000)
+				continue;
+
+			run(counts[i], ALLOC_STRATEGY_HIGH_TO_LOW, "high-to-low",
+			    list);
+			run(counts[i], ALLOC_STRATEGY_LOW_TO_HIGH, "low-to-high",
+			    list);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures software (de)tiling of a 32bpp surface in system memory, the
+ * tile-at-a-time converters against the per-pixel reference.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "drmtest.h"
+#include "intel_bufops.h"
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+static double run(const struct intel_buf *buf, void *tiled, uint32_t *linear,
+		  bool to_tiled, bool per_pixel, int reps)
+{
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < reps; i++) {
+		if (to_tiled)
+			__intel_buf_linear_to_tiled(buf, tiled, linear,
+						    I915_BIT_6_SWIZZLE_NONE,
+						    per_pixel);
+		else
+			__intel_buf_tiled_to_linear(buf, tiled, linear,
+						    I915_BIT_6_SWIZZLE_NONE,
+						    per_pixel);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed(&start, &end) / reps;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		uint32_t tiling;
+		const char *name;
+		unsigned int width;
+		unsigned int height;
+	} tilings[] = {
+		{ I915_TILING_X, "X", 512, 8 },
+		{ I915_TILING_Y, "Y", 128, 32 },
+		{ I915_TILING_Yf, "Yf", 128, 32 },
+		{ I915_TILING_Ys, "Ys", 512, 128 },
+	};
+	int width = 3840, height = 2160, reps = 5;
+	int c;
+
+	while ((c = getopt(argc, argv, "w:h:r:")) != -1) {
+		switch (c) {
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-w width] [-h height] [-r repetitions]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (width <= 0 || height <= 0 || reps <= 0)
+		return 1;
+
+	printf("%dx%d 32bpp, average of %d runs\n", width, height, reps);
+	printf("%-6s %-10s %12s %12s %8s\n",
+	       "tiling", "direction", "per-pixel", "per-tile", "speedup");
+
+	for (int t = 0; t < ARRAY_SIZE(tilings); t++) {
+		struct intel_buf buf = {};
+		unsigned int stride = ALIGN(width * 4, tilings[t].width);
+		size_t size = (size_t)stride * ALIGN(height, tilings[t].height);
+		uint32_t *linear;
+		void *tiled;
+
+		buf.tiling = tilings[t].tiling;
+		buf.bpp = 32;
+		buf.surface[0].stride = stride;
+		buf.surface[0].size = (uint64_t)stride * height;
+
+		if (posix_memalign(&tiled, 4096, size) ||
+		    posix_memalign((void **)&linear, 4096, buf.surface[0].size))
+			return 1;
+
+		memset(tiled, 0, size);
+		memset(linear, 0x5a, buf.surface[0].size);
+
+		for (int dir = 0; dir < 2; dir++) {
+			double pixel = run(&buf, tiled, linear, !dir, true, reps);
+			double tile = run(&buf, tiled, linear, !dir, false, reps);
+
+			printf("%-6s %-10s %10.2fms %10.2fms %7.1fx\n",
+			       tilings[t].name, dir ? "to linear" : "to tiled",
+			       pixel * 1e3, tile * 1e3, pixel / tile);
+		}
+
+		free(linear);
+		free(tiled);
+	}
+
+	return 0;
+}
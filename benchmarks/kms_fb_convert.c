@@ -0,0 +1,212 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the CPU conversions behind igt_get_cairo_surface() for formats
+ * cairo can't draw to, from each format to its cairo shadow format and
+ * back, on one thread and on the igt_workers pool.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_fb.h"
+
+static const struct {
+	uint32_t format;
+	uint32_t shadow;
+} pairs[] = {
+	{ DRM_FORMAT_RGB565, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_XRGB2101010, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_NV12, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_NV16, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_NV21, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_NV61, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_YUV420, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_YUV422, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_YVU420, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_YVU422, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_YUYV, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_YVYU, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_UYVY, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_VYUY, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_XYUV8888, DRM_FORMAT_XRGB8888 },
+	{ DRM_FORMAT_P010, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_P012, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_P016, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_Y210, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_Y212, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_Y216, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_XVYU2101010, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_XVYU12_16161616, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_XVYU16161616, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_Y410, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_Y412, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_Y416, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_XRGB16161616F, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_ARGB16161616F, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_XBGR16161616F, IGT_FORMAT_FLOAT },
+	{ DRM_FORMAT_ABGR16161616F, IGT_FORMAT_FLOAT },
+};
+
+static const struct {
+	const char *name;
+	int width;
+	int height;
+} sizes[] = {
+	{ "1080p", 1920, 1080 },
+	{ "4k", 3840, 2160 },
+	{ "8k", 7680, 4320 },
+};
+
+static void *create_fb(struct igt_fb *fb, uint32_t format,
+		       int width, int height)
+{
+	void *ptr;
+
+	igt_init_fb(fb, -1, width, height, format, DRM_FORMAT_MOD_LINEAR,
+		    IGT_COLOR_YCBCR_BT709, IGT_COLOR_YCBCR_LIMITED_RANGE);
+
+	for (int i = 0; i < fb->num_planes; i++) {
+		fb->strides[i] = ALIGN(fb->plane_width[i] *
+				       fb->plane_bpp[i] / 8, 64);
+		fb->offsets[i] = fb->size;
+		fb->size += (uint64_t)fb->strides[i] * fb->plane_height[i];
+	}
+
+	if (posix_memalign(&ptr, 4096, fb->size))
+		return NULL;
+
+	/* Not all of it makes sense for every format, it doesn't matter */
+	for (uint64_t i = 0; i < fb->size / 4; i++)
+		((uint32_t *)ptr)[i] = i * 2654435761u;
+
+	return ptr;
+}
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+/* Returns the MB/s read and written */
+static double run(struct igt_fb *dst, void *dst_ptr,
+		  struct igt_fb *src, void *src_ptr,
+		  int threads, int reps)
+{
+	struct timespec start, end;
+	char env[16];
+
+	snprintf(env, sizeof(env), "%d", threads);
+	setenv("IGT_WORKER_THREADS", env, 1);
+
+	/* Warm up, starting the workers */
+	igt_fb_convert_pixels(dst, dst_ptr, src, src_ptr);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < reps; i++)
+		igt_fb_convert_pixels(dst, dst_ptr, src, src_ptr);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (dst->size + src->size) * reps / elapsed(&start, &end) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *only_size = NULL;
+	int reps = 3;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:r:")) != -1) {
+		switch (c) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			only_size = optarg;
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t threads] [-s 1080p|4k|8k] [-r repetitions]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (threads <= 0 || reps <= 0)
+		return 1;
+
+	printf("MB/s read and written, average of %d runs\n", reps);
+	printf("%-6s %-10s %-10s %12s %12s %8s\n",
+	       "size", "from", "to", "1 thread", "threads", "speedup");
+
+	for (int s = 0; s < ARRAY_SIZE(sizes); s++) {
+		if (only_size && strcmp(only_size, sizes[s].name))
+			continue;
+
+		for (int p = 0; p < ARRAY_SIZE(pairs); p++) {
+			struct igt_fb fb, shadow;
+			void *fb_ptr, *shadow_ptr;
+
+			fb_ptr = create_fb(&fb, pairs[p].format,
+					   sizes[s].width, sizes[s].height);
+			shadow_ptr = create_fb(&shadow, pairs[p].shadow,
+					       sizes[s].width, sizes[s].height);
+			if (!fb_ptr || !shadow_ptr)
+				return 1;
+
+			for (int dir = 0; dir < 2; dir++) {
+				struct igt_fb *dst = dir ? &fb : &shadow;
+				struct igt_fb *src = dir ? &shadow : &fb;
+				void *dst_ptr = dir ? fb_ptr : shadow_ptr;
+				void *src_ptr = dir ? shadow_ptr : fb_ptr;
+				double single, multi;
+
+				single = run(dst, dst_ptr, src, src_ptr, 1, reps);
+				multi = run(dst, dst_ptr, src, src_ptr,
+					    threads, reps);
+
+				printf("%-6s %-10s %-10s %12.1f %12.1f %7.1fx\n",
+				       sizes[s].name,
+				       igt_format_str(src->drm_format),
+				       igt_format_str(dst->drm_format),
+				       single, multi, multi / single);
+			}
+
+			free(shadow_ptr);
+			free(fb_ptr);
+		}
+	}
+
+	return 0;
+}
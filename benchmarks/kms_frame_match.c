@@ -0,0 +1,239 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Measures the frame comparisons used by the Chamelium tests on synthetic
+ * captures: an analog (VGA) capture off by some gain and noise,
+ * and a checkerboard capture with blurred edges, on one thread and on the
+ * igt_workers pool.
+ */
+
+#include <cairo.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_frame.h"
+
+static const struct {
+	const char *name;
+	int width;
+	int height;
+} sizes[] = {
+	{ "1080p", 1920, 1080 },
+	{ "4k", 3840, 2160 },
+	{ "8k", 7680, 4320 },
+};
+
+static uint32_t noise(uint32_t *state)
+{
+	*state = *state * 1664525 + 1013904223;
+	return *state >> 24;
+}
+
+static cairo_surface_t *create_surface(int width, int height)
+{
+	cairo_surface_t *surface;
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+		return NULL;
+
+	return surface;
+}
+
+static uint32_t *row(cairo_surface_t *surface, int y)
+{
+	return (uint32_t *)(cairo_image_surface_get_data(surface) +
+			    y * cairo_image_surface_get_stride(surface));
+}
+
+/* Gradients in each channel, captured with some gain and noise */
+static void fill_analog(cairo_surface_t *reference, cairo_surface_t *capture)
+{
+	int width = cairo_image_surface_get_width(reference);
+	int height = cairo_image_surface_get_height(reference);
+	uint32_t state = 1;
+
+	for (int y = 0; y < height; y++) {
+		uint32_t *ref = row(reference, y);
+		uint32_t *cap = row(capture, y);
+
+		for (int x = 0; x < width; x++) {
+			uint32_t r = x * 256 / width;
+			uint32_t g = y * 256 / height;
+			uint32_t b = (x + y) & 0xff;
+			uint32_t pixel = 0;
+
+			ref[x] = r << 16 | g << 8 | b;
+
+			for (int i = 0; i < 3; i++) {
+				uint32_t value = (ref[x] >> (8 * i)) & 0xff;
+
+				value += value / 32 + noise(&state) % 3;
+				pixel |= min(value, 255u) << (8 * i);
+			}
+			cap[x] = pixel;
+		}
+	}
+}
+
+/* Squares of two colors, with the capture smeared across each edge */
+static void fill_checkerboard(cairo_surface_t *reference,
+			      cairo_surface_t *capture)
+{
+	int width = cairo_image_surface_get_width(reference);
+	int height = cairo_image_surface_get_height(reference);
+	const uint32_t colors[2] = { 0x202020, 0xe0e0e0 };
+	const int square = 64;
+
+	for (int y = 0; y < height; y++) {
+		uint32_t *ref = row(reference, y);
+		uint32_t *cap = row(capture, y);
+
+		for (int x = 0; x < width; x++) {
+			ref[x] = colors[(x / square + y / square) & 1];
+			cap[x] = x % square ? ref[x] : 0x808080;
+		}
+	}
+}
+
+static double elapsed(const struct timespec *start,
+		      const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + 1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+/* Returns the ms per comparison */
+static double run(bool (*check)(cairo_surface_t *, cairo_surface_t *),
+		  cairo_surface_t *reference, cairo_surface_t *capture,
+		  int threads, int reps, bool *match)
+{
+	struct timespec start, end;
+	char env[16];
+
+	snprintf(env, sizeof(env), "%d", threads);
+	setenv("IGT_WORKER_THREADS", env, 1);
+
+	/* Warm up, starting the workers */
+	*match = check(reference, capture);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int i = 0; i < reps; i++)
+		*match &= check(reference, capture);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return elapsed(&start, &end) * 1e3 / reps;
+}
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		void (*fill)(cairo_surface_t *, cairo_surface_t *);
+		bool (*check)(cairo_surface_t *, cairo_surface_t *);
+	} checks[] = {
+		{ "analog", fill_analog, igt_check_analog_frame_match },
+		{ "checkerboard", fill_checkerboard,
+		  igt_check_checkerboard_frame_match },
+	};
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	const char *only_size = NULL;
+	int reps = 3;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:r:")) != -1) {
+		switch (c) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			only_size = optarg;
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t threads] [-s 1080p|4k|8k] [-r repetitions]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (threads <= 0 || reps <= 0)
+		return 1;
+
+	printf("ms per comparison, average of %d runs\n", reps);
+	printf("%-6s %-13s %6s %12s %12s %8s\n",
+	       "size", "check", "match", "1 thread", "threads", "speedup");
+
+	for (int s = 0; s < ARRAY_SIZE(sizes); s++) {
+		if (only_size && strcmp(only_size, sizes[s].name))
+			continue;
+
+		for (int i = 0; i < ARRAY_SIZE(checks); i++) {
+			cairo_surface_t *reference, *capture;
+			bool single_match, multi_match;
+			double single, multi;
+
+			reference = create_surface(sizes[s].width,
+						   sizes[s].height);
+			capture = create_surface(sizes[s].width,
+						 sizes[s].height);
+			if (!reference || !capture)
+				return 1;
+
+			cairo_surface_flush(reference);
+			cairo_surface_flush(capture);
+			checks[i].fill(reference, capture);
+			cairo_surface_mark_dirty(reference);
+			cairo_surface_mark_dirty(capture);
+
+			single = run(checks[i].check, reference, capture,
+				     1, reps, &single_match);
+			multi = run(checks[i].check, reference, capture,
+				    threads, reps, &multi_match);
+
+			/* The decision must not depend on the split */
+			if (single_match != multi_match)
+				return 1;
+
+			printf("%-6s %-13s %6s %12.1f %12.1f %7.1fx\n",
+			       sizes[s].name, checks[i].name,
+			       single_match ? "yes" : "no",
+			       single, multi, single / multi);
+
+			cairo_surface_destroy(capture);
+			cairo_surface_destroy(reference);
+		}
+	}
+
+	return 0;
+}
@@ -593,6 +593,50 @@ intel_perf_load_perf_configs(struct intel_perf *perf, int drm_fd)
 	}
 }
 
+/*
+ * Counters of a report format as runs of consecutive dwords, in the order
+ * of intel_perf_accumulator.deltas[]. 40bit counters have their high bytes
+ * stored separately, one after the other.
+ */
+struct oa_counter_run {
+	uint8_t bits;
+	uint8_t count;
+	uint16_t offset;	/* dword of the first counter */
+	uint16_t high_offset;	/* byte of the first high byte, 40bit only */
+};
+
+struct oa_format_layout {
+	int oa_format;
+	int n_runs;
+	struct oa_counter_run runs[5];
+};
+
+static const struct oa_format_layout oa_format_layouts[] = {
+	/* Haswell */
+	{ I915_OA_FORMAT_A45_B8_C8, 2, {
+		{ 32, 1, 1 },		/* timestamp */
+		{ 32, 61, 3 },		/* 45x A, 8x B, 8x C */
+	} },
+	/* Gen8 up to Gen12 */
+	{ I915_OA_FORMAT_A32u40_A4u32_B8_C8, 5, {
+		{ 32, 1, 1 },		/* timestamp */
+		{ 32, 1, 3 },		/* clock */
+		{ 40, 32, 4, 160 },	/* 32x 40bit A */
+		{ 32, 4, 36 },		/* 4x 32bit A */
+		{ 32, 16, 48 },		/* 8x B, 8x C */
+	} },
+};
+
+static const struct oa_format_layout *get_oa_format_layout(int oa_format)
+{
+	for (size_t i = 0; i < sizeof(oa_format_layouts) / sizeof(oa_format_layouts[0]); i++)
+		if (oa_format_layouts[i].oa_format == oa_format)
+			return &oa_format_layouts[i];
+
+	assert(0);
+	return NULL;
+}
+
 static void
 accumulate_uint32(const uint32_t *report0,
                   const uint32_t *report1,
@@ -602,17 +646,14 @@ accumulate_uint32(const uint32_t *report0,
 }
 
 static void
-accumulate_uint40(int a_index,
-                  const uint32_t *report0,
-                  const uint32_t *report1,
-                  uint64_t *deltas)
+accumulate_uint40(const uint32_t *low0, const uint32_t *low1,
+		  const uint8_t *high_bytes0, const uint8_t *high_bytes1,
+		  uint64_t *deltas)
 {
-	const uint8_t *high_bytes0 = (uint8_t *)(report0 + 40);
-	const uint8_t *high_bytes1 = (uint8_t *)(report1 + 40);
-	uint64_t high0 = (uint64_t)(high_bytes0[a_index]) << 32;
-	uint64_t high1 = (uint64_t)(high_bytes1[a_index]) << 32;
-	uint64_t value0 = report0[a_index + 4] | high0;
-	uint64_t value1 = report1[a_index + 4] | high1;
+	uint64_t high0 = (uint64_t)(*high_bytes0) << 32;
+	uint64_t high1 = (uint64_t)(*high_bytes1) << 32;
+	uint64_t value0 = *low0 | high0;
+	uint64_t value1 = *low1 | high1;
 	uint64_t delta;
 
 	if (value0 > value1)
@@ -623,45 +664,219 @@ accumulate_uint40(int a_index,
 	*deltas += delta;
 }
 
+typedef void (*accumulate_fn)(const struct oa_format_layout *layout,
+			      const uint32_t *start, const uint32_t *end,
+			      uint64_t *deltas);
+
+static void accumulate_report(const struct oa_format_layout *layout,
+			      const uint32_t *start, const uint32_t *end,
+			      uint64_t *deltas)
+{
+	for (int r = 0; r < layout->n_runs; r++) {
+		const struct oa_counter_run *run = &layout->runs[r];
+		const uint8_t *high0 = (const uint8_t *) start + run->high_offset;
+		const uint8_t *high1 = (const uint8_t *) end + run->high_offset;
+
+		for (int i = 0; i < run->count; i++) {
+			if (run->bits == 40)
+				accumulate_uint40(start + run->offset + i,
+						  end + run->offset + i,
+						  high0 + i, high1 + i,
+						  deltas++);
+			else
+				accumulate_uint32(start + run->offset + i,
+						  end + run->offset + i,
+						  deltas++);
+		}
+	}
+}
+
+/*
+ * The vector versions compute the 40bit deltas without a branch, as the
+ * difference modulo 2^40 is the same as adding 2^40 when the counter
+ * wrapped.
+ */
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+
+#include <smmintrin.h>
+
+static void accumulate_report_sse41(const struct oa_format_layout *layout,
+				    const uint32_t *start, const uint32_t *end,
+				    uint64_t *deltas)
+{
+	const __m128i mask40 = _mm_set1_epi64x((1ULL << 40) - 1);
+
+	for (int r = 0; r < layout->n_runs; r++) {
+		const struct oa_counter_run *run = &layout->runs[r];
+		const uint32_t *s = start + run->offset;
+		const uint32_t *e = end + run->offset;
+		int i = 0;
+
+		if (run->bits == 40) {
+			const uint8_t *high0 = (const uint8_t *) start + run->high_offset;
+			const uint8_t *high1 = (const uint8_t *) end + run->high_offset;
+
+			for (; i + 2 <= run->count; i += 2) {
+				uint16_t h0, h1;
+				__m128i v0, v1, d;
+
+				memcpy(&h0, high0 + i, sizeof(h0));
+				memcpy(&h1, high1 + i, sizeof(h1));
+
+				v0 = _mm_or_si128(_mm_cvtepu32_epi64(_mm_loadl_epi64((const __m128i *)(s + i))),
+						  _mm_slli_epi64(_mm_cvtepu8_epi64(_mm_cvtsi32_si128(h0)), 32));
+				v1 = _mm_or_si128(_mm_cvtepu32_epi64(_mm_loadl_epi64((const __m128i *)(e + i))),
+						  _mm_slli_epi64(_mm_cvtepu8_epi64(_mm_cvtsi32_si128(h1)), 32));
+				d = _mm_and_si128(_mm_sub_epi64(v1, v0), mask40);
+
+				_mm_storeu_si128((__m128i *)(deltas + i),
+						 _mm_add_epi64(_mm_loadu_si128((const __m128i *)(deltas + i)), d));
+			}
+
+			for (; i < run->count; i++)
+				accumulate_uint40(s + i, e + i, high0 + i, high1 + i,
+						  deltas + i);
+		} else {
+			for (; i + 4 <= run->count; i += 4) {
+				__m128i d = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(e + i)),
+							  _mm_loadu_si128((const __m128i *)(s + i)));
+				__m128i *acc = (__m128i *)(deltas + i);
+
+				_mm_storeu_si128(acc,
+						 _mm_add_epi64(_mm_loadu_si128(acc),
+							       _mm_cvtepu32_epi64(d)));
+				_mm_storeu_si128(acc + 1,
+						 _mm_add_epi64(_mm_loadu_si128(acc + 1),
+							       _mm_cvtepu32_epi64(_mm_srli_si128(d, 8))));
+			}
+
+			for (; i < run->count; i++)
+				accumulate_uint32(s + i, e + i, deltas + i);
+		}
+
+		deltas += run->count;
+	}
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+#include <immintrin.h>
+
+static void accumulate_report_avx2(const struct oa_format_layout *layout,
+				   const uint32_t *start, const uint32_t *end,
+				   uint64_t *deltas)
+{
+	const __m256i mask40 = _mm256_set1_epi64x((1ULL << 40) - 1);
+
+	for (int r = 0; r < layout->n_runs; r++) {
+		const struct oa_counter_run *run = &layout->runs[r];
+		const uint32_t *s = start + run->offset;
+		const uint32_t *e = end + run->offset;
+		int i = 0;
+
+		if (run->bits == 40) {
+			const uint8_t *high0 = (const uint8_t *) start + run->high_offset;
+			const uint8_t *high1 = (const uint8_t *) end + run->high_offset;
+
+			for (; i + 4 <= run->count; i += 4) {
+				uint32_t h0, h1;
+				__m256i v0, v1, d;
+
+				memcpy(&h0, high0 + i, sizeof(h0));
+				memcpy(&h1, high1 + i, sizeof(h1));
+
+				v0 = _mm256_or_si256(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(s + i))),
+						     _mm256_slli_epi64(_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(h0)), 32));
+				v1 = _mm256_or_si256(_mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i *)(e + i))),
+						     _mm256_slli_epi64(_mm256_cvtepu8_epi64(_mm_cvtsi32_si128(h1)), 32));
+				d = _mm256_and_si256(_mm256_sub_epi64(v1, v0), mask40);
+
+				_mm256_storeu_si256((__m256i *)(deltas + i),
+						    _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(deltas + i)), d));
+			}
+
+			for (; i < run->count; i++)
+				accumulate_uint40(s + i, e + i, high0 + i, high1 + i,
+						  deltas + i);
+		} else {
+			for (; i + 8 <= run->count; i += 8) {
+				__m256i d = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)(e + i)),
+							     _mm256_loadu_si256((const __m256i *)(s + i)));
+				__m256i *acc = (__m256i *)(deltas + i);
+
+				_mm256_storeu_si256(acc,
+						    _mm256_add_epi64(_mm256_loadu_si256(acc),
+								     _mm256_cvtepu32_epi64(_mm256_castsi256_si128(d))));
+				_mm256_storeu_si256(acc + 1,
+						    _mm256_add_epi64(_mm256_loadu_si256(acc + 1),
+								     _mm256_cvtepu32_epi64(_mm256_extracti128_si256(d, 1))));
+			}
+
+			for (; i < run->count; i++)
+				accumulate_uint32(s + i, e + i, deltas + i);
+		}
+
+		deltas += run->count;
+	}
+}
+
+#pragma GCC pop_options
+
+static accumulate_fn get_accumulate_fn(void)
+{
+	static accumulate_fn fn;
+
+	if (!fn) {
+		if (__builtin_cpu_supports("avx2"))
+			fn = accumulate_report_avx2;
+		else if (__builtin_cpu_supports("sse4.1"))
+			fn = accumulate_report_sse41;
+		else
+			fn = accumulate_report;
+	}
+
+	return fn;
+}
+#else
+static accumulate_fn get_accumulate_fn(void)
+{
+	return accumulate_report;
+}
+#endif
+
 void intel_perf_accumulate_reports(struct intel_perf_accumulator *acc,
 				   int oa_format,
 				   const struct drm_i915_perf_record_header *record0,
 				   const struct drm_i915_perf_record_header *record1)
 {
-	const uint32_t *start = (const uint32_t *)(record0 + 1);
-	const uint32_t *end = (const uint32_t *)(record1 + 1);
-	uint64_t *deltas = acc->deltas;
-	int idx = 0;
-	int i;
+	const struct oa_format_layout *layout = get_oa_format_layout(oa_format);
 
 	memset(acc, 0, sizeof(*acc));
 
-	switch (oa_format) {
-	case I915_OA_FORMAT_A32u40_A4u32_B8_C8:
-		accumulate_uint32(start + 1, end + 1, deltas + idx++); /* timestamp */
-		accumulate_uint32(start + 3, end + 3, deltas + idx++); /* clock */
-
-		/* 32x 40bit A counters... */
-		for (i = 0; i < 32; i++)
-			accumulate_uint40(i, start, end, deltas + idx++);
-
-		/* 4x 32bit A counters... */
-		for (i = 0; i < 4; i++)
-			accumulate_uint32(start + 36 + i, end + 36 + i, deltas + idx++);
-
-		/* 8x 32bit B counters + 8x 32bit C counters... */
-		for (i = 0; i < 16; i++)
-			accumulate_uint32(start + 48 + i, end + 48 + i, deltas + idx++);
-		break;
+	get_accumulate_fn()(layout,
+			    (const uint32_t *)(record0 + 1),
+			    (const uint32_t *)(record1 + 1),
+			    acc->deltas);
+}
 
-	case I915_OA_FORMAT_A45_B8_C8:
-		accumulate_uint32(start + 1, end + 1, deltas); /* timestamp */
+void intel_perf_accumulate_reports_batch(struct intel_perf_accumulator *acc,
+					 int oa_format,
+					 const struct drm_i915_perf_record_header **records,
+					 uint32_t n_records)
+{
+	const struct oa_format_layout *layout = get_oa_format_layout(oa_format);
+	accumulate_fn fn = get_accumulate_fn();
 
-		for (i = 0; i < 61; i++)
-			accumulate_uint32(start + 3 + i, end + 3 + i, deltas + 1 + i);
-		break;
-	default:
-		assert(0);
-	}
+	memset(acc, 0, sizeof(*acc));
 
+	for (uint32_t i = 1; i < n_records; i++)
+		fn(layout,
+		   (const uint32_t *)(records[i - 1] + 1),
+		   (const uint32_t *)(records[i] + 1),
+		   acc->deltas);
 }
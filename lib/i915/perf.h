@@ -240,6 +240,11 @@ void intel_perf_accumulate_reports(struct intel_perf_accumulator *acc,
 				   const struct drm_i915_perf_record_header *record0,
 				   const struct drm_i915_perf_record_header *record1);
 
+void intel_perf_accumulate_reports_batch(struct intel_perf_accumulator *acc,
+					 int oa_format,
+					 const struct drm_i915_perf_record_header **records,
+					 uint32_t n_records);
+
 #ifdef __cplusplus
 };
 #endif
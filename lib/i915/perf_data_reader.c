@@ -117,6 +117,28 @@ find_metric_set(struct intel_perf *perf, const char *symbol_name)
 	return NULL;
 }
 
+static struct intel_perf *
+perf_for_recording(const struct intel_perf_record_device_info *record_info,
+		   const struct intel_perf_record_device_topology *record_topology,
+		   char *error_msg, size_t error_msg_len)
+{
+	struct intel_perf *perf;
+
+	perf = intel_perf_for_devinfo(record_info->device_id,
+				      record_info->device_revision,
+				      record_info->timestamp_frequency,
+				      record_info->gt_min_frequency,
+				      record_info->gt_max_frequency,
+				      &record_topology->topology);
+	if (!perf) {
+		snprintf(error_msg, error_msg_len,
+			 "Recording occured on unsupported device (0x%x)",
+			 record_info->device_id);
+	}
+
+	return perf;
+}
+
 static bool
 parse_data(struct intel_perf_data_reader *reader)
 {
@@ -183,18 +205,11 @@ parse_data(struct intel_perf_data_reader *reader)
 	record_info = reader->record_info;
 	record_topology = reader->record_topology;
 
-	reader->perf = intel_perf_for_devinfo(record_info->device_id,
-					      record_info->device_revision,
-					      record_info->timestamp_frequency,
-					      record_info->gt_min_frequency,
-					      record_info->gt_max_frequency,
-					      &record_topology->topology);
-	if (!reader->perf) {
-		snprintf(reader->error_msg, sizeof(reader->error_msg),
-			 "Recording occured on unsupported device (0x%x)",
-			 record_info->device_id);
+	reader->perf = perf_for_recording(record_info, record_topology,
+					  reader->error_msg,
+					  sizeof(reader->error_msg));
+	if (!reader->perf)
 		return false;
-	}
 
 	reader->devinfo = reader->perf->devinfo;
 
@@ -205,49 +220,66 @@ parse_data(struct intel_perf_data_reader *reader)
 	return true;
 }
 
+static uint64_t
+interpolate_cpu_timestamp(const struct intel_perf_correlation_point *p0,
+			  const struct intel_perf_correlation_point *p1,
+			  uint64_t timestamp_frequency,
+			  uint64_t gpu_ts)
+{
+	int64_t num, den, delta, scaled;
+
+	if (p1 && p1->gpu_ts != p0->gpu_ts) {
+		num = p1->cpu_ts - p0->cpu_ts;
+		den = p1->gpu_ts - p0->gpu_ts;
+	} else {
+		/* Not enough points to interpolate, rely on the
+		 * timestamp frequency.
+		 */
+		num = 1000000000ull;
+		den = timestamp_frequency;
+		if (!den)
+			return p0->cpu_ts;
+	}
+
+	delta = gpu_ts - p0->gpu_ts;
+	if (__builtin_mul_overflow(delta, num, &scaled))
+		return p0->cpu_ts + (int64_t)((double) delta * num / den);
+
+	return p0->cpu_ts + scaled / den;
+}
+
+static const struct intel_perf_correlation_point correlation_origin;
+
 static uint64_t
 correlate_gpu_timestamp(struct intel_perf_data_reader *reader,
 			uint64_t gpu_ts)
 {
-	/* OA reports only have the lower 32bits of the timestamp
-	 * register, while our correlation data has the whole 36bits.
-	 * Try to figure what portion of the correlation data the
-	 * 32bit timestamp belongs to.
-	 */
-	uint64_t mask = 0xffffffff;
-	int corr_idx = -1;
+	const struct intel_perf_correlation_point *points = reader->correlation_points;
+	uint32_t n = reader->n_correlations;
+	uint32_t lo = 0, hi;
 
-	for (uint32_t i = 0; i < reader->n_correlation_chunks; i++) {
-		if (gpu_ts >= (reader->correlation_chunks[i].gpu_ts_begin & mask) &&
-		    gpu_ts <= (reader->correlation_chunks[i].gpu_ts_end & mask)) {
-			corr_idx = reader->correlation_chunks[i].idx;
-			break;
-		}
-	}
-
-	/* Not found? Assume prior to the first timestamp correlation.
+	/* Find the last correlation point at or before gpu_ts. Timestamps
+	 * outside of the correlated range are extrapolated from the
+	 * closest pair of points.
 	 */
-	if (corr_idx < 0) {
-		return reader->correlations[0]->cpu_timestamp -
-			((reader->correlations[0]->gpu_timestamp & mask) - gpu_ts) *
-			(reader->correlations[1]->cpu_timestamp - reader->correlations[0]->cpu_timestamp) /
-			(reader->correlations[1]->gpu_timestamp - reader->correlations[0]->gpu_timestamp);
-	}
-
-	for (uint32_t i = corr_idx; i < (reader->n_correlations - 1); i++) {
-		if (gpu_ts >= (reader->correlations[i]->gpu_timestamp & mask) &&
-		    gpu_ts < (reader->correlations[i + 1]->gpu_timestamp & mask)) {
-			return reader->correlations[i]->cpu_timestamp +
-				(gpu_ts - (reader->correlations[i]->gpu_timestamp & mask)) *
-				(reader->correlations[i + 1]->cpu_timestamp - reader->correlations[i]->cpu_timestamp) /
-				(reader->correlations[i + 1]->gpu_timestamp - reader->correlations[i]->gpu_timestamp);
+	if (n && (int64_t)(gpu_ts - points[0].gpu_ts) > 0) {
+		hi = n - 1;
+		while (lo < hi) {
+			uint32_t mid = lo + (hi - lo + 1) / 2;
+
+			if (points[mid].gpu_ts <= gpu_ts)
+				lo = mid;
+			else
+				hi = mid - 1;
 		}
 	}
+	if (n > 1 && lo == n - 1)
+		lo--;
 
-	/* This is a bit harsh, but the recording tool should ensure we have
-	 * sampling points on either side of the bag of OA reports.
-	 */
-	assert(0);
+	return interpolate_cpu_timestamp(n ? &points[lo] : &correlation_origin,
+					 lo + 1 < n ? &points[lo + 1] : NULL,
+					 reader->devinfo.timestamp_frequency,
+					 gpu_ts);
 }
 
 static void
@@ -278,60 +310,132 @@ append_timeline_event(struct intel_perf_data_reader *reader,
 	reader->n_timelines++;
 }
 
+/* OA reports come in order, each less than a 32bit wrap apart from the
+ * previous one.
+ */
+static uint64_t
+extend_report_timestamp(uint64_t prev_ts, uint32_t ts)
+{
+	return prev_ts + (uint32_t)(ts - (uint32_t) prev_ts);
+}
+
+static uint64_t
+first_report_timestamp(const struct intel_perf_data_reader *reader,
+		       uint32_t ts)
+{
+	uint64_t corr_ts;
+
+	if (!reader->n_correlations)
+		return ts;
+
+	/* Closest to the first correlation, which may come a bit after
+	 * the first report.
+	 */
+	corr_ts = reader->correlation_points[0].gpu_ts;
+	return corr_ts + (int32_t)(ts - (uint32_t) corr_ts);
+}
+
 static void
 generate_cpu_events(struct intel_perf_data_reader *reader)
 {
 	uint32_t last_header_idx = 0;
-	const struct drm_i915_perf_record_header *last_header = reader->records[0],
-		*current_header = reader->records[0];
-	const uint8_t *start_report, *end_report;
 	uint32_t last_ctx_id, current_ctx_id;
-	uint64_t gpu_ts_start, gpu_ts_end;
+	uint64_t last_ts, current_ts;
+	const uint8_t *report;
 
-	for (uint32_t i = 1; i < reader->n_records; i++) {
-		current_header = reader->records[i];
+	if (!reader->n_records)
+		return;
 
-		start_report = (const uint8_t *) (last_header + 1);
-		end_report = (const uint8_t *) (current_header + 1);
+	report = (const uint8_t *) (reader->records[0] + 1);
+	last_ctx_id = oa_report_ctx_id(&reader->devinfo, report);
+	last_ts = current_ts = first_report_timestamp(reader, oa_report_timestamp(report));
 
-		last_ctx_id = oa_report_ctx_id(&reader->devinfo, start_report);
-		current_ctx_id = oa_report_ctx_id(&reader->devinfo, end_report);
+	for (uint32_t i = 1; i < reader->n_records; i++) {
+		report = (const uint8_t *) (reader->records[i] + 1);
 
-		gpu_ts_start = oa_report_timestamp(start_report);
-		gpu_ts_end = oa_report_timestamp(end_report);
+		current_ctx_id = oa_report_ctx_id(&reader->devinfo, report);
+		current_ts = extend_report_timestamp(current_ts, oa_report_timestamp(report));
 
 		if (last_ctx_id == current_ctx_id)
 			continue;
 
-		append_timeline_event(reader, gpu_ts_start, gpu_ts_end, last_header_idx, i, last_ctx_id);
+		append_timeline_event(reader, last_ts, current_ts, last_header_idx, i, last_ctx_id);
 
-		last_header = current_header;
 		last_header_idx = i;
+		last_ts = current_ts;
+		last_ctx_id = current_ctx_id;
 	}
 
-	if (last_header != current_header)
-		append_timeline_event(reader, gpu_ts_start, gpu_ts_end, last_header_idx, reader->n_records - 1, last_ctx_id);
+	if (last_header_idx != reader->n_records - 1)
+		append_timeline_event(reader, last_ts, current_ts, last_header_idx, reader->n_records - 1, last_ctx_id);
+}
+
+static int
+compare_correlations(const void *a, const void *b)
+{
+	const struct intel_perf_record_timestamp_correlation *corr_a =
+		*(const struct intel_perf_record_timestamp_correlation **) a;
+	const struct intel_perf_record_timestamp_correlation *corr_b =
+		*(const struct intel_perf_record_timestamp_correlation **) b;
+
+	if (corr_a->cpu_timestamp < corr_b->cpu_timestamp)
+		return -1;
+	return corr_a->cpu_timestamp > corr_b->cpu_timestamp;
+}
+
+/* The GPU timestamps of the correlations are wider than the OA report
+ * ones (36bits on most platforms) but still wrap around. Assume they
+ * wrap at the next power of two above the largest value seen so far.
+ */
+static uint64_t
+correlation_wrap_mask(uint64_t max_ts)
+{
+	uint64_t mask = 0xffffffff;
+
+	while (mask < max_ts)
+		mask = (mask << 1) | 1;
+
+	return mask;
 }
 
 static void
-compute_correlation_chunks(struct intel_perf_data_reader *reader)
+compute_correlation_points(struct intel_perf_data_reader *reader)
 {
-	uint64_t mask = ~(0xffffffff);
-	uint32_t last_idx = 0;
-	uint64_t last_ts = reader->correlations[last_idx]->gpu_timestamp;
+	struct intel_perf_correlation_point *points;
+	uint64_t max_ts = 0;
+
+	if (!reader->n_correlations)
+		return;
+
+	/* Sorting by CPU time (already the recording order) makes the
+	 * extended GPU timestamps increasing too.
+	 */
+	qsort(reader->correlations, reader->n_correlations,
+	      sizeof(*reader->correlations), compare_correlations);
+
+	points = calloc(reader->n_correlations, sizeof(*points));
+	assert(points);
 
 	for (uint32_t i = 0; i < reader->n_correlations; i++) {
-		if (!reader->n_correlation_chunks ||
-		    (last_ts & mask) != (reader->correlations[i]->gpu_timestamp & mask)) {
-			assert(reader->n_correlation_chunks < ARRAY_SIZE(reader->correlation_chunks));
-			reader->correlation_chunks[reader->n_correlation_chunks].gpu_ts_begin = last_ts;
-			reader->correlation_chunks[reader->n_correlation_chunks].gpu_ts_end = last_ts | ~mask;
-			reader->correlation_chunks[reader->n_correlation_chunks].idx = last_idx;
-			last_ts = reader->correlation_chunks[reader->n_correlation_chunks].gpu_ts_end + 1;
-			last_idx = i;
-			reader->n_correlation_chunks++;
+		uint64_t ts = reader->correlations[i]->gpu_timestamp;
+
+		if (i == 0) {
+			points[i].gpu_ts = ts;
+		} else {
+			uint64_t prev_ts = reader->correlations[i - 1]->gpu_timestamp;
+			uint64_t delta = ts - prev_ts;
+
+			if (ts < prev_ts)
+				delta &= correlation_wrap_mask(max_ts);
+
+			points[i].gpu_ts = points[i - 1].gpu_ts + delta;
 		}
+		points[i].cpu_ts = reader->correlations[i]->cpu_timestamp;
+
+		max_ts = MAX(max_ts, ts);
 	}
+
+	reader->correlation_points = points;
 }
 
 bool
@@ -360,7 +464,7 @@ intel_perf_data_reader_init(struct intel_perf_data_reader *reader,
 	if (!parse_data(reader))
 		return false;
 
-	compute_correlation_chunks(reader);
+	compute_correlation_points(reader);
 	generate_cpu_events(reader);
 
 	return true;
@@ -373,5 +477,448 @@ intel_perf_data_reader_fini(struct intel_perf_data_reader *reader)
 	free(reader->records);
 	free(reader->timelines);
 	free(reader->correlations);
+	free(reader->correlation_points);
 	munmap((void *)reader->mmap_data, reader->mmap_size);
 }
+
+/* Record sizes are 16bits */
+#define STREAM_RECORD_MAX_SIZE (UINT16_MAX + 1)
+#define STREAM_BUFFER_SIZE (4 * STREAM_RECORD_MAX_SIZE)
+
+/* Make @size bytes available at the start of the read buffer. */
+static bool
+stream_fill(struct intel_perf_data_stream *stream, size_t size)
+{
+	if (stream->buf_end - stream->buf_start >= size)
+		return true;
+
+	if (stream->buf_start + size > STREAM_BUFFER_SIZE) {
+		memmove(stream->buf, stream->buf + stream->buf_start,
+			stream->buf_end - stream->buf_start);
+		stream->buf_end -= stream->buf_start;
+		stream->buf_start = 0;
+	}
+
+	while (stream->buf_end - stream->buf_start < size && !stream->eof) {
+		ssize_t ret = read(stream->fd, stream->buf + stream->buf_end,
+				   STREAM_BUFFER_SIZE - stream->buf_end);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			snprintf(stream->error_msg, sizeof(stream->error_msg),
+				 "Unable to read recording (%s)", strerror(errno));
+			return false;
+		}
+
+		if (ret == 0)
+			stream->eof = true;
+		stream->buf_end += ret;
+	}
+
+	return stream->buf_end - stream->buf_start >= size;
+}
+
+/* Returns the next record, valid until the following call, or NULL at
+ * the end of the recording or on error. A truncated record at the end
+ * (recorder interrupted) is dropped.
+ */
+static const struct drm_i915_perf_record_header *
+stream_read_record(struct intel_perf_data_stream *stream)
+{
+	const struct drm_i915_perf_record_header *header;
+
+	if (!stream_fill(stream, sizeof(*header)))
+		return NULL;
+
+	header = (const struct drm_i915_perf_record_header *)
+		(stream->buf + stream->buf_start);
+	if (header->size < sizeof(*header)) {
+		snprintf(stream->error_msg, sizeof(stream->error_msg),
+			 "Invalid record size (%u)", header->size);
+		return NULL;
+	}
+
+	if (!stream_fill(stream, header->size))
+		return NULL;
+
+	header = (const struct drm_i915_perf_record_header *)
+		(stream->buf + stream->buf_start);
+	stream->buf_start += header->size;
+
+	return header;
+}
+
+static void
+stream_push_pending(struct intel_perf_data_stream *stream,
+		    const struct intel_perf_data_stream_item *item)
+{
+	if (stream->pending_head + stream->n_pending >= stream->n_allocated_pending) {
+		if (stream->pending_head) {
+			memmove(stream->pending, stream->pending + stream->pending_head,
+				stream->n_pending * sizeof(*stream->pending));
+			stream->pending_head = 0;
+		}
+
+		if (stream->n_pending >= stream->n_allocated_pending) {
+			stream->n_allocated_pending = MAX(16, 2 * stream->n_allocated_pending);
+			stream->pending =
+				(struct intel_perf_data_stream_item *)
+				realloc(stream->pending,
+					stream->n_allocated_pending *
+					sizeof(*stream->pending));
+			assert(stream->pending);
+		}
+	}
+
+	stream->pending[stream->pending_head + stream->n_pending++] = *item;
+}
+
+/* Same correlation as the batch reader: a timestamp uses the pair of
+ * points around it, which is known once a point after it has been read.
+ * At the end of the recording, what remains is extrapolated from the
+ * last pair.
+ */
+static bool
+stream_correlate(struct intel_perf_data_stream *stream, bool final,
+		 uint64_t gpu_ts, uint64_t *cpu_ts)
+{
+	const struct intel_perf_correlation_point *points = stream->correlation_points;
+
+	if (stream->n_correlations >= 2 &&
+	    (final || (int64_t)(gpu_ts - points[1].gpu_ts) < 0)) {
+		*cpu_ts = interpolate_cpu_timestamp(&points[0], &points[1],
+						    stream->devinfo.timestamp_frequency,
+						    gpu_ts);
+		return true;
+	}
+
+	if (!final)
+		return false;
+
+	*cpu_ts = interpolate_cpu_timestamp(stream->n_correlations ?
+					    &points[1] : &correlation_origin,
+					    NULL,
+					    stream->devinfo.timestamp_frequency,
+					    gpu_ts);
+	return true;
+}
+
+static void
+stream_resolve_item(struct intel_perf_data_stream *stream, bool final,
+		    struct intel_perf_data_stream_item *item, bool open)
+{
+	if (!item->cpu_ts_start_valid)
+		item->cpu_ts_start_valid =
+			stream_correlate(stream, final, item->item.ts_start,
+					 &item->item.cpu_ts_start);
+
+	if (!open && !item->cpu_ts_end_valid)
+		item->cpu_ts_end_valid =
+			stream_correlate(stream, final, item->item.ts_end,
+					 &item->item.cpu_ts_end);
+}
+
+static void
+stream_resolve(struct intel_perf_data_stream *stream, bool final)
+{
+	for (uint32_t i = 0; i < stream->n_pending; i++) {
+		struct intel_perf_data_stream_item *item =
+			&stream->pending[stream->pending_head + i];
+
+		stream_resolve_item(stream, final, item, false);
+		if (!item->cpu_ts_end_valid)
+			return;
+	}
+
+	if (stream->n_records && !stream->done)
+		stream_resolve_item(stream, final, &stream->current, true);
+}
+
+static void
+stream_start_item(struct intel_perf_data_stream *stream, uint64_t ts,
+		  uint32_t hw_id)
+{
+	memset(&stream->current, 0, sizeof(stream->current));
+	stream->current.item.ts_start = ts;
+	stream->current.item.record_start = stream->n_records;
+	stream->current.item.hw_id = hw_id;
+}
+
+static void
+stream_add_sample(struct intel_perf_data_stream *stream,
+		  const struct drm_i915_perf_record_header *header)
+{
+	const uint8_t *report = (const uint8_t *) (header + 1);
+	uint32_t ctx_id = oa_report_ctx_id(&stream->devinfo, report);
+	uint32_t ts32 = oa_report_timestamp(report);
+	uint64_t ts;
+
+	if (!stream->n_records) {
+		ts = ts32;
+		if (stream->n_correlations) {
+			uint64_t corr_ts = stream->correlation_points[1].gpu_ts;
+
+			ts = corr_ts + (int32_t)(ts32 - (uint32_t) corr_ts);
+		}
+		stream_start_item(stream, ts, ctx_id);
+	} else {
+		struct intel_perf_accumulator accumulator;
+
+		ts = extend_report_timestamp(stream->last_ts, ts32);
+
+		intel_perf_accumulate_reports(&accumulator,
+					      stream->record_info.oa_format,
+					      stream->last_record, header);
+		for (uint32_t i = 0; i < ARRAY_SIZE(accumulator.deltas); i++)
+			stream->current.accumulator.deltas[i] += accumulator.deltas[i];
+
+		if (ctx_id != stream->current.item.hw_id) {
+			stream->current.item.ts_end = ts;
+			stream->current.item.record_end = stream->n_records;
+			stream_push_pending(stream, &stream->current);
+
+			stream_start_item(stream, ts, ctx_id);
+		}
+	}
+
+	memcpy(stream->last_record, header, header->size);
+	stream->last_ts = ts;
+	stream->n_records++;
+
+	if (stream->current.item.record_start == stream->n_records - 1)
+		stream_resolve(stream, false);
+}
+
+/* Reports read before the first correlation could only be extended
+ * from their own 32bits, move them next to it.
+ */
+static void
+stream_rebase_reports(struct intel_perf_data_stream *stream, uint64_t corr_ts)
+{
+	uint64_t offset = corr_ts + (int32_t)((uint32_t) stream->last_ts -
+					      (uint32_t) corr_ts) - stream->last_ts;
+
+	for (uint32_t i = 0; i < stream->n_pending; i++) {
+		stream->pending[stream->pending_head + i].item.ts_start += offset;
+		stream->pending[stream->pending_head + i].item.ts_end += offset;
+	}
+	stream->current.item.ts_start += offset;
+	stream->last_ts += offset;
+}
+
+static void
+stream_add_correlation(struct intel_perf_data_stream *stream,
+		       const struct intel_perf_record_timestamp_correlation *corr)
+{
+	uint64_t ts = corr->gpu_timestamp;
+	struct intel_perf_correlation_point point = {
+		.gpu_ts = ts,
+		.cpu_ts = corr->cpu_timestamp,
+	};
+
+	if (!stream->n_correlations) {
+		if (stream->n_records)
+			stream_rebase_reports(stream, ts);
+	} else {
+		uint64_t delta = ts - stream->last_correlation_ts;
+
+		if (ts < stream->last_correlation_ts)
+			delta &= correlation_wrap_mask(stream->max_correlation_ts);
+
+		point.gpu_ts = stream->correlation_points[1].gpu_ts + delta;
+	}
+
+	stream->correlation_points[0] = stream->correlation_points[1];
+	stream->correlation_points[1] = point;
+	stream->last_correlation_ts = ts;
+	stream->max_correlation_ts = MAX(stream->max_correlation_ts, ts);
+	stream->n_correlations++;
+
+	stream_resolve(stream, false);
+}
+
+static void
+stream_finish(struct intel_perf_data_stream *stream)
+{
+	if (stream->n_records &&
+	    stream->current.item.record_start != stream->n_records - 1) {
+		stream->current.item.ts_end = stream->last_ts;
+		stream->current.item.record_end = stream->n_records - 1;
+		stream_push_pending(stream, &stream->current);
+	}
+
+	stream->done = true;
+	stream_resolve(stream, true);
+}
+
+/**
+ * intel_perf_data_stream_init:
+ * @stream: stream reader to initialize
+ * @perf_fd: file descriptor of the recording, a file or a pipe
+ *
+ * Reads the headers of an i915-perf recording, up to the device
+ * information needed to decode the reports. intel_perf_data_stream_fini()
+ * must be called even if this fails.
+ *
+ * Returns: true on success, false with @stream->error_msg set otherwise.
+ */
+bool
+intel_perf_data_stream_init(struct intel_perf_data_stream *stream,
+			    int perf_fd)
+{
+	bool has_info = false;
+
+	memset(stream, 0, sizeof(*stream));
+	stream->fd = perf_fd;
+	stream->buf = malloc(STREAM_BUFFER_SIZE);
+	stream->last_record = malloc(STREAM_RECORD_MAX_SIZE);
+	assert(stream->buf && stream->last_record);
+
+	while (!has_info || !stream->record_topology) {
+		const struct drm_i915_perf_record_header *header =
+			stream_read_record(stream);
+
+		if (!header) {
+			if (!stream->error_msg[0])
+				snprintf(stream->error_msg, sizeof(stream->error_msg),
+					 "Invalid file, missing device or topology info");
+			return false;
+		}
+
+		switch (header->type) {
+		case INTEL_PERF_RECORD_TYPE_VERSION: {
+			const struct intel_perf_record_version *version =
+				(const struct intel_perf_record_version *) (header + 1);
+			if (version->version != INTEL_PERF_RECORD_VERSION) {
+				snprintf(stream->error_msg, sizeof(stream->error_msg),
+					 "Unsupported recording version (%u, expected %u)",
+					 version->version, INTEL_PERF_RECORD_VERSION);
+				return false;
+			}
+			break;
+		}
+
+		case INTEL_PERF_RECORD_TYPE_DEVICE_INFO:
+			if (header->size != sizeof(*header) + sizeof(stream->record_info)) {
+				snprintf(stream->error_msg, sizeof(stream->error_msg),
+					 "Invalid device info record");
+				return false;
+			}
+			memcpy(&stream->record_info, header + 1,
+			       sizeof(stream->record_info));
+			has_info = true;
+			break;
+
+		case INTEL_PERF_RECORD_TYPE_DEVICE_TOPOLOGY:
+			free(stream->record_topology);
+			stream->record_topology = malloc(header->size - sizeof(*header));
+			assert(stream->record_topology);
+			memcpy(stream->record_topology, header + 1,
+			       header->size - sizeof(*header));
+			break;
+
+		case DRM_I915_PERF_RECORD_SAMPLE:
+		case INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION:
+			snprintf(stream->error_msg, sizeof(stream->error_msg),
+				 "Invalid file, missing device or topology info");
+			return false;
+		}
+	}
+
+	stream->perf = perf_for_recording(&stream->record_info,
+					  stream->record_topology,
+					  stream->error_msg,
+					  sizeof(stream->error_msg));
+	if (!stream->perf)
+		return false;
+
+	stream->devinfo = stream->perf->devinfo;
+
+	stream->metric_set_name = stream->record_info.metric_set_name;
+	stream->metric_set_uuid = stream->record_info.metric_set_uuid;
+	stream->metric_set = find_metric_set(stream->perf,
+					     stream->record_info.metric_set_name);
+
+	return true;
+}
+
+/**
+ * intel_perf_data_stream_next:
+ * @stream: stream reader
+ * @item: returned timeline item
+ * @accumulator: returned deltas of the counters over @item, or NULL
+ *
+ * Reads the recording until the next timeline item and its CPU
+ * timestamps are known. The items and their deltas are the same as the
+ * ones intel_perf_data_reader_init() and
+ * intel_perf_accumulate_reports_batch() give over the whole recording.
+ *
+ * Returns: false at the end of the recording, or on error with
+ * @stream->error_msg set.
+ */
+bool
+intel_perf_data_stream_next(struct intel_perf_data_stream *stream,
+			    struct intel_perf_timeline_item *item,
+			    struct intel_perf_accumulator *accumulator)
+{
+	for (;;) {
+		const struct drm_i915_perf_record_header *header;
+
+		if (stream->n_pending) {
+			const struct intel_perf_data_stream_item *pending =
+				&stream->pending[stream->pending_head];
+
+			if (pending->cpu_ts_start_valid && pending->cpu_ts_end_valid) {
+				*item = pending->item;
+				if (accumulator)
+					*accumulator = pending->accumulator;
+
+				stream->pending_head++;
+				if (!--stream->n_pending)
+					stream->pending_head = 0;
+				stream->n_timelines++;
+				return true;
+			}
+		}
+
+		if (stream->done || stream->error_msg[0])
+			return false;
+
+		header = stream_read_record(stream);
+		if (!header) {
+			if (!stream->error_msg[0])
+				stream_finish(stream);
+			continue;
+		}
+
+		switch (header->type) {
+		case DRM_I915_PERF_RECORD_SAMPLE:
+			stream_add_sample(stream, header);
+			break;
+
+		case INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION:
+			stream_add_correlation(stream,
+					       (const struct intel_perf_record_timestamp_correlation *) (header + 1));
+			break;
+		}
+	}
+}
+
+/**
+ * intel_perf_data_stream_fini:
+ * @stream: stream reader
+ *
+ * Frees the resources of @stream. The file descriptor is left open.
+ */
+void
+intel_perf_data_stream_fini(struct intel_perf_data_stream *stream)
+{
+	if (stream->perf)
+		intel_perf_free(stream->perf);
+	free(stream->record_topology);
+	free(stream->pending);
+	free(stream->last_record);
+	free(stream->buf);
+	memset(stream, 0, sizeof(*stream));
+}
@@ -35,7 +35,13 @@ extern "C" {
 #include "perf.h"
 #include "perf_data.h"
 
+struct intel_perf_correlation_point {
+	uint64_t gpu_ts;
+	uint64_t cpu_ts;
+};
+
 struct intel_perf_timeline_item {
+	/* GPU timestamps, extended to 64bits */
 	uint64_t ts_start;
 	uint64_t ts_end;
 	uint64_t cpu_ts_start;
@@ -69,12 +75,10 @@ struct intel_perf_data_reader {
 	uint32_t n_correlations;
 	uint32_t n_allocated_correlations;
 
-	struct {
-		uint64_t gpu_ts_begin;
-		uint64_t gpu_ts_end;
-		uint32_t idx;
-	} correlation_chunks[4];
-	uint32_t n_correlation_chunks;
+	/* Correlations with their GPU timestamps extended to 64bits,
+	 * sorted by GPU timestamp (n_correlations entries).
+	 */
+	struct intel_perf_correlation_point *correlation_points;
 
 	const char *metric_set_uuid;
 	const char *metric_set_name;
@@ -98,6 +102,71 @@ bool intel_perf_data_reader_init(struct intel_perf_data_reader *reader,
 				 int perf_file_fd);
 void intel_perf_data_reader_fini(struct intel_perf_data_reader *reader);
 
+/* Timeline item waiting for the correlations around it. */
+struct intel_perf_data_stream_item {
+	struct intel_perf_timeline_item item;
+	struct intel_perf_accumulator accumulator;
+	bool cpu_ts_start_valid;
+	bool cpu_ts_end_valid;
+};
+
+/* Incremental reader, for recordings too large to map or coming from a
+ * pipe. Timeline items are produced as soon as the correlations around
+ * them have been read, only a few records are kept in memory at any
+ * time.
+ */
+struct intel_perf_data_stream {
+	int fd;
+	bool eof;
+	bool done;
+
+	/* Read buffer, large enough for any record */
+	uint8_t *buf;
+	size_t buf_start;
+	size_t buf_end;
+
+	struct intel_perf_record_device_info record_info;
+	struct intel_perf_record_device_topology *record_topology;
+
+	const char *metric_set_name;
+	const char *metric_set_uuid;
+
+	struct intel_perf_devinfo devinfo;
+
+	struct intel_perf *perf;
+	struct intel_perf_metric_set *metric_set;
+
+	/* Counts of what has been read so far */
+	uint32_t n_records;
+	uint32_t n_timelines;
+	uint32_t n_correlations;
+
+	/* Last two correlation points, GPU timestamps extended to 64bits */
+	struct intel_perf_correlation_point correlation_points[2];
+	uint64_t last_correlation_ts;
+	uint64_t max_correlation_ts;
+
+	/* Last report read and the timeline item it belongs to */
+	struct drm_i915_perf_record_header *last_record;
+	uint64_t last_ts;
+	struct intel_perf_data_stream_item current;
+
+	/* Completed items waiting for their CPU timestamps */
+	struct intel_perf_data_stream_item *pending;
+	uint32_t pending_head;
+	uint32_t n_pending;
+	uint32_t n_allocated_pending;
+
+	char error_msg[256];
+};
+
+bool intel_perf_data_stream_init(struct intel_perf_data_stream *stream,
+				 int perf_fd);
+bool intel_perf_data_stream_next(struct intel_perf_data_stream *stream,
+				 struct intel_perf_timeline_item *item,
+				 struct intel_perf_accumulator *accumulator);
+void intel_perf_data_stream_fini(struct intel_perf_data_stream *stream);
+
 #ifdef __cplusplus
 };
 #endif
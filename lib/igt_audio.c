@@ -28,8 +28,10 @@
 
 #include <errno.h>
 #include <fcntl.h>
-#include <gsl/gsl_fft_real.h>
+#include <limits.h>
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "igt_audio.h"
@@ -316,35 +318,178 @@ void audio_signal_fill(struct audio_signal *signal, double *buffer,
 	audio_sanity_check(buffer, signal->channels * samples);
 }
 
-/* See https://en.wikipedia.org/wiki/Window_function#Hann_and_Hamming_windows */
-static double hann_window(double v, size_t i, size_t N)
+/*
+ * A radix-2 FFT of real input, done as a complex FFT of half the length
+ * over the even and odd samples followed by a split step. Everything that
+ * only depends on the length, the bit reversal permutation and the
+ * twiddle factors, is computed once when the plan is created.
+ */
+struct fft_plan {
+	size_t len;		/* real samples, a power of two */
+	size_t *bitrev;		/* len / 2 */
+	double *tw_re, *tw_im;	/* exp(-2 pi i k / len), k < len / 2 */
+	double *re, *im;	/* len / 2 */
+};
+
+static void fft_plan_init(struct fft_plan *fft, size_t len)
+{
+	size_t half = len / 2;
+	unsigned int bits = 0;
+	size_t i;
+
+	igt_assert_f(len >= 2 && (len & (len - 1)) == 0,
+		     "FFT length %zu isn't a power of two\n", len);
+
+	while ((1ul << bits) < half)
+		bits++;
+
+	fft->len = len;
+	fft->bitrev = malloc(half * sizeof(*fft->bitrev));
+	fft->tw_re = malloc(half * sizeof(double));
+	fft->tw_im = malloc(half * sizeof(double));
+	fft->re = malloc(half * sizeof(double));
+	fft->im = malloc(half * sizeof(double));
+	igt_assert(fft->bitrev && fft->tw_re && fft->tw_im &&
+		   fft->re && fft->im);
+
+	for (i = 0; i < half; i++) {
+		size_t r = 0;
+
+		for (unsigned int b = 0; b < bits; b++)
+			if (i & (1ul << b))
+				r |= 1ul << (bits - 1 - b);
+		fft->bitrev[i] = r;
+
+		fft->tw_re[i] = cos(2.0 * M_PI * i / len);
+		fft->tw_im[i] = -sin(2.0 * M_PI * i / len);
+	}
+}
+
+static void fft_plan_fini(struct fft_plan *fft)
 {
-	return v * 0.5 * (1 - cos(2.0 * M_PI * (double) i / (double) N));
+	free(fft->bitrev);
+	free(fft->tw_re);
+	free(fft->tw_im);
+	free(fft->re);
+	free(fft->im);
 }
 
+/*
+ * Computes the magnitude of the first len / 2 + 1 terms of the DFT of
+ * @in into @mag, except for the first and the last ones, which are purely
+ * real and stored as such.
+ */
+static void fft_real_magnitude(struct fft_plan *fft, const double *in,
+			       double *mag)
+{
+	size_t half = fft->len / 2;
+	double *re = fft->re, *im = fft->im;
+	size_t i, k, size;
+
+	for (i = 0; i < half; i++) {
+		re[fft->bitrev[i]] = in[2 * i];
+		im[fft->bitrev[i]] = in[2 * i + 1];
+	}
+
+	/* The twiddles of a half length FFT are every other one of ours */
+	for (size = 2; size <= half; size *= 2) {
+		size_t step = fft->len / size;
+
+		for (i = 0; i < half; i += size) {
+			for (k = 0; k < size / 2; k++) {
+				size_t a = i + k, b = a + size / 2;
+				double wr = fft->tw_re[k * step];
+				double wi = fft->tw_im[k * step];
+				double tr = re[b] * wr - im[b] * wi;
+				double ti = re[b] * wi + im[b] * wr;
+
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+
+	/*
+	 * With Z the DFT of the even + i * odd samples, the DFT X of the real
+	 * input is, for 0 < k < len / 2:
+	 *   X[k] = (Z[k] + Z*[half - k]) / 2 -
+	 *          i * W^k * (Z[k] - Z*[half - k]) / 2
+	 */
+	mag[0] = re[0] + im[0];
+	mag[half] = re[0] - im[0];
+	for (k = 1; k < half; k++) {
+		double even_re = (re[k] + re[half - k]) / 2;
+		double even_im = (im[k] - im[half - k]) / 2;
+		double odd_re = (im[k] + im[half - k]) / 2;
+		double odd_im = -(re[k] - re[half - k]) / 2;
+
+		mag[k] = hypot(even_re + odd_re * fft->tw_re[k] - odd_im * fft->tw_im[k],
+			       even_im + odd_re * fft->tw_im[k] + odd_im * fft->tw_re[k]);
+	}
+}
+
+struct audio_signal_detector {
+	struct audio_signal *signal;
+	int sampling_rate;
+	int channel;
+
+	struct fft_plan fft;
+	size_t window_len;
+	double *window;		/* Hann coefficients */
+	double *samples;	/* pending input, up to window_len */
+	size_t samples_len;
+	double *windowed;	/* window_len */
+	double *mag;		/* window_len / 2 + 1 */
+	double *bin_power;	/* window_len / 2 + 1, summed over windows */
+	size_t windows;
+};
+
 /**
- * Checks that frequencies specified in signal, and only those, are included
- * in the input data.
+ * audio_signal_detector_init:
+ * @signal: The signal expected to be found
+ * @sampling_rate: The sampling rate of the input, in Hz
+ * @channel: The channel of @signal the input was captured from
+ * @window_len: The length of the FFT windows, a power of two
+ *
+ * Creates a detector checking that the frequencies of @signal for
+ * @channel, and only those, are in an input fed piecewise with
+ * audio_signal_detector_feed(). The input is cut in windows of
+ * @window_len samples overlapping by half, and the power of each window
+ * is averaged into the spectrum which audio_signal_detector_check() looks
+ * at. Only a window worth of input is ever kept around, whatever the
+ * length of the capture.
  *
- * sampling_rate is given in Hz. samples_len is the number of elements in
- * samples.
+ * The frequency resolution is @sampling_rate / @window_len.
+ *
+ * Returns: A newly-allocated detector, to be freed with
+ * audio_signal_detector_fini().
  */
-bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
-			 int channel, const double *samples, size_t samples_len)
+struct audio_signal_detector *
+audio_signal_detector_init(struct audio_signal *signal, int sampling_rate,
+			   int channel, size_t window_len)
 {
-	double *data;
-	size_t data_len = samples_len;
-	size_t bin_power_len = data_len / 2 + 1;
-	double bin_power[bin_power_len];
-	bool detected[FREQS_MAX];
-	int ret, freq_accuracy, freq, local_max_freq;
-	double max, local_max, threshold;
-	size_t i, j;
-	bool above, success;
+	struct audio_signal_detector *det;
+	size_t i;
 
-	/* gsl will mutate the array in-place, so make a copy */
-	data = malloc(samples_len * sizeof(double));
-	memcpy(data, samples, samples_len * sizeof(double));
+	det = calloc(1, sizeof(*det));
+	igt_assert(det);
+
+	det->signal = signal;
+	det->sampling_rate = sampling_rate;
+	det->channel = channel;
+	det->window_len = window_len;
+
+	fft_plan_init(&det->fft, window_len);
+
+	det->window = malloc(window_len * sizeof(double));
+	det->samples = malloc(window_len * sizeof(double));
+	det->windowed = malloc(window_len * sizeof(double));
+	det->mag = malloc((window_len / 2 + 1) * sizeof(double));
+	det->bin_power = calloc(window_len / 2 + 1, sizeof(double));
+	igt_assert(det->window && det->samples && det->windowed &&
+		   det->mag && det->bin_power);
 
 	/* Apply a Hann window to the input signal, to reduce frequency leaks
 	 * due to the endpoints of the signal being discontinuous.
@@ -353,38 +498,158 @@ bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
 	 * - https://download.ni.com/evaluation/pxi/Understanding%20FFTs%20and%20Windowing.pdf
 	 * - https://en.wikipedia.org/wiki/Window_function
 	 */
-	for (i = 0; i < data_len; i++)
-		data[i] = hann_window(data[i], i, data_len);
+	for (i = 0; i < window_len; i++)
+		det->window[i] = 0.5 * (1 - cos(2.0 * M_PI * i / window_len));
+
+	return det;
+}
+
+/**
+ * audio_signal_detector_fini:
+ * @det: The detector
+ *
+ * Release the detector.
+ */
+void audio_signal_detector_fini(struct audio_signal_detector *det)
+{
+	fft_plan_fini(&det->fft);
+	free(det->window);
+	free(det->samples);
+	free(det->windowed);
+	free(det->mag);
+	free(det->bin_power);
+	free(det);
+}
+
+/**
+ * audio_signal_detector_reset:
+ * @det: The detector
+ *
+ * Forget about all the input fed so far, to start checking a new one.
+ */
+void audio_signal_detector_reset(struct audio_signal_detector *det)
+{
+	memset(det->bin_power, 0, (det->window_len / 2 + 1) * sizeof(double));
+	det->samples_len = 0;
+	det->windows = 0;
+}
+
+static void audio_signal_detector_window(struct audio_signal_detector *det)
+{
+	size_t len = det->window_len;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		det->windowed[i] = det->samples[i] * det->window[i];
+
+	fft_real_magnitude(&det->fft, det->windowed, det->mag);
+
+	for (i = 0; i < len / 2 + 1; i++)
+		det->bin_power[i] += det->mag[i];
+	det->windows++;
+
+	/* The next window starts halfway through this one */
+	memmove(det->samples, det->samples + len / 2,
+		(len - len / 2) * sizeof(double));
+	det->samples_len = len - len / 2;
+}
+
+/**
+ * audio_signal_detector_feed:
+ * @det: The detector
+ * @samples: The next samples of the input
+ * @samples_len: The number of elements in @samples
+ *
+ * Feeds the detector with the next part of its input.
+ */
+void audio_signal_detector_feed(struct audio_signal_detector *det,
+				const double *samples, size_t samples_len)
+{
+	while (samples_len) {
+		size_t n = det->window_len - det->samples_len;
+
+		if (n > samples_len)
+			n = samples_len;
+
+		memcpy(det->samples + det->samples_len, samples,
+		       n * sizeof(double));
+		det->samples_len += n;
+		samples += n;
+		samples_len -= n;
+
+		if (det->samples_len == det->window_len)
+			audio_signal_detector_window(det);
+	}
+}
+
+/**
+ * audio_signal_detector_feed_s32_le:
+ * @det: The detector
+ * @src: The next frames of a multi-channel S32_LE input
+ * @src_len: The number of elements in @src
+ * @n_channels: The number of channels of @src
+ * @channel: The channel of @src to feed the detector with
+ *
+ * Same as audio_signal_detector_feed(), straight from a buffer of
+ * interleaved samples, as received from the capture device.
+ */
+void audio_signal_detector_feed_s32_le(struct audio_signal_detector *det,
+				       const int32_t *src, size_t src_len,
+				       int n_channels, int channel)
+{
+	size_t i;
+
+	igt_assert(channel < n_channels);
+	igt_assert(src_len % n_channels == 0);
+
+	for (i = channel; i < src_len; i += n_channels) {
+		det->samples[det->samples_len++] = (double) src[i] / INT32_MAX;
+
+		if (det->samples_len == det->window_len)
+			audio_signal_detector_window(det);
+	}
+}
+
+/**
+ * audio_signal_detector_check:
+ * @det: The detector
+ *
+ * Checks that the frequencies of the signal, and only those, are included
+ * in the input fed so far. Input that doesn't fill a whole window yet is
+ * left out.
+ *
+ * Returns: Whether the signal was found, false if the detector wasn't fed
+ * a whole window yet.
+ */
+bool audio_signal_detector_check(struct audio_signal_detector *det)
+{
+	struct audio_signal *signal = det->signal;
+	int sampling_rate = det->sampling_rate;
+	int channel = det->channel;
+	size_t data_len = det->window_len;
+	size_t bin_power_len = data_len / 2 + 1;
+	double *bin_power = det->mag;
+	bool detected[FREQS_MAX];
+	int freq_accuracy, freq, local_max_freq;
+	double max, local_max, threshold;
+	size_t i, j;
+	bool above, success;
+
+	if (!det->windows)
+		return false;
 
 	/* Allowed error in Hz due to FFT step */
 	freq_accuracy = sampling_rate / data_len;
 	igt_debug("Allowed freq. error: %d Hz\n", freq_accuracy);
 
-	ret = gsl_fft_real_radix2_transform(data, 1, data_len);
-	if (ret != 0) {
-		free(data);
-		igt_assert(0);
-	}
-
-	/* Compute the power received by every bin of the FFT.
-	 *
-	 * For i < data_len / 2, the real part of the i-th term is stored at
-	 * data[i] and its imaginary part is stored at data[data_len - i].
-	 * i = 0 and i = data_len / 2 are special cases, they are purely real
-	 * so their imaginary part isn't stored.
+	/* Average and normalize the power received by every bin of the FFT.
 	 *
 	 * The power is encoded as the magnitude of the complex number and the
-	 * phase is encoded as its angle.
+	 * phase is encoded as its angle. The terms for 0 and data_len / 2 are
+	 * purely real and kept as such.
 	 */
-	bin_power[0] = data[0];
-	for (i = 1; i < bin_power_len - 1; i++) {
-		bin_power[i] = hypot(data[i], data[data_len - i]);
-	}
-	bin_power[bin_power_len - 1] = data[data_len / 2];
-
-	/* Normalize the power */
 	for (i = 0; i < bin_power_len; i++)
-		bin_power[i] = 2 * bin_power[i] / data_len;
+		bin_power[i] = 2 * det->bin_power[i] / det->windows / data_len;
 
 	/* Detect noise with a threshold on the power of low frequencies */
 	for (i = 0; i < bin_power_len; i++) {
@@ -487,7 +752,34 @@ bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
 		}
 	}
 
-	free(data);
+	return success;
+}
+
+/**
+ * audio_signal_detect:
+ * @signal: The signal expected to be found
+ * @sampling_rate: The sampling rate of @samples, in Hz
+ * @channel: The channel of @signal @samples was captured from
+ * @samples: The input
+ * @samples_len: The number of elements in @samples, a power of two
+ *
+ * Checks that frequencies specified in signal, and only those, are included
+ * in the input data, with a single FFT over the whole input. See
+ * audio_signal_detector_init() to check long inputs as they arrive.
+ *
+ * Returns: Whether the signal was found.
+ */
+bool audio_signal_detect(struct audio_signal *signal, int sampling_rate,
+			 int channel, const double *samples, size_t samples_len)
+{
+	struct audio_signal_detector *det;
+	bool success;
+
+	det = audio_signal_detector_init(signal, sampling_rate, channel,
+					 samples_len);
+	audio_signal_detector_feed(det, samples, samples_len);
+	success = audio_signal_detector_check(det);
+	audio_signal_detector_fini(det);
 
 	return success;
 }
@@ -37,6 +37,7 @@
 #include <cairo.h>
 
 #include "igt_chamelium.h"
+#include "igt_chamelium_stream.h"
 #include "igt_core.h"
 #include "igt_aux.h"
 #include "igt_edid.h"
@@ -65,6 +66,7 @@
  * |[<!-- language="plain" -->
  *	[Chamelium]
  *	URL=http://chameleon:9992 # The URL used for connecting to the Chamelium's RPC server
+ *	StreamPort=9994 # Optional, the port of the Chamelium's stream server
  *
  *	# The rest of the sections are used for defining connector mappings.
  *	# This is required so any tests using the Chamelium know which connector
@@ -80,6 +82,13 @@
  *	ChameliumPortID=3
  * ]|
  *
+ * Captured frames are read over XML-RPC, base64 encoded inside XML. The stream
+ * server of the Chamelium emulator can also send them as raw pixels, through
+ * an extension of the stream protocol which boards don't implement, and is
+ * used instead when it advertises it.
+ *
+ * See chamelium_emulator_create() for running against a local stand-in instead
+ * of a board.
  */
 
 /*
@@ -113,10 +122,30 @@ struct chamelium_frame_dump {
 	struct chamelium_port *port;
 };
 
+#define CHAMELIUM_CRC_LANES 4
+
+struct chamelium_crc_lanes {
+	uint64_t sum[CHAMELIUM_CRC_LANES];
+	uint64_t weighted[CHAMELIUM_CRC_LANES];
+	uint64_t count[CHAMELIUM_CRC_LANES];
+};
+
+struct chamelium_fb_crc_work {
+	const unsigned char *buffer;
+	int start, end;
+
+	pthread_t thread_id;
+	struct chamelium_crc_lanes lanes;
+};
+
+#define CHAMELIUM_CRC_MAX_THREADS 8
+#define CHAMELIUM_CRC_MIN_THREAD_PIXELS (256 * 1024)
+
 struct chamelium_fb_crc_async_data {
 	cairo_surface_t *fb_surface;
 
-	pthread_t thread_id;
+	struct chamelium_fb_crc_work work[CHAMELIUM_CRC_MAX_THREADS];
+	int num_threads;
 	igt_crc_t *ret;
 };
 
@@ -128,6 +157,11 @@ struct chamelium {
 	/* Indicates the last port to have been used for capturing video */
 	struct chamelium_port *capturing_port;
 
+	/* Stream client for frame transfers, if the server can send them */
+	struct chamelium_stream *stream;
+	int stream_port;
+	bool stream_probed;
+
 	int drm_fd;
 
 	struct igt_list_head edids;
@@ -444,6 +478,39 @@ static void *chamelium_fsm_mon(void *data)
 
 #define _RECEIVER_RESPONSIVE_AFTER_RESET_SECONDS 10
 
+/* Unfortunately xmlrpc_client's event loop helpers are rather useless
+ * for implementing any sort of event loop, since they provide no way
+ * to poll for events other then the RPC response. This means in order
+ * to handle the chamelium attempting FSM, we have to fork into another
+ * thread and have that handle hotplugging displays
+ */
+static void chamelium_fsm_start(struct chamelium *chamelium,
+				struct chamelium_port *fsm_port,
+				struct fsm_monitor_args *monitor_args,
+				pthread_t *fsm_thread_id)
+{
+	if (fsm_port && fsm_port->connector_id &&
+	    igt_chamelium_allow_fsm_handling) {
+		monitor_args->chamelium = chamelium;
+		monitor_args->port = fsm_port;
+		monitor_args->mon = igt_watch_uevents();
+		pthread_create(fsm_thread_id, NULL, chamelium_fsm_mon,
+			       monitor_args);
+	}
+}
+
+static void chamelium_fsm_stop(struct chamelium_port *fsm_port,
+			       struct fsm_monitor_args *monitor_args,
+			       pthread_t fsm_thread_id)
+{
+	if (fsm_port && fsm_port->connector_id &&
+	    igt_chamelium_allow_fsm_handling) {
+		pthread_cancel(fsm_thread_id);
+		pthread_join(fsm_thread_id, NULL);
+		igt_cleanup_uevents(monitor_args->mon);
+	}
+}
+
 static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
 					struct chamelium_port *fsm_port,
 					const char *method_name,
@@ -454,19 +521,7 @@ static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
 	struct fsm_monitor_args monitor_args;
 	pthread_t fsm_thread_id;
 
-	/* Unfortunately xmlrpc_client's event loop helpers are rather useless
-	 * for implementing any sort of event loop, since they provide no way
-	 * to poll for events other then the RPC response. This means in order
-	 * to handle the chamelium attempting FSM, we have to fork into another
-	 * thread and have that handle hotplugging displays
-	 */
-	if (fsm_port && igt_chamelium_allow_fsm_handling) {
-		monitor_args.chamelium = chamelium;
-		monitor_args.port = fsm_port;
-		monitor_args.mon = igt_watch_uevents();
-		pthread_create(&fsm_thread_id, NULL, chamelium_fsm_mon,
-			       &monitor_args);
-	}
+	chamelium_fsm_start(chamelium, fsm_port, &monitor_args, &fsm_thread_id);
 
 	igt_until_timeout(_RECEIVER_RESPONSIVE_AFTER_RESET_SECONDS) {
 		/* Cleanup the last error, if any */
@@ -488,11 +543,7 @@ static xmlrpc_value *__chamelium_rpc_va(struct chamelium *chamelium,
 		/* i2c error, let's try to retry */
 	}
 
-	if (fsm_port && igt_chamelium_allow_fsm_handling) {
-		pthread_cancel(fsm_thread_id);
-		pthread_join(fsm_thread_id, NULL);
-		igt_cleanup_uevents(monitor_args.mon);
-	}
+	chamelium_fsm_stop(fsm_port, &monitor_args, fsm_thread_id);
 
 	return res;
 }
@@ -1168,6 +1219,39 @@ static struct chamelium_frame_dump *frame_from_xml(struct chamelium *chamelium,
 	return ret;
 }
 
+/*
+ * Returns the stream client to read frames with, or NULL to use XML-RPC. The
+ * stream server is tried once, and left alone after any failure.
+ */
+static struct chamelium_stream *chamelium_frame_stream(struct chamelium *chamelium)
+{
+	if (chamelium->stream_probed)
+		return chamelium->stream;
+
+	chamelium->stream_probed = true;
+	chamelium->stream = __chamelium_stream_init(chamelium->url,
+						    chamelium->stream_port,
+						    true);
+	if (chamelium->stream &&
+	    !chamelium_stream_supports_frames(chamelium->stream)) {
+		chamelium_stream_deinit(chamelium->stream);
+		chamelium->stream = NULL;
+	}
+
+	igt_debug("Reading Chamelium frames over %s\n",
+		  chamelium->stream ? "the stream server" : "XML-RPC");
+
+	return chamelium->stream;
+}
+
+static void chamelium_frame_stream_failed(struct chamelium *chamelium)
+{
+	igt_debug("Chamelium stream failed, falling back to XML-RPC\n");
+
+	chamelium_stream_deinit(chamelium->stream);
+	chamelium->stream = NULL;
+}
+
 /**
  * chamelium_port_dump_pixels:
  * @chamelium: The Chamelium instance to use
@@ -1203,13 +1287,38 @@ struct chamelium_frame_dump *chamelium_port_dump_pixels(struct chamelium *chamel
 							int x, int y,
 							int w, int h)
 {
+	struct chamelium_stream *stream = chamelium_frame_stream(chamelium);
 	xmlrpc_value *res;
 	struct chamelium_frame_dump *frame;
 
+	chamelium->capturing_port = port;
+
+	if (stream) {
+		struct fsm_monitor_args monitor_args;
+		pthread_t fsm_thread_id;
+		bool ok;
+
+		frame = malloc(sizeof(*frame));
+		frame->port = port;
+
+		chamelium_fsm_start(chamelium, port, &monitor_args,
+				    &fsm_thread_id);
+		ok = chamelium_stream_dump_pixels(stream, port->id,
+						  x, y, w, h,
+						  &frame->width, &frame->height,
+						  &frame->bgr, &frame->size);
+		chamelium_fsm_stop(port, &monitor_args, fsm_thread_id);
+
+		if (ok)
+			return frame;
+
+		free(frame);
+		chamelium_frame_stream_failed(chamelium);
+	}
+
 	res = chamelium_rpc(chamelium, port, "DumpPixels",
 			    (w && h) ? "(iiiii)" : "(innnn)",
 			    port->id, x, y, w, h);
-	chamelium->capturing_port = port;
 
 	frame = frame_from_xml(chamelium, res);
 	xmlrpc_DECREF(res);
@@ -1410,9 +1519,25 @@ igt_crc_t *chamelium_read_captured_crcs(struct chamelium *chamelium,
 struct chamelium_frame_dump *chamelium_read_captured_frame(struct chamelium *chamelium,
 							   unsigned int index)
 {
+	struct chamelium_stream *stream = chamelium_frame_stream(chamelium);
 	xmlrpc_value *res;
 	struct chamelium_frame_dump *frame;
 
+	if (stream) {
+		frame = malloc(sizeof(*frame));
+		frame->port = chamelium->capturing_port;
+
+		if (chamelium_stream_read_captured_frame(stream, index,
+							 &frame->width,
+							 &frame->height,
+							 &frame->bgr,
+							 &frame->size))
+			return frame;
+
+		free(frame);
+		chamelium_frame_stream_failed(chamelium);
+	}
+
 	res = chamelium_rpc(chamelium, NULL, "ReadCapturedFrame", "(i)", index);
 	frame = frame_from_xml(chamelium, res);
 	xmlrpc_DECREF(res);
@@ -1687,7 +1812,16 @@ static pixman_image_t *convert_frame_format(pixman_image_t *src,
 	return converted;
 }
 
-static cairo_surface_t *convert_frame_dump_argb32(const struct chamelium_frame_dump *dump)
+/**
+ * chamelium_frame_dump_to_surface:
+ * @dump: The frame dump to convert
+ *
+ * Converts a frame dump, for comparing it or writing it out.
+ *
+ * Returns: a new ARGB32 surface with the pixels of @dump, to be destroyed by
+ * the caller with cairo_surface_destroy()
+ */
+cairo_surface_t *chamelium_frame_dump_to_surface(const struct chamelium_frame_dump *dump)
 {
 	cairo_surface_t *dump_surface;
 	pixman_image_t *image_bgr;
@@ -1829,7 +1963,7 @@ void chamelium_assert_crc_eq_or_dump(struct chamelium *chamelium,
 		igt_assert(frame);
 
 		/* Convert the captured frame to cairo. */
-		capture = convert_frame_dump_argb32(frame);
+		capture = chamelium_frame_dump_to_surface(frame);
 		igt_assert(capture);
 
 		compared_frames_dump(reference, capture, reference_crc,
@@ -1891,7 +2025,7 @@ bool chamelium_frame_match_or_dump(struct chamelium *chamelium,
 	reference = igt_get_cairo_surface(chamelium->drm_fd, fb);
 
 	/* Grab the captured frame from chamelium */
-	capture = convert_frame_dump_argb32(frame);
+	capture = chamelium_frame_dump_to_surface(frame);
 
 	switch (check) {
 	case CHAMELIUM_CHECK_ANALOG:
@@ -2054,54 +2188,178 @@ int chamelium_get_frame_limit(struct chamelium *chamelium,
 	return ret;
 }
 
-static uint32_t chamelium_xrgb_hash16(const unsigned char *buffer, int width,
-				      int height, int k, int m)
+/*
+ * The Chamelium CRC is made of four 16 bit hashes, hash k covering the pixels
+ * i with i % 4 == k. Each is folded from
+ *
+ *	sum = 1 * v(k) + 2 * v(4 + k) + 3 * v(8 + k) + ...
+ *
+ * with v the 24 bit RGB value of a pixel. To compute all four in a single
+ * pass without multiplications, every lane keeps the plain sum of its values
+ * and the sum of those running sums, from which
+ *
+ *	sum = (count + 1) * plain - weighted
+ *
+ * All of it wraps around at 64 bits just like the direct sum does, so the
+ * result is exact, and parts of a frame can be hashed on their own and merged
+ * in order afterwards.
+ */
+static void chamelium_xrgb_hash_lanes(const unsigned char *buffer,
+				      int start, int end,
+				      struct chamelium_crc_lanes *lanes)
 {
-	unsigned char r, g, b;
-	uint64_t sum = 0;
-	uint64_t count = 0;
-	uint64_t value;
-	uint32_t hash;
-	int index;
-	int i;
+	uint64_t sum[CHAMELIUM_CRC_LANES] = {};
+	uint64_t weighted[CHAMELIUM_CRC_LANES] = {};
+	const unsigned char *p;
+	int i, k;
 
-	for (i=0; i < width * height; i++) {
-		if ((i % m) != k)
-			continue;
+	igt_assert(start % CHAMELIUM_CRC_LANES == 0);
+
+	for (i = start; i + CHAMELIUM_CRC_LANES <= end;
+	     i += CHAMELIUM_CRC_LANES) {
+		p = buffer + i * 4;
+
+		for (k = 0; k < CHAMELIUM_CRC_LANES; k++, p += 4) {
+			sum[k] += p[2] | (p[1] << 8) | (p[0] << 16);
+			weighted[k] += sum[k];
+		}
+	}
 
-		index = i * 4;
+	for (k = 0; i < end; i++, k++) {
+		p = buffer + i * 4;
 
-		r = buffer[index + 2];
-		g = buffer[index + 1];
-		b = buffer[index + 0];
+		sum[k] += p[2] | (p[1] << 8) | (p[0] << 16);
+		weighted[k] += sum[k];
+	}
 
-		value = r | (g << 8) | (b << 16);
-		sum += ++count * value;
+	for (k = 0; k < CHAMELIUM_CRC_LANES; k++) {
+		lanes->sum[k] = sum[k];
+		lanes->weighted[k] = weighted[k];
+		lanes->count[k] = (end - start - k + CHAMELIUM_CRC_LANES - 1) /
+				  CHAMELIUM_CRC_LANES;
 	}
+}
 
-	hash = ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+/* Append the lanes of the next part of the frame to @acc. */
+static void chamelium_crc_lanes_merge(struct chamelium_crc_lanes *acc,
+				      const struct chamelium_crc_lanes *next)
+{
+	int k;
 
-	return hash;
+	for (k = 0; k < CHAMELIUM_CRC_LANES; k++) {
+		acc->weighted[k] += next->weighted[k] +
+				    next->count[k] * acc->sum[k];
+		acc->sum[k] += next->sum[k];
+		acc->count[k] += next->count[k];
+	}
 }
 
-static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
-					  igt_crc_t *out)
+static void chamelium_crc_lanes_finish(const struct chamelium_crc_lanes *lanes,
+				       igt_crc_t *out)
+{
+	int i, k;
+
+	for (i = 0; i < CHAMELIUM_CRC_LANES; i++) {
+		uint64_t sum;
+
+		k = CHAMELIUM_CRC_LANES - i - 1;
+		sum = (lanes->count[k] + 1) * lanes->sum[k] -
+		      lanes->weighted[k];
+
+		out->crc[i] = ((sum >> 0) ^ (sum >> 16) ^
+			       (sum >> 32) ^ (sum >> 48)) & 0xffff;
+	}
+
+	out->n_words = CHAMELIUM_CRC_LANES;
+}
+
+static void *chamelium_calculate_fb_crc_async_work(void *data)
 {
-	unsigned char *buffer;
-	int n = 4;
-	int w, h;
-	int i, j;
+	struct chamelium_fb_crc_work *work = data;
+
+	chamelium_xrgb_hash_lanes(work->buffer, work->start, work->end,
+				  &work->lanes);
 
-	buffer = cairo_image_surface_get_data(fb_surface);
-	w = cairo_image_surface_get_width(fb_surface);
-	h = cairo_image_surface_get_height(fb_surface);
+	return NULL;
+}
+
+/* Hashes the pixels in @n parts, each on its own thread. */
+static void chamelium_crc_launch(struct chamelium_fb_crc_async_data *fb_crc,
+				 const unsigned char *buffer, int pixels, int n)
+{
+	int part, i;
+
+	/* Parts have to start on a whole group of lanes. */
+	part = pixels / n & ~(CHAMELIUM_CRC_LANES - 1);
 
 	for (i = 0; i < n; i++) {
-		j = n - i - 1;
-		out->crc[i] = chamelium_xrgb_hash16(buffer, w, h, j, n);
+		struct chamelium_fb_crc_work *work = &fb_crc->work[i];
+
+		work->buffer = buffer;
+		work->start = i * part;
+		work->end = i == n - 1 ? pixels : (i + 1) * part;
+
+		igt_assert_eq(pthread_create(&work->thread_id, NULL,
+					     chamelium_calculate_fb_crc_async_work,
+					     work), 0);
 	}
+	fb_crc->num_threads = n;
+}
+
+static void chamelium_crc_join(struct chamelium_fb_crc_async_data *fb_crc,
+			       igt_crc_t *out)
+{
+	struct chamelium_crc_lanes *lanes = &fb_crc->work[0].lanes;
+	int i;
 
-	out->n_words = n;
+	for (i = 0; i < fb_crc->num_threads; i++) {
+		pthread_join(fb_crc->work[i].thread_id, NULL);
+		if (i)
+			chamelium_crc_lanes_merge(lanes,
+						  &fb_crc->work[i].lanes);
+	}
+
+	chamelium_crc_lanes_finish(lanes, out);
+}
+
+/**
+ * chamelium_calculate_crc_pixels:
+ * @pixels: XRGB8888 pixels in system memory, with no padding between rows
+ * @width: the width of the image
+ * @height: the height of the image
+ * @threads: the number of threads to split the calculation across
+ * @out: will be set to the calculated CRC
+ *
+ * Calculates the CRC of an image, using the Chamelium's CRC algorithm. With
+ * more than one thread, the image is split the same way
+ * chamelium_calculate_fb_crc_async_start() splits large framebuffers, while a
+ * single thread hashes it in one pass on the calling thread, like
+ * chamelium_calculate_fb_crc() does.
+ */
+void chamelium_calculate_crc_pixels(const void *pixels, int width, int height,
+				    int threads, igt_crc_t *out)
+{
+	struct chamelium_fb_crc_async_data fb_crc = {};
+	struct chamelium_crc_lanes lanes;
+
+	if (threads > 1) {
+		chamelium_crc_launch(&fb_crc, pixels, width * height,
+				     min(threads, CHAMELIUM_CRC_MAX_THREADS));
+		chamelium_crc_join(&fb_crc, out);
+		return;
+	}
+
+	chamelium_xrgb_hash_lanes(pixels, 0, width * height, &lanes);
+	chamelium_crc_lanes_finish(&lanes, out);
+}
+
+static void chamelium_do_calculate_fb_crc(cairo_surface_t *fb_surface,
+					  igt_crc_t *out)
+{
+	chamelium_calculate_crc_pixels(cairo_image_surface_get_data(fb_surface),
+				       cairo_image_surface_get_width(fb_surface),
+				       cairo_image_surface_get_height(fb_surface),
+				       1, out);
 }
 
 /**
@@ -2129,17 +2387,6 @@ igt_crc_t *chamelium_calculate_fb_crc(int fd, struct igt_fb *fb)
 	return ret;
 }
 
-static void *chamelium_calculate_fb_crc_async_work(void *data)
-{
-	struct chamelium_fb_crc_async_data *fb_crc;
-
-	fb_crc = (struct chamelium_fb_crc_async_data *) data;
-
-	chamelium_do_calculate_fb_crc(fb_crc->fb_surface, fb_crc->ret);
-
-	return NULL;
-}
-
 /**
  * chamelium_calculate_fb_crc_launch:
  * @fd: The drm file descriptor
@@ -2147,7 +2394,7 @@ static void *chamelium_calculate_fb_crc_async_work(void *data)
  *
  * Launches the CRC calculation for the provided framebuffer, using the
  * Chamelium's CRC algorithm. This calculates the CRC in an asynchronous
- * fashion.
+ * fashion, split across several threads for large framebuffers.
  *
  * The returned structure should be passed to a subsequent call to
  * chamelium_calculate_fb_crc_result. It should not be freed.
@@ -2158,6 +2405,8 @@ struct chamelium_fb_crc_async_data *chamelium_calculate_fb_crc_async_start(int f
 									   struct igt_fb *fb)
 {
 	struct chamelium_fb_crc_async_data *fb_crc;
+	const unsigned char *buffer;
+	int pixels, n;
 
 	fb_crc = calloc(1, sizeof(struct chamelium_fb_crc_async_data));
 	fb_crc->ret = calloc(1, sizeof(igt_crc_t));
@@ -2165,8 +2414,15 @@ struct chamelium_fb_crc_async_data *chamelium_calculate_fb_crc_async_start(int f
 	/* Get the cairo surface for the framebuffer */
 	fb_crc->fb_surface = igt_get_cairo_surface(fd, fb);
 
-	pthread_create(&fb_crc->thread_id, NULL,
-		       chamelium_calculate_fb_crc_async_work, fb_crc);
+	buffer = cairo_image_surface_get_data(fb_crc->fb_surface);
+	pixels = cairo_image_surface_get_width(fb_crc->fb_surface) *
+		 cairo_image_surface_get_height(fb_crc->fb_surface);
+
+	n = min(sysconf(_SC_NPROCESSORS_ONLN), CHAMELIUM_CRC_MAX_THREADS);
+	n = min(n, pixels / CHAMELIUM_CRC_MIN_THREAD_PIXELS);
+	n = max(n, 1);
+
+	chamelium_crc_launch(fb_crc, buffer, pixels, n);
 
 	return fb_crc;
 }
@@ -2182,11 +2438,9 @@ struct chamelium_fb_crc_async_data *chamelium_calculate_fb_crc_async_start(int f
  */
 igt_crc_t *chamelium_calculate_fb_crc_async_finish(struct chamelium_fb_crc_async_data *fb_crc)
 {
-	igt_crc_t *ret;
+	igt_crc_t *ret = fb_crc->ret;
 
-	pthread_join(fb_crc->thread_id, NULL);
-
-	ret = fb_crc->ret;
+	chamelium_crc_join(fb_crc, ret);
 	free(fb_crc);
 
 	return ret;
@@ -2270,6 +2524,51 @@ static size_t chamelium_get_video_ports(struct chamelium *chamelium,
 	return port_ids_len;
 }
 
+/**
+ * chamelium_get_unmapped_port:
+ * @chamelium: The Chamelium instance to use
+ * @port_id: The ID of the port on the Chamelium
+ *
+ * Gets a port by its ID on the Chamelium, adding it without a DRM connector if
+ * it isn't configured. This lets instances from #chamelium_init_rpc_only make
+ * the calls which only involve the Chamelium, such as
+ * #chamelium_port_dump_pixels, but not those involving the connector. FSM is
+ * not handled on such ports.
+ *
+ * Returns: the port, or NULL if the Chamelium has no such video port
+ */
+struct chamelium_port *chamelium_get_unmapped_port(struct chamelium *chamelium,
+						   int port_id)
+{
+	int port_ids[CHAMELIUM_MAX_PORTS];
+	struct chamelium_port *port;
+	char name[32];
+	ssize_t count;
+	int i;
+
+	for (i = 0; i < chamelium->port_count; i++)
+		if (chamelium->ports[i].id == port_id)
+			return &chamelium->ports[i];
+
+	count = chamelium_get_video_ports(chamelium, port_ids);
+	for (i = 0; i < count; i++)
+		if (port_ids[i] == port_id)
+			break;
+	if (i >= count)
+		return NULL;
+
+	igt_assert(chamelium->port_count < CHAMELIUM_MAX_PORTS);
+	port = &chamelium->ports[chamelium->port_count++];
+	memset(port, 0, sizeof(*port));
+	port->id = port_id;
+	port->type = chamelium_get_port_type(chamelium, port);
+
+	snprintf(name, sizeof(name), "Chamelium-%d", port_id);
+	port->name = strdup(name);
+
+	return port;
+}
+
 static bool chamelium_read_port_mappings(struct chamelium *chamelium,
 					 int drm_fd)
 {
@@ -2590,6 +2889,11 @@ static bool chamelium_read_config(struct chamelium *chamelium)
 		return false;
 	}
 
+	/* Optional, 0 for the board's usual stream port */
+	chamelium->stream_port = g_key_file_get_integer(igt_key_file,
+							"Chamelium",
+							"StreamPort", NULL);
+
 	return true;
 }
 
@@ -2623,6 +2927,11 @@ static void chamelium_exit_handler(int sig)
  */
 void chamelium_deinit_rpc_only(struct chamelium *chamelium)
 {
+	for (int i = 0; i < chamelium->port_count; i++)
+		free(chamelium->ports[i].name);
+
+	if (chamelium->stream)
+		chamelium_stream_deinit(chamelium->stream);
 	xmlrpc_env_clean(&chamelium->env);
 	free(chamelium);
 }
@@ -2633,8 +2942,9 @@ void chamelium_deinit_rpc_only(struct chamelium *chamelium)
  * Sets up a connection with a chamelium, using the URL specified in the
  * Chamelium configuration. The function initializes only the RPC - no port
  * autodiscovery happens, which means only the functions that do not require
- * struct #chamelium_port can be called with an instance produced by this
- * function.
+ * struct #chamelium_port, or that can do with a port from
+ * #chamelium_get_unmapped_port, can be called with an instance produced by
+ * this function.
  *
  * #chamelium_init is almost always a better choice.
  *
@@ -2789,9 +3099,6 @@ void chamelium_deinit(struct chamelium *chamelium)
 
 	xmlrpc_client_destroy(chamelium->client);
 
-	for (i = 0; i < chamelium->port_count; i++)
-		free(chamelium->ports[i].name);
-
 	chamelium_deinit_rpc_only(chamelium);
 }
 
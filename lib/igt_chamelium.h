@@ -113,6 +113,8 @@ void chamelium_reset(struct chamelium *chamelium);
 
 struct chamelium_port **chamelium_get_ports(struct chamelium *chamelium,
 					    int *count);
+struct chamelium_port *chamelium_get_unmapped_port(struct chamelium *chamelium,
+						   int port_id);
 unsigned int chamelium_port_get_type(const struct chamelium_port *port);
 drmModeConnector *chamelium_port_get_connector(struct chamelium *chamelium,
 					       struct chamelium_port *port,
@@ -215,6 +217,8 @@ struct chamelium_frame_dump *chamelium_port_dump_pixels(struct chamelium *chamel
 							int x, int y,
 							int w, int h);
 igt_crc_t *chamelium_calculate_fb_crc(int fd, struct igt_fb *fb);
+void chamelium_calculate_crc_pixels(const void *pixels, int width, int height,
+				    int threads, igt_crc_t *out);
 struct chamelium_fb_crc_async_data *chamelium_calculate_fb_crc_async_start(int fd,
 									   struct igt_fb *fb);
 igt_crc_t *chamelium_calculate_fb_crc_async_finish(struct chamelium_fb_crc_async_data *fb_crc);
@@ -241,6 +245,7 @@ bool chamelium_frame_match_or_dump(struct chamelium *chamelium,
 				   enum chamelium_check check);
 void chamelium_crop_analog_frame(struct chamelium_frame_dump *dump, int width,
 				 int height);
+cairo_surface_t *chamelium_frame_dump_to_surface(const struct chamelium_frame_dump *dump);
 void chamelium_destroy_frame_dump(struct chamelium_frame_dump *dump);
 void chamelium_destroy_audio_file(struct chamelium_audio_file *audio_file);
 void chamelium_infoframe_destroy(struct chamelium_infoframe *infoframe);
@@ -0,0 +1,1733 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "config.h"
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <xmlrpc-c/base.h>
+#include <cairo.h>
+#include <glib.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_chamelium_emulator.h"
+#include "igt_core.h"
+#include "igt_rc.h"
+
+/**
+ * SECTION:igt_chamelium_emulator
+ * @short_description: Local stand-in for a Chamelium board
+ * @title: Chamelium emulator
+ * @include: igt_chamelium_emulator.h
+ *
+ * The emulator answers the XML-RPC calls of the Chamelium library and runs a
+ * stream server, for audio pages and frames, so that the library can be used
+ * without a board.
+ *
+ * Each of its four ports (DP1, DP2, HDMI and VGA, with the board's port IDs)
+ * shows the same virtual display: the frames added with
+ * chamelium_emulator_add_frame(), moving on to the next one with each captured
+ * frame, or a test pattern if none were added. Frames added before
+ * chamelium_emulator_start() also make up the initial capture, as if they had
+ * just been captured, so that they can be read back right away. Pixel dumps
+ * capture one frame, like on the board, replacing the captured frames.
+ * Checksums are computed the way the board computes them.
+ *
+ * Audio comes from a raw S32_LE file, looping, and is sent in real time to the
+ * stream clients dumping audio while a capture runs.
+ *
+ * Nothing is connected to the DUT, so the emulator is meant for exercising and
+ * benchmarking the transport, comparison and checksum code of the library,
+ * with chamelium_init_rpc_only(), rather than for running kms_chamelium.
+ */
+
+#define EMULATOR_PORTS 4
+#define EMULATOR_MAX_STREAMS 8
+#define EMULATOR_MAX_REQUEST (1 << 20)
+/* Size of the capture memory, which limits the number of captured frames */
+#define EMULATOR_CAPTURE_MEMORY (512 << 20)
+#define EMULATOR_AUDIO_CHANNELS 8
+#define EMULATOR_AUDIO_PAGE_FRAMES 128
+
+/* The stream protocol, as spoken by igt_chamelium_stream.c */
+#define STREAM_VERSION_MAJOR 1
+#define STREAM_VERSION_MINOR 0
+/* Appended to the version to advertise the frame requests, ours only */
+#define STREAM_EMULATOR_FRAMES "igt-emulator-frames"
+
+enum stream_error {
+	STREAM_ERROR_NONE = 0,
+	STREAM_ERROR_COMMAND = 1,
+	STREAM_ERROR_ARGUMENT = 2,
+	STREAM_ERROR_EXISTS = 3,
+};
+
+enum stream_message_kind {
+	STREAM_MESSAGE_REQUEST = 0,
+	STREAM_MESSAGE_RESPONSE = 1,
+	STREAM_MESSAGE_DATA = 2,
+};
+
+enum stream_message_type {
+	STREAM_MESSAGE_RESET = 0,
+	STREAM_MESSAGE_GET_VERSION = 1,
+	STREAM_MESSAGE_DUMP_REALTIME_AUDIO = 7,
+	STREAM_MESSAGE_STOP_DUMP_AUDIO = 8,
+	STREAM_MESSAGE_READ_CAPTURED_FRAME = 0x80,
+	STREAM_MESSAGE_DUMP_PIXELS = 0x81,
+};
+
+/* Pixels with red, green and blue bytes, like the board's frame dumps */
+struct emulator_frame {
+	int width, height;
+	unsigned char *rgb;
+};
+
+struct emulator_stream {
+	int fd;
+
+	bool audio;
+	uint64_t audio_start;
+	uint32_t pages;
+};
+
+struct chamelium_emulator {
+	int width, height;
+	bool stream_frames;
+
+	struct emulator_frame *frames;
+	int frame_count;
+	int shown;
+
+	struct emulator_frame *captured;
+	int captured_count;
+	int capture_x, capture_y, capture_w, capture_h;
+
+	bool plugged[EMULATOR_PORTS];
+	bool ddc[EMULATOR_PORTS];
+	int last_edid;
+
+	int32_t *audio;
+	size_t audio_frames;
+	int audio_rate, audio_channels;
+	bool audio_capturing, audio_save;
+	uint64_t audio_capture_start;
+
+	char address[INET_ADDRSTRLEN];
+	unsigned int rpc_port, stream_port;
+	int rpc_fd, stream_fd;
+	struct emulator_stream streams[EMULATOR_MAX_STREAMS];
+
+	int wake[2];
+	pthread_t thread;
+	bool running;
+};
+
+static const struct {
+	int id;
+	const char *type;
+} emulator_ports[EMULATOR_PORTS] = {
+	{ 1, "DP" },
+	{ 2, "DP" },
+	{ 3, "HDMI" },
+	{ 4, "VGA" },
+};
+
+static uint64_t emulator_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void frame_init(struct emulator_frame *frame, int width, int height)
+{
+	frame->width = width;
+	frame->height = height;
+	frame->rgb = malloc((size_t) width * height * 3);
+	igt_assert(frame->rgb || !width || !height);
+}
+
+/* Copies the area of @src at @x, @y, all of it if @w or @h is 0, clipped */
+static void frame_crop(struct emulator_frame *dst,
+		       const struct emulator_frame *src,
+		       int x, int y, int w, int h)
+{
+	if (!w || !h) {
+		x = y = 0;
+		w = src->width;
+		h = src->height;
+	}
+
+	x = clamp(x, 0, src->width);
+	y = clamp(y, 0, src->height);
+	w = clamp(w, 0, src->width - x);
+	h = clamp(h, 0, src->height - y);
+
+	frame_init(dst, w, h);
+
+	for (int row = 0; row < h; row++)
+		memcpy(dst->rgb + (size_t) row * w * 3,
+		       src->rgb + ((size_t) (y + row) * src->width + x) * 3,
+		       (size_t) w * 3);
+}
+
+/* Color bars over the top half, ramps of red, green and blue below */
+static void frame_pattern(struct emulator_frame *frame, int width, int height)
+{
+	static const uint32_t bars[] = {
+		0xffffff, 0xffff00, 0x00ffff, 0x00ff00,
+		0xff00ff, 0xff0000, 0x0000ff, 0x000000,
+	};
+
+	frame_init(frame, width, height);
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			unsigned char *p = frame->rgb +
+					   ((size_t) y * width + x) * 3;
+			uint32_t color;
+
+			if (y < height / 2) {
+				color = bars[x * ARRAY_SIZE(bars) / width];
+			} else {
+				int ramp = (y - height / 2) * 3 /
+					   (height - height / 2);
+
+				color = (x * 255 / max(width - 1, 1)) <<
+					(16 - 8 * ramp);
+			}
+
+			p[0] = color >> 16;
+			p[1] = color >> 8;
+			p[2] = color;
+		}
+	}
+}
+
+/* The board's checksum, which chamelium_calculate_fb_crc() also computes */
+static void frame_crc(const struct emulator_frame *frame, int crc[4])
+{
+	size_t pixels = (size_t) frame->width * frame->height;
+	uint64_t sum[4] = {}, count[4] = {};
+
+	for (size_t i = 0; i < pixels; i++) {
+		const unsigned char *p = frame->rgb + i * 3;
+		uint64_t value = p[0] | p[1] << 8 | p[2] << 16;
+
+		sum[i % 4] += ++count[i % 4] * value;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		uint64_t s = sum[4 - i - 1];
+
+		crc[i] = ((s >> 0) ^ (s >> 16) ^ (s >> 32) ^ (s >> 48)) & 0xffff;
+	}
+}
+
+static void emulator_free_captured(struct chamelium_emulator *emu)
+{
+	for (int i = 0; i < emu->captured_count; i++)
+		free(emu->captured[i].rgb);
+	free(emu->captured);
+
+	emu->captured = NULL;
+	emu->captured_count = 0;
+}
+
+/* Captures the next @count frames shown, in the area set up for capture */
+static bool emulator_capture(struct chamelium_emulator *emu, int count)
+{
+	struct emulator_frame *shown;
+
+	emulator_free_captured(emu);
+
+	if ((uint64_t) count * emu->width * emu->height * 3 >
+	    EMULATOR_CAPTURE_MEMORY)
+		return false;
+
+	emu->captured = calloc(count, sizeof(*emu->captured));
+	igt_assert(emu->captured || !count);
+
+	for (int i = 0; i < count; i++) {
+		shown = &emu->frames[(emu->shown + i) % emu->frame_count];
+		frame_crop(&emu->captured[i], shown,
+			   emu->capture_x, emu->capture_y,
+			   emu->capture_w, emu->capture_h);
+	}
+
+	emu->captured_count = count;
+	emu->shown = (emu->shown + count) % emu->frame_count;
+
+	return true;
+}
+
+/*
+ * Dumps the pixels of an area the way the board does, as a capture of one
+ * frame, which leaves the dump to be read back as the captured frame
+ */
+static bool emulator_dump_pixels(struct chamelium_emulator *emu,
+				 int x, int y, int w, int h)
+{
+	emu->capture_x = x;
+	emu->capture_y = y;
+	emu->capture_w = w;
+	emu->capture_h = h;
+
+	return emulator_capture(emu, 1);
+}
+
+/*
+ * XML-RPC methods, named and called like the board's, see
+ * https://chromium.googlesource.com/chromiumos/platform/chameleon/+/refs/heads/master/chameleond/interface.py
+ */
+
+static xmlrpc_value *param(xmlrpc_env *env, xmlrpc_value *params, int index)
+{
+	xmlrpc_value *value = NULL;
+
+	if (!env->fault_occurred)
+		xmlrpc_array_read_item(env, params, index, &value);
+
+	return env->fault_occurred ? NULL : value;
+}
+
+/* Reads an integer argument, or @nil_value if it is nil */
+static int param_int(xmlrpc_env *env, xmlrpc_value *params, int index,
+		     int nil_value)
+{
+	xmlrpc_value *value = param(env, params, index);
+	int ret = nil_value;
+
+	if (!value)
+		return nil_value;
+
+	if (xmlrpc_value_type(value) != XMLRPC_TYPE_NIL)
+		xmlrpc_read_int(env, value, &ret);
+	xmlrpc_DECREF(value);
+
+	return ret;
+}
+
+static bool param_bool(xmlrpc_env *env, xmlrpc_value *params, int index)
+{
+	xmlrpc_value *value = param(env, params, index);
+	xmlrpc_bool ret = false;
+
+	if (!value)
+		return false;
+
+	xmlrpc_read_bool(env, value, &ret);
+	xmlrpc_DECREF(value);
+
+	return ret;
+}
+
+/* Returns the index of the port given by its ID, or -1 with a fault */
+static int param_port(xmlrpc_env *env, xmlrpc_value *params, int index)
+{
+	int id = param_int(env, params, index, 0);
+
+	if (env->fault_occurred)
+		return -1;
+
+	for (int i = 0; i < EMULATOR_PORTS; i++)
+		if (emulator_ports[i].id == id)
+			return i;
+
+	xmlrpc_env_set_fault_formatted(env, XMLRPC_INDEX_ERROR,
+				       "No such port %d", id);
+	return -1;
+}
+
+static xmlrpc_value *int_array(xmlrpc_env *env, const int *values, int count)
+{
+	xmlrpc_value *array = xmlrpc_array_new(env);
+
+	for (int i = 0; i < count && !env->fault_occurred; i++) {
+		xmlrpc_value *item = xmlrpc_int_new(env, values[i]);
+
+		xmlrpc_array_append_item(env, array, item);
+		xmlrpc_DECREF(item);
+	}
+
+	return array;
+}
+
+static xmlrpc_value *frame_base64(xmlrpc_env *env,
+				  const struct emulator_frame *frame)
+{
+	return xmlrpc_base64_new(env, (size_t) frame->width * frame->height * 3,
+				 frame->rgb);
+}
+
+static xmlrpc_value *frame_crc_array(xmlrpc_env *env,
+				     const struct emulator_frame *frame)
+{
+	int crc[4];
+
+	frame_crc(frame, crc);
+
+	return int_array(env, crc, ARRAY_SIZE(crc));
+}
+
+static xmlrpc_value *rpc_reset(struct chamelium_emulator *emu,
+			       xmlrpc_env *env, xmlrpc_value *params)
+{
+	for (int i = 0; i < EMULATOR_PORTS; i++) {
+		emu->plugged[i] = false;
+		emu->ddc[i] = true;
+	}
+	emu->audio_capturing = false;
+
+	return xmlrpc_nil_new(env);
+}
+
+static xmlrpc_value *rpc_get_supported_inputs(struct chamelium_emulator *emu,
+					      xmlrpc_env *env,
+					      xmlrpc_value *params)
+{
+	int ids[EMULATOR_PORTS];
+
+	for (int i = 0; i < EMULATOR_PORTS; i++)
+		ids[i] = emulator_ports[i].id;
+
+	return int_array(env, ids, EMULATOR_PORTS);
+}
+
+static xmlrpc_value *rpc_has_video_support(struct chamelium_emulator *emu,
+					   xmlrpc_env *env,
+					   xmlrpc_value *params)
+{
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	return xmlrpc_bool_new(env, true);
+}
+
+static xmlrpc_value *rpc_get_connector_type(struct chamelium_emulator *emu,
+					    xmlrpc_env *env,
+					    xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+
+	if (port < 0)
+		return NULL;
+
+	return xmlrpc_string_new(env, emulator_ports[port].type);
+}
+
+static xmlrpc_value *rpc_plug(struct chamelium_emulator *emu,
+			      xmlrpc_env *env, xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+
+	if (port < 0)
+		return NULL;
+
+	emu->plugged[port] = true;
+
+	return xmlrpc_nil_new(env);
+}
+
+static xmlrpc_value *rpc_unplug(struct chamelium_emulator *emu,
+				xmlrpc_env *env, xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+
+	if (port < 0)
+		return NULL;
+
+	emu->plugged[port] = false;
+
+	return xmlrpc_nil_new(env);
+}
+
+/* Also WaitVideoInputStable, the display is stable as soon as plugged */
+static xmlrpc_value *rpc_is_plugged(struct chamelium_emulator *emu,
+				    xmlrpc_env *env, xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+
+	if (port < 0)
+		return NULL;
+
+	return xmlrpc_bool_new(env, emu->plugged[port]);
+}
+
+/* HPD pulses and toggles, which only the DUT would notice */
+static xmlrpc_value *rpc_port_nop(struct chamelium_emulator *emu,
+				  xmlrpc_env *env, xmlrpc_value *params)
+{
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	return xmlrpc_nil_new(env);
+}
+
+static xmlrpc_value *rpc_create_edid(struct chamelium_emulator *emu,
+				     xmlrpc_env *env, xmlrpc_value *params)
+{
+	return xmlrpc_int_new(env, ++emu->last_edid);
+}
+
+static xmlrpc_value *rpc_destroy_edid(struct chamelium_emulator *emu,
+				      xmlrpc_env *env, xmlrpc_value *params)
+{
+	return xmlrpc_nil_new(env);
+}
+
+static xmlrpc_value *rpc_set_ddc_state(struct chamelium_emulator *emu,
+				       xmlrpc_env *env, xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+	bool enabled = param_bool(env, params, 1);
+
+	if (env->fault_occurred)
+		return NULL;
+
+	emu->ddc[port] = enabled;
+
+	return xmlrpc_nil_new(env);
+}
+
+static xmlrpc_value *rpc_is_ddc_enabled(struct chamelium_emulator *emu,
+					xmlrpc_env *env, xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+
+	if (port < 0)
+		return NULL;
+
+	return xmlrpc_bool_new(env, emu->ddc[port]);
+}
+
+static xmlrpc_value *rpc_detect_resolution(struct chamelium_emulator *emu,
+					   xmlrpc_env *env,
+					   xmlrpc_value *params)
+{
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	return xmlrpc_build_value(env, "(ii)", emu->width, emu->height);
+}
+
+/* Reduced blanking timings at 60Hz for the display size */
+static xmlrpc_value *rpc_get_video_params(struct chamelium_emulator *emu,
+					  xmlrpc_env *env,
+					  xmlrpc_value *params)
+{
+	int htotal = emu->width + 160, vtotal = emu->height + 30;
+
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	return xmlrpc_build_value(env,
+				  "{s:d,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i,s:i}",
+				  "clock", htotal * vtotal * 60 / 1e6,
+				  "htotal", htotal,
+				  "hactive", emu->width,
+				  "hsync_offset", 48,
+				  "hsync_width", 32,
+				  "hsync_polarity", 1,
+				  "vtotal", vtotal,
+				  "vactive", emu->height,
+				  "vsync_offset", 3,
+				  "vsync_width", 6,
+				  "vsync_polarity", 0);
+}
+
+static xmlrpc_value *rpc_get_captured_resolution(struct chamelium_emulator *emu,
+						 xmlrpc_env *env,
+						 xmlrpc_value *params)
+{
+	if (!emu->captured_count) {
+		xmlrpc_env_set_fault(env, XMLRPC_INTERNAL_ERROR,
+				     "No frames captured");
+		return NULL;
+	}
+
+	return xmlrpc_build_value(env, "(ii)", emu->captured[0].width,
+				  emu->captured[0].height);
+}
+
+/* Crops the frame shown to the area given from argument @index on */
+static bool shown_area(struct chamelium_emulator *emu, xmlrpc_env *env,
+		       xmlrpc_value *params, int index,
+		       struct emulator_frame *area)
+{
+	int x = param_int(env, params, index, 0);
+	int y = param_int(env, params, index + 1, 0);
+	int w = param_int(env, params, index + 2, 0);
+	int h = param_int(env, params, index + 3, 0);
+
+	if (env->fault_occurred)
+		return false;
+
+	frame_crop(area, &emu->frames[emu->shown], x, y, w, h);
+
+	return true;
+}
+
+static xmlrpc_value *rpc_dump_pixels(struct chamelium_emulator *emu,
+				     xmlrpc_env *env, xmlrpc_value *params)
+{
+	int x, y, w, h;
+
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	x = param_int(env, params, 1, 0);
+	y = param_int(env, params, 2, 0);
+	w = param_int(env, params, 3, 0);
+	h = param_int(env, params, 4, 0);
+	if (env->fault_occurred)
+		return NULL;
+
+	if (!emulator_dump_pixels(emu, x, y, w, h)) {
+		xmlrpc_env_set_fault(env, XMLRPC_LIMIT_EXCEEDED_ERROR,
+				     "Not enough capture memory");
+		return NULL;
+	}
+
+	return frame_base64(env, &emu->captured[0]);
+}
+
+static xmlrpc_value *rpc_compute_pixel_checksum(struct chamelium_emulator *emu,
+						xmlrpc_env *env,
+						xmlrpc_value *params)
+{
+	struct emulator_frame area;
+	xmlrpc_value *ret;
+
+	if (param_port(env, params, 0) < 0 ||
+	    !shown_area(emu, env, params, 1, &area))
+		return NULL;
+
+	ret = frame_crc_array(env, &area);
+	free(area.rgb);
+
+	return ret;
+}
+
+/* Reads the capture area from argument @index on */
+static bool capture_area(struct chamelium_emulator *emu, xmlrpc_env *env,
+			 xmlrpc_value *params, int index)
+{
+	emu->capture_x = param_int(env, params, index, 0);
+	emu->capture_y = param_int(env, params, index + 1, 0);
+	emu->capture_w = param_int(env, params, index + 2, 0);
+	emu->capture_h = param_int(env, params, index + 3, 0);
+
+	return !env->fault_occurred;
+}
+
+static xmlrpc_value *rpc_start_capturing_video(struct chamelium_emulator *emu,
+					       xmlrpc_env *env,
+					       xmlrpc_value *params)
+{
+	if (param_port(env, params, 0) < 0 ||
+	    !capture_area(emu, env, params, 1))
+		return NULL;
+
+	emulator_free_captured(emu);
+
+	return xmlrpc_nil_new(env);
+}
+
+static xmlrpc_value *rpc_stop_capturing_video(struct chamelium_emulator *emu,
+					      xmlrpc_env *env,
+					      xmlrpc_value *params)
+{
+	int count = param_int(env, params, 0, 0);
+
+	if (env->fault_occurred)
+		return NULL;
+
+	/* Stopping right away still gets the frame being captured */
+	if (!emulator_capture(emu, max(count, 1))) {
+		xmlrpc_env_set_fault(env, XMLRPC_LIMIT_EXCEEDED_ERROR,
+				     "Not enough capture memory");
+		return NULL;
+	}
+
+	return xmlrpc_nil_new(env);
+}
+
+static xmlrpc_value *rpc_capture_video(struct chamelium_emulator *emu,
+				       xmlrpc_env *env, xmlrpc_value *params)
+{
+	int count;
+
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	count = param_int(env, params, 1, 0);
+	if (!capture_area(emu, env, params, 2))
+		return NULL;
+
+	if (count <= 0 || !emulator_capture(emu, count)) {
+		xmlrpc_env_set_fault_formatted(env, XMLRPC_LIMIT_EXCEEDED_ERROR,
+					       "Can't capture %d frames", count);
+		return NULL;
+	}
+
+	return xmlrpc_nil_new(env);
+}
+
+static xmlrpc_value *rpc_get_captured_frame_count(struct chamelium_emulator *emu,
+						  xmlrpc_env *env,
+						  xmlrpc_value *params)
+{
+	return xmlrpc_int_new(env, emu->captured_count);
+}
+
+static xmlrpc_value *rpc_read_captured_frame(struct chamelium_emulator *emu,
+					     xmlrpc_env *env,
+					     xmlrpc_value *params)
+{
+	int index = param_int(env, params, 0, 0);
+
+	if (env->fault_occurred)
+		return NULL;
+
+	if (index < 0 || index >= emu->captured_count) {
+		xmlrpc_env_set_fault_formatted(env, XMLRPC_INDEX_ERROR,
+					       "No captured frame %d", index);
+		return NULL;
+	}
+
+	return frame_base64(env, &emu->captured[index]);
+}
+
+static xmlrpc_value *rpc_get_captured_checksums(struct chamelium_emulator *emu,
+						xmlrpc_env *env,
+						xmlrpc_value *params)
+{
+	int start = param_int(env, params, 0, 0);
+	int stop = param_int(env, params, 1, emu->captured_count);
+	xmlrpc_value *array;
+
+	if (env->fault_occurred)
+		return NULL;
+
+	start = clamp(start, 0, emu->captured_count);
+	stop = clamp(stop, start, emu->captured_count);
+
+	array = xmlrpc_array_new(env);
+	for (int i = start; i < stop && !env->fault_occurred; i++) {
+		xmlrpc_value *crc = frame_crc_array(env, &emu->captured[i]);
+
+		xmlrpc_array_append_item(env, array, crc);
+		xmlrpc_DECREF(crc);
+	}
+
+	return array;
+}
+
+static xmlrpc_value *rpc_get_max_frame_limit(struct chamelium_emulator *emu,
+					     xmlrpc_env *env,
+					     xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+	int w = param_int(env, params, 1, emu->width);
+	int h = param_int(env, params, 2, emu->height);
+
+	if (port < 0)
+		return NULL;
+
+	return xmlrpc_int_new(env, EMULATOR_CAPTURE_MEMORY /
+				   ((size_t) max(w, 1) * max(h, 1) * 3));
+}
+
+static xmlrpc_value *rpc_has_audio_support(struct chamelium_emulator *emu,
+					   xmlrpc_env *env,
+					   xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+
+	if (port < 0)
+		return NULL;
+
+	return xmlrpc_bool_new(env, emu->audio &&
+			       strcmp(emulator_ports[port].type, "VGA"));
+}
+
+static xmlrpc_value *rpc_get_audio_channel_mapping(struct chamelium_emulator *emu,
+						   xmlrpc_env *env,
+						   xmlrpc_value *params)
+{
+	int mapping[EMULATOR_AUDIO_CHANNELS];
+
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	for (int i = 0; i < EMULATOR_AUDIO_CHANNELS; i++)
+		mapping[i] = i < emu->audio_channels ? i : -1;
+
+	return int_array(env, mapping, EMULATOR_AUDIO_CHANNELS);
+}
+
+static xmlrpc_value *audio_format(struct chamelium_emulator *emu,
+				  xmlrpc_env *env)
+{
+	return xmlrpc_build_value(env, "{s:s,s:s,s:i,s:i}",
+				  "file_type", "raw",
+				  "sample_format", "S32_LE",
+				  "channel", EMULATOR_AUDIO_CHANNELS,
+				  "rate", emu->audio_rate);
+}
+
+static xmlrpc_value *rpc_get_audio_format(struct chamelium_emulator *emu,
+					  xmlrpc_env *env,
+					  xmlrpc_value *params)
+{
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	return audio_format(emu, env);
+}
+
+/* Fills a page of the capture with the audio file, looping */
+static void audio_page(struct chamelium_emulator *emu, uint64_t page,
+		       int32_t *samples)
+{
+	uint64_t frame = page * EMULATOR_AUDIO_PAGE_FRAMES;
+
+	for (int i = 0; i < EMULATOR_AUDIO_PAGE_FRAMES; i++, frame++) {
+		const int32_t *in = emu->audio + (frame % emu->audio_frames) *
+						 emu->audio_channels;
+
+		for (int c = 0; c < EMULATOR_AUDIO_CHANNELS; c++)
+			*samples++ = htole32(c < emu->audio_channels ?
+					     in[c] : 0);
+	}
+}
+
+static xmlrpc_value *rpc_start_capturing_audio(struct chamelium_emulator *emu,
+					       xmlrpc_env *env,
+					       xmlrpc_value *params)
+{
+	int port = param_port(env, params, 0);
+	bool save = param_bool(env, params, 1);
+
+	if (env->fault_occurred)
+		return NULL;
+
+	if (!emu->audio || !strcmp(emulator_ports[port].type, "VGA")) {
+		xmlrpc_env_set_fault_formatted(env, XMLRPC_INTERNAL_ERROR,
+					       "No audio on port %d",
+					       emulator_ports[port].id);
+		return NULL;
+	}
+
+	emu->audio_capturing = true;
+	emu->audio_save = save;
+	emu->audio_capture_start = emulator_now();
+
+	for (int i = 0; i < EMULATOR_MAX_STREAMS; i++)
+		emu->streams[i].pages = 0;
+
+	return xmlrpc_nil_new(env);
+}
+
+/* Writes what was captured so far to a file, returns its path or NULL */
+static char *save_audio(struct chamelium_emulator *emu)
+{
+	int32_t samples[EMULATOR_AUDIO_PAGE_FRAMES * EMULATOR_AUDIO_CHANNELS];
+	char path[] = "/tmp/chamelium_emulator_audio_XXXXXX.raw";
+	uint64_t pages;
+	int fd;
+
+	pages = (emulator_now() - emu->audio_capture_start) * emu->audio_rate /
+		NSEC_PER_SEC / EMULATOR_AUDIO_PAGE_FRAMES;
+
+	fd = mkstemps(path, strlen(".raw"));
+	if (fd < 0)
+		return NULL;
+
+	for (uint64_t page = 0; page < pages; page++) {
+		audio_page(emu, page, samples);
+		if (write(fd, samples, sizeof(samples)) != sizeof(samples)) {
+			close(fd);
+			unlink(path);
+			return NULL;
+		}
+	}
+
+	close(fd);
+
+	return strdup(path);
+}
+
+static xmlrpc_value *rpc_stop_capturing_audio(struct chamelium_emulator *emu,
+					      xmlrpc_env *env,
+					      xmlrpc_value *params)
+{
+	xmlrpc_value *format, *ret;
+	char *path = NULL;
+
+	if (param_port(env, params, 0) < 0)
+		return NULL;
+
+	if (!emu->audio_capturing) {
+		xmlrpc_env_set_fault(env, XMLRPC_INTERNAL_ERROR,
+				     "Audio capture isn't running");
+		return NULL;
+	}
+
+	if (emu->audio_save)
+		path = save_audio(emu);
+	emu->audio_capturing = false;
+
+	format = audio_format(emu, env);
+	ret = xmlrpc_build_value(env, "(sV)", path ?: "", format);
+	xmlrpc_DECREF(format);
+	free(path);
+
+	return ret;
+}
+
+static const struct {
+	const char *name;
+	xmlrpc_value *(*call)(struct chamelium_emulator *emu,
+			      xmlrpc_env *env, xmlrpc_value *params);
+} emulator_methods[] = {
+	{ "ApplyEdid", rpc_port_nop },
+	{ "CaptureVideo", rpc_capture_video },
+	{ "ComputePixelChecksum", rpc_compute_pixel_checksum },
+	{ "CreateEdid", rpc_create_edid },
+	{ "DestroyEdid", rpc_destroy_edid },
+	{ "DetectResolution", rpc_detect_resolution },
+	{ "DumpPixels", rpc_dump_pixels },
+	{ "FireMixedHpdPulses", rpc_port_nop },
+	{ "GetAudioChannelMapping", rpc_get_audio_channel_mapping },
+	{ "GetAudioFormat", rpc_get_audio_format },
+	{ "GetCapturedChecksums", rpc_get_captured_checksums },
+	{ "GetCapturedFrameCount", rpc_get_captured_frame_count },
+	{ "GetCapturedResolution", rpc_get_captured_resolution },
+	{ "GetConnectorType", rpc_get_connector_type },
+	{ "GetMaxFrameLimit", rpc_get_max_frame_limit },
+	{ "GetSupportedInputs", rpc_get_supported_inputs },
+	{ "GetVideoParams", rpc_get_video_params },
+	{ "HasAudioSupport", rpc_has_audio_support },
+	{ "HasVideoSupport", rpc_has_video_support },
+	{ "IsDdcEnabled", rpc_is_ddc_enabled },
+	{ "IsPlugged", rpc_is_plugged },
+	{ "Plug", rpc_plug },
+	{ "ReadCapturedFrame", rpc_read_captured_frame },
+	{ "Reset", rpc_reset },
+	{ "ScheduleHpdToggle", rpc_port_nop },
+	{ "SetDdcState", rpc_set_ddc_state },
+	{ "StartCapturingAudio", rpc_start_capturing_audio },
+	{ "StartCapturingVideo", rpc_start_capturing_video },
+	{ "StopCapturingAudio", rpc_stop_capturing_audio },
+	{ "StopCapturingVideo", rpc_stop_capturing_video },
+	{ "Unplug", rpc_unplug },
+	{ "WaitVideoInputStable", rpc_is_plugged },
+};
+
+static bool emulator_write(int fd, const void *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+
+		buf = (const char *) buf + ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static bool emulator_read(int fd, void *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = read(fd, buf, len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return false;
+
+		buf = (char *) buf + ret;
+		len -= ret;
+	}
+
+	return true;
+}
+
+static xmlrpc_value *emulator_call(struct chamelium_emulator *emu,
+				   xmlrpc_env *env, const char *method,
+				   xmlrpc_value *params)
+{
+	igt_debug("Emulated Chamelium call: %s\n", method);
+
+	for (int i = 0; i < ARRAY_SIZE(emulator_methods); i++)
+		if (!strcmp(emulator_methods[i].name, method))
+			return emulator_methods[i].call(emu, env, params);
+
+	/* Phrased like the board, see chamelium_supports_method() */
+	xmlrpc_env_set_fault_formatted(env, XMLRPC_NO_SUCH_METHOD_ERROR,
+				       "Method %s is not supported", method);
+	return NULL;
+}
+
+static void emulator_respond(struct chamelium_emulator *emu, int fd,
+			     const char *xml, size_t len)
+{
+	xmlrpc_value *params = NULL, *result = NULL;
+	const char *method = NULL;
+	xmlrpc_mem_block *output;
+	xmlrpc_env env, fault;
+	char header[128];
+	int header_len;
+
+	xmlrpc_env_init(&env);
+	xmlrpc_env_init(&fault);
+
+	xmlrpc_parse_call(&fault, xml, len, &method, &params);
+	if (!fault.fault_occurred)
+		result = emulator_call(emu, &fault, method, params);
+
+	output = xmlrpc_mem_block_new(&env, 0);
+	igt_assert(!env.fault_occurred);
+
+	if (fault.fault_occurred)
+		xmlrpc_serialize_fault(&env, output, &fault);
+	else
+		xmlrpc_serialize_response(&env, output, result);
+
+	if (!env.fault_occurred) {
+		header_len = snprintf(header, sizeof(header),
+				      "HTTP/1.1 200 OK\r\n"
+				      "Content-Type: text/xml\r\n"
+				      "Content-Length: %zu\r\n"
+				      "Connection: close\r\n\r\n",
+				      xmlrpc_mem_block_size(output));
+
+		if (emulator_write(fd, header, header_len))
+			emulator_write(fd, xmlrpc_mem_block_contents(output),
+				       xmlrpc_mem_block_size(output));
+	}
+
+	xmlrpc_mem_block_free(output);
+	if (result)
+		xmlrpc_DECREF(result);
+	if (params)
+		xmlrpc_DECREF(params);
+	if (method)
+		xmlrpc_strfree(method);
+	xmlrpc_env_clean(&fault);
+	xmlrpc_env_clean(&env);
+}
+
+/* Serves one XML-RPC call over HTTP, closing the connection afterwards */
+static void emulator_serve_rpc(struct chamelium_emulator *emu)
+{
+	struct timeval tv = { .tv_sec = 5 };
+	size_t len = 0, size = 4096, header_len, body_len;
+	char *request, *end, *content_length;
+	ssize_t ret;
+	int fd;
+
+	fd = accept4(emu->rpc_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	request = malloc(size);
+	igt_assert(request);
+
+	while (!(end = memmem(request, len, "\r\n\r\n", 4))) {
+		if (len == size) {
+			if (size >= EMULATOR_MAX_REQUEST)
+				goto out;
+			size *= 2;
+			request = realloc(request, size);
+			igt_assert(request);
+		}
+
+		ret = read(fd, request + len, size - len);
+		if (ret <= 0)
+			goto out;
+		len += ret;
+	}
+
+	header_len = end + 4 - request;
+	request[header_len - 1] = '\0';
+	content_length = strcasestr(request, "\ncontent-length:");
+	body_len = content_length ?
+		   strtoul(content_length + strlen("\ncontent-length:"),
+			   NULL, 10) : 0;
+	if (body_len > EMULATOR_MAX_REQUEST)
+		goto out;
+
+	if (header_len + body_len > size) {
+		size = header_len + body_len;
+		request = realloc(request, size);
+		igt_assert(request);
+	}
+
+	/* curl asks before sending larger bodies */
+	if (len < header_len + body_len &&
+	    strcasestr(request, "\nexpect: 100-continue") &&
+	    !emulator_write(fd, "HTTP/1.1 100 Continue\r\n\r\n",
+			    strlen("HTTP/1.1 100 Continue\r\n\r\n")))
+		goto out;
+
+	if (len < header_len + body_len &&
+	    !emulator_read(fd, request + len, header_len + body_len - len))
+		goto out;
+
+	emulator_respond(emu, fd, request + header_len, body_len);
+out:
+	free(request);
+	close(fd);
+}
+
+static bool stream_send_header(int fd, enum stream_message_kind kind,
+			       enum stream_message_type type,
+			       enum stream_error err, size_t len)
+{
+	char header[8];
+
+	*(uint16_t *) &header[0] = htons(type | kind << 8);
+	*(uint16_t *) &header[2] = htons(err);
+	*(uint32_t *) &header[4] = htonl(len);
+
+	return emulator_write(fd, header, sizeof(header));
+}
+
+static bool stream_reply(int fd, enum stream_message_type type,
+			 enum stream_error err, const void *body, size_t len)
+{
+	return stream_send_header(fd, STREAM_MESSAGE_RESPONSE, type, err, len) &&
+	       emulator_write(fd, body, len);
+}
+
+static bool stream_reply_frame(int fd, enum stream_message_type type,
+			       const struct emulator_frame *frame)
+{
+	size_t len = (size_t) frame->width * frame->height * 3;
+	char dims[8];
+
+	*(uint32_t *) &dims[0] = htonl(frame->width);
+	*(uint32_t *) &dims[4] = htonl(frame->height);
+
+	return stream_send_header(fd, STREAM_MESSAGE_RESPONSE, type,
+				  STREAM_ERROR_NONE, sizeof(dims) + len) &&
+	       emulator_write(fd, dims, sizeof(dims)) &&
+	       emulator_write(fd, frame->rgb, len);
+}
+
+static bool stream_dump_pixels(struct chamelium_emulator *emu, int fd,
+			       const char *req)
+{
+	int id = ntohl(*(uint32_t *) &req[0]);
+	int i;
+
+	for (i = 0; i < EMULATOR_PORTS; i++)
+		if (emulator_ports[i].id == id)
+			break;
+	if (i == EMULATOR_PORTS)
+		return stream_reply(fd, STREAM_MESSAGE_DUMP_PIXELS,
+				    STREAM_ERROR_ARGUMENT, NULL, 0);
+
+	if (!emulator_dump_pixels(emu, ntohl(*(uint32_t *) &req[4]),
+				  ntohl(*(uint32_t *) &req[8]),
+				  ntohl(*(uint32_t *) &req[12]),
+				  ntohl(*(uint32_t *) &req[16])))
+		return stream_reply(fd, STREAM_MESSAGE_DUMP_PIXELS,
+				    STREAM_ERROR_ARGUMENT, NULL, 0);
+
+	return stream_reply_frame(fd, STREAM_MESSAGE_DUMP_PIXELS,
+				  &emu->captured[0]);
+}
+
+/* Serves one request, returns false when the connection is to be closed */
+static bool emulator_serve_stream(struct chamelium_emulator *emu,
+				  struct emulator_stream *stream)
+{
+	static const char frames[] = STREAM_EMULATOR_FRAMES;
+	enum stream_message_type type;
+	char header[8], req[20], version[2 + sizeof(frames) - 1];
+	unsigned int index;
+	size_t len;
+
+	if (!emulator_read(stream->fd, header, sizeof(header)))
+		return false;
+
+	type = (uint8_t) header[1];
+	len = ntohl(*(uint32_t *) &header[4]);
+	if (header[0] != STREAM_MESSAGE_REQUEST || len > sizeof(req) ||
+	    !emulator_read(stream->fd, req, len))
+		return false;
+
+	switch (type) {
+	case STREAM_MESSAGE_RESET:
+		stream->audio = false;
+		return stream_reply(stream->fd, type, STREAM_ERROR_NONE,
+				    NULL, 0);
+	case STREAM_MESSAGE_GET_VERSION:
+		version[0] = STREAM_VERSION_MAJOR;
+		version[1] = STREAM_VERSION_MINOR;
+		memcpy(&version[2], frames, sizeof(frames) - 1);
+		return stream_reply(stream->fd, type, STREAM_ERROR_NONE,
+				    version, emu->stream_frames ?
+				    sizeof(version) : 2);
+	case STREAM_MESSAGE_DUMP_REALTIME_AUDIO:
+		if (stream->audio)
+			return stream_reply(stream->fd, type,
+					    STREAM_ERROR_EXISTS, NULL, 0);
+		stream->audio = true;
+		stream->audio_start = emulator_now();
+		stream->pages = 0;
+		return stream_reply(stream->fd, type, STREAM_ERROR_NONE,
+				    NULL, 0);
+	case STREAM_MESSAGE_STOP_DUMP_AUDIO:
+		stream->audio = false;
+		return stream_reply(stream->fd, type, STREAM_ERROR_NONE,
+				    NULL, 0);
+	case STREAM_MESSAGE_READ_CAPTURED_FRAME:
+		if (!emu->stream_frames)
+			break;
+		index = len == 4 ? ntohl(*(uint32_t *) &req[0]) : -1;
+		if (index >= emu->captured_count)
+			return stream_reply(stream->fd, type,
+					    STREAM_ERROR_ARGUMENT, NULL, 0);
+		return stream_reply_frame(stream->fd, type,
+					  &emu->captured[index]);
+	case STREAM_MESSAGE_DUMP_PIXELS:
+		if (!emu->stream_frames)
+			break;
+		if (len != 20)
+			return stream_reply(stream->fd, type,
+					    STREAM_ERROR_ARGUMENT, NULL, 0);
+		return stream_dump_pixels(emu, stream->fd, req);
+	}
+
+	return stream_reply(stream->fd, type, STREAM_ERROR_COMMAND, NULL, 0);
+}
+
+static void emulator_accept_stream(struct chamelium_emulator *emu)
+{
+	struct timeval tv = { .tv_sec = 5 };
+	int fd;
+
+	fd = accept4(emu->stream_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
+		return;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	for (int i = 0; i < EMULATOR_MAX_STREAMS; i++) {
+		if (emu->streams[i].fd < 0) {
+			memset(&emu->streams[i], 0, sizeof(emu->streams[i]));
+			emu->streams[i].fd = fd;
+			return;
+		}
+	}
+
+	igt_warn("Too many Chamelium emulator stream clients\n");
+	close(fd);
+}
+
+static void emulator_close_stream(struct emulator_stream *stream)
+{
+	close(stream->fd);
+	stream->fd = -1;
+	stream->audio = false;
+}
+
+/*
+ * Sends the audio pages which are due to the clients dumping audio, and
+ * returns the time until the next one in ms, or -1 if there is none.
+ */
+static int emulator_send_audio(struct chamelium_emulator *emu)
+{
+	int32_t page[1 + EMULATOR_AUDIO_PAGE_FRAMES * EMULATOR_AUDIO_CHANNELS];
+	uint64_t now = emulator_now();
+	int timeout = -1;
+
+	if (!emu->audio_capturing)
+		return -1;
+
+	for (int i = 0; i < EMULATOR_MAX_STREAMS; i++) {
+		struct emulator_stream *stream = &emu->streams[i];
+		uint64_t start, due;
+
+		if (stream->fd < 0 || !stream->audio)
+			continue;
+
+		start = max(stream->audio_start, emu->audio_capture_start);
+
+		for (;;) {
+			due = start + (uint64_t) (stream->pages + 1) *
+				      EMULATOR_AUDIO_PAGE_FRAMES *
+				      NSEC_PER_SEC / emu->audio_rate;
+			if (due > now) {
+				int wait = DIV_ROUND_UP(due - now, 1000000);
+
+				timeout = timeout < 0 ? wait :
+					  min(timeout, wait);
+				break;
+			}
+
+			page[0] = htonl(stream->pages);
+			audio_page(emu, stream->pages, page + 1);
+
+			if (!stream_send_header(stream->fd, STREAM_MESSAGE_DATA,
+						STREAM_MESSAGE_DUMP_REALTIME_AUDIO,
+						STREAM_ERROR_NONE,
+						sizeof(page)) ||
+			    !emulator_write(stream->fd, page, sizeof(page))) {
+				emulator_close_stream(stream);
+				break;
+			}
+
+			stream->pages++;
+		}
+	}
+
+	return timeout;
+}
+
+static void *emulator_thread(void *data)
+{
+	struct chamelium_emulator *emu = data;
+
+	for (;;) {
+		struct pollfd pfd[3 + EMULATOR_MAX_STREAMS] = {
+			{ .fd = emu->wake[0], .events = POLLIN },
+			{ .fd = emu->rpc_fd, .events = POLLIN },
+			{ .fd = emu->stream_fd, .events = POLLIN },
+		};
+		int timeout;
+
+		for (int i = 0; i < EMULATOR_MAX_STREAMS; i++) {
+			pfd[3 + i].fd = emu->streams[i].fd;
+			pfd[3 + i].events = POLLIN;
+		}
+
+		timeout = emulator_send_audio(emu);
+		if (poll(pfd, ARRAY_SIZE(pfd), timeout) < 0 && errno != EINTR)
+			break;
+
+		if (pfd[0].revents)
+			break;
+
+		if (pfd[1].revents & POLLIN)
+			emulator_serve_rpc(emu);
+
+		for (int i = 0; i < EMULATOR_MAX_STREAMS; i++) {
+			if (pfd[3 + i].revents &&
+			    !emulator_serve_stream(emu, &emu->streams[i]))
+				emulator_close_stream(&emu->streams[i]);
+		}
+
+		if (pfd[2].revents & POLLIN)
+			emulator_accept_stream(emu);
+	}
+
+	return NULL;
+}
+
+static int emulator_listen(const char *address, unsigned int *port)
+{
+	struct sockaddr_in addr = { .sin_family = AF_INET };
+	socklen_t len = sizeof(addr);
+	int fd, on = 1;
+
+	if (inet_pton(AF_INET, address, &addr.sin_addr) != 1) {
+		igt_warn("Invalid address %s\n", address);
+		return -1;
+	}
+	addr.sin_port = htons(*port);
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+	    listen(fd, 8) ||
+	    getsockname(fd, (struct sockaddr *) &addr, &len)) {
+		igt_warn("Failed to listen on %s:%u: %s\n",
+			 address, *port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	*port = ntohs(addr.sin_port);
+
+	return fd;
+}
+
+/**
+ * chamelium_emulator_create:
+ * @width: width of the virtual display
+ * @height: height of the virtual display
+ *
+ * Creates an emulator, to be set up with the other chamelium_emulator_*()
+ * functions, then started with chamelium_emulator_start().
+ *
+ * Returns: the new emulator, to be freed with chamelium_emulator_destroy()
+ */
+struct chamelium_emulator *chamelium_emulator_create(int width, int height)
+{
+	struct chamelium_emulator *emu;
+
+	igt_assert(width > 0 && height > 0);
+
+	emu = calloc(1, sizeof(*emu));
+	igt_assert(emu);
+
+	emu->width = width;
+	emu->height = height;
+	emu->stream_frames = true;
+
+	emu->rpc_fd = emu->stream_fd = -1;
+	emu->wake[0] = emu->wake[1] = -1;
+	for (int i = 0; i < EMULATOR_MAX_STREAMS; i++)
+		emu->streams[i].fd = -1;
+
+	for (int i = 0; i < EMULATOR_PORTS; i++)
+		emu->ddc[i] = true;
+
+	return emu;
+}
+
+/**
+ * chamelium_emulator_add_frame:
+ * @emu: the emulator
+ * @surface: an RGB24 or ARGB32 image surface, of the size of the display
+ *
+ * Adds a copy of @surface to the frames shown on the virtual display.
+ *
+ * Returns: whether @surface could be added
+ */
+bool chamelium_emulator_add_frame(struct chamelium_emulator *emu,
+				  cairo_surface_t *surface)
+{
+	cairo_format_t format = cairo_image_surface_get_format(surface);
+	int width = cairo_image_surface_get_width(surface);
+	int height = cairo_image_surface_get_height(surface);
+	struct emulator_frame *frame;
+	const unsigned char *data;
+	int stride;
+
+	igt_assert(!emu->running);
+
+	if (format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_ARGB32) {
+		igt_warn("Unsupported frame format %d\n", format);
+		return false;
+	}
+
+	if (width != emu->width || height != emu->height) {
+		igt_warn("Frame size %dx%d doesn't match the display's %dx%d\n",
+			 width, height, emu->width, emu->height);
+		return false;
+	}
+
+	emu->frames = realloc(emu->frames,
+			      (emu->frame_count + 1) * sizeof(*emu->frames));
+	igt_assert(emu->frames);
+	frame = &emu->frames[emu->frame_count++];
+	frame_init(frame, width, height);
+
+	cairo_surface_flush(surface);
+	data = cairo_image_surface_get_data(surface);
+	stride = cairo_image_surface_get_stride(surface);
+
+	for (int y = 0; y < height; y++) {
+		const uint32_t *row = (const uint32_t *) (data + y * stride);
+		unsigned char *p = frame->rgb + (size_t) y * width * 3;
+
+		for (int x = 0; x < width; x++, p += 3) {
+			p[0] = row[x] >> 16;
+			p[1] = row[x] >> 8;
+			p[2] = row[x];
+		}
+	}
+
+	return true;
+}
+
+/**
+ * chamelium_emulator_add_frame_png:
+ * @emu: the emulator
+ * @path: a PNG file, of the size of the display
+ *
+ * Adds the image in @path to the frames shown on the virtual display.
+ *
+ * Returns: whether the image could be added
+ */
+bool chamelium_emulator_add_frame_png(struct chamelium_emulator *emu,
+				      const char *path)
+{
+	cairo_surface_t *surface;
+	bool ret;
+
+	surface = cairo_image_surface_create_from_png(path);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		igt_warn("Failed to load %s: %s\n", path,
+			 cairo_status_to_string(cairo_surface_status(surface)));
+		cairo_surface_destroy(surface);
+		return false;
+	}
+
+	ret = chamelium_emulator_add_frame(emu, surface);
+	cairo_surface_destroy(surface);
+
+	return ret;
+}
+
+/**
+ * chamelium_emulator_set_audio:
+ * @emu: the emulator
+ * @path: a file of interleaved S32_LE samples
+ * @rate: sampling rate of the file in Hz
+ * @channels: number of channels of the file, up to 8
+ *
+ * Sets the audio received on the DP and HDMI ports. Without it, the ports have
+ * no audio support.
+ *
+ * Returns: whether the file could be loaded
+ */
+bool chamelium_emulator_set_audio(struct chamelium_emulator *emu,
+				  const char *path, int rate, int channels)
+{
+	GError *error = NULL;
+	gchar *contents;
+	gsize len;
+
+	igt_assert(!emu->running);
+	igt_assert(rate > 0);
+	igt_assert(channels > 0 && channels <= EMULATOR_AUDIO_CHANNELS);
+
+	if (!g_file_get_contents(path, &contents, &len, &error)) {
+		igt_warn("Failed to load %s: %s\n", path, error->message);
+		g_error_free(error);
+		return false;
+	}
+
+	if (len < sizeof(int32_t) * channels) {
+		igt_warn("No audio in %s\n", path);
+		g_free(contents);
+		return false;
+	}
+
+	free(emu->audio);
+	emu->audio_frames = len / (sizeof(int32_t) * channels);
+	emu->audio = malloc(emu->audio_frames * channels * sizeof(int32_t));
+	igt_assert(emu->audio);
+
+	for (size_t i = 0; i < emu->audio_frames * channels; i++)
+		emu->audio[i] = le32toh(((const int32_t *) contents)[i]);
+	g_free(contents);
+
+	emu->audio_rate = rate;
+	emu->audio_channels = channels;
+
+	return true;
+}
+
+/**
+ * chamelium_emulator_set_frame_streaming:
+ * @emu: the emulator
+ * @enable: whether to send frames over the stream server
+ *
+ * Frame streaming, an extension of the board's stream protocol advertised in
+ * the version the stream server reports, is enabled by default. Without it,
+ * the stream server behaves like the board's, only streaming audio, and
+ * clients read frames over XML-RPC.
+ */
+void chamelium_emulator_set_frame_streaming(struct chamelium_emulator *emu,
+					    bool enable)
+{
+	igt_assert(!emu->running);
+
+	emu->stream_frames = enable;
+}
+
+/**
+ * chamelium_emulator_start:
+ * @emu: the emulator
+ * @address: the IPv4 address to listen on, or NULL for the loopback
+ * @rpc_port: the port of the XML-RPC server, or 0 for any free one
+ * @stream_port: the port of the stream server, or 0 for any free one
+ *
+ * Starts serving, from a thread of its own.
+ *
+ * Returns: whether the servers could be started
+ */
+bool chamelium_emulator_start(struct chamelium_emulator *emu,
+			      const char *address,
+			      unsigned int rpc_port, unsigned int stream_port)
+{
+	igt_assert(!emu->running);
+
+	snprintf(emu->address, sizeof(emu->address), "%s",
+		 address ?: "127.0.0.1");
+
+	if (!emu->frame_count) {
+		emu->frames = calloc(1, sizeof(*emu->frames));
+		igt_assert(emu->frames);
+		frame_pattern(&emu->frames[0], emu->width, emu->height);
+		emu->frame_count = 1;
+	}
+
+	/* The frames make up the initial capture */
+	igt_assert(emulator_capture(emu, emu->frame_count));
+
+	emu->rpc_port = rpc_port;
+	emu->rpc_fd = emulator_listen(emu->address, &emu->rpc_port);
+	emu->stream_port = stream_port;
+	emu->stream_fd = emulator_listen(emu->address, &emu->stream_port);
+	if (emu->rpc_fd < 0 || emu->stream_fd < 0)
+		goto err;
+
+	if (pipe2(emu->wake, O_CLOEXEC))
+		goto err;
+
+	if (pthread_create(&emu->thread, NULL, emulator_thread, emu)) {
+		close(emu->wake[0]);
+		close(emu->wake[1]);
+		emu->wake[0] = emu->wake[1] = -1;
+		goto err;
+	}
+
+	emu->running = true;
+
+	igt_debug("Chamelium emulator listening on %s, "
+		  "XML-RPC port %u, stream port %u\n",
+		  emu->address, emu->rpc_port, emu->stream_port);
+
+	return true;
+
+err:
+	if (emu->rpc_fd >= 0)
+		close(emu->rpc_fd);
+	if (emu->stream_fd >= 0)
+		close(emu->stream_fd);
+	emu->rpc_fd = emu->stream_fd = -1;
+
+	return false;
+}
+
+/**
+ * chamelium_emulator_get_rpc_port:
+ * @emu: a started emulator
+ *
+ * Returns: the port of the XML-RPC server
+ */
+unsigned int chamelium_emulator_get_rpc_port(struct chamelium_emulator *emu)
+{
+	return emu->rpc_port;
+}
+
+/**
+ * chamelium_emulator_get_stream_port:
+ * @emu: a started emulator
+ *
+ * Returns: the port of the stream server
+ */
+unsigned int chamelium_emulator_get_stream_port(struct chamelium_emulator *emu)
+{
+	return emu->stream_port;
+}
+
+/**
+ * chamelium_emulator_set_config:
+ * @emu: a started emulator
+ *
+ * Points the Chamelium configuration of this process at @emu, so that
+ * chamelium_init_rpc_only() and chamelium_stream_init() connect to it.
+ */
+void chamelium_emulator_set_config(struct chamelium_emulator *emu)
+{
+	const char *host = emu->address;
+	char *url;
+
+	if (!strcmp(host, "0.0.0.0"))
+		host = "127.0.0.1";
+
+	if (!igt_key_file)
+		igt_key_file = g_key_file_new();
+
+	url = g_strdup_printf("http://%s:%u", host, emu->rpc_port);
+	g_key_file_set_string(igt_key_file, "Chamelium", "URL", url);
+	g_key_file_set_integer(igt_key_file, "Chamelium", "StreamPort",
+			       emu->stream_port);
+	g_free(url);
+}
+
+/**
+ * chamelium_emulator_destroy:
+ * @emu: the emulator
+ *
+ * Stops @emu if it was started, closing all connections, and frees it.
+ */
+void chamelium_emulator_destroy(struct chamelium_emulator *emu)
+{
+	if (emu->running) {
+		igt_assert_eq(write(emu->wake[1], "", 1), 1);
+		pthread_join(emu->thread, NULL);
+
+		close(emu->wake[0]);
+		close(emu->wake[1]);
+		close(emu->rpc_fd);
+		close(emu->stream_fd);
+
+		for (int i = 0; i < EMULATOR_MAX_STREAMS; i++)
+			if (emu->streams[i].fd >= 0)
+				emulator_close_stream(&emu->streams[i]);
+	}
+
+	emulator_free_captured(emu);
+	for (int i = 0; i < emu->frame_count; i++)
+		free(emu->frames[i].rgb);
+	free(emu->frames);
+	free(emu->audio);
+	free(emu);
+}
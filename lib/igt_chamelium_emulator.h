@@ -0,0 +1,55 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef IGT_CHAMELIUM_EMULATOR_H
+#define IGT_CHAMELIUM_EMULATOR_H
+
+#include "config.h"
+
+#include <stdbool.h>
+#include <cairo.h>
+
+#define CHAMELIUM_EMULATOR_RPC_PORT 9992
+#define CHAMELIUM_EMULATOR_STREAM_PORT 9994
+
+struct chamelium_emulator;
+
+struct chamelium_emulator *chamelium_emulator_create(int width, int height);
+bool chamelium_emulator_add_frame(struct chamelium_emulator *emu,
+				  cairo_surface_t *surface);
+bool chamelium_emulator_add_frame_png(struct chamelium_emulator *emu,
+				      const char *path);
+bool chamelium_emulator_set_audio(struct chamelium_emulator *emu,
+				  const char *path, int rate, int channels);
+void chamelium_emulator_set_frame_streaming(struct chamelium_emulator *emu,
+					    bool enable);
+bool chamelium_emulator_start(struct chamelium_emulator *emu,
+			      const char *address,
+			      unsigned int rpc_port, unsigned int stream_port);
+unsigned int chamelium_emulator_get_rpc_port(struct chamelium_emulator *emu);
+unsigned int chamelium_emulator_get_stream_port(struct chamelium_emulator *emu);
+void chamelium_emulator_set_config(struct chamelium_emulator *emu);
+void chamelium_emulator_destroy(struct chamelium_emulator *emu);
+
+#endif /* IGT_CHAMELIUM_EMULATOR_H */
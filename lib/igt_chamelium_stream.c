@@ -41,6 +41,15 @@
 #define STREAM_VERSION_MAJOR 1
 #define STREAM_VERSION_MINOR 0
 
+/*
+ * Sending frames is an extension of the protocol only the IGT Chamelium
+ * emulator implements. It advertises it by appending this tag to its version,
+ * which the board's server never does, and the extension's requests are
+ * outside of the range of the board's message types. They are never sent to
+ * a server without the tag.
+ */
+#define STREAM_EMULATOR_FRAMES "igt-emulator-frames"
+
 enum stream_error {
 	STREAM_ERROR_NONE = 0,
 	STREAM_ERROR_COMMAND = 1,
@@ -69,15 +78,25 @@ enum stream_message_type {
 	STREAM_MESSAGE_STOP_DUMP_VIDEO = 6,
 	STREAM_MESSAGE_DUMP_REALTIME_AUDIO = 7,
 	STREAM_MESSAGE_STOP_DUMP_AUDIO = 8,
+	/* Emulator only, see STREAM_EMULATOR_FRAMES */
+	STREAM_MESSAGE_READ_CAPTURED_FRAME = 0x80,
+	STREAM_MESSAGE_DUMP_PIXELS = 0x81,
 };
 
 struct chamelium_stream {
 	char *host;
 	unsigned int port;
+	bool frames;
+	bool quiet;
 
 	int fd;
 };
 
+/* Failing to connect is only worth a warning if the stream is required */
+#define stream_init_warn(client, ...) \
+	igt_log(IGT_LOG_DOMAIN, \
+		(client)->quiet ? IGT_LOG_DEBUG : IGT_LOG_WARN, __VA_ARGS__)
+
 static const char *stream_error_str(enum stream_error err)
 {
 	switch (err) {
@@ -123,33 +142,50 @@ static char *parse_url_host(const char *url)
 	return strndup(url, colon - url);
 }
 
+static bool chamelium_stream_set_server(struct chamelium_stream *client,
+					const char *url, int port)
+{
+	client->host = parse_url_host(url);
+	if (!client->host) {
+		stream_init_warn(client, "Invalid Chamelium URL: %s\n", url);
+		return false;
+	}
+
+	client->port = port > 0 ? port : STREAM_PORT;
+
+	return true;
+}
+
 static bool chamelium_stream_read_config(struct chamelium_stream *client)
 {
 	GError *error = NULL;
 	gchar *chamelium_url;
+	bool ret;
+	int port;
 
 	if (!igt_key_file) {
-		igt_warn("No configuration file available for chamelium\n");
+		stream_init_warn(client,
+				 "No configuration file available for chamelium\n");
 		return false;
 	}
 
 	chamelium_url = g_key_file_get_string(igt_key_file, "Chamelium", "URL",
 					      &error);
 	if (!chamelium_url) {
-		igt_warn("Couldn't read Chamelium URL from config file: %s\n",
-			 error->message);
+		stream_init_warn(client,
+				 "Couldn't read Chamelium URL from config file: %s\n",
+				 error->message);
 		return false;
 	}
 
-	client->host = parse_url_host(chamelium_url);
-	if (!client->host) {
-		igt_warn("Invalid Chamelium URL in config file: %s\n",
-			 chamelium_url);
-		return false;
-	}
-	client->port = STREAM_PORT;
+	/* Optional, for servers not listening on the board's usual port */
+	port = g_key_file_get_integer(igt_key_file, "Chamelium", "StreamPort",
+				      NULL);
 
-	return true;
+	ret = chamelium_stream_set_server(client, chamelium_url, port);
+	g_free(chamelium_url);
+
+	return ret;
 }
 
 static bool chamelium_stream_connect(struct chamelium_stream *client)
@@ -169,7 +205,8 @@ static bool chamelium_stream_connect(struct chamelium_stream *client)
 	hints.ai_socktype = SOCK_STREAM;
 	ret = getaddrinfo(client->host, port_str, &hints, &results);
 	if (ret != 0) {
-		igt_warn("getaddrinfo failed: %s\n", gai_strerror(ret));
+		stream_init_warn(client, "getaddrinfo failed: %s\n",
+				 gai_strerror(ret));
 		return false;
 	}
 
@@ -192,7 +229,8 @@ static bool chamelium_stream_connect(struct chamelium_stream *client)
 	freeaddrinfo(results);
 
 	if (client->fd < 0) {
-		igt_warn("Failed to connect to Chamelium stream server\n");
+		stream_init_warn(client,
+				 "Failed to connect to Chamelium stream server\n");
 		return false;
 	}
 
@@ -312,17 +350,17 @@ static bool chamelium_stream_write_header(struct chamelium_stream *client,
 	return write_whole(client->fd, buf, sizeof(buf));
 }
 
-static bool chamelium_stream_read_response(struct chamelium_stream *client,
-					   enum stream_message_type type,
-					   void *buf, size_t buf_len)
+/* Reads the header of a successful response, leaving its body to be read */
+static bool chamelium_stream_read_response_header(struct chamelium_stream *client,
+						  enum stream_message_type type,
+						  size_t *len)
 {
 	enum stream_message_kind read_kind;
 	enum stream_message_type read_type;
 	enum stream_error read_err;
-	size_t read_len;
 
 	if (!chamelium_stream_read_header(client, &read_kind, &read_type,
-					  &read_err, &read_len))
+					  &read_err, len))
 		return false;
 
 	if (read_kind != STREAM_MESSAGE_RESPONSE) {
@@ -339,6 +377,19 @@ static bool chamelium_stream_read_response(struct chamelium_stream *client,
 			 stream_error_str(read_err), read_err);
 		return false;
 	}
+
+	return true;
+}
+
+static bool chamelium_stream_read_response(struct chamelium_stream *client,
+					   enum stream_message_type type,
+					   void *buf, size_t buf_len)
+{
+	size_t read_len;
+
+	if (!chamelium_stream_read_response_header(client, type, &read_len))
+		return false;
+
 	if (buf_len != read_len) {
 		igt_warn("Received invalid message body size "
 			 "(got %zu bytes, want %zu bytes)\n",
@@ -374,23 +425,47 @@ static bool chamelium_stream_call(struct chamelium_stream *client,
 	return chamelium_stream_read_response(client, type, resp_buf, resp_len);
 }
 
+/** Read the version response.
+ *
+ * The body is laid out as follows:
+ * - u8: major version
+ * - u8: minor version
+ * - STREAM_EMULATOR_FRAMES, without the NUL terminator, from the emulator only
+ */
 static bool chamelium_stream_check_version(struct chamelium_stream *client)
 {
-	char resp[2];
+	static const char frames[] = STREAM_EMULATOR_FRAMES;
+	char resp[2 + sizeof(frames) - 1];
 	uint8_t major, minor;
+	size_t len;
+
+	if (!chamelium_stream_write_request(client, STREAM_MESSAGE_GET_VERSION,
+					    NULL, 0) ||
+	    !chamelium_stream_read_response_header(client,
+						   STREAM_MESSAGE_GET_VERSION,
+						   &len))
+		return false;
+
+	if (len != 2 && len != sizeof(resp)) {
+		igt_warn("Received invalid version size (got %zu bytes)\n",
+			 len);
+		return false;
+	}
 
-	if (!chamelium_stream_call(client, STREAM_MESSAGE_GET_VERSION,
-				   NULL, 0, resp, sizeof(resp)))
+	if (!read_whole(client->fd, resp, len))
 		return false;
 
 	major = resp[0];
 	minor = resp[1];
 	if (major != STREAM_VERSION_MAJOR || minor < STREAM_VERSION_MINOR) {
-		igt_warn("Version mismatch (want %d.%d, got %d.%d)\n",
-			 STREAM_VERSION_MAJOR, STREAM_VERSION_MINOR,
-			 major, minor);
+		stream_init_warn(client,
+				 "Version mismatch (want %d.%d, got %d.%d)\n",
+				 STREAM_VERSION_MAJOR, STREAM_VERSION_MINOR,
+				 major, minor);
 		return false;
 	}
+	client->frames = len == sizeof(resp) &&
+			 !memcmp(&resp[2], frames, sizeof(frames) - 1);
 
 	return true;
 }
@@ -538,17 +613,169 @@ bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client)
 }
 
 /**
- * chamelium_stream_init:
+ * chamelium_stream_supports_frames:
  *
- * Connects to the Chamelium streaming server.
+ * Returns: whether the streaming server can send frames, with
+ * #chamelium_stream_read_captured_frame and #chamelium_stream_dump_pixels.
+ * Only the stream server of the Chamelium emulator can, as an extension of the
+ * protocol; the board's only streams audio.
  */
-struct chamelium_stream *chamelium_stream_init(void)
+bool chamelium_stream_supports_frames(struct chamelium_stream *client)
+{
+	return client->frames;
+}
+
+/** Read a frame response.
+ *
+ * The body is laid out as follows:
+ * - u32: width
+ * - u32: height
+ * - width * height * 3 bytes: pixels, with red, green and blue bytes, the
+ *   same as the XML-RPC frame dumps
+ */
+static bool chamelium_stream_receive_frame(struct chamelium_stream *client,
+					   enum stream_message_type type,
+					   int *width, int *height,
+					   unsigned char **buf, size_t *buf_len)
+{
+	size_t read_len;
+	char dims[8];
+
+	if (!chamelium_stream_read_response_header(client, type, &read_len))
+		return false;
+
+	if (read_len < sizeof(dims)) {
+		igt_warn("Received a frame without a size\n");
+		return false;
+	}
+
+	if (!read_whole(client->fd, dims, sizeof(dims)))
+		return false;
+	*width = ntohl(*(uint32_t *) &dims[0]);
+	*height = ntohl(*(uint32_t *) &dims[4]);
+	read_len -= sizeof(dims);
+
+	if (read_len != (size_t) *width * *height * 3) {
+		igt_warn("Received invalid frame size "
+			 "(got %zu bytes for %dx%d)\n",
+			 read_len, *width, *height);
+		return false;
+	}
+
+	*buf = malloc(read_len);
+	if (!*buf) {
+		igt_warn("malloc failed: %s\n", strerror(errno));
+		return false;
+	}
+	*buf_len = read_len;
+
+	if (!read_whole(client->fd, *buf, read_len)) {
+		free(*buf);
+		*buf = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * chamelium_stream_read_captured_frame:
+ * @index: the index of the captured frame
+ * @width: will be set to the width of the frame
+ * @height: will be set to the height of the frame
+ * @buf: will be set to the pixels, 3 bytes each
+ * @buf_len: will be set to the size of @buf
+ *
+ * Receives a frame captured during the last video capture, without the base64
+ * encoding of the ReadCapturedFrame XML-RPC call. The server must support it,
+ * see #chamelium_stream_supports_frames.
+ *
+ * The caller is responsible for calling free(3) on *buf.
+ */
+bool chamelium_stream_read_captured_frame(struct chamelium_stream *client,
+					  unsigned int index,
+					  int *width, int *height,
+					  unsigned char **buf, size_t *buf_len)
+{
+	char req[4];
+
+	igt_assert(chamelium_stream_supports_frames(client));
+
+	*(uint32_t *) &req[0] = htonl(index);
+
+	if (!chamelium_stream_write_request(client,
+					    STREAM_MESSAGE_READ_CAPTURED_FRAME,
+					    req, sizeof(req)))
+		return false;
+
+	return chamelium_stream_receive_frame(client,
+					      STREAM_MESSAGE_READ_CAPTURED_FRAME,
+					      width, height, buf, buf_len);
+}
+
+/**
+ * chamelium_stream_dump_pixels:
+ * @port_id: the Chamelium port to capture
+ * @x: the X coordinate to crop the capture to
+ * @y: the Y coordinate to crop the capture to
+ * @w: the width to crop the capture to, or 0 for the whole screen
+ * @h: the height to crop the capture to, or 0 for the whole screen
+ * @width: will be set to the width of the frame
+ * @height: will be set to the height of the frame
+ * @buf: will be set to the pixels, 3 bytes each
+ * @buf_len: will be set to the size of @buf
+ *
+ * Captures the currently displayed image on a port, like the DumpPixels
+ * XML-RPC call but without the base64 encoding. The server must support it,
+ * see #chamelium_stream_supports_frames.
+ *
+ * The caller is responsible for calling free(3) on *buf.
+ */
+bool chamelium_stream_dump_pixels(struct chamelium_stream *client,
+				  int port_id, int x, int y, int w, int h,
+				  int *width, int *height,
+				  unsigned char **buf, size_t *buf_len)
+{
+	char req[20];
+
+	igt_assert(chamelium_stream_supports_frames(client));
+
+	*(uint32_t *) &req[0] = htonl(port_id);
+	*(uint32_t *) &req[4] = htonl(x);
+	*(uint32_t *) &req[8] = htonl(y);
+	*(uint32_t *) &req[12] = htonl(w);
+	*(uint32_t *) &req[16] = htonl(h);
+
+	if (!chamelium_stream_write_request(client, STREAM_MESSAGE_DUMP_PIXELS,
+					    req, sizeof(req)))
+		return false;
+
+	return chamelium_stream_receive_frame(client,
+					      STREAM_MESSAGE_DUMP_PIXELS,
+					      width, height, buf, buf_len);
+}
+
+/**
+ * __chamelium_stream_init:
+ * @url: the URL of the Chamelium's RPC server, or NULL to read the URL and
+ * the stream port from the Chamelium configuration
+ * @port: the port of the stream server, or 0 for the usual one, when @url is
+ * given
+ * @quiet: whether to log failures to connect as debug messages only
+ *
+ * Connects to the Chamelium streaming server, like #chamelium_stream_init,
+ * for callers which already know the board or can do without the stream.
+ */
+struct chamelium_stream *__chamelium_stream_init(const char *url, int port,
+						 bool quiet)
 {
 	struct chamelium_stream *client;
 
 	client = calloc(1, sizeof(*client));
+	client->quiet = quiet;
 
-	if (!chamelium_stream_read_config(client))
+	if (url ? !chamelium_stream_set_server(client, url, port) :
+		  !chamelium_stream_read_config(client))
 		goto error_client;
 	if (!chamelium_stream_connect(client))
 		goto error_client;
@@ -560,13 +787,25 @@ struct chamelium_stream *chamelium_stream_init(void)
 error_fd:
 	close(client->fd);
 error_client:
+	free(client->host);
 	free(client);
 	return NULL;
 }
 
+/**
+ * chamelium_stream_init:
+ *
+ * Connects to the Chamelium streaming server.
+ */
+struct chamelium_stream *chamelium_stream_init(void)
+{
+	return __chamelium_stream_init(NULL, 0, false);
+}
+
 void chamelium_stream_deinit(struct chamelium_stream *client)
 {
 	if (close(client->fd) != 0)
 		igt_warn("close failed: %s\n", strerror(errno));
+	free(client->host);
 	free(client);
 }
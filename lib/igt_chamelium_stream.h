@@ -38,6 +38,8 @@ enum chamelium_stream_realtime_mode {
 
 struct chamelium_stream;
 
+struct chamelium_stream *__chamelium_stream_init(const char *url, int port,
+						 bool quiet);
 struct chamelium_stream *chamelium_stream_init(void);
 void chamelium_stream_deinit(struct chamelium_stream *client);
 bool chamelium_stream_dump_realtime_audio(struct chamelium_stream *client,
@@ -46,5 +48,14 @@ bool chamelium_stream_receive_realtime_audio(struct chamelium_stream *client,
 					     size_t *page_count,
 					     int32_t **buf, size_t *buf_len);
 bool chamelium_stream_stop_realtime_audio(struct chamelium_stream *client);
+bool chamelium_stream_supports_frames(struct chamelium_stream *client);
+bool chamelium_stream_read_captured_frame(struct chamelium_stream *client,
+					  unsigned int index,
+					  int *width, int *height,
+					  unsigned char **buf, size_t *buf_len);
+bool chamelium_stream_dump_pixels(struct chamelium_stream *client,
+				  int port_id, int x, int y, int w, int h,
+				  int *width, int *height,
+				  unsigned char **buf, size_t *buf_len);
 
 #endif
@@ -249,6 +249,7 @@
  *	&num; The common configuration section follows.
  *	[Common]
  *	FrameDumpPath=/tmp # The path to dump frames that fail comparison checks
+ *	WorkerThreads=4 # Threads for CPU heavy work, defaults to the CPU count
  *
  *	&num; Device selection filter
  *	Device=pci:vendor=8086,card=0;sys:/sys/devices/platform/vgem
@@ -334,11 +335,39 @@ static int igt_exitcode = IGT_EXIT_SUCCESS;
 static const char *command_str;
 
 static char* igt_log_domain_filter;
-static struct {
-	char *entries[256];
-	uint8_t start, end;
-} log_buffer;
-static pthread_mutex_t log_buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Lines kept for _igt_log_buffer_dump(). Each thread formats its lines
+ * into slots of its own preallocated ring without taking any lock, a
+ * global sequence number orders the lines of all threads. Only lines
+ * too long for a slot are allocated.
+ */
+#define LOG_BUFFER_LINES 256
+#define LOG_BUFFER_LINE_SIZE 256
+
+struct log_entry {
+	/* 0 while being written */
+	uint64_t seq;
+	char *long_line;
+	char line[LOG_BUFFER_LINE_SIZE];
+};
+
+struct log_ring {
+	struct log_ring *next;
+	/* Its thread exited, can be handed to a new one */
+	bool retired;
+	unsigned int count;
+	struct log_entry entries[LOG_BUFFER_LINES];
+};
+
+static struct log_ring *log_rings;
+static pthread_mutex_t log_rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t log_ring_key;
+static __thread struct log_ring *thread_log_ring;
+
+/* Sequence of the next line, and of the first one not yet dumped */
+static uint64_t log_seq = 1;
+static uint64_t log_start_seq = 1;
 
 GKeyFile *igt_key_file;
 
@@ -369,31 +398,112 @@ const char *igt_test_name(void)
 	return command_str;
 }
 
-static void _igt_log_buffer_append(char *line)
+static void log_ring_retire(void *data)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	struct log_ring *ring = data;
 
-	free(log_buffer.entries[log_buffer.end]);
-	log_buffer.entries[log_buffer.end] = line;
-	log_buffer.end++;
-	if (log_buffer.end == log_buffer.start)
-		log_buffer.start++;
+	pthread_mutex_lock(&log_rings_mutex);
+	ring->retired = true;
+	pthread_mutex_unlock(&log_rings_mutex);
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	thread_log_ring = NULL;
 }
 
-static void _igt_log_buffer_reset(void)
+static struct log_ring *log_ring_get(void)
+{
+	struct log_ring *ring;
+
+	if (thread_log_ring)
+		return thread_log_ring;
+
+	pthread_mutex_lock(&log_rings_mutex);
+
+	for (ring = log_rings; ring; ring = ring->next) {
+		if (ring->retired) {
+			ring->retired = false;
+			break;
+		}
+	}
+
+	if (!ring) {
+		ring = calloc(1, sizeof(*ring));
+		if (ring) {
+			ring->next = log_rings;
+			log_rings = ring;
+		}
+	}
+
+	pthread_mutex_unlock(&log_rings_mutex);
+
+	if (ring)
+		pthread_setspecific(log_ring_key, ring);
+
+	return thread_log_ring = ring;
+}
+
+/* Copies of the lines being dumped, protected by log_rings_mutex */
+static char log_window_lines[LOG_BUFFER_LINES][LOG_BUFFER_LINE_SIZE];
+
+/*
+ * Collects the lines not dumped yet, up to the last LOG_BUFFER_LINES, in
+ * order. The writers don't wait for us, so each line is copied out and
+ * dropped if it got overwritten meanwhile. Long lines can only be freed
+ * under log_rings_mutex, which must be held for as long as the window is
+ * used.
+ */
+static unsigned int log_buffer_window(const char **window, uint64_t *end_seq)
 {
-	pthread_mutex_lock(&log_buffer_mutex);
+	uint64_t end = __atomic_load_n(&log_seq, __ATOMIC_ACQUIRE);
+	uint64_t start = __atomic_load_n(&log_start_seq, __ATOMIC_RELAXED);
+	struct log_ring *ring;
+
+	if (end - start > LOG_BUFFER_LINES)
+		start = end - LOG_BUFFER_LINES;
+
+	memset(window, 0, sizeof(*window) * LOG_BUFFER_LINES);
+
+	for (ring = log_rings; ring; ring = ring->next) {
+		for (int i = 0; i < LOG_BUFFER_LINES; i++) {
+			struct log_entry *entry = &ring->entries[i];
+			uint64_t seq = __atomic_load_n(&entry->seq,
+						       __ATOMIC_ACQUIRE);
+			const char *long_line;
+			char *copy;
+
+			if (seq < start || seq >= end)
+				continue;
+
+			copy = log_window_lines[seq - start];
+			long_line = __atomic_load_n(&entry->long_line,
+						    __ATOMIC_ACQUIRE);
+			if (!long_line)
+				memcpy(copy, entry->line, sizeof(entry->line));
+
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) != seq)
+				continue;
 
-	log_buffer.start = log_buffer.end = 0;
+			window[seq - start] = long_line ?: copy;
+		}
+	}
+
+	*end_seq = end;
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	return end - start;
+}
+
+static void _igt_log_buffer_reset(void)
+{
+	__atomic_store_n(&log_start_seq,
+			 __atomic_load_n(&log_seq, __ATOMIC_RELAXED),
+			 __ATOMIC_RELAXED);
 }
 
 static void _igt_log_buffer_dump(void)
 {
-	uint8_t i;
+	const char *window[LOG_BUFFER_LINES];
+	unsigned int i, n;
+	uint64_t end;
 
 	if (in_subtest && !in_dynamic_subtest && _igt_dynamic_tests_executed >= 0) {
 		/*
@@ -419,26 +529,26 @@ static void _igt_log_buffer_dump(void)
 	else
 		fprintf(stderr, "Test %s failed.\n", command_str);
 
-	if (log_buffer.start == log_buffer.end) {
+	pthread_mutex_lock(&log_rings_mutex);
+
+	n = log_buffer_window(window, &end);
+	if (!n) {
+		pthread_mutex_unlock(&log_rings_mutex);
 		fprintf(stderr, "No log.\n");
 		return;
 	}
 
-	pthread_mutex_lock(&log_buffer_mutex);
 	fprintf(stderr, "**** DEBUG ****\n");
 
-	i = log_buffer.start;
-	do {
-		char *last_line = log_buffer.entries[i];
-		fprintf(stderr, "%s", last_line);
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
+	for (i = 0; i < n; i++)
+		if (window[i])
+			fprintf(stderr, "%s", window[i]);
 
 	/* reset the buffer */
-	log_buffer.start = log_buffer.end = 0;
+	__atomic_store_n(&log_start_seq, end, __ATOMIC_RELAXED);
 
 	fprintf(stderr, "****  END  ****\n");
-	pthread_mutex_unlock(&log_buffer_mutex);
+	pthread_mutex_unlock(&log_rings_mutex);
 }
 
 /**
@@ -452,17 +562,19 @@ static void _igt_log_buffer_dump(void)
  */
 void igt_log_buffer_inspect(igt_buffer_log_handler_t check, void *data)
 {
-	uint8_t i;
-	pthread_mutex_lock(&log_buffer_mutex);
+	const char *window[LOG_BUFFER_LINES];
+	unsigned int n;
+	uint64_t end;
 
-	i = log_buffer.start;
-	do {
-		if (check(log_buffer.entries[i], data))
+	pthread_mutex_lock(&log_rings_mutex);
+
+	n = log_buffer_window(window, &end);
+	for (unsigned int i = 0; i < n; i++) {
+		if (window[i] && check(window[i], data))
 			break;
-		i++;
-	} while (i != log_buffer.start && i != log_buffer.end);
+	}
 
-	pthread_mutex_unlock(&log_buffer_mutex);
+	pthread_mutex_unlock(&log_rings_mutex);
 }
 
 void igt_kmsg(const char *format, ...)
@@ -2321,6 +2433,7 @@ bool __igt_fork(void)
 	case 0:
 		test_child = true;
 		pthread_mutex_init(&print_mutex, NULL);
+		pthread_mutex_init(&log_rings_mutex, NULL);
 		child_pid = getpid();
 		child_tid = -1;
 		exit_handler_count = 0;
@@ -2726,10 +2839,10 @@ void igt_log(const char *domain, enum igt_log_level level, const char *format, .
 	va_end(args);
 }
 
-static pthread_key_t __vlog_line_continuation;
+static __thread bool vlog_line_continuation;
 
 igt_constructor {
-	pthread_key_create(&__vlog_line_continuation, NULL);
+	pthread_key_create(&log_ring_key, log_ring_retire);
 }
 
 /**
@@ -2748,17 +2861,22 @@ igt_constructor {
  */
 void igt_vlog(const char *domain, enum igt_log_level level, const char *format, va_list args)
 {
-	FILE *file;
-	char *line, *formatted_line;
-	char *thread_id;
-	const char *program_name;
-	const char *igt_log_level_str[] = {
+	static const char * const igt_log_level_str[] = {
 		"DEBUG",
 		"INFO",
 		"WARNING",
 		"CRITICAL",
 		"NONE"
 	};
+	struct log_entry *entry, scratch;
+	struct log_ring *ring;
+	char thread_id[32];
+	const char *program_name;
+	const char *formatted_line, *line;
+	size_t prefix, len;
+	va_list copy;
+	FILE *file;
+	int ret;
 
 	assert(format);
 
@@ -2768,40 +2886,81 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 	program_name = command_str;
 #endif
 
-
-	if (igt_thread_is_main()) {
-		thread_id = strdup("");
-	} else {
-		if (asprintf(&thread_id, "[thread:%d] ", gettid()) == -1)
-			thread_id = NULL;
-	}
-
-	if (!thread_id)
-		return;
+	if (igt_thread_is_main())
+		thread_id[0] = '\0';
+	else
+		snprintf(thread_id, sizeof(thread_id), "[thread:%d] ", gettid());
 
 	if (list_subtests && level <= IGT_LOG_WARN)
 		return;
 
-	if (vasprintf(&line, format, args) == -1)
-		return;
+	/*
+	 * Format straight into the next slot of this thread's ring, nobody
+	 * else writes to it. Should the ring be unavailable, format on the
+	 * stack and only print.
+	 */
+	ring = log_ring_get();
+	if (ring) {
+		entry = &ring->entries[ring->count++ % LOG_BUFFER_LINES];
+
+		/* A dump may be looking at the line we are about to free */
+		if (entry->long_line) {
+			pthread_mutex_lock(&log_rings_mutex);
+			free(entry->long_line);
+			entry->long_line = NULL;
+			pthread_mutex_unlock(&log_rings_mutex);
+		}
 
-	if (pthread_getspecific(__vlog_line_continuation)) {
-		formatted_line = strdup(line);
-		if (!formatted_line)
-			goto out;
-	} else if (asprintf(&formatted_line, "(%s:%d) %s%s%s%s: %s", program_name,
-		     getpid(), thread_id, (domain) ? domain : "", (domain) ? "-" : "",
-		     igt_log_level_str[level], line) == -1) {
-		goto out;
+		__atomic_store_n(&entry->seq, 0, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	} else {
+		entry = &scratch;
+		entry->long_line = NULL;
+	}
+
+	prefix = 0;
+	if (!vlog_line_continuation)
+		prefix = snprintf(entry->line, sizeof(entry->line),
+				  "(%s:%d) %s%s%s%s: ", program_name,
+				  getpid(), thread_id, (domain) ? domain : "",
+				  (domain) ? "-" : "", igt_log_level_str[level]);
+	if (prefix >= sizeof(entry->line))
+		prefix = sizeof(entry->line) - 1;
+
+	va_copy(copy, args);
+	ret = vsnprintf(entry->line + prefix, sizeof(entry->line) - prefix,
+			format, copy);
+	va_end(copy);
+	if (ret < 0) {
+		ret = 0;
+		entry->line[prefix] = '\0';
+	}
+	len = ret;
+
+	/* Too long for the slot, which holds its truncated start otherwise */
+	if (prefix + len >= sizeof(entry->line)) {
+		char *long_line = malloc(prefix + len + 1);
+
+		if (long_line) {
+			memcpy(long_line, entry->line, prefix);
+			vsnprintf(long_line + prefix, len + 1, format, args);
+			__atomic_store_n(&entry->long_line, long_line,
+					 __ATOMIC_RELEASE);
+		} else {
+			len = sizeof(entry->line) - prefix - 1;
+		}
 	}
 
-	if (line[strlen(line) - 1] == '\n')
-		pthread_setspecific(__vlog_line_continuation, (void*) false);
-	else
-		pthread_setspecific(__vlog_line_continuation, (void*) true);
+	formatted_line = entry->long_line ?: entry->line;
+	line = formatted_line + prefix;
+
+	vlog_line_continuation = !len || line[len - 1] != '\n';
 
 	/* append log buffer */
-	_igt_log_buffer_append(formatted_line);
+	if (entry != &scratch)
+		__atomic_store_n(&entry->seq,
+				 __atomic_fetch_add(&log_seq, 1, __ATOMIC_RELAXED),
+				 __ATOMIC_RELEASE);
 
 	/* check print log level */
 	if (igt_log_level > level)
@@ -2830,18 +2989,17 @@ void igt_vlog(const char *domain, enum igt_log_level level, const char *format,
 	/* prepend all except information messages with process, domain and log
 	 * level information */
 	if (level != IGT_LOG_INFO) {
-		fwrite(formatted_line, sizeof(char), strlen(formatted_line),
-		       file);
+		fwrite(formatted_line, sizeof(char), prefix + len, file);
 	} else {
 		fwrite(thread_id, sizeof(char), strlen(thread_id), file);
-		fwrite(line, sizeof(char), strlen(line), file);
+		fwrite(line, sizeof(char), len, file);
 	}
 
 	pthread_mutex_unlock(&print_mutex);
 
 out:
-	free(line);
-	free(thread_id);
+	if (entry == &scratch)
+		free(scratch.long_line);
 }
 
 static const char *timeout_op;
@@ -0,0 +1,594 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "igt_drm_fdinfo.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+
+/**
+ * SECTION:igt_drm_fdinfo
+ * @short_description: DRM client usage stats from procfs
+ * @title: DRM fdinfo
+ * @include: igt_drm_fdinfo.h
+ *
+ * Helpers to parse the DRM client usage stats exported in
+ * /proc/<pid>/fdinfo/<fd>, and to keep track of all the DRM clients in the
+ * system cheaply enough to be sampled many times a second.
+ *
+ * Tracked clients keep their fdinfo file open and are reread with pread().
+ * The process directories are only walked again when processes appear or go
+ * away, as seen by inotify or by the last pid in loadavg moving, when a client
+ * goes away, or every @rescan_period scans to catch DRM files opened by known
+ * processes.
+ */
+
+/* Engine class names, indexed as the i915 engine classes. */
+static const char *engine_class[] = {
+	"render",
+	"copy",
+	"video",
+	"video-enhance",
+	"compute",
+};
+
+static int engine_class_index(const char *name, size_t len)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(engine_class); i++) {
+		if (strlen(engine_class[i]) == len &&
+		    !strncmp(engine_class[i], name, len))
+			return i;
+	}
+
+	return -1;
+}
+
+static void copy_value(char *dst, size_t size, const char *val, size_t len)
+{
+	if (len >= size)
+		len = size - 1;
+
+	memcpy(dst, val, len);
+	dst[len] = '\0';
+}
+
+/**
+ * __igt_parse_drm_fdinfo:
+ * @buf: NUL terminated contents of a fdinfo file
+ * @info: stats to fill in
+ *
+ * Returns: the number of DRM keys found, or 0 if @buf does not describe a DRM
+ * client (no drm-driver or drm-client-id).
+ */
+unsigned int
+__igt_parse_drm_fdinfo(const char *buf, struct drm_client_fdinfo *info)
+{
+	bool have_driver = false, have_id = false;
+	unsigned int found = 0;
+	const char *l;
+
+	memset(info, 0, sizeof(*info));
+
+	for (l = buf; *l; ) {
+		const char *eol = strchrnul(l, '\n');
+		const char *colon = memchr(l, ':', eol - l);
+		const char *val;
+
+		if (!colon || strncmp(l, "drm-", 4))
+			goto next;
+
+		val = colon + 1;
+		while (val < eol && isspace(*val))
+			val++;
+
+		if (colon - l == 10 && !strncmp(l, "drm-driver", 10)) {
+			copy_value(info->driver, sizeof(info->driver),
+				   val, eol - val);
+			have_driver = true;
+			found++;
+		} else if (colon - l == 8 && !strncmp(l, "drm-pdev", 8)) {
+			copy_value(info->pdev, sizeof(info->pdev),
+				   val, eol - val);
+			found++;
+		} else if (colon - l == 13 && !strncmp(l, "drm-client-id", 13)) {
+			info->id = strtoul(val, NULL, 10);
+			have_id = true;
+			found++;
+		} else if (!strncmp(l, "drm-engine-", 11)) {
+			int class = engine_class_index(l + 11, colon - l - 11);
+
+			if (class >= 0) {
+				info->busy[class] = strtoull(val, NULL, 10);
+				info->num_engines++;
+				found++;
+			}
+		}
+
+next:
+		l = *eol ? eol + 1 : eol;
+	}
+
+	return have_driver && have_id ? found : 0;
+}
+
+static unsigned int
+read_fdinfo(int fd, struct drm_client_fdinfo *info)
+{
+	char buf[4096];
+	ssize_t len;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return 0;
+
+	buf[len] = '\0';
+
+	return __igt_parse_drm_fdinfo(buf, info);
+}
+
+/**
+ * igt_parse_drm_fdinfo:
+ * @dir: fdinfo directory of a process
+ * @fd: file descriptor number, as a string
+ * @info: stats to fill in
+ *
+ * Returns: the number of DRM keys found, or 0 if @fd is not a DRM client.
+ */
+unsigned int
+igt_parse_drm_fdinfo(int dir, const char *fd, struct drm_client_fdinfo *info)
+{
+	unsigned int ret;
+	int f;
+
+	f = openat(dir, fd, O_RDONLY | O_CLOEXEC);
+	if (f < 0)
+		return 0;
+
+	ret = read_fdinfo(f, info);
+	close(f);
+
+	return ret;
+}
+
+#define GOLDEN_RATIO_PRIME_32 0x9e370001UL
+#define GOLDEN_RATIO_PRIME_64 0x9e37fffffffc0001UL
+
+static uint32_t hash_client_id(const void *key)
+{
+	uint64_t hash = *(const unsigned long *)key;
+
+	hash = hash * GOLDEN_RATIO_PRIME_64;
+	return hash >> 32;
+}
+
+static int equal_client_id(const void *a, const void *b)
+{
+	return *(const unsigned long *)a == *(const unsigned long *)b;
+}
+
+static uint32_t hash_pid(const void *key)
+{
+	uint32_t hash = *(const unsigned int *)key;
+
+	hash = hash * GOLDEN_RATIO_PRIME_32;
+	return hash;
+}
+
+static int equal_pid(const void *a, const void *b)
+{
+	return *(const unsigned int *)a == *(const unsigned int *)b;
+}
+
+struct drm_clients_pid {
+	unsigned int pid;
+	unsigned int generation;
+};
+
+static void free_client(struct igt_map_entry *entry)
+{
+	struct igt_drm_client *c = entry->data;
+
+	close(c->fdinfo);
+	free(c);
+}
+
+static void free_pid(struct igt_map_entry *entry)
+{
+	free(entry->data);
+}
+
+static bool update_client(struct igt_drm_client *c)
+{
+	struct drm_client_fdinfo info;
+
+	/* A reused fd number no longer belongs to the client. */
+	if (!read_fdinfo(c->fdinfo, &info) || info.id != c->id)
+		return false;
+
+	c->info = info;
+
+	return true;
+}
+
+static void read_comm(struct igt_drm_clients *clients,
+		      struct igt_drm_client *c)
+{
+	char path[PATH_MAX];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), "%u/comm", c->pid);
+	fd = openat(clients->root_dir, path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	len = read(fd, c->name, sizeof(c->name) - 1);
+	close(fd);
+	if (len <= 0)
+		return;
+
+	if (c->name[len - 1] == '\n')
+		len--;
+	c->name[len] = '\0';
+}
+
+static bool is_drm_fd(int fd_dir, const char *name)
+{
+	char link[PATH_MAX];
+	ssize_t len;
+
+	len = readlinkat(fd_dir, name, link, sizeof(link) - 1);
+	if (len <= 0)
+		return false;
+
+	link[len] = '\0';
+
+	return !strncmp(link, "/dev/dri/", 9);
+}
+
+static void
+scan_pid(struct igt_drm_clients *clients, unsigned int pid)
+{
+	struct dirent *dent;
+	char path[PATH_MAX];
+	int fd_dir;
+	DIR *d;
+
+	snprintf(path, sizeof(path), "%u/fd", pid);
+	fd_dir = openat(clients->root_dir, path,
+			O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+	if (fd_dir < 0)
+		return;
+
+	d = fdopendir(fd_dir);
+	if (!d) {
+		close(fd_dir);
+		return;
+	}
+
+	while ((dent = readdir(d))) {
+		struct drm_client_fdinfo info;
+		struct igt_drm_client *c;
+		int fd;
+
+		if (!isdigit(dent->d_name[0]))
+			continue;
+
+		if (!is_drm_fd(fd_dir, dent->d_name))
+			continue;
+
+		snprintf(path, sizeof(path), "%u/fdinfo/%s",
+			 pid, dent->d_name);
+		fd = openat(clients->root_dir, path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		if (!read_fdinfo(fd, &info) ||
+		    (clients->driver[0] &&
+		     strcmp(info.driver, clients->driver)) ||
+		    (clients->pdev[0] && strcmp(info.pdev, clients->pdev)) ||
+		    igt_map_search(clients->clients, &info.id)) {
+			close(fd);
+			continue;
+		}
+
+		c = calloc(1, sizeof(*c));
+		if (!c) {
+			close(fd);
+			break;
+		}
+
+		c->id = info.id;
+		c->pid = pid;
+		c->info = info;
+		c->fdinfo = fd;
+		read_comm(clients, c);
+
+		igt_map_insert(clients->clients, &c->id, c);
+	}
+
+	closedir(d);
+}
+
+/*
+ * Walk the process directories, looking at the open files of new processes,
+ * or of all of them if @full, and forget the processes which went away.
+ */
+static void scan_procs(struct igt_drm_clients *clients, bool full)
+{
+	struct igt_map_entry *entry;
+	struct dirent *dent;
+
+	clients->generation++;
+	clients->rescans++;
+
+	rewinddir(clients->proc);
+	while ((dent = readdir(clients->proc))) {
+		struct drm_clients_pid *p;
+		unsigned int pid;
+		bool new = false;
+
+		if (!isdigit(dent->d_name[0]))
+			continue;
+
+		pid = strtoul(dent->d_name, NULL, 10);
+
+		p = igt_map_search(clients->pids, &pid);
+		if (!p) {
+			p = malloc(sizeof(*p));
+			if (!p)
+				continue;
+
+			p->pid = pid;
+			igt_map_insert(clients->pids, &p->pid, p);
+			new = true;
+		}
+		p->generation = clients->generation;
+
+		if (new || full)
+			scan_pid(clients, pid);
+	}
+
+	igt_map_foreach(clients->pids, entry) {
+		struct drm_clients_pid *p = entry->data;
+
+		if (p->generation != clients->generation) {
+			igt_map_remove_entry(clients->pids, entry);
+			free_pid(entry);
+		}
+	}
+
+	igt_map_foreach(clients->clients, entry) {
+		struct igt_drm_client *c = entry->data;
+
+		if (igt_map_search(clients->pids, &c->pid))
+			continue;
+
+		/*
+		 * The client may live on in a child, which only a full rescan
+		 * would find.
+		 */
+		igt_map_remove_entry(clients->clients, entry);
+		free_client(entry);
+		clients->ticks = clients->rescan_period;
+	}
+}
+
+static bool inotify_events(struct igt_drm_clients *clients)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	bool events = false;
+
+	if (clients->inotify < 0)
+		return false;
+
+	while (read(clients->inotify, buf, sizeof(buf)) > 0)
+		events = true;
+
+	return events;
+}
+
+/* The last field of loadavg is the most recently created pid. */
+static bool pid_churn(struct igt_drm_clients *clients)
+{
+	unsigned int last_pid;
+	char buf[128], *p;
+	ssize_t len;
+
+	if (clients->loadavg < 0)
+		return false;
+
+	len = pread(clients->loadavg, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return false;
+
+	buf[len] = '\0';
+	p = strrchr(buf, ' ');
+	if (!p)
+		return false;
+
+	last_pid = strtoul(p + 1, NULL, 10);
+	if (last_pid == clients->last_pid)
+		return false;
+
+	clients->last_pid = last_pid;
+
+	return true;
+}
+
+/**
+ * igt_drm_clients_init:
+ * @proc_root: procfs mount point, or NULL for /proc
+ * @driver: only track clients of this driver, if not NULL
+ * @pdev: only track clients of the device in this PCI slot, if not NULL
+ *
+ * Returns: client tracking state for igt_drm_clients_scan(), or NULL if
+ * @proc_root cannot be read.
+ */
+struct igt_drm_clients *
+igt_drm_clients_init(const char *proc_root, const char *driver,
+		     const char *pdev)
+{
+	struct igt_drm_clients *clients;
+	int dir;
+
+	if (!proc_root)
+		proc_root = "/proc";
+
+	clients = calloc(1, sizeof(*clients));
+	if (!clients)
+		return NULL;
+
+	clients->root_dir = open(proc_root, O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+	if (clients->root_dir < 0)
+		goto err_free;
+
+	dir = dup(clients->root_dir);
+	clients->proc = dir >= 0 ? fdopendir(dir) : NULL;
+	if (!clients->proc) {
+		if (dir >= 0)
+			close(dir);
+		goto err_root;
+	}
+
+	clients->clients = igt_map_create(hash_client_id, equal_client_id);
+	clients->pids = igt_map_create(hash_pid, equal_pid);
+	if (!clients->clients || !clients->pids)
+		goto err_maps;
+
+	/* procfs has no inotify events, other roots may. */
+	clients->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (clients->inotify >= 0 &&
+	    inotify_add_watch(clients->inotify, proc_root,
+			      IN_CREATE | IN_DELETE |
+			      IN_MOVED_FROM | IN_MOVED_TO) < 0) {
+		close(clients->inotify);
+		clients->inotify = -1;
+	}
+
+	clients->loadavg = openat(clients->root_dir, "loadavg",
+				  O_RDONLY | O_CLOEXEC);
+
+	if (driver)
+		copy_value(clients->driver, sizeof(clients->driver),
+			   driver, strlen(driver));
+	if (pdev)
+		copy_value(clients->pdev, sizeof(clients->pdev),
+			   pdev, strlen(pdev));
+
+	clients->rescan_period = IGT_DRM_CLIENTS_RESCAN_PERIOD;
+	clients->ticks = clients->rescan_period;
+
+	return clients;
+
+err_maps:
+	if (clients->pids)
+		igt_map_destroy(clients->pids, NULL);
+	if (clients->clients)
+		igt_map_destroy(clients->clients, NULL);
+	closedir(clients->proc);
+err_root:
+	close(clients->root_dir);
+err_free:
+	free(clients);
+	return NULL;
+}
+
+/**
+ * igt_drm_clients_scan:
+ * @clients: state from igt_drm_clients_init()
+ *
+ * Rereads the usage stats of all known clients, dropping those which went
+ * away, and looks for new clients if processes came or went, or if
+ * @rescan_period scans have passed since all processes were last looked at.
+ *
+ * Returns: the number of clients.
+ */
+unsigned int igt_drm_clients_scan(struct igt_drm_clients *clients)
+{
+	struct igt_map_entry *entry;
+	bool full, rescan;
+
+	full = ++clients->ticks >= clients->rescan_period;
+
+	igt_map_foreach(clients->clients, entry) {
+		struct igt_drm_client *c = entry->data;
+
+		if (update_client(c))
+			continue;
+
+		/* Another file of the process may hold the same client. */
+		igt_map_remove_entry(clients->clients, entry);
+		free_client(entry);
+		full = true;
+	}
+
+	/* Always consume the events, even if rescanning anyway. */
+	rescan = inotify_events(clients);
+	rescan |= pid_churn(clients);
+
+	if (full) {
+		clients->ticks = 0;
+		scan_procs(clients, true);
+	} else if (rescan) {
+		scan_procs(clients, false);
+	}
+
+	return clients->clients->entries;
+}
+
+/**
+ * igt_drm_clients_free:
+ * @clients: state from igt_drm_clients_init()
+ *
+ * Closes all the tracked clients and frees @clients.
+ */
+void igt_drm_clients_free(struct igt_drm_clients *clients)
+{
+	if (!clients)
+		return;
+
+	igt_map_destroy(clients->clients, free_client);
+	igt_map_destroy(clients->pids, free_pid);
+
+	if (clients->loadavg >= 0)
+		close(clients->loadavg);
+	if (clients->inotify >= 0)
+		close(clients->inotify);
+	closedir(clients->proc);
+	close(clients->root_dir);
+	free(clients);
+}
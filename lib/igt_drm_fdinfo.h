@@ -0,0 +1,116 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#ifndef IGT_DRM_FDINFO_H
+#define IGT_DRM_FDINFO_H
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "igt_map.h"
+
+#define DRM_CLIENT_FDINFO_MAX_ENGINES 16
+
+/**
+ * drm_client_fdinfo:
+ * @driver: the drm-driver key
+ * @pdev: the drm-pdev key, the PCI slot of the device, if any
+ * @id: the drm-client-id key, unique for each open DRM file
+ * @num_engines: number of drm-engine-<class> keys found
+ * @busy: nanoseconds of GPU time by engine class
+ *
+ * DRM client usage stats, as read from /proc/<pid>/fdinfo/<fd>.
+ */
+struct drm_client_fdinfo {
+	char driver[128];
+	char pdev[128];
+	unsigned long id;
+
+	unsigned int num_engines;
+	uint64_t busy[DRM_CLIENT_FDINFO_MAX_ENGINES];
+};
+
+unsigned int
+__igt_parse_drm_fdinfo(const char *buf, struct drm_client_fdinfo *info);
+
+unsigned int
+igt_parse_drm_fdinfo(int dir, const char *fd, struct drm_client_fdinfo *info);
+
+/**
+ * igt_drm_client:
+ * @id: DRM client id
+ * @pid: the first process found holding the client
+ * @name: command name of @pid
+ * @info: usage stats from the last scan
+ *
+ * A DRM client found by igt_drm_clients_scan().
+ */
+struct igt_drm_client {
+	unsigned long id;
+	unsigned int pid;
+	char name[24];
+	struct drm_client_fdinfo info;
+
+	/* private: fdinfo file kept open for rereading */
+	int fdinfo;
+};
+
+/**
+ * igt_drm_clients:
+ * @clients: map of struct igt_drm_client by id, walk with igt_map_foreach()
+ * @rescan_period: number of scans after which all processes are rescanned
+ * @rescans: number of times the process directories were walked
+ *
+ * Tracks the DRM clients of all processes under a procfs root.
+ */
+struct igt_drm_clients {
+	struct igt_map *clients;
+	unsigned int rescan_period;
+	unsigned int rescans;
+
+	/* private */
+	int root_dir;
+	DIR *proc;
+	int inotify;
+	int loadavg;
+	unsigned int last_pid;
+
+	char driver[128];
+	char pdev[128];
+
+	struct igt_map *pids;
+	unsigned int generation;
+	unsigned int ticks;
+};
+
+#define IGT_DRM_CLIENTS_RESCAN_PERIOD 10
+
+struct igt_drm_clients *
+igt_drm_clients_init(const char *proc_root, const char *driver,
+		     const char *pdev);
+unsigned int igt_drm_clients_scan(struct igt_drm_clients *clients);
+void igt_drm_clients_free(struct igt_drm_clients *clients);
+
+#endif /* IGT_DRM_FDINFO_H */
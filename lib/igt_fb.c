@@ -43,7 +43,9 @@
 #include "igt_matrix.h"
 #include "igt_vc4.h"
 #include "igt_amd.h"
+#include "igt_workers.h"
 #include "igt_x86.h"
+#include "igt_yuv.h"
 #include "igt_nouveau.h"
 #include "ioctl_wrappers.h"
 #include "intel_batchbuffer.h"
@@ -1330,25 +1332,132 @@ static uint16_t update_crc16_dp(uint16_t crc_old, uint16_t d)
 	return crc_new;
 }
 
+/*
+ * update_crc16_dp() only depends on crc_old ^ d, and linearly so: the new
+ * CRC is the xor of what the high and the low byte of crc_old ^ d each
+ * contribute, which can be looked up in two tables.
+ */
+struct crc16_dp_table {
+	uint16_t hi[256];
+	uint16_t lo[256];
+};
+
+static void crc16_dp_table_init(struct crc16_dp_table *t)
+{
+	for (int i = 0; i < 256; i++) {
+		t->hi[i] = update_crc16_dp(0, i << 8);
+		t->lo[i] = update_crc16_dp(0, i);
+	}
+}
+
+/* An 8 bit component, zero padded to 16 bits */
+static inline uint16_t crc16_dp_u8(const struct crc16_dp_table *t,
+				   uint16_t crc, uint8_t c)
+{
+	return t->hi[(crc >> 8) ^ c] ^ t->lo[crc & 0xff];
+}
+
+/*
+ * The 16x16 bit matrix of a linear map, @m[j] being the image of bit j.
+ */
+static uint16_t crc16_dp_matrix_apply(const uint16_t *m, uint16_t x)
+{
+	uint16_t y = 0;
+
+	for (int j = 0; x; j++, x >>= 1)
+		if (x & 1)
+			y ^= m[j];
+
+	return y;
+}
+
+/*
+ * Running update_crc16_dp() over @n words starting from @crc rather than
+ * from 0 xors the result with @crc run through the CRC step, on zero
+ * data, @n times. That's what this returns, in log(n) matrix squarings.
+ */
+static uint16_t crc16_dp_shift(uint16_t crc, uint64_t n)
+{
+	uint16_t m[16], sq[16];
+
+	for (int j = 0; j < 16; j++)
+		m[j] = update_crc16_dp(1 << j, 0);
+
+	while (n) {
+		if (n & 1)
+			crc = crc16_dp_matrix_apply(m, crc);
+
+		for (int j = 0; j < 16; j++)
+			sq[j] = crc16_dp_matrix_apply(m, m[j]);
+		memcpy(m, sq, sizeof(m));
+
+		n >>= 1;
+	}
+
+	return crc;
+}
+
+struct fb_crc_bands {
+	struct crc16_dp_table table;
+	const uint8_t *data;
+	unsigned int stride;
+	unsigned int width;
+	unsigned int height;
+	unsigned int rows;
+	uint16_t (*crc)[3];
+};
+
+/* The R, G and B CRCs of one band of XRGB8888 rows, starting from 0 */
+static void fb_crc_band(void *data, unsigned int band)
+{
+	struct fb_crc_bands *bands = data;
+	const struct crc16_dp_table *t = &bands->table;
+	unsigned int y0 = band * bands->rows;
+	unsigned int y1 = min(y0 + bands->rows, bands->height);
+	uint16_t r = 0, g = 0, b = 0;
+	uint8_t *line;
+
+	/* Same as for the conversions, the fb may well be uncached */
+	line = malloc(bands->width * 4);
+	igt_assert(line);
+
+	for (unsigned int y = y0; y < y1; y++) {
+		const uint8_t *px = line;
+
+		igt_memcpy_from_wc(line, bands->data + y * bands->stride,
+				   bands->width * 4);
+
+		for (unsigned int x = 0; x < bands->width; x++, px += 4) {
+			r = crc16_dp_u8(t, r, px[2]);
+			g = crc16_dp_u8(t, g, px[1]);
+			b = crc16_dp_u8(t, b, px[0]);
+		}
+	}
+
+	bands->crc[band][0] = r;
+	bands->crc[band][1] = g;
+	bands->crc[band][2] = b;
+
+	free(line);
+}
+
 /**
- * igt_fb_calc_crc:
- * @fb: pointer to an #igt_fb structure
+ * igt_fb_calc_crc_pixels:
+ * @fb: linear framebuffer describing the layout of @ptr
+ * @ptr: pixels of @fb
  * @crc: pointer to an #igt_crc_t structure
  *
- * This function calculate the 16-bit frame CRC of RGB components over all
- * the active pixels.
+ * Same as igt_fb_calc_crc(), over pixels already mapped or in system
+ * memory.
  */
-void igt_fb_calc_crc(struct igt_fb *fb, igt_crc_t *crc)
+void igt_fb_calc_crc_pixels(struct igt_fb *fb, void *ptr, igt_crc_t *crc)
 {
-	int x, y, i;
-	void *ptr;
-	uint8_t *data;
-	uint16_t din;
-
-	igt_assert(fb && crc);
+	struct fb_crc_bands bands;
+	unsigned int threads, jobs;
 
-	ptr = igt_fb_map_buffer(fb->fd, fb);
-	igt_assert(ptr);
+	igt_assert(fb && ptr && crc);
+	igt_assert_f(fb->drm_format == DRM_FORMAT_XRGB8888 ||
+		     !fb->width || !fb->height, "DRM Format Invalid");
 
 	/* set for later CRC comparison */
 	crc->has_valid_frame = true;
@@ -1358,31 +1467,57 @@ void igt_fb_calc_crc(struct igt_fb *fb, igt_crc_t *crc)
 	crc->crc[1] = 0;	/* G */
 	crc->crc[2] = 0;	/* B */
 
-	data = ptr + fb->offsets[0];
-	for (y = 0; y < fb->height; ++y) {
-		for (x = 0; x < fb->width; ++x) {
-			switch (fb->drm_format) {
-			case DRM_FORMAT_XRGB8888:
-				i = x * 4 + y * fb->strides[0];
+	if (!fb->width || !fb->height)
+		return;
 
-				din = data[i + 2] << 8; /* padding-zeros */
-				crc->crc[0] = update_crc16_dp(crc->crc[0], din);
+	crc16_dp_table_init(&bands.table);
+	bands.data = (uint8_t *)ptr + fb->offsets[0];
+	bands.stride = fb->strides[0];
+	bands.width = fb->width;
+	bands.height = fb->height;
 
-				/* Green-component */
-				din = data[i + 1] << 8;
-				crc->crc[1] = update_crc16_dp(crc->crc[1], din);
+	threads = min(igt_workers_threads(), (unsigned int)fb->height);
+	bands.rows = DIV_ROUND_UP(fb->height, threads);
+	jobs = DIV_ROUND_UP(fb->height, bands.rows);
 
-				/* Blue-component */
-				din = data[i] << 8;
-				crc->crc[2] = update_crc16_dp(crc->crc[2], din);
-				break;
-			default:
-				igt_assert_f(0, "DRM Format Invalid");
-				break;
-			}
-		}
+	bands.crc = calloc(jobs, sizeof(*bands.crc));
+	igt_assert(bands.crc);
+
+	igt_workers_run(threads, jobs, fb_crc_band, &bands);
+
+	/* Chain the bands, each computed as if the CRC started from 0 */
+	for (unsigned int i = 0; i < jobs; i++) {
+		unsigned int rows = min(bands.rows, fb->height - i * bands.rows);
+		uint64_t words = (uint64_t)rows * fb->width;
+
+		for (int c = 0; c < 3; c++)
+			crc->crc[c] = crc16_dp_shift(crc->crc[c], words) ^
+				      bands.crc[i][c];
 	}
 
+	free(bands.crc);
+}
+
+/**
+ * igt_fb_calc_crc:
+ * @fb: pointer to an #igt_fb structure
+ * @crc: pointer to an #igt_crc_t structure
+ *
+ * This function calculate the 16-bit frame CRC of RGB components over all
+ * the active pixels. Large framebuffers are split in bands of rows, whose
+ * CRCs are computed in parallel and then chained together.
+ */
+void igt_fb_calc_crc(struct igt_fb *fb, igt_crc_t *crc)
+{
+	void *ptr;
+
+	igt_assert(fb && crc);
+
+	ptr = igt_fb_map_buffer(fb->fd, fb);
+	igt_assert(ptr);
+
+	igt_fb_calc_crc_pixels(fb, ptr, crc);
+
 	igt_fb_unmap_buffer(fb, ptr);
 }
 
@@ -2733,26 +2868,6 @@ static void igt_fb_destroy_cairo_shadow_buffer(struct igt_fb *shadow,
 	munmap(ptr, shadow->size);
 }
 
-static uint8_t clamprgb(float val)
-{
-	return clamp((int)(val + 0.5f), 0, 255);
-}
-
-static void read_rgb(struct igt_vec4 *rgb, const uint8_t *rgb24)
-{
-	rgb->d[0] = rgb24[2];
-	rgb->d[1] = rgb24[1];
-	rgb->d[2] = rgb24[0];
-	rgb->d[3] = 1.0f;
-}
-
-static void write_rgb(uint8_t *rgb24, const struct igt_vec4 *rgb)
-{
-	rgb24[2] = clamprgb(rgb->d[0]);
-	rgb24[1] = clamprgb(rgb->d[1]);
-	rgb24[0] = clamprgb(rgb->d[2]);
-}
-
 struct fb_convert_buf {
 	void			*ptr;
 	struct igt_fb		*fb;
@@ -2968,153 +3083,67 @@ static void get_yuv_parameters(struct igt_fb *fb, struct yuv_parameters *params)
 	}
 }
 
+static void get_yuv_planes(struct igt_fb *fb, uint8_t *buf,
+			   struct igt_yuv_planes *planes)
+{
+	const struct format_desc_struct *fmt = lookup_drm_format(fb->drm_format);
+	struct yuv_parameters params = { };
+
+	get_yuv_parameters(fb, &params);
+
+	planes->y = buf + params.y_offset;
+	planes->u = buf + params.u_offset;
+	planes->v = buf + params.v_offset;
+	planes->ay_inc = params.ay_inc;
+	planes->uv_inc = params.uv_inc;
+	planes->ay_stride = params.ay_stride;
+	planes->uv_stride = params.uv_stride;
+	planes->hsub = fmt->hsub;
+	planes->vsub = fmt->vsub;
+}
+
 static void convert_yuv_to_rgb24(struct fb_convert *cvt)
 {
-	const struct format_desc_struct *src_fmt =
-		lookup_drm_format(cvt->src.fb->drm_format);
-	int i, j;
-	uint8_t bpp = 4;
-	uint8_t *y, *u, *v;
-	uint8_t *rgb24 = cvt->dst.ptr;
-	unsigned int rgb24_stride = cvt->dst.fb->strides[0];
 	struct igt_mat4 m = igt_ycbcr_to_rgb_matrix(cvt->src.fb->drm_format,
 						    cvt->dst.fb->drm_format,
 						    cvt->src.fb->color_encoding,
 						    cvt->src.fb->color_range);
+	struct igt_yuv_matrix fixed;
+	struct igt_yuv_planes planes;
 	uint8_t *buf;
-	struct yuv_parameters params = { };
 
 	igt_assert(cvt->dst.fb->drm_format == DRM_FORMAT_XRGB8888 &&
 		   igt_format_is_yuv(cvt->src.fb->drm_format));
 
-	buf = convert_src_get(cvt);
-	get_yuv_parameters(cvt->src.fb, &params);
-	y = buf + params.y_offset;
-	u = buf + params.u_offset;
-	v = buf + params.v_offset;
-
-	for (i = 0; i < cvt->dst.fb->height; i++) {
-		const uint8_t *y_tmp = y;
-		const uint8_t *u_tmp = u;
-		const uint8_t *v_tmp = v;
-		uint8_t *rgb_tmp = rgb24;
-
-		for (j = 0; j < cvt->dst.fb->width; j++) {
-			struct igt_vec4 rgb, yuv;
-
-			yuv.d[0] = *y_tmp;
-			yuv.d[1] = *u_tmp;
-			yuv.d[2] = *v_tmp;
-			yuv.d[3] = 1.0f;
-
-			rgb = igt_matrix_transform(&m, &yuv);
-			write_rgb(rgb_tmp, &rgb);
-
-			rgb_tmp += bpp;
-			y_tmp += params.ay_inc;
-
-			if ((src_fmt->hsub == 1) || (j % src_fmt->hsub)) {
-				u_tmp += params.uv_inc;
-				v_tmp += params.uv_inc;
-			}
-		}
+	igt_yuv_matrix_init(&fixed, &m);
 
-		rgb24 += rgb24_stride;
-		y += params.ay_stride;
+	buf = convert_src_get(cvt);
+	get_yuv_planes(cvt->src.fb, buf, &planes);
 
-		if ((src_fmt->vsub == 1) || (i % src_fmt->vsub)) {
-			u += params.uv_stride;
-			v += params.uv_stride;
-		}
-	}
+	igt_yuv_to_xrgb8888(&fixed, &planes, cvt->dst.ptr,
+			    cvt->dst.fb->strides[0],
+			    cvt->dst.fb->width, cvt->dst.fb->height);
 
 	convert_src_put(cvt, buf);
 }
 
 static void convert_rgb24_to_yuv(struct fb_convert *cvt)
 {
-	const struct format_desc_struct *dst_fmt =
-		lookup_drm_format(cvt->dst.fb->drm_format);
-	int i, j;
-	uint8_t *y, *u, *v;
-	const uint8_t *rgb24 = cvt->src.ptr;
-	uint8_t bpp = 4;
-	unsigned rgb24_stride = cvt->src.fb->strides[0];
 	struct igt_mat4 m = igt_rgb_to_ycbcr_matrix(cvt->src.fb->drm_format,
 						    cvt->dst.fb->drm_format,
 						    cvt->dst.fb->color_encoding,
 						    cvt->dst.fb->color_range);
-	struct yuv_parameters params = { };
+	struct igt_yuv_matrix fixed;
+	struct igt_yuv_planes planes;
 
 	igt_assert(cvt->src.fb->drm_format == DRM_FORMAT_XRGB8888 &&
 		   igt_format_is_yuv(cvt->dst.fb->drm_format));
 
-	get_yuv_parameters(cvt->dst.fb, &params);
-	y = cvt->dst.ptr + params.y_offset;
-	u = cvt->dst.ptr + params.u_offset;
-	v = cvt->dst.ptr + params.v_offset;
-
-	for (i = 0; i < cvt->dst.fb->height; i++) {
-		const uint8_t *rgb_tmp = rgb24;
-		uint8_t *y_tmp = y;
-		uint8_t *u_tmp = u;
-		uint8_t *v_tmp = v;
-
-		for (j = 0; j < cvt->dst.fb->width; j++) {
-			const uint8_t *pair_rgb24 = rgb_tmp;
-			struct igt_vec4 pair_rgb, rgb;
-			struct igt_vec4 pair_yuv, yuv;
-
-			read_rgb(&rgb, rgb_tmp);
-			yuv = igt_matrix_transform(&m, &rgb);
+	igt_yuv_matrix_init(&fixed, &m);
+	get_yuv_planes(cvt->dst.fb, cvt->dst.ptr, &planes);
 
-			rgb_tmp += bpp;
-
-			*y_tmp = yuv.d[0];
-			y_tmp += params.ay_inc;
-
-			if ((i % dst_fmt->vsub) || (j % dst_fmt->hsub))
-				continue;
-
-			/*
-			 * We assume the MPEG2 chroma siting convention, where
-			 * pixel center for Cb'Cr' is between the left top and
-			 * bottom pixel in a 2x2 block, so take the average.
-			 *
-			 * Therefore, if we use subsampling, we only really care
-			 * about two pixels all the time, either the two
-			 * subsequent pixels horizontally, vertically, or the
-			 * two corners in a 2x2 block.
-			 *
-			 * The only corner case is when we have an odd number of
-			 * pixels, but this can be handled pretty easily by not
-			 * incrementing the paired pixel pointer in the
-			 * direction it's odd in.
-			 */
-			if (j != (cvt->dst.fb->width - 1))
-				pair_rgb24 += (dst_fmt->hsub - 1) * bpp;
-
-			if (i != (cvt->dst.fb->height - 1))
-				pair_rgb24 += rgb24_stride * (dst_fmt->vsub - 1);
-
-			read_rgb(&pair_rgb, pair_rgb24);
-			pair_yuv = igt_matrix_transform(&m, &pair_rgb);
-
-			*u_tmp = (yuv.d[1] + pair_yuv.d[1]) / 2.0f;
-			*v_tmp = (yuv.d[2] + pair_yuv.d[2]) / 2.0f;
-
-			u_tmp += params.uv_inc;
-			v_tmp += params.uv_inc;
-		}
-
-		rgb24 += rgb24_stride;
-		y += params.ay_stride;
-
-		if ((i % dst_fmt->vsub) == (dst_fmt->vsub - 1)) {
-			u += params.uv_stride;
-			v += params.uv_stride;
-		}
-	}
+	igt_xrgb8888_to_yuv(&fixed, cvt->src.ptr, cvt->src.fb->strides[0],
+			    &planes, cvt->dst.fb->width, cvt->dst.fb->height);
 }
 
 static void read_rgbf(struct igt_vec4 *rgb, const float *rgb24)
@@ -3531,7 +3560,7 @@ static void convert_pixman(struct fb_convert *cvt)
 	convert_src_put(cvt, src_ptr);
 }
 
-static void fb_convert(struct fb_convert *cvt)
+static void __fb_convert(struct fb_convert *cvt)
 {
 	if ((drm_format_to_pixman(cvt->src.fb->drm_format) != PIXMAN_invalid) &&
 	    (drm_format_to_pixman(cvt->dst.fb->drm_format) != PIXMAN_invalid)) {
@@ -3640,6 +3669,88 @@ static void fb_convert(struct fb_convert *cvt)
 		     IGT_FORMAT_ARGS(cvt->dst.fb->drm_format));
 }
 
+struct fb_convert_bands {
+	struct fb_convert cvt;
+	unsigned int rows;
+};
+
+/*
+ * Describes rows [y, y + height) of @buf as a framebuffer of its own. The
+ * chroma planes start from row y / vsub, y being a multiple of vsub.
+ */
+static void fb_convert_band_buf(struct fb_convert_buf *band,
+				struct igt_fb *fb,
+				const struct fb_convert_buf *buf,
+				unsigned int y, unsigned int height)
+{
+	const struct format_desc_struct *f = lookup_drm_format(buf->fb->drm_format);
+
+	*fb = *buf->fb;
+	fb->height = height;
+
+	for (int i = 1; i < fb->num_planes; i++)
+		fb->offsets[i] += y / f->vsub * fb->strides[i] -
+				  y * fb->strides[0];
+
+	band->ptr = buf->ptr + (size_t)y * fb->strides[0];
+	band->fb = fb;
+	band->slow_reads = false;
+}
+
+static void fb_convert_band(void *data, unsigned int band)
+{
+	const struct fb_convert_bands *bands = data;
+	const struct fb_convert *cvt = &bands->cvt;
+	unsigned int y = band * bands->rows;
+	unsigned int height = min(bands->rows, cvt->dst.fb->height - y);
+	struct igt_fb src_fb, dst_fb;
+	struct fb_convert band_cvt;
+
+	fb_convert_band_buf(&band_cvt.src, &src_fb, &cvt->src, y, height);
+	fb_convert_band_buf(&band_cvt.dst, &dst_fb, &cvt->dst, y, height);
+
+	__fb_convert(&band_cvt);
+}
+
+/*
+ * Splits the conversion into bands of rows for the igt_workers pool, on
+ * igt_workers_threads() threads.
+ */
+static void fb_convert(struct fb_convert *cvt)
+{
+	const struct format_desc_struct *src_fmt =
+		lookup_drm_format(cvt->src.fb->drm_format);
+	const struct format_desc_struct *dst_fmt =
+		lookup_drm_format(cvt->dst.fb->drm_format);
+	unsigned int threads = igt_workers_threads();
+	unsigned int height = cvt->dst.fb->height;
+	unsigned int align = 1;
+	struct fb_convert_bands bands;
+	void *src_buf;
+
+	/* Keep the chroma rows of either side within a band */
+	align = max(align, (unsigned int)src_fmt->vsub);
+	align = max(align, (unsigned int)dst_fmt->vsub);
+
+	if (threads == 1 || height < 2 * align) {
+		__fb_convert(cvt);
+		return;
+	}
+
+	/* Read back the whole source once, rather than band by band */
+	src_buf = convert_src_get(cvt);
+
+	bands.cvt = *cvt;
+	bands.cvt.src.ptr = src_buf;
+	bands.cvt.src.slow_reads = false;
+	bands.rows = ALIGN(DIV_ROUND_UP(height, threads), align);
+
+	igt_workers_run(threads, DIV_ROUND_UP(height, bands.rows),
+			fb_convert_band, &bands);
+
+	convert_src_put(cvt, src_buf);
+}
+
 static void destroy_cairo_surface__convert(void *arg)
 {
 	struct fb_convert_blit_upload *blit = arg;
@@ -3906,6 +4017,39 @@ unsigned int igt_fb_convert_with_stride(struct igt_fb *dst, struct igt_fb *src,
 	return fb_id;
 }
 
+/**
+ * igt_fb_convert_pixels:
+ * @dst: linear framebuffer describing the layout of @dst_ptr
+ * @dst_ptr: destination pixels
+ * @src: linear framebuffer describing the layout of @src_ptr
+ * @src_ptr: source pixels
+ *
+ * Converts pixels in system memory between the formats of @src and @dst,
+ * the way the cairo surface of a framebuffer in a format cairo doesn't
+ * support gets converted to and back from XRGB8888 or #IGT_FORMAT_FLOAT.
+ * No buffer object is involved, which is mostly useful to benchmark the
+ * conversions.
+ */
+void igt_fb_convert_pixels(struct igt_fb *dst, void *dst_ptr,
+			   struct igt_fb *src, void *src_ptr)
+{
+	struct fb_convert cvt = {
+		.dst	= {
+			.ptr	= dst_ptr,
+			.fb	= dst,
+		},
+
+		.src	= {
+			.ptr	= src_ptr,
+			.fb	= src,
+		},
+	};
+
+	igt_assert(dst->width == src->width && dst->height == src->height);
+
+	fb_convert(&cvt);
+}
+
 /**
  * igt_fb_convert:
  * @dst: pointer to the #igt_fb structure that will store the conversion result
@@ -4040,44 +4184,170 @@ bool igt_fb_supported_format(uint32_t drm_format)
  *
  * 32 bit offset_basis = 2166136261
  * 32 bit FNV_prime = 224 + 28 + 0x93 = 16777619
+ *
+ * Each step depends on the previous one, which leaves the CPU waiting on
+ * the multiplication for every byte. The bytes of each row are instead
+ * dealt out to FNV1A_LANES independent hashes, byte i going to lane
+ * i % FNV1A_LANES, which are then hashed together into the final value.
  */
-int igt_fb_get_fnv1a_crc(struct igt_fb *fb, igt_crc_t *crc)
+#define FNV1A_OFFSET_BIAS	2166136261u
+#define FNV1A_PRIME		16777619u
+#define FNV1A_LANES		32
+
+static void fnv1a_lanes_scalar(uint32_t *lanes, const uint8_t *data,
+			       unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i + FNV1A_LANES <= n; i += FNV1A_LANES)
+		for (int j = 0; j < FNV1A_LANES; j++)
+			lanes[j] = (lanes[j] ^ data[i + j]) * FNV1A_PRIME;
+
+	for (int j = 0; i < n; i++, j++)
+		lanes[j] = (lanes[j] ^ data[i]) * FNV1A_PRIME;
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+
+#include <immintrin.h>
+
+#define FNV1A_SSE41_STEP(l, v) \
+	_mm_mullo_epi32(_mm_xor_si128(l, _mm_cvtepu8_epi32(v)), prime)
+
+static void fnv1a_lanes_sse41(uint32_t *lanes, const uint8_t *data,
+			      unsigned int n)
+{
+	const __m128i prime = _mm_set1_epi32(FNV1A_PRIME);
+	__m128i l[8];
+	unsigned int i;
+
+	for (int j = 0; j < 8; j++)
+		l[j] = _mm_loadu_si128((const __m128i *)lanes + j);
+
+	for (i = 0; i + FNV1A_LANES <= n; i += FNV1A_LANES) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(data + i + 16));
+
+		l[0] = FNV1A_SSE41_STEP(l[0], a);
+		l[1] = FNV1A_SSE41_STEP(l[1], _mm_srli_si128(a, 4));
+		l[2] = FNV1A_SSE41_STEP(l[2], _mm_srli_si128(a, 8));
+		l[3] = FNV1A_SSE41_STEP(l[3], _mm_srli_si128(a, 12));
+		l[4] = FNV1A_SSE41_STEP(l[4], b);
+		l[5] = FNV1A_SSE41_STEP(l[5], _mm_srli_si128(b, 4));
+		l[6] = FNV1A_SSE41_STEP(l[6], _mm_srli_si128(b, 8));
+		l[7] = FNV1A_SSE41_STEP(l[7], _mm_srli_si128(b, 12));
+	}
+
+	for (int j = 0; j < 8; j++)
+		_mm_storeu_si128((__m128i *)lanes + j, l[j]);
+
+	fnv1a_lanes_scalar(lanes, data + i, n - i);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static void fnv1a_lanes_avx2(uint32_t *lanes, const uint8_t *data,
+			     unsigned int n)
+{
+	const __m256i prime = _mm256_set1_epi32(FNV1A_PRIME);
+	__m256i l[4];
+	unsigned int i;
+
+	for (int j = 0; j < 4; j++)
+		l[j] = _mm256_loadu_si256((const __m256i *)lanes + j);
+
+	for (i = 0; i + FNV1A_LANES <= n; i += FNV1A_LANES) {
+		for (int j = 0; j < 4; j++) {
+			__m128i v = _mm_loadl_epi64((const __m128i *)(data + i + 8 * j));
+
+			l[j] = _mm256_mullo_epi32(_mm256_xor_si256(l[j], _mm256_cvtepu8_epi32(v)),
+						  prime);
+		}
+	}
+
+	for (int j = 0; j < 4; j++)
+		_mm256_storeu_si256((__m256i *)lanes + j, l[j]);
+
+	fnv1a_lanes_scalar(lanes, data + i, n - i);
+}
+
+#pragma GCC pop_options
+
+static void (*resolve_fnv1a_lanes(void))(uint32_t *lanes, const uint8_t *data,
+					 unsigned int n)
 {
-	const uint32_t FNV1a_OFFSET_BIAS = 2166136261;
-	const uint32_t FNV1a_PRIME = 16777619;
+	unsigned int features = igt_x86_features();
+
+	if (features & AVX2)
+		return fnv1a_lanes_avx2;
+	if (features & SSE4_1)
+		return fnv1a_lanes_sse41;
+
+	return fnv1a_lanes_scalar;
+}
+
+static void fnv1a_lanes(uint32_t *lanes, const uint8_t *data, unsigned int n)
+	__attribute__((ifunc("resolve_fnv1a_lanes")));
+
+#else
+
+static void fnv1a_lanes(uint32_t *lanes, const uint8_t *data, unsigned int n)
+{
+	fnv1a_lanes_scalar(lanes, data, n);
+}
+
+#endif
+
+/**
+ * igt_fb_get_fnv1a_crc_pixels:
+ * @fb: linear single plane framebuffer describing the layout of @ptr
+ * @ptr: pixels of @fb
+ * @crc: pointer to an #igt_crc_t structure
+ *
+ * Same as igt_fb_get_fnv1a_crc(), over pixels already mapped or in system
+ * memory.
+ *
+ * Returns:
+ * 0 on success or a negative errno.
+ */
+int igt_fb_get_fnv1a_crc_pixels(struct igt_fb *fb, void *ptr, igt_crc_t *crc)
+{
+	uint32_t lanes[FNV1A_LANES];
+	int cpp = igt_drm_format_to_bpp(fb->drm_format) / 8;
+	const uint8_t *data = (uint8_t *)ptr + fb->offsets[0];
+	uint8_t *line;
 	uint32_t hash;
-	void *map;
-	char *ptr, *line = NULL;
-	int x, y, cpp = igt_drm_format_to_bpp(fb->drm_format) / 8;
-	uint32_t stride = calc_plane_stride(fb, 0);
 
 	if (fb->num_planes != 1)
 		return -EINVAL;
 
-	ptr = igt_fb_map_buffer(fb->fd, fb);
-	igt_assert(ptr);
-	map = ptr;
-
 	/*
 	 * Framebuffers are often uncached, which can make byte-wise accesses
 	 * very slow. We copy each line of the FB into a local buffer to speed
 	 * up the hashing.
 	 */
-	line = malloc(stride);
-	if (!line) {
-		munmap(map, fb->size);
+	line = malloc(fb->width * cpp);
+	if (!line)
 		return -ENOMEM;
-	}
-
-	hash = FNV1a_OFFSET_BIAS;
 
-	for (y = 0; y < fb->height; y++, ptr += stride) {
+	for (int i = 0; i < FNV1A_LANES; i++)
+		lanes[i] = FNV1A_OFFSET_BIAS;
 
-		igt_memcpy_from_wc(line, ptr, fb->width * cpp);
+	for (int y = 0; y < fb->height; y++, data += fb->strides[0]) {
+		igt_memcpy_from_wc(line, data, fb->width * cpp);
+		fnv1a_lanes(lanes, line, fb->width * cpp);
+	}
 
-		for (x = 0; x < fb->width * cpp; x++) {
-			hash ^= line[x];
-			hash *= FNV1a_PRIME;
+	hash = FNV1A_OFFSET_BIAS;
+	for (int i = 0; i < FNV1A_LANES; i++) {
+		for (int j = 0; j < 4; j++) {
+			hash ^= (lanes[i] >> (8 * j)) & 0xff;
+			hash *= FNV1A_PRIME;
 		}
 	}
 
@@ -4085,11 +4355,39 @@ int igt_fb_get_fnv1a_crc(struct igt_fb *fb, igt_crc_t *crc)
 	crc->crc[0] = hash;
 
 	free(line);
-	igt_fb_unmap_buffer(fb, map);
 
 	return 0;
 }
 
+/**
+ * igt_fb_get_fnv1a_crc:
+ * @fb: pointer to a single plane #igt_fb structure
+ * @crc: pointer to an #igt_crc_t structure
+ *
+ * Hashes the visible pixels of @fb into @crc. The result is only meant to
+ * be compared with other hashes computed by this function.
+ *
+ * Returns:
+ * 0 on success or a negative errno.
+ */
+int igt_fb_get_fnv1a_crc(struct igt_fb *fb, igt_crc_t *crc)
+{
+	void *map;
+	int ret;
+
+	if (fb->num_planes != 1)
+		return -EINVAL;
+
+	map = igt_fb_map_buffer(fb->fd, fb);
+	igt_assert(map);
+
+	ret = igt_fb_get_fnv1a_crc_pixels(fb, map, crc);
+
+	igt_fb_unmap_buffer(fb, map);
+
+	return ret;
+}
+
 /**
  * igt_format_is_yuv:
  * @drm_format: drm fourcc
@@ -160,6 +160,8 @@ unsigned int igt_fb_convert_with_stride(struct igt_fb *dst, struct igt_fb *src,
 					unsigned int stride);
 unsigned int igt_fb_convert(struct igt_fb *dst, struct igt_fb *src,
 			    uint32_t dst_fourcc, uint64_t dst_modifier);
+void igt_fb_convert_pixels(struct igt_fb *dst, void *dst_ptr,
+			   struct igt_fb *src, void *src_ptr);
 void igt_remove_fb(int fd, struct igt_fb *fb);
 int igt_dirty_fb(int fd, struct igt_fb *fb);
 void *igt_fb_map_buffer(int fd, struct igt_fb *fb);
@@ -173,6 +175,7 @@ int igt_create_bo_with_dimensions(int fd, int width, int height, uint32_t format
 				  uint64_t *size_ret, unsigned *stride_ret,
 				  bool *is_dumb);
 void igt_fb_calc_crc(struct igt_fb *fb, igt_crc_t *crc);
+void igt_fb_calc_crc_pixels(struct igt_fb *fb, void *ptr, igt_crc_t *crc);
 
 uint64_t igt_fb_mod_to_tiling(uint64_t modifier);
 uint64_t igt_fb_tiling_to_mod(uint64_t tiling);
@@ -217,6 +220,7 @@ int igt_fill_cts_framebuffer(uint32_t *pixmap, uint32_t video_width,
 		uint32_t video_height, uint32_t bitdepth, int alpha);
 
 int igt_fb_get_fnv1a_crc(struct igt_fb *fb, igt_crc_t *crc);
+int igt_fb_get_fnv1a_crc_pixels(struct igt_fb *fb, void *ptr, igt_crc_t *crc);
 
 #endif /* __IGT_FB_H__ */
 
@@ -27,13 +27,14 @@
 #include "config.h"
 
 #include <fcntl.h>
-#include <pixman.h>
 #include <cairo.h>
 #include <gsl/gsl_statistics_double.h>
 #include <gsl/gsl_fit.h>
 
 #include "igt_frame.h"
+#include "igt_aux.h"
 #include "igt_core.h"
+#include "igt_workers.h"
 
 /**
  * SECTION:igt_frame
@@ -43,8 +44,19 @@
  *
  * This library contains helpers for frame-related tests. This includes common
  * frame dumping as well as frame comparison helpers.
+ *
+ * Frame comparisons are split in bands of rows across the igt_workers pool,
+ * on igt_workers_threads() threads.
  */
 
+/* Bands of rows the comparisons get split in, at most one per thread. */
+static unsigned int frame_compare_threads(unsigned int height)
+{
+	unsigned int threads = igt_workers_threads();
+
+	return height ? min(threads, height) : 1;
+}
+
 /**
  * igt_frame_dump_is_enabled:
  *
@@ -166,56 +178,83 @@ void igt_write_compared_frames_to_png(cairo_surface_t *reference,
  * Returns: a boolean indicating whether the frames match
  */
 
+struct analog_hist {
+	uint64_t error[3][256];
+	uint32_t count[3][256];
+};
+
+struct analog_bands {
+	const uint8_t *reference;
+	const uint8_t *capture;
+	unsigned int width, height, rows;
+	struct analog_hist *hist;
+};
+
+static void analog_hist_band(void *data, unsigned int band)
+{
+	struct analog_bands *bands = data;
+	struct analog_hist *hist = &bands->hist[band];
+	unsigned int y0 = band * bands->rows;
+	unsigned int y1 = min(y0 + bands->rows, bands->height);
+	size_t offset = (size_t)y0 * bands->width * 4;
+	size_t end = (size_t)y1 * bands->width * 4;
+	const uint8_t *p = bands->capture + offset;
+	const uint8_t *q = bands->reference + offset;
+
+	memset(hist, 0, sizeof(*hist));
+
+	/* Walk the pixels in memory order, one channel after the other. */
+	for (; offset < end; offset += 4, p += 4, q += 4) {
+		for (int i = 0; i < 3; i++) {
+			hist->error[i][q[i]] += abs((int)p[i] - q[i]);
+			hist->count[i][q[i]]++;
+		}
+	}
+}
+
 bool igt_check_analog_frame_match(cairo_surface_t *reference,
 				  cairo_surface_t *capture)
 {
-	pixman_image_t *reference_src, *capture_src;
-	int w, h;
-	int error_count[3][256][2] = { 0 };
+	struct analog_bands bands;
+	uint64_t error_count[3][256][2] = { 0 };
 	double error_average[4][250];
 	double error_trend[250];
 	double c0, c1, cov00, cov01, cov11, sumsq;
 	double correlation;
-	unsigned char *reference_pixels, *capture_pixels;
-	unsigned char *p;
-	unsigned char *q;
+	unsigned int threads, jobs;
 	bool match = true;
-	int diff;
-	int x, y;
+	int w, h;
 	int i, j;
 
 	w = cairo_image_surface_get_width(reference);
 	h = cairo_image_surface_get_height(reference);
 
-	reference_src = pixman_image_create_bits(
-	    PIXMAN_x8r8g8b8, w, h,
-	    (void*)cairo_image_surface_get_data(reference),
-	    cairo_image_surface_get_stride(reference));
-	reference_pixels = (unsigned char *) pixman_image_get_data(reference_src);
-
-	capture_src = pixman_image_create_bits(
-	    PIXMAN_x8r8g8b8, w, h,
-	    (void*)cairo_image_surface_get_data(capture),
-	    cairo_image_surface_get_stride(capture));
-	capture_pixels = (unsigned char *) pixman_image_get_data(capture_src);
+	bands.reference = cairo_image_surface_get_data(reference);
+	bands.capture = cairo_image_surface_get_data(capture);
+	bands.width = w;
+	bands.height = h;
 
 	/* Collect the absolute error for each color value */
-	for (x = 0; x < w; x++) {
-		for (y = 0; y < h; y++) {
-			p = &capture_pixels[(x + y * w) * 4];
-			q = &reference_pixels[(x + y * w) * 4];
-
-			for (i = 0; i < 3; i++) {
-				diff = (int) p[i] - q[i];
-				if (diff < 0)
-					diff = -diff;
-
-				error_count[i][q[i]][0] += diff;
-				error_count[i][q[i]][1]++;
+	threads = frame_compare_threads(h);
+	bands.rows = DIV_ROUND_UP(h, threads);
+	jobs = h ? DIV_ROUND_UP(h, bands.rows) : 0;
+
+	bands.hist = malloc(max(jobs, 1u) * sizeof(*bands.hist));
+	igt_assert(bands.hist);
+
+	igt_workers_run(threads, jobs, analog_hist_band, &bands);
+
+	for (unsigned int band = 0; band < jobs; band++) {
+		for (i = 0; i < 3; i++) {
+			for (j = 0; j < 256; j++) {
+				error_count[i][j][0] += bands.hist[band].error[i][j];
+				error_count[i][j][1] += bands.hist[band].count[i][j];
 			}
 		}
 	}
 
+	free(bands.hist);
+
 	/* Calculate the average absolute error for each color value */
 	for (i = 0; i < 250; i++) {
 		error_average[0][i] = i;
@@ -262,14 +301,100 @@ bool igt_check_analog_frame_match(cairo_surface_t *reference,
 	}
 
 complete:
-	pixman_image_unref(reference_src);
-	pixman_image_unref(capture_src);
-
 	return match;
 }
 
-#define XR24_COLOR_VALUE(data, stride, x, y, c) \
-	*((uint8_t *)(data) + (y) * (stride) + 4 * (x) + (c))
+struct checkerboard_bands {
+	const uint8_t *ref_data, *cap_data;
+	unsigned int ref_stride, cap_stride;
+	unsigned int width, height, rows;
+	unsigned int span;
+	unsigned int edge_threshold;
+	unsigned int color_error_threshold;
+	unsigned char *edges_map;
+	unsigned int *errors, *pixels;
+};
+
+static void checkerboard_edges_band(void *data, unsigned int band)
+{
+	struct checkerboard_bands *bands = data;
+	unsigned int span = bands->span, width = bands->width;
+	unsigned int y0 = max(band * bands->rows, span);
+	unsigned int y1 = min((band + 1) * bands->rows, bands->height);
+
+	for (unsigned int y = y0; y < y1 && y + span < bands->height; y++) {
+		const uint8_t *row = bands->ref_data + y * bands->ref_stride;
+		const uint8_t *above = row - span * bands->ref_stride;
+		const uint8_t *below = row + span * bands->ref_stride;
+		unsigned char *edges = bands->edges_map + y * width;
+
+		for (unsigned int x = span; x + span < width; x++) {
+			const uint8_t *left = row + 4 * (x - span);
+			const uint8_t *right = row + 4 * (x + span);
+			unsigned int xdiff = 0, ydiff = 0;
+
+			for (int c = 0; c < 3; c++) {
+				xdiff += abs(right[c] - left[c]);
+				ydiff += abs(below[4 * x + c] - above[4 * x + c]);
+			}
+
+			edges[x] = (xdiff > bands->edge_threshold ||
+				    ydiff > bands->edge_threshold);
+		}
+	}
+}
+
+static void checkerboard_errors_band(void *data, unsigned int band)
+{
+	struct checkerboard_bands *bands = data;
+	unsigned int span = bands->span, width = bands->width;
+	unsigned int threshold = bands->color_error_threshold;
+	unsigned int y0 = band * bands->rows;
+	unsigned int y1 = min(y0 + bands->rows, bands->height);
+	unsigned int errors = 0, pixels = 0;
+
+	for (unsigned int y = y0; y < y1; y++) {
+		const uint8_t *ref = bands->ref_data + y * bands->ref_stride;
+		const uint8_t *cap = bands->cap_data + y * bands->cap_stride;
+		const unsigned char *edges = bands->edges_map + y * width;
+		bool y_inside = y >= span && y + span < bands->height;
+		const unsigned char *edges_above = edges;
+		const unsigned char *edges_below = edges;
+
+		if (y_inside) {
+			edges_above -= span * width;
+			edges_below += span * width;
+		}
+
+		for (unsigned int x = 0; x < width; x++, ref += 4, cap += 4) {
+			bool error;
+
+			if (edges[x])
+				continue;
+
+			/* Compare the reference and capture values. */
+			error = (abs(ref[0] - cap[0]) > threshold) |
+				(abs(ref[1] - cap[1]) > threshold) |
+				(abs(ref[2] - cap[2]) > threshold);
+
+			/* Allow error if coming on or off an edge (on x). */
+			if (error && x >= span && x + span < width &&
+			    edges[x - span] != edges[x + span])
+				continue;
+
+			/* Allow error if coming on or off an edge (on y). */
+			if (error && y_inside &&
+			    edges_above[x] != edges_below[x])
+				continue;
+
+			errors += error;
+			pixels++;
+		}
+	}
+
+	bands->errors[band] = errors;
+	bands->pixels[band] = pixels;
+}
 
 /**
  * igt_check_checkerboard_frame_match:
@@ -303,94 +428,58 @@ complete:
 bool igt_check_checkerboard_frame_match(cairo_surface_t *reference,
 					cairo_surface_t *capture)
 {
-	unsigned int width, height, ref_stride, cap_stride;
-	void *ref_data, *cap_data;
-	unsigned char *edges_map;
-	unsigned int x, y, c;
+	struct checkerboard_bands bands = {
+		.span = 2,
+		.edge_threshold = 100,
+		.color_error_threshold = 24,
+	};
+	unsigned int width, height;
+	unsigned int threads, jobs, i;
 	unsigned int errors = 0, pixels = 0;
-	unsigned int edge_threshold = 100;
-	unsigned int color_error_threshold = 24;
 	double error_rate_threshold = 0.01;
 	double error_rate;
-	unsigned int span = 2;
 	bool match = false;
 
 	width = cairo_image_surface_get_width(reference);
 	height = cairo_image_surface_get_height(reference);
 
-	ref_stride = cairo_image_surface_get_stride(reference);
-	ref_data = cairo_image_surface_get_data(reference);
-	igt_assert(ref_data);
-
-	cap_stride = cairo_image_surface_get_stride(capture);
-	cap_data = cairo_image_surface_get_data(capture);
-	igt_assert(cap_data);
-
-	edges_map = calloc(1, width * height);
-	igt_assert(edges_map);
-
-	/* First pass to detect the pattern edges. */
-	for (y = 0; y < height; y++) {
-		if (y < span || y > (height - span - 1))
-			continue;
-
-		for (x = 0; x < width; x++) {
-			unsigned int xdiff = 0, ydiff = 0;
-
-			if (x < span || x > (width - span - 1))
-				continue;
-
-			for (c = 0; c < 3; c++) {
-				xdiff += abs(XR24_COLOR_VALUE(ref_data, ref_stride, x + span, y, c) -
-					     XR24_COLOR_VALUE(ref_data, ref_stride, x - span, y, c));
-				ydiff += abs(XR24_COLOR_VALUE(ref_data, ref_stride, x, y + span, c) -
-					     XR24_COLOR_VALUE(ref_data, ref_stride, x, y - span, c));
-			}
-
-			edges_map[y * width + x] = (xdiff > edge_threshold ||
-						    ydiff > edge_threshold);
-		}
-	}
+	bands.ref_stride = cairo_image_surface_get_stride(reference);
+	bands.ref_data = cairo_image_surface_get_data(reference);
+	igt_assert(bands.ref_data);
 
-	/* Second pass to detect errors. */
-	for (y = 0; y < height; y++) {
-		for (x = 0; x < width; x++) {
-			bool error = false;
+	bands.cap_stride = cairo_image_surface_get_stride(capture);
+	bands.cap_data = cairo_image_surface_get_data(capture);
+	igt_assert(bands.cap_data);
 
-			if (edges_map[y * width + x])
-				continue;
+	bands.edges_map = calloc(1, width * height);
+	igt_assert(bands.edges_map);
 
-			for (c = 0; c < 3; c++) {
-				unsigned int diff;
+	bands.width = width;
+	bands.height = height;
 
-				/* Compare the reference and capture values. */
-				diff = abs(XR24_COLOR_VALUE(ref_data, ref_stride, x, y, c) -
-					   XR24_COLOR_VALUE(cap_data, cap_stride, x, y, c));
+	threads = frame_compare_threads(height);
+	bands.rows = DIV_ROUND_UP(height, threads);
+	jobs = height ? DIV_ROUND_UP(height, bands.rows) : 0;
 
-				if (diff > color_error_threshold)
-					error = true;
-			}
+	bands.errors = calloc(max(jobs, 1u), sizeof(*bands.errors));
+	bands.pixels = calloc(max(jobs, 1u), sizeof(*bands.pixels));
+	igt_assert(bands.errors && bands.pixels);
 
-			/* Allow error if coming on or off an edge (on x). */
-			if (error && x >= span && x <= (width - span - 1) &&
-			    edges_map[y * width + (x - span)] !=
-			    edges_map[y * width + (x + span)])
-				continue;
-
-			/* Allow error if coming on or off an edge (on y). */
-			if (error && y >= span && y <= (height - span - 1) &&
-			    edges_map[(y - span) * width + x] !=
-			    edges_map[(y + span) * width + x] && error)
-				continue;
-
-			if (error)
-				errors++;
+	/*
+	 * First pass to detect the pattern edges, which the second pass to
+	 * detect errors needs complete a few rows around each band.
+	 */
+	igt_workers_run(threads, jobs, checkerboard_edges_band, &bands);
+	igt_workers_run(threads, jobs, checkerboard_errors_band, &bands);
 
-			pixels++;
-		}
+	for (i = 0; i < jobs; i++) {
+		errors += bands.errors[i];
+		pixels += bands.pixels[i];
 	}
 
-	free(edges_map);
+	free(bands.errors);
+	free(bands.pixels);
+	free(bands.edges_map);
 
 	error_rate = (double) errors / pixels;
 
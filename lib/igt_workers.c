@@ -0,0 +1,219 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "igt_rc.h"
+#include "igt_workers.h"
+
+/**
+ * SECTION:igt_workers
+ * @short_description: Shared worker threads
+ * @title: Workers
+ * @include: igt_workers.h
+ *
+ * A pool of worker threads, started on first use and kept around for the
+ * next ones, to split CPU heavy work such as framebuffer conversions.
+ *
+ * The work is split across as many threads as there are CPUs, unless the
+ * IGT_WORKER_THREADS environment variable, or WorkerThreads in the Common
+ * section of .igtrc, says otherwise, see igt_workers_threads().
+ */
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t work;
+	pthread_cond_t done;
+
+	unsigned int count;
+
+	/* The current run, if busy */
+	bool busy;
+	uint64_t generation;
+	igt_workers_fn_t fn;
+	void *data;
+	unsigned int jobs, next_job, pending;
+	unsigned int helpers, joined;
+} pool = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER,
+};
+
+/* Runs the jobs left, with pool.mutex held */
+static void run_jobs(void)
+{
+	while (pool.next_job < pool.jobs) {
+		unsigned int job = pool.next_job++;
+
+		pthread_mutex_unlock(&pool.mutex);
+		pool.fn(pool.data, job);
+		pthread_mutex_lock(&pool.mutex);
+
+		if (--pool.pending == 0)
+			pthread_cond_signal(&pool.done);
+	}
+}
+
+static void *worker(void *arg)
+{
+	uint64_t generation = 0;
+
+	pthread_mutex_lock(&pool.mutex);
+	for (;;) {
+		while (!pool.busy || pool.generation == generation)
+			pthread_cond_wait(&pool.work, &pool.mutex);
+
+		generation = pool.generation;
+		if (pool.joined == pool.helpers)
+			continue;
+
+		pool.joined++;
+		run_jobs();
+	}
+
+	return NULL;
+}
+
+/*
+ * The workers don't survive a fork, the child starts over with an empty
+ * pool.
+ */
+static void reset_pool(void)
+{
+	pthread_mutex_init(&pool.mutex, NULL);
+	pthread_cond_init(&pool.work, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	pool.count = 0;
+	pool.busy = false;
+}
+
+static void register_atfork(void)
+{
+	pthread_atfork(NULL, NULL, reset_pool);
+}
+
+static void grow_pool(unsigned int count)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	if (count <= pool.count)
+		return;
+
+	pthread_once(&once, register_atfork);
+
+	while (pool.count < count) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, worker, NULL))
+			break;
+
+		pthread_detach(thread);
+		pool.count++;
+	}
+}
+
+/**
+ * igt_workers_run:
+ * @threads: maximum number of threads to use, including the caller
+ * @jobs: number of jobs
+ * @fn: function running one job
+ * @data: passed to @fn
+ *
+ * Runs @fn for each job from 0 to @jobs - 1, spread over the calling
+ * thread and up to @threads - 1 workers of the pool, and waits for all of
+ * them to complete. Should the pool be busy, for instance when called
+ * from within a job, all the jobs run in the calling thread.
+ */
+void igt_workers_run(unsigned int threads, unsigned int jobs,
+		     igt_workers_fn_t fn, void *data)
+{
+	if (threads > jobs)
+		threads = jobs;
+
+	pthread_mutex_lock(&pool.mutex);
+
+	if (threads <= 1 || pool.busy) {
+		pthread_mutex_unlock(&pool.mutex);
+
+		for (unsigned int job = 0; job < jobs; job++)
+			fn(data, job);
+
+		return;
+	}
+
+	grow_pool(threads - 1);
+
+	pool.busy = true;
+	pool.generation++;
+	pool.fn = fn;
+	pool.data = data;
+	pool.jobs = jobs;
+	pool.next_job = 0;
+	pool.pending = jobs;
+	pool.helpers = threads - 1;
+	pool.joined = 0;
+	pthread_cond_broadcast(&pool.work);
+
+	run_jobs();
+	while (pool.pending)
+		pthread_cond_wait(&pool.done, &pool.mutex);
+
+	pool.busy = false;
+	pthread_mutex_unlock(&pool.mutex);
+}
+
+/**
+ * igt_workers_threads:
+ *
+ * Gets the number of threads to split CPU heavy work across, to be passed
+ * to igt_workers_run(): IGT_WORKER_THREADS from the environment, else
+ * Common::WorkerThreads from .igtrc, else the number of online CPUs.
+ *
+ * Returns: the number of threads, at least 1
+ */
+unsigned int igt_workers_threads(void)
+{
+	const char *env = getenv("IGT_WORKER_THREADS");
+	long threads = 0;
+
+	if (env) {
+		threads = atol(env);
+	} else if (igt_key_file) {
+		GError *error = NULL;
+
+		threads = g_key_file_get_integer(igt_key_file, "Common",
+						 "WorkerThreads", &error);
+		g_clear_error(&error);
+	}
+
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return threads > 0 ? threads : 1;
+}
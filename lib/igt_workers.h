@@ -0,0 +1,41 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_WORKERS_H__
+#define __IGT_WORKERS_H__
+
+/**
+ * igt_workers_fn_t:
+ * @data: the data passed to igt_workers_run()
+ * @job: index of the job to run
+ *
+ * Runs one of the jobs queued by igt_workers_run(), concurrently with the
+ * others.
+ */
+typedef void (*igt_workers_fn_t)(void *data, unsigned int job);
+
+void igt_workers_run(unsigned int threads, unsigned int jobs,
+		     igt_workers_fn_t fn, void *data);
+unsigned int igt_workers_threads(void);
+
+#endif /* __IGT_WORKERS_H__ */
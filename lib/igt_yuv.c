@@ -0,0 +1,516 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "igt_x86.h"
+#include "igt_yuv.h"
+
+/**
+ * SECTION:igt_yuv
+ * @short_description: Fixed point YCbCr conversion
+ * @title: YUV
+ * @include: igt_yuv.h
+ *
+ * Converts between XRGB8888 and 8 bit YCbCr images in 16.16 fixed point,
+ * with SSE4.1 or AVX2 kernels when the CPU has them. The results stay
+ * within one step of transforming each pixel with the igt_mat4 the
+ * conversion matrix was built from, rounding the RGB components and
+ * truncating the YCbCr ones the way igt_fb does.
+ */
+
+#define FRAC_BITS 16
+
+/**
+ * igt_yuv_matrix_init:
+ * @fixed: the fixed point matrix to fill
+ * @m: matrix from igt_ycbcr_to_rgb_matrix() or igt_rgb_to_ycbcr_matrix()
+ *
+ * Converts the first three rows of @m to fixed point, the fourth column
+ * being applied as an offset.
+ */
+void igt_yuv_matrix_init(struct igt_yuv_matrix *fixed,
+			 const struct igt_mat4 *m)
+{
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 4; col++)
+			fixed->c[row][col] =
+				lround(m->d[m(row, col)] * (1 << FRAC_BITS));
+}
+
+static inline int32_t clamp8(int32_t v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/*
+ * The row kernels work on contiguous samples: one luma and one pair of
+ * chroma samples per pixel in, or out along with the unshifted chroma
+ * sums, which the caller averages over the subsampled pixels.
+ */
+static void yuv_row_scalar(const struct igt_yuv_matrix *m, uint32_t *rgb,
+			   const uint8_t *y, const uint8_t *u,
+			   const uint8_t *v, unsigned int n)
+{
+	const int32_t round = 1 << (FRAC_BITS - 1);
+
+	for (unsigned int i = 0; i < n; i++) {
+		int32_t c[3];
+
+		for (int k = 0; k < 3; k++)
+			c[k] = clamp8((m->c[k][0] * y[i] + m->c[k][1] * u[i] +
+				       m->c[k][2] * v[i] + m->c[k][3] + round) >>
+				      FRAC_BITS);
+
+		rgb[i] = (rgb[i] & 0xff000000) | c[0] << 16 | c[1] << 8 | c[2];
+	}
+}
+
+static void rgb_row_scalar(const struct igt_yuv_matrix *m,
+			   const uint32_t *rgb, uint8_t *y,
+			   int32_t *u, int32_t *v, unsigned int n)
+{
+	for (unsigned int i = 0; i < n; i++) {
+		int32_t r = (rgb[i] >> 16) & 0xff;
+		int32_t g = (rgb[i] >> 8) & 0xff;
+		int32_t b = rgb[i] & 0xff;
+		int32_t c[3];
+
+		for (int k = 0; k < 3; k++)
+			c[k] = m->c[k][0] * r + m->c[k][1] * g +
+			       m->c[k][2] * b + m->c[k][3];
+
+		y[i] = clamp8(c[0] >> FRAC_BITS);
+		u[i] = c[1];
+		v[i] = c[2];
+	}
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+
+#include <immintrin.h>
+
+static inline __m128i load_u8x4(const uint8_t *p)
+{
+	int32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(v));
+}
+
+static inline __m128i mad3_sse41(__m128i a, __m128i b, __m128i c,
+				 const __m128i *k)
+{
+	return _mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(a, k[0]),
+					   _mm_mullo_epi32(b, k[1])),
+			     _mm_add_epi32(_mm_mullo_epi32(c, k[2]), k[3]));
+}
+
+static void yuv_row_sse41(const struct igt_yuv_matrix *m, uint32_t *rgb,
+			  const uint8_t *y, const uint8_t *u,
+			  const uint8_t *v, unsigned int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi32(255);
+	const __m128i x = _mm_set1_epi32(0xff000000);
+	__m128i k[3][4];
+	unsigned int i;
+
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++)
+			k[row][col] = _mm_set1_epi32(m->c[row][col]);
+		k[row][3] = _mm_set1_epi32(m->c[row][3] +
+					   (1 << (FRAC_BITS - 1)));
+	}
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i vy = load_u8x4(y + i);
+		__m128i vu = load_u8x4(u + i);
+		__m128i vv = load_u8x4(v + i);
+		__m128i c[3], out;
+
+		for (int row = 0; row < 3; row++) {
+			c[row] = mad3_sse41(vy, vu, vv, k[row]);
+			c[row] = _mm_srai_epi32(c[row], FRAC_BITS);
+			c[row] = _mm_min_epi32(_mm_max_epi32(c[row], zero), max);
+		}
+
+		out = _mm_and_si128(_mm_loadu_si128((__m128i *)(rgb + i)), x);
+		out = _mm_or_si128(out, _mm_slli_epi32(c[0], 16));
+		out = _mm_or_si128(out, _mm_slli_epi32(c[1], 8));
+		out = _mm_or_si128(out, c[2]);
+		_mm_storeu_si128((__m128i *)(rgb + i), out);
+	}
+
+	yuv_row_scalar(m, rgb + i, y + i, u + i, v + i, n - i);
+}
+
+static void rgb_row_sse41(const struct igt_yuv_matrix *m,
+			  const uint32_t *rgb, uint8_t *y,
+			  int32_t *u, int32_t *v, unsigned int n)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i k[3][4];
+	unsigned int i;
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 4; col++)
+			k[row][col] = _mm_set1_epi32(m->c[row][col]);
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i px = _mm_loadu_si128((const __m128i *)(rgb + i));
+		__m128i r = _mm_and_si128(_mm_srli_epi32(px, 16), mask);
+		__m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), mask);
+		__m128i b = _mm_and_si128(px, mask);
+		__m128i luma;
+		int32_t packed;
+
+		luma = _mm_srai_epi32(mad3_sse41(r, g, b, k[0]), FRAC_BITS);
+		luma = _mm_packus_epi32(luma, luma);
+		luma = _mm_packus_epi16(luma, luma);
+		packed = _mm_cvtsi128_si32(luma);
+		memcpy(y + i, &packed, sizeof(packed));
+
+		_mm_storeu_si128((__m128i *)(u + i), mad3_sse41(r, g, b, k[1]));
+		_mm_storeu_si128((__m128i *)(v + i), mad3_sse41(r, g, b, k[2]));
+	}
+
+	rgb_row_scalar(m, rgb + i, y + i, u + i, v + i, n - i);
+}
+
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static inline __m256i load_u8x8(const uint8_t *p)
+{
+	return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+}
+
+static inline __m256i mad3_avx2(__m256i a, __m256i b, __m256i c,
+				const __m256i *k)
+{
+	return _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(a, k[0]),
+						 _mm256_mullo_epi32(b, k[1])),
+				_mm256_add_epi32(_mm256_mullo_epi32(c, k[2]),
+						 k[3]));
+}
+
+static void yuv_row_avx2(const struct igt_yuv_matrix *m, uint32_t *rgb,
+			 const uint8_t *y, const uint8_t *u,
+			 const uint8_t *v, unsigned int n)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(255);
+	const __m256i x = _mm256_set1_epi32(0xff000000);
+	__m256i k[3][4];
+	unsigned int i;
+
+	for (int row = 0; row < 3; row++) {
+		for (int col = 0; col < 3; col++)
+			k[row][col] = _mm256_set1_epi32(m->c[row][col]);
+		k[row][3] = _mm256_set1_epi32(m->c[row][3] +
+					      (1 << (FRAC_BITS - 1)));
+	}
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i vy = load_u8x8(y + i);
+		__m256i vu = load_u8x8(u + i);
+		__m256i vv = load_u8x8(v + i);
+		__m256i c[3], out;
+
+		for (int row = 0; row < 3; row++) {
+			c[row] = mad3_avx2(vy, vu, vv, k[row]);
+			c[row] = _mm256_srai_epi32(c[row], FRAC_BITS);
+			c[row] = _mm256_min_epi32(_mm256_max_epi32(c[row], zero),
+						  max);
+		}
+
+		out = _mm256_loadu_si256((__m256i *)(rgb + i));
+		out = _mm256_and_si256(out, x);
+		out = _mm256_or_si256(out, _mm256_slli_epi32(c[0], 16));
+		out = _mm256_or_si256(out, _mm256_slli_epi32(c[1], 8));
+		out = _mm256_or_si256(out, c[2]);
+		_mm256_storeu_si256((__m256i *)(rgb + i), out);
+	}
+
+	yuv_row_scalar(m, rgb + i, y + i, u + i, v + i, n - i);
+}
+
+static void rgb_row_avx2(const struct igt_yuv_matrix *m,
+			 const uint32_t *rgb, uint8_t *y,
+			 int32_t *u, int32_t *v, unsigned int n)
+{
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	__m256i k[3][4];
+	unsigned int i;
+
+	for (int row = 0; row < 3; row++)
+		for (int col = 0; col < 4; col++)
+			k[row][col] = _mm256_set1_epi32(m->c[row][col]);
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m256i px = _mm256_loadu_si256((const __m256i *)(rgb + i));
+		__m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), mask);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), mask);
+		__m256i b = _mm256_and_si256(px, mask);
+		__m256i luma;
+		__m128i packed;
+
+		luma = _mm256_srai_epi32(mad3_avx2(r, g, b, k[0]), FRAC_BITS);
+		packed = _mm_packus_epi32(_mm256_castsi256_si128(luma),
+					  _mm256_extracti128_si256(luma, 1));
+		packed = _mm_packus_epi16(packed, packed);
+		_mm_storel_epi64((__m128i *)(y + i), packed);
+
+		_mm256_storeu_si256((__m256i *)(u + i),
+				    mad3_avx2(r, g, b, k[1]));
+		_mm256_storeu_si256((__m256i *)(v + i),
+				    mad3_avx2(r, g, b, k[2]));
+	}
+
+	rgb_row_scalar(m, rgb + i, y + i, u + i, v + i, n - i);
+}
+
+#pragma GCC pop_options
+
+static void (*resolve_yuv_row(void))(const struct igt_yuv_matrix *m,
+				     uint32_t *rgb, const uint8_t *y,
+				     const uint8_t *u, const uint8_t *v,
+				     unsigned int n)
+{
+	unsigned int features = igt_x86_features();
+
+	if (features & AVX2)
+		return yuv_row_avx2;
+	if (features & SSE4_1)
+		return yuv_row_sse41;
+
+	return yuv_row_scalar;
+}
+
+static void yuv_row(const struct igt_yuv_matrix *m, uint32_t *rgb,
+		    const uint8_t *y, const uint8_t *u,
+		    const uint8_t *v, unsigned int n)
+	__attribute__((ifunc("resolve_yuv_row")));
+
+static void (*resolve_rgb_row(void))(const struct igt_yuv_matrix *m,
+				     const uint32_t *rgb, uint8_t *y,
+				     int32_t *u, int32_t *v, unsigned int n)
+{
+	unsigned int features = igt_x86_features();
+
+	if (features & AVX2)
+		return rgb_row_avx2;
+	if (features & SSE4_1)
+		return rgb_row_sse41;
+
+	return rgb_row_scalar;
+}
+
+static void rgb_row(const struct igt_yuv_matrix *m,
+		    const uint32_t *rgb, uint8_t *y,
+		    int32_t *u, int32_t *v, unsigned int n)
+	__attribute__((ifunc("resolve_rgb_row")));
+
+#else
+
+static void yuv_row(const struct igt_yuv_matrix *m, uint32_t *rgb,
+		    const uint8_t *y, const uint8_t *u,
+		    const uint8_t *v, unsigned int n)
+{
+	yuv_row_scalar(m, rgb, y, u, v, n);
+}
+
+static void rgb_row(const struct igt_yuv_matrix *m,
+		    const uint32_t *rgb, uint8_t *y,
+		    int32_t *u, int32_t *v, unsigned int n)
+{
+	rgb_row_scalar(m, rgb, y, u, v, n);
+}
+
+#endif
+
+/**
+ * igt_yuv_to_xrgb8888:
+ * @m: YCbCr to RGB matrix
+ * @yuv: layout of the source image
+ * @rgb: destination XRGB8888 image
+ * @rgb_stride: bytes between two rows of @rgb
+ * @width: width of the image
+ * @height: height of the image
+ *
+ * Converts an 8 bit YCbCr image to XRGB8888, leaving the X channel of
+ * @rgb untouched. Chroma samples are replicated over the pixels they
+ * cover.
+ */
+void igt_yuv_to_xrgb8888(const struct igt_yuv_matrix *m,
+			 const struct igt_yuv_planes *yuv,
+			 uint8_t *rgb, unsigned int rgb_stride,
+			 unsigned int width, unsigned int height)
+{
+	uint8_t *ys, *us, *vs;
+
+	/* Room for the replicated chroma of an odd last pixel */
+	ys = malloc(width * 3 + 2);
+	igt_assert(ys);
+	us = ys + width;
+	vs = us + width + 1;
+
+	for (unsigned int i = 0; i < height; i++) {
+		const uint8_t *y = yuv->y + i * yuv->ay_stride;
+
+		if (i % yuv->vsub == 0) {
+			unsigned int offset = i / yuv->vsub * yuv->uv_stride;
+			const uint8_t *u = yuv->u + offset;
+			const uint8_t *v = yuv->v + offset;
+
+			if (yuv->hsub == 2) {
+				for (unsigned int j = 0; j < width; j += 2) {
+					us[j] = us[j + 1] = *u;
+					vs[j] = vs[j + 1] = *v;
+					u += yuv->uv_inc;
+					v += yuv->uv_inc;
+				}
+			} else {
+				for (unsigned int j = 0; j < width; j++) {
+					us[j] = u[j / yuv->hsub * yuv->uv_inc];
+					vs[j] = v[j / yuv->hsub * yuv->uv_inc];
+				}
+			}
+		}
+
+		if (yuv->ay_inc != 1) {
+			for (unsigned int j = 0; j < width; j++)
+				ys[j] = y[j * yuv->ay_inc];
+			y = ys;
+		}
+
+		yuv_row(m, (uint32_t *)(rgb + i * rgb_stride), y, us, vs, width);
+	}
+
+	free(ys);
+}
+
+struct rgb_row_buf {
+	int32_t *u, *v;
+};
+
+static void convert_rgb_row(const struct igt_yuv_matrix *m,
+			    const uint8_t *rgb, unsigned int rgb_stride,
+			    const struct igt_yuv_planes *yuv, uint8_t *ys,
+			    struct rgb_row_buf *buf,
+			    unsigned int row, unsigned int width)
+{
+	uint8_t *y = yuv->y + row * yuv->ay_stride;
+
+	rgb_row(m, (const uint32_t *)(rgb + row * rgb_stride),
+		yuv->ay_inc == 1 ? y : ys, buf->u, buf->v, width);
+
+	if (yuv->ay_inc != 1)
+		for (unsigned int j = 0; j < width; j++)
+			y[j * yuv->ay_inc] = ys[j];
+}
+
+/**
+ * igt_xrgb8888_to_yuv:
+ * @m: RGB to YCbCr matrix
+ * @rgb: source XRGB8888 image
+ * @rgb_stride: bytes between two rows of @rgb
+ * @yuv: layout of the destination image
+ * @width: width of the image
+ * @height: height of the image
+ *
+ * Converts an XRGB8888 image to 8 bit YCbCr. Following the MPEG2 chroma
+ * siting convention, each chroma sample is the average of the top left
+ * pixel it covers and the one at the opposite corner of the block.
+ */
+void igt_xrgb8888_to_yuv(const struct igt_yuv_matrix *m,
+			 const uint8_t *rgb, unsigned int rgb_stride,
+			 const struct igt_yuv_planes *yuv,
+			 unsigned int width, unsigned int height)
+{
+	struct rgb_row_buf cur, pair, tmp;
+	unsigned int cached = height;
+	uint8_t *ys;
+	int32_t *acc;
+
+	acc = malloc(sizeof(*acc) * width * 4 + width);
+	igt_assert(acc);
+	cur.u = acc;
+	cur.v = cur.u + width;
+	pair.u = cur.v + width;
+	pair.v = pair.u + width;
+	ys = (uint8_t *)(pair.v + width);
+
+	for (unsigned int i = 0; i < height; i++) {
+		const struct rgb_row_buf *chroma;
+		unsigned int pair_row, offset;
+		uint8_t *u, *v;
+
+		/* Already converted as the pair of the previous chroma row */
+		if (cached == i) {
+			tmp = cur;
+			cur = pair;
+			pair = tmp;
+		} else {
+			convert_rgb_row(m, rgb, rgb_stride, yuv, ys, &cur,
+					i, width);
+		}
+
+		if (i % yuv->vsub)
+			continue;
+
+		pair_row = i != height - 1 ? i + yuv->vsub - 1 : i;
+		if (pair_row != i) {
+			convert_rgb_row(m, rgb, rgb_stride, yuv, ys, &pair,
+					pair_row, width);
+			cached = pair_row;
+			chroma = &pair;
+		} else {
+			chroma = &cur;
+		}
+
+		offset = i / yuv->vsub * yuv->uv_stride;
+		u = yuv->u + offset;
+		v = yuv->v + offset;
+
+		for (unsigned int j = 0; j < width; j += yuv->hsub) {
+			unsigned int pj = j != width - 1 ? j + yuv->hsub - 1 : j;
+
+			*u = clamp8((cur.u[j] + chroma->u[pj]) >> (FRAC_BITS + 1));
+			*v = clamp8((cur.v[j] + chroma->v[pj]) >> (FRAC_BITS + 1));
+			u += yuv->uv_inc;
+			v += yuv->uv_inc;
+		}
+	}
+
+	free(acc);
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __IGT_YUV_H__
+#define __IGT_YUV_H__
+
+#include <stdint.h>
+
+#include "igt_matrix.h"
+
+/**
+ * igt_yuv_matrix:
+ * @c: rows of coefficients, the last column holding the offset
+ *
+ * A color conversion matrix in 16.16 fixed point, for 8 bit components.
+ */
+struct igt_yuv_matrix {
+	int32_t c[3][4];
+};
+
+/**
+ * igt_yuv_planes:
+ * @y: first luma sample
+ * @u: first Cb sample
+ * @v: first Cr sample
+ * @ay_inc: bytes between two luma samples of a row
+ * @uv_inc: bytes between two chroma samples of a row
+ * @ay_stride: bytes between two luma rows
+ * @uv_stride: bytes between two chroma rows
+ * @hsub: horizontal chroma subsampling
+ * @vsub: vertical chroma subsampling
+ *
+ * Layout of an 8 bit YCbCr image, which covers planar, semi-planar and
+ * packed formats alike.
+ */
+struct igt_yuv_planes {
+	uint8_t *y, *u, *v;
+	unsigned int ay_inc, uv_inc;
+	unsigned int ay_stride, uv_stride;
+	unsigned int hsub, vsub;
+};
+
+void igt_yuv_matrix_init(struct igt_yuv_matrix *fixed,
+			 const struct igt_mat4 *m);
+
+void igt_yuv_to_xrgb8888(const struct igt_yuv_matrix *m,
+			 const struct igt_yuv_planes *yuv,
+			 uint8_t *rgb, unsigned int rgb_stride,
+			 unsigned int width, unsigned int height);
+void igt_xrgb8888_to_yuv(const struct igt_yuv_matrix *m,
+			 const uint8_t *rgb, unsigned int rgb_stride,
+			 const struct igt_yuv_planes *yuv,
+			 unsigned int width, unsigned int height);
+
+#endif /* __IGT_YUV_H__ */
@@ -34,10 +34,11 @@ static const char *reqtype_str[] = {
 	[REQ_UNRESERVE]		= "unreserve",
 	[REQ_RESERVE_IF_NOT_ALLOCATED] = "reserve-ina",
 	[REQ_IS_RESERVED]	= "is reserved",
+	[REQ_ALLOC_BATCH]	= "alloc batch",
 };
 static inline const char *reqstr(enum reqtype request_type)
 {
-	igt_assert(request_type >= REQ_STOP && request_type <= REQ_IS_RESERVED);
+	igt_assert(request_type >= REQ_STOP && request_type <= REQ_ALLOC_BATCH);
 	return reqtype_str[request_type];
 }
 #else
@@ -447,7 +448,7 @@ static int handle_request(struct alloc_req *req, struct alloc_resp *resp)
 		struct intel_allocator *ial;
 		struct allocator *al;
 		uint64_t start, end, size, ahnd;
-		uint32_t ctx, vm;
+		uint32_t ctx, vm, i;
 		bool allocated, reserved, unreserved;
 		/* Used when debug is on, so avoid compilation warnings */
 		(void) ctx;
@@ -605,6 +606,25 @@ static int handle_request(struct alloc_req *req, struct alloc_resp *resp)
 				   req->alloc.strategy);
 			break;
 
+		case REQ_ALLOC_BATCH:
+			resp->response_type = RESP_ALLOC_BATCH;
+			igt_assert(req->alloc_batch.count <= ALLOC_BATCH_MAX);
+			for (i = 0; i < req->alloc_batch.count; i++)
+				resp->alloc_batch.offsets[i] =
+					ial->alloc(ial,
+						   req->alloc_batch.handles[i],
+						   req->alloc_batch.sizes[i],
+						   req->alloc_batch.alignment,
+						   req->alloc_batch.strategy);
+			alloc_info("<alloc batch> [tid: %ld] ahnd: %" PRIx64
+				   ", ctx: %u, vm: %u, count: %u"
+				   ", alignment: 0x%" PRIx64 ", strategy: %u\n",
+				   (long) req->tid, req->allocator_handle,
+				   al->ctx, al->vm, req->alloc_batch.count,
+				   req->alloc_batch.alignment,
+				   req->alloc_batch.strategy);
+			break;
+
 		case REQ_FREE:
 			resp->response_type = RESP_FREE;
 			resp->free.freed = ial->free(ial, req->free.handle);
@@ -868,6 +888,8 @@ void intel_allocator_multiprocess_stop(void)
 		/* Deinit, this should stop all blocked syscalls, if any */
 		channel->deinit(channel);
 		pthread_join(allocator_thread, NULL);
+		if (channel->release)
+			channel->release(channel);
 
 		/* But we're not sure does child will stuck */
 		igt_waitchildren_timeout(5, "Stopping children");
@@ -1147,6 +1169,95 @@ uint64_t intel_allocator_alloc_with_strategy(uint64_t allocator_handle,
 }
 
 
+/**
+ * __intel_allocator_alloc_batch:
+ * @allocator_handle: handle to an allocator
+ * @count: number of objects
+ * @obj_handles: array of @count object handles
+ * @sizes: array of @count object sizes
+ * @alignment: determines alignment of every object
+ * @strategy: strategy of allocation
+ * @offsets: array of @count receiving the offsets
+ *
+ * Function works like calling __intel_allocator_alloc() for each of @count
+ * objects, but takes allocator lock once per group of objects and, in
+ * multiprocess mode, sends many objects in a single request to the allocator
+ * thread. Objects which couldn't be allocated get ALLOC_INVALID_ADDRESS.
+ *
+ * Returns: number of objects which got a valid offset.
+ */
+unsigned int __intel_allocator_alloc_batch(uint64_t allocator_handle,
+					   unsigned int count,
+					   const uint32_t *obj_handles,
+					   const uint64_t *sizes,
+					   uint64_t alignment,
+					   enum allocator_strategy strategy,
+					   uint64_t *offsets)
+{
+	struct alloc_req req = { .request_type = REQ_ALLOC_BATCH,
+				 .allocator_handle = allocator_handle,
+				 .alloc_batch.strategy = strategy };
+	struct alloc_resp resp;
+	unsigned int allocated = 0;
+
+	igt_assert((alignment & (alignment-1)) == 0);
+	req.alloc_batch.alignment = max(alignment, 1 << 12);
+
+	while (count) {
+		unsigned int n = min(count, ALLOC_BATCH_MAX);
+
+		req.alloc_batch.count = n;
+		memcpy(req.alloc_batch.handles, obj_handles,
+		       n * sizeof(*obj_handles));
+		memcpy(req.alloc_batch.sizes, sizes, n * sizeof(*sizes));
+
+		igt_assert(handle_request(&req, &resp) == 0);
+		igt_assert(resp.response_type == RESP_ALLOC_BATCH);
+
+		for (unsigned int i = 0; i < n; i++) {
+			offsets[i] = resp.alloc_batch.offsets[i];
+			if (offsets[i] != ALLOC_INVALID_ADDRESS)
+				allocated++;
+		}
+
+		obj_handles += n;
+		sizes += n;
+		offsets += n;
+		count -= n;
+	}
+
+	return allocated;
+}
+
+/**
+ * intel_allocator_alloc_batch:
+ * @allocator_handle: handle to an allocator
+ * @count: number of objects
+ * @obj_handles: array of @count object handles
+ * @sizes: array of @count object sizes
+ * @alignment: determines alignment of every object
+ * @offsets: array of @count receiving the offsets
+ *
+ * Same as __intel_allocator_alloc_batch() but asserts if allocator can't
+ * return valid address for any of the objects. Uses default allocation
+ * strategy chosen during opening the allocator.
+ */
+void intel_allocator_alloc_batch(uint64_t allocator_handle,
+				 unsigned int count,
+				 const uint32_t *obj_handles,
+				 const uint64_t *sizes,
+				 uint64_t alignment,
+				 uint64_t *offsets)
+{
+	unsigned int allocated;
+
+	allocated = __intel_allocator_alloc_batch(allocator_handle, count,
+						  obj_handles, sizes, alignment,
+						  ALLOC_STRATEGY_NONE, offsets);
+	igt_assert_eq(allocated, count);
+}
+
+
 /**
  * intel_allocator_free:
  * @allocator_handle: handle to an allocator
@@ -1420,6 +1531,21 @@ static void __free_maps(struct igt_map *map, bool close_allocators)
 	igt_map_destroy(map, map_entry_free_func);
 }
 
+static enum msg_channel_type get_channel_type(void)
+{
+	const char *env = getenv("IGT_ALLOCATOR_CHANNEL");
+
+	if (!env || !strcmp(env, "msgqueue"))
+		return CHANNEL_SYSVIPC_MSGQUEUE;
+
+	if (!strcmp(env, "shm"))
+		return CHANNEL_SHM_RING;
+
+	igt_warn("Unknown IGT_ALLOCATOR_CHANNEL '%s', using msgqueue\n", env);
+
+	return CHANNEL_SYSVIPC_MSGQUEUE;
+}
+
 /**
  * intel_allocator_init:
  *
@@ -1444,7 +1570,7 @@ void intel_allocator_init(void)
 	vm_map = igt_map_create(hash_instance, equal_vm);
 	igt_assert(handles && ctx_map && vm_map);
 
-	channel = intel_allocator_get_msgchannel(CHANNEL_SYSVIPC_MSGQUEUE);
+	channel = intel_allocator_get_msgchannel(get_channel_type());
 }
 
 igt_constructor {
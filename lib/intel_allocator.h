@@ -99,10 +99,11 @@
  * is required to assign proper addresses for gem objects and avoid collision.
  * Additional thread is spawned for such case to cover child processes needs.
  * It uses some form of communication channel to receive, perform action
- * (alloc, free...) and send response to requesting process. Currently
- * SYSVIPC message queue was chosen for this but it can replaced by other
- * mechanism. Allocation techniques are same as for single process, we
- * just need to wrap such code with:
+ * (alloc, free...) and send response to requesting process. By default
+ * SYSVIPC message queue is used for this. Setting IGT_ALLOCATOR_CHANNEL=shm
+ * in the environment selects a ring in shared memory instead, which avoids
+ * syscalls while the allocator thread is busy. Allocation techniques are
+ * same as for single process, we just need to wrap such code with:
  *
  *
  * |[<!-- language="c" -->
@@ -190,6 +191,19 @@ uint64_t intel_allocator_alloc_with_strategy(uint64_t allocator_handle,
 					     uint32_t handle,
 					     uint64_t size, uint64_t alignment,
 					     enum allocator_strategy strategy);
+unsigned int __intel_allocator_alloc_batch(uint64_t allocator_handle,
+					   unsigned int count,
+					   const uint32_t *obj_handles,
+					   const uint64_t *sizes,
+					   uint64_t alignment,
+					   enum allocator_strategy strategy,
+					   uint64_t *offsets);
+void intel_allocator_alloc_batch(uint64_t allocator_handle,
+				 unsigned int count,
+				 const uint32_t *obj_handles,
+				 const uint64_t *sizes,
+				 uint64_t alignment,
+				 uint64_t *offsets);
 bool intel_allocator_free(uint64_t allocator_handle, uint32_t handle);
 bool intel_allocator_is_allocated(uint64_t allocator_handle, uint32_t handle,
 				  uint64_t size, uint64_t offset);
@@ -5,9 +5,15 @@
 
 #include <sys/types.h>
 #include <sys/ipc.h>
+#include <sys/mman.h>
 #include <sys/msg.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "igt.h"
 #include "intel_allocator_msgchannel.h"
 
@@ -180,6 +186,259 @@ static struct msg_channel msgqueue_channel = {
 	.recv_resp = msgqueue_recv_resp,
 };
 
+/* ----- SHARED MEMORY RING ----- */
+
+/*
+ * Requests are exchanged through an anonymous shared mapping created
+ * before the children are forked. A requester claims one of the slots,
+ * writes its request there and publishes the slot index on the ring,
+ * which the allocator thread consumes in order. The response is written
+ * back to the same slot. Both sides spin for a while before going to
+ * sleep on a futex, and the other side only does the wake syscall when
+ * it sees a sleeper.
+ */
+
+#define SHM_SLOTS 1024
+#define SHM_SPIN 1000
+
+enum shm_slot_state {
+	SLOT_FREE,
+	SLOT_CLAIMED,
+	SLOT_REQUEST,
+	SLOT_WAITING,	/* as SLOT_REQUEST, requester sleeps on the futex */
+	SLOT_RESPONSE,
+};
+
+struct shm_slot {
+	_Atomic(uint32_t) state;
+	struct alloc_req request;
+	struct alloc_resp response;
+};
+
+struct shm_ring {
+	int spin;			/* polls before sleeping on a futex */
+	_Atomic(uint32_t) stopped;
+	_Atomic(uint32_t) sleeping;	/* allocator thread waits for requests */
+	_Atomic(uint32_t) tail;
+	uint32_t head;			/* only used by the allocator thread */
+	_Atomic(uint32_t) ring[SHM_SLOTS]; /* slot index + 1, 0 when empty */
+	struct shm_slot slots[SHM_SLOTS];
+};
+
+struct shm_data {
+	struct shm_ring *shm;
+	uint32_t current;		/* slot of the request being handled */
+};
+
+/* Slot of the request this thread waits the response for */
+static __thread int shm_slot = -1;
+
+static void shm_futex_wait(_Atomic(uint32_t) *addr, uint32_t val)
+{
+	syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+}
+
+static void shm_futex_wake(_Atomic(uint32_t) *addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static void shm_release(struct msg_channel *channel)
+{
+	struct shm_data *shmdata = channel->priv;
+
+	if (!shmdata)
+		return;
+
+	munmap(shmdata->shm, sizeof(*shmdata->shm));
+	free(shmdata);
+	channel->priv = NULL;
+}
+
+static void shm_init(struct msg_channel *channel)
+{
+	struct shm_data *shmdata;
+	struct shm_ring *shm;
+
+	igt_debug("Init shm ring\n");
+
+	shm = mmap(NULL, sizeof(*shm), PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	igt_assert(shm != MAP_FAILED);
+
+	/* With a single cpu the other side can't make progress meanwhile */
+	shm->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN : 0;
+
+	shmdata = calloc(1, sizeof(*shmdata));
+	igt_assert(shmdata);
+	shmdata->shm = shm;
+	channel->priv = shmdata;
+}
+
+static void shm_deinit(struct msg_channel *channel)
+{
+	struct shm_data *shmdata = channel->priv;
+	struct shm_ring *shm = shmdata->shm;
+
+	igt_debug("Deinit shm ring\n");
+
+	/*
+	 * Unblock everyone waiting. The allocator thread may still be
+	 * about to notice, so the mapping is only released by
+	 * shm_release() once it has been joined.
+	 */
+	atomic_store(&shm->stopped, 1);
+	shm_futex_wake(&shm->sleeping);
+	for (int i = 0; i < SHM_SLOTS; i++)
+		if (atomic_load(&shm->slots[i].state) == SLOT_WAITING)
+			shm_futex_wake(&shm->slots[i].state);
+}
+
+static int shm_send_req(struct msg_channel *channel,
+			struct alloc_req *request)
+{
+	struct shm_ring *shm = ((struct shm_data *) channel->priv)->shm;
+	uint32_t idx, pos;
+
+	/* Start searching at a different slot for each thread */
+	idx = (uint32_t) request->tid % SHM_SLOTS;
+	for (;;) {
+		uint32_t expected = SLOT_FREE;
+
+		if (atomic_compare_exchange_strong(&shm->slots[idx].state,
+						   &expected, SLOT_CLAIMED))
+			break;
+
+		idx = (idx + 1) % SHM_SLOTS;
+		if (idx == (uint32_t) request->tid % SHM_SLOTS) {
+			if (atomic_load(&shm->stopped)) {
+				errno = ECANCELED;
+				return -1;
+			}
+			sched_yield();
+		}
+	}
+
+	memcpy(&shm->slots[idx].request, request, sizeof(*request));
+	atomic_store(&shm->slots[idx].state, SLOT_REQUEST);
+
+	/*
+	 * There are never more entries on the ring than there are slots,
+	 * so it can't overflow.
+	 */
+	pos = atomic_fetch_add(&shm->tail, 1);
+	atomic_store(&shm->ring[pos % SHM_SLOTS], idx + 1);
+
+	if (atomic_exchange(&shm->sleeping, 0))
+		shm_futex_wake(&shm->sleeping);
+
+	shm_slot = idx;
+
+	return 0;
+}
+
+static int shm_recv_req(struct msg_channel *channel,
+			struct alloc_req *request)
+{
+	struct shm_data *shmdata = channel->priv;
+	struct shm_ring *shm = shmdata->shm;
+	_Atomic(uint32_t) *entry;
+	uint32_t idx;
+	int spin = 0;
+
+	for (;;) {
+		entry = &shm->ring[shm->head % SHM_SLOTS];
+		idx = atomic_load(entry);
+		if (idx)
+			break;
+
+		if (atomic_load(&shm->stopped)) {
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (spin++ < shm->spin)
+			continue;
+
+		atomic_store(&shm->sleeping, 1);
+		if (!atomic_load(entry) && !atomic_load(&shm->stopped))
+			shm_futex_wait(&shm->sleeping, 1);
+		atomic_store(&shm->sleeping, 0);
+	}
+
+	atomic_store(entry, 0);
+	shm->head++;
+
+	shmdata->current = idx - 1;
+	memcpy(request, &shm->slots[idx - 1].request, sizeof(*request));
+
+	return sizeof(*request);
+}
+
+static int shm_send_resp(struct msg_channel *channel,
+			 struct alloc_resp *response)
+{
+	struct shm_data *shmdata = channel->priv;
+	struct shm_slot *slot = &shmdata->shm->slots[shmdata->current];
+
+	igt_assert(slot->request.tid == response->tid);
+	memcpy(&slot->response, response, sizeof(*response));
+
+	if (atomic_exchange(&slot->state, SLOT_RESPONSE) == SLOT_WAITING)
+		shm_futex_wake(&slot->state);
+
+	return 0;
+}
+
+static int shm_recv_resp(struct msg_channel *channel,
+			 struct alloc_resp *response)
+{
+	struct shm_ring *shm = ((struct shm_data *) channel->priv)->shm;
+	struct shm_slot *slot;
+	pid_t tid = response->tid;
+	uint32_t state;
+	int spin = 0;
+
+	igt_assert(shm_slot >= 0);
+	slot = &shm->slots[shm_slot];
+
+	while ((state = atomic_load(&slot->state)) != SLOT_RESPONSE) {
+		if (atomic_load(&shm->stopped)) {
+			errno = ECANCELED;
+			return -1;
+		}
+
+		if (spin++ < shm->spin)
+			continue;
+
+		if (state == SLOT_REQUEST &&
+		    !atomic_compare_exchange_strong(&slot->state, &state,
+						    SLOT_WAITING))
+			continue;
+
+		shm_futex_wait(&slot->state, SLOT_WAITING);
+	}
+
+	memcpy(response, &slot->response, sizeof(*response));
+	igt_assert(response->tid == tid);
+
+	shm_slot = -1;
+	atomic_store(&slot->state, SLOT_FREE);
+
+	return sizeof(*response);
+}
+
+static struct msg_channel shm_channel = {
+	.priv = NULL,
+	.init = shm_init,
+	.deinit = shm_deinit,
+	.release = shm_release,
+	.send_req = shm_send_req,
+	.recv_req = shm_recv_req,
+	.send_resp = shm_send_resp,
+	.recv_resp = shm_recv_resp,
+};
+
 struct msg_channel *intel_allocator_get_msgchannel(enum msg_channel_type type)
 {
 	struct msg_channel *channel = NULL;
@@ -187,6 +446,10 @@ struct msg_channel *intel_allocator_get_msgchannel(enum msg_channel_type type)
 	switch (type) {
 	case CHANNEL_SYSVIPC_MSGQUEUE:
 		channel = &msgqueue_channel;
+		break;
+	case CHANNEL_SHM_RING:
+		channel = &shm_channel;
+		break;
 	}
 
 	igt_assert(channel);
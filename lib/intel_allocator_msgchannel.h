@@ -23,6 +23,7 @@ enum reqtype {
 	REQ_UNRESERVE,
 	REQ_RESERVE_IF_NOT_ALLOCATED,
 	REQ_IS_RESERVED,
+	REQ_ALLOC_BATCH,
 };
 
 enum resptype {
@@ -37,8 +38,12 @@ enum resptype {
 	RESP_UNRESERVE,
 	RESP_IS_RESERVED,
 	RESP_RESERVE_IF_NOT_ALLOCATED,
+	RESP_ALLOC_BATCH,
 };
 
+/* Maximum number of objects in a single REQ_ALLOC_BATCH */
+#define ALLOC_BATCH_MAX 16
+
 struct alloc_req {
 	enum reqtype request_type;
 
@@ -68,6 +73,14 @@ struct alloc_req {
 			uint8_t strategy;
 		} alloc;
 
+		struct {
+			uint32_t count;
+			uint32_t handles[ALLOC_BATCH_MAX];
+			uint64_t sizes[ALLOC_BATCH_MAX];
+			uint64_t alignment;
+			uint8_t strategy;
+		} alloc_batch;
+
 		struct {
 			uint32_t handle;
 		} free;
@@ -115,6 +128,10 @@ struct alloc_resp {
 			uint64_t offset;
 		} alloc;
 
+		struct {
+			uint64_t offsets[ALLOC_BATCH_MAX];
+		} alloc_batch;
+
 		struct {
 			bool freed;
 		} free;
@@ -142,6 +159,8 @@ struct msg_channel {
 	void *priv;
 	void (*init)(struct msg_channel *channel);
 	void (*deinit)(struct msg_channel *channel);
+	/* optional, frees what deinit leaves to the exiting allocator thread */
+	void (*release)(struct msg_channel *channel);
 	int (*send_req)(struct msg_channel *channel, struct alloc_req *request);
 	int (*recv_req)(struct msg_channel *channel, struct alloc_req *request);
 	int (*send_resp)(struct msg_channel *channel, struct alloc_resp *response);
@@ -149,7 +168,8 @@ struct msg_channel {
 };
 
 enum msg_channel_type {
-	CHANNEL_SYSVIPC_MSGQUEUE
+	CHANNEL_SYSVIPC_MSGQUEUE,
+	CHANNEL_SHM_RING,
 };
 
 struct msg_channel *intel_allocator_get_msgchannel(enum msg_channel_type type);
@@ -16,16 +16,28 @@
 struct intel_allocator *
 intel_allocator_simple_create(int fd, uint64_t start, uint64_t end,
 			      enum allocator_strategy strategy);
+void intel_allocator_simple_validate(struct intel_allocator *ial);
 
+/*
+ * Holes are kept both on a list, ordered from high to low address, and
+ * in an AVL tree ordered by address. Each node of the tree also tracks
+ * the largest hole in its subtree, which lets alloc find the first
+ * suitable hole from either end in O(log n) without visiting the holes
+ * which are too small.
+ */
 struct simple_vma_heap {
 	struct igt_list_head holes;
+	struct simple_vma_hole *root;
 	enum allocator_strategy strategy;
 };
 
 struct simple_vma_hole {
 	struct igt_list_head link;
+	struct simple_vma_hole *parent, *left, *right;
 	uint64_t offset;
 	uint64_t size;
+	uint64_t max_size;	/* largest hole in the subtree */
+	int height;
 };
 
 struct intel_allocator_simple {
@@ -56,9 +68,6 @@ struct intel_allocator_record {
 #define simple_vma_foreach_hole_safe(_hole, _heap, _tmp) \
 	igt_list_for_each_entry_safe(_hole, _tmp,  &(_heap)->holes, link)
 
-#define simple_vma_foreach_hole_safe_rev(_hole, _heap, _tmp) \
-	igt_list_for_each_entry_safe_reverse(_hole, _tmp,  &(_heap)->holes, link)
-
 /* 2^31 + 2^29 - 2^25 + 2^22 - 2^19 - 2^16 + 1 */
 #define GOLDEN_RATIO_PRIME_32 0x9e370001UL
 
@@ -104,35 +113,323 @@ static void map_entry_free_func(struct igt_map_entry *entry)
 #define GEN8_GTT_ADDRESS_WIDTH 48
 #define DECANONICAL(offset) (offset & ((1ull << GEN8_GTT_ADDRESS_WIDTH) - 1))
 
-static void simple_vma_heap_validate(struct simple_vma_heap *heap)
+static inline int hole_height(const struct simple_vma_hole *hole)
 {
-	uint64_t prev_offset = 0;
-	struct simple_vma_hole *hole;
+	return hole ? hole->height : 0;
+}
 
-	simple_vma_foreach_hole(hole, heap) {
-		igt_assert(hole->size > 0);
+static inline uint64_t hole_max_size(const struct simple_vma_hole *hole)
+{
+	return hole ? hole->max_size : 0;
+}
 
-		if (&hole->link == heap->holes.next) {
-			/*
-			 * This must be the top-most hole.  Assert that,
-			 * if it overflows, it overflows to 0, i.e. 2^64.
-			 */
-			igt_assert(hole->size + hole->offset == 0 ||
-				   hole->size + hole->offset > hole->offset);
+static void hole_update(struct simple_vma_hole *hole)
+{
+	uint64_t max_size = max(hole_max_size(hole->left),
+				hole_max_size(hole->right));
+
+	hole->height = 1 + max(hole_height(hole->left),
+			       hole_height(hole->right));
+	hole->max_size = max(hole->size, max_size);
+}
+
+static void hole_replace_child(struct simple_vma_heap *heap,
+			       struct simple_vma_hole *parent,
+			       struct simple_vma_hole *old,
+			       struct simple_vma_hole *new)
+{
+	if (!parent)
+		heap->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+
+	if (new)
+		new->parent = parent;
+}
+
+static struct simple_vma_hole *hole_rotate_right(struct simple_vma_heap *heap,
+						 struct simple_vma_hole *hole)
+{
+	struct simple_vma_hole *pivot = hole->left;
+
+	hole->left = pivot->right;
+	if (hole->left)
+		hole->left->parent = hole;
+	hole_replace_child(heap, hole->parent, hole, pivot);
+	pivot->right = hole;
+	hole->parent = pivot;
+
+	hole_update(hole);
+	hole_update(pivot);
+
+	return pivot;
+}
+
+static struct simple_vma_hole *hole_rotate_left(struct simple_vma_heap *heap,
+						struct simple_vma_hole *hole)
+{
+	struct simple_vma_hole *pivot = hole->right;
+
+	hole->right = pivot->left;
+	if (hole->right)
+		hole->right->parent = hole;
+	hole_replace_child(heap, hole->parent, hole, pivot);
+	pivot->left = hole;
+	hole->parent = pivot;
+
+	hole_update(hole);
+	hole_update(pivot);
+
+	return pivot;
+}
+
+/*
+ * Walks up to the root fixing heights and max sizes, rotating wherever
+ * the subtrees got out of balance. Also used after a hole changes size.
+ */
+static void simple_vma_tree_rebalance(struct simple_vma_heap *heap,
+				      struct simple_vma_hole *hole)
+{
+	while (hole) {
+		int balance;
+
+		hole_update(hole);
+		balance = hole_height(hole->left) - hole_height(hole->right);
+
+		if (balance > 1) {
+			if (hole_height(hole->left->left) <
+			    hole_height(hole->left->right))
+				hole_rotate_left(heap, hole->left);
+			hole = hole_rotate_right(heap, hole);
+		} else if (balance < -1) {
+			if (hole_height(hole->right->right) <
+			    hole_height(hole->right->left))
+				hole_rotate_right(heap, hole->right);
+			hole = hole_rotate_left(heap, hole);
+		}
+
+		hole = hole->parent;
+	}
+}
+
+static void simple_vma_tree_insert(struct simple_vma_heap *heap,
+				   struct simple_vma_hole *hole)
+{
+	struct simple_vma_hole *parent = NULL, **link = &heap->root;
+
+	while (*link) {
+		parent = *link;
+		link = hole->offset < parent->offset ? &parent->left : &parent->right;
+	}
+
+	hole->parent = parent;
+	hole->left = hole->right = NULL;
+	*link = hole;
+
+	simple_vma_tree_rebalance(heap, hole);
+}
+
+static void simple_vma_tree_remove(struct simple_vma_heap *heap,
+				   struct simple_vma_hole *hole)
+{
+	struct simple_vma_hole *next, *start;
+
+	if (!hole->left || !hole->right) {
+		start = hole->parent;
+		hole_replace_child(heap, hole->parent, hole,
+				   hole->left ?: hole->right);
+	} else {
+		/* Put the next higher hole in place of the removed one */
+		next = hole->right;
+		while (next->left)
+			next = next->left;
+
+		if (next->parent != hole) {
+			start = next->parent;
+			hole_replace_child(heap, next->parent, next, next->right);
+			next->right = hole->right;
+			next->right->parent = next;
 		} else {
-			/*
-			 * This is not the top-most hole so it must not overflow and,
-			 * in fact, must be strictly lower than the top-most hole.  If
-			 * hole->size + hole->offset == prev_offset, then we failed to
-			 * join holes during a simple_vma_heap_free.
-			 */
-			igt_assert(hole->size + hole->offset > hole->offset &&
-				   hole->size + hole->offset < prev_offset);
+			start = next;
+		}
+
+		next->left = hole->left;
+		next->left->parent = next;
+		hole_replace_child(heap, hole->parent, hole, next);
+	}
+
+	simple_vma_tree_rebalance(heap, start);
+}
+
+/* Highest hole with offset <= @offset */
+static struct simple_vma_hole *
+simple_vma_tree_floor(struct simple_vma_heap *heap, uint64_t offset)
+{
+	struct simple_vma_hole *hole = heap->root, *found = NULL;
+
+	while (hole) {
+		if (hole->offset <= offset) {
+			found = hole;
+			hole = hole->right;
+		} else {
+			hole = hole->left;
 		}
-		prev_offset = hole->offset;
+	}
+
+	return found;
+}
+
+/* Highest hole in the subtree with at least @size bytes */
+static struct simple_vma_hole *
+simple_vma_tree_last_fit(struct simple_vma_hole *hole, uint64_t size)
+{
+	if (!hole || hole->max_size < size)
+		return NULL;
+
+	for (;;) {
+		if (hole_max_size(hole->right) >= size)
+			hole = hole->right;
+		else if (hole->size >= size)
+			return hole;
+		else
+			hole = hole->left;
+	}
+}
+
+/* Lowest hole in the subtree with at least @size bytes */
+static struct simple_vma_hole *
+simple_vma_tree_first_fit(struct simple_vma_hole *hole, uint64_t size)
+{
+	if (!hole || hole->max_size < size)
+		return NULL;
+
+	for (;;) {
+		if (hole_max_size(hole->left) >= size)
+			hole = hole->left;
+		else if (hole->size >= size)
+			return hole;
+		else
+			hole = hole->right;
+	}
+}
+
+/* Next lower hole than @hole with at least @size bytes */
+static struct simple_vma_hole *
+simple_vma_tree_prev_fit(struct simple_vma_hole *hole, uint64_t size)
+{
+	struct simple_vma_hole *parent;
+
+	if (hole_max_size(hole->left) >= size)
+		return simple_vma_tree_last_fit(hole->left, size);
+
+	for (parent = hole->parent; parent; hole = parent, parent = hole->parent) {
+		if (parent->right != hole)
+			continue;
+
+		if (parent->size >= size)
+			return parent;
+
+		if (hole_max_size(parent->left) >= size)
+			return simple_vma_tree_last_fit(parent->left, size);
+	}
+
+	return NULL;
+}
+
+/* Next higher hole than @hole with at least @size bytes */
+static struct simple_vma_hole *
+simple_vma_tree_next_fit(struct simple_vma_hole *hole, uint64_t size)
+{
+	struct simple_vma_hole *parent;
+
+	if (hole_max_size(hole->right) >= size)
+		return simple_vma_tree_first_fit(hole->right, size);
+
+	for (parent = hole->parent; parent; hole = parent, parent = hole->parent) {
+		if (parent->left != hole)
+			continue;
+
+		if (parent->size >= size)
+			return parent;
+
+		if (hole_max_size(parent->right) >= size)
+			return simple_vma_tree_first_fit(parent->right, size);
+	}
+
+	return NULL;
+}
+
+static void simple_vma_hole_validate(struct simple_vma_heap *heap,
+				     struct simple_vma_hole *hole)
+{
+	struct simple_vma_hole *high_hole;
+
+	igt_assert(hole->size > 0);
+
+	if (&hole->link == heap->holes.next) {
+		/*
+		 * This must be the top-most hole.  Assert that,
+		 * if it overflows, it overflows to 0, i.e. 2^64.
+		 */
+		igt_assert(hole->size + hole->offset == 0 ||
+			   hole->size + hole->offset > hole->offset);
+	} else {
+		/*
+		 * This is not the top-most hole so it must not overflow and,
+		 * in fact, must be strictly lower than the hole above.  If
+		 * hole->size + hole->offset == high_hole->offset, then we failed
+		 * to join holes during a simple_vma_heap_free.
+		 */
+		high_hole = igt_container_of(hole->link.prev, hole, link);
+		igt_assert(hole->size + hole->offset > hole->offset &&
+			   hole->size + hole->offset < high_hole->offset);
 	}
 }
 
+static int simple_vma_tree_validate(struct simple_vma_hole *hole,
+				    uint64_t *count)
+{
+	uint64_t max_size;
+	int left, right;
+
+	if (!hole)
+		return 0;
+
+	left = simple_vma_tree_validate(hole->left, count);
+	right = simple_vma_tree_validate(hole->right, count);
+
+	igt_assert(!hole->left || (hole->left->parent == hole &&
+				   hole->left->offset < hole->offset));
+	igt_assert(!hole->right || (hole->right->parent == hole &&
+				    hole->right->offset > hole->offset));
+	igt_assert(abs(left - right) <= 1);
+	igt_assert_eq(hole->height, 1 + max(left, right));
+	max_size = max(hole_max_size(hole->left), hole_max_size(hole->right));
+	igt_assert_eq_u64(hole->max_size, max(hole->size, max_size));
+	(*count)++;
+
+	return hole->height;
+}
+
+/*
+ * Checks the whole heap, which is O(n). Alloc and free only validate
+ * the holes they touch.
+ */
+static void simple_vma_heap_validate(struct simple_vma_heap *heap)
+{
+	struct simple_vma_hole *hole;
+	uint64_t holes = 0, nodes = 0;
+
+	simple_vma_foreach_hole(hole, heap) {
+		simple_vma_hole_validate(heap, hole);
+		holes++;
+	}
+
+	simple_vma_tree_validate(heap->root, &nodes);
+	igt_assert_eq_u64(holes, nodes);
+}
 
 static void simple_vma_heap_free(struct simple_vma_heap *heap,
 				 uint64_t offset, uint64_t size)
@@ -149,15 +446,14 @@ static void simple_vma_heap_free(struct simple_vma_heap *heap,
 	 */
 	igt_assert(offset + size == 0 || offset + size > offset);
 
-	simple_vma_heap_validate(heap);
-
 	/* Find immediately higher and lower holes if they exist. */
-	simple_vma_foreach_hole(hole, heap) {
-		if (hole->offset <= offset) {
-			low_hole = hole;
-			break;
-		}
-		high_hole = hole;
+	low_hole = simple_vma_tree_floor(heap, offset);
+	if (low_hole) {
+		if (&low_hole->link != heap->holes.next)
+			high_hole = igt_container_of(low_hole->link.prev,
+						     low_hole, link);
+	} else if (!igt_list_empty(&heap->holes)) {
+		high_hole = igt_list_last_entry(&heap->holes, high_hole, link);
 	}
 
 	if (high_hole)
@@ -174,14 +470,21 @@ static void simple_vma_heap_free(struct simple_vma_heap *heap,
 		/* Merge the two holes */
 		low_hole->size += size + high_hole->size;
 		igt_list_del(&high_hole->link);
+		simple_vma_tree_remove(heap, high_hole);
 		free(high_hole);
+		simple_vma_tree_rebalance(heap, low_hole);
+		hole = low_hole;
 	} else if (low_adjacent) {
 		/* Merge into the low hole */
 		low_hole->size += size;
+		simple_vma_tree_rebalance(heap, low_hole);
+		hole = low_hole;
 	} else if (high_adjacent) {
 		/* Merge into the high hole */
 		high_hole->offset = offset;
 		high_hole->size += size;
+		simple_vma_tree_rebalance(heap, high_hole);
+		hole = high_hole;
 	} else {
 		/* Neither hole is adjacent; make a new one */
 		hole = calloc(1, sizeof(*hole));
@@ -197,9 +500,13 @@ static void simple_vma_heap_free(struct simple_vma_heap *heap,
 			igt_list_add(&hole->link, &high_hole->link);
 		else
 			igt_list_add(&hole->link, &heap->holes);
+		simple_vma_tree_insert(heap, hole);
 	}
 
-	simple_vma_heap_validate(heap);
+	simple_vma_hole_validate(heap, hole);
+	if (hole->link.next != &heap->holes)
+		simple_vma_hole_validate(heap, igt_container_of(hole->link.next,
+								hole, link));
 }
 
 static void simple_vma_heap_init(struct simple_vma_heap *heap,
@@ -207,6 +514,7 @@ static void simple_vma_heap_init(struct simple_vma_heap *heap,
 				 enum allocator_strategy strategy)
 {
 	IGT_INIT_LIST_HEAD(&heap->holes);
+	heap->root = NULL;
 	simple_vma_heap_free(heap, start, size);
 
 	/* Use LOW_TO_HIGH or HIGH_TO_LOW strategy only */
@@ -224,7 +532,8 @@ static void simple_vma_heap_finish(struct simple_vma_heap *heap)
 		free(hole);
 }
 
-static void simple_vma_hole_alloc(struct simple_vma_hole *hole,
+static void simple_vma_hole_alloc(struct simple_vma_heap *heap,
+				  struct simple_vma_hole *hole,
 				  uint64_t offset, uint64_t size)
 {
 	struct simple_vma_hole *high_hole;
@@ -236,6 +545,7 @@ static void simple_vma_hole_alloc(struct simple_vma_hole *hole,
 	if (offset == hole->offset && size == hole->size) {
 		/* Just get rid of the hole. */
 		igt_list_del(&hole->link);
+		simple_vma_tree_remove(heap, hole);
 		free(hole);
 		return;
 	}
@@ -245,6 +555,7 @@ static void simple_vma_hole_alloc(struct simple_vma_hole *hole,
 	if (waste == 0) {
 		/* We allocated at the top->  Shrink the hole down. */
 		hole->size -= size;
+		simple_vma_tree_rebalance(heap, hole);
 		return;
 	}
 
@@ -252,6 +563,7 @@ static void simple_vma_hole_alloc(struct simple_vma_hole *hole,
 		/* We allocated at the bottom. Shrink the hole up-> */
 		hole->offset += size;
 		hole->size -= size;
+		simple_vma_tree_rebalance(heap, hole);
 		return;
 	}
 
@@ -270,12 +582,14 @@ static void simple_vma_hole_alloc(struct simple_vma_hole *hole,
 	 * original hole.
 	 */
 	hole->size = offset - hole->offset;
+	simple_vma_tree_rebalance(heap, hole);
 
 	/*
 	 * Place the new hole before the old hole so that the list is in order
 	 * from high to low.
 	 */
 	igt_list_add_tail(&high_hole->link, &hole->link);
+	simple_vma_tree_insert(heap, high_hole);
 }
 
 static bool simple_vma_heap_alloc(struct simple_vma_heap *heap,
@@ -283,15 +597,13 @@ static bool simple_vma_heap_alloc(struct simple_vma_heap *heap,
 				  uint64_t alignment,
 				  enum allocator_strategy strategy)
 {
-	struct simple_vma_hole *hole, *tmp;
+	struct simple_vma_hole *hole;
 	uint64_t misalign;
 
 	/* The caller is expected to reject zero-size allocations */
 	igt_assert(size > 0);
 	igt_assert(alignment > 0);
 
-	simple_vma_heap_validate(heap);
-
 	/* Ensure we support only NONE/LOW_TO_HIGH/HIGH_TO_LOW strategies */
 	igt_assert(strategy == ALLOC_STRATEGY_NONE ||
 		   strategy == ALLOC_STRATEGY_LOW_TO_HIGH ||
@@ -301,10 +613,13 @@ static bool simple_vma_heap_alloc(struct simple_vma_heap *heap,
 	if (strategy == ALLOC_STRATEGY_NONE)
 		strategy = heap->strategy;
 
+	/*
+	 * Visit holes big enough for the allocation in the same order as
+	 * walking the list would, from the top or from the bottom.
+	 */
 	if (strategy == ALLOC_STRATEGY_HIGH_TO_LOW) {
-		simple_vma_foreach_hole_safe(hole, heap, tmp) {
-			if (size > hole->size)
-				continue;
+		for (hole = simple_vma_tree_last_fit(heap->root, size); hole;
+		     hole = simple_vma_tree_prev_fit(hole, size)) {
 			/*
 			 * Compute the offset as the highest address where a chunk of the
 			 * given size can be without going over the top of the hole.
@@ -324,14 +639,12 @@ static bool simple_vma_heap_alloc(struct simple_vma_heap *heap,
 			if (*offset < hole->offset)
 				continue;
 
-			simple_vma_hole_alloc(hole, *offset, size);
-			simple_vma_heap_validate(heap);
+			simple_vma_hole_alloc(heap, hole, *offset, size);
 			return true;
 		}
 	} else {
-		simple_vma_foreach_hole_safe_rev(hole, heap, tmp) {
-			if (size > hole->size)
-				continue;
+		for (hole = simple_vma_tree_first_fit(heap->root, size); hole;
+		     hole = simple_vma_tree_next_fit(hole, size)) {
 
 			*offset = hole->offset;
 
@@ -346,8 +659,7 @@ static bool simple_vma_heap_alloc(struct simple_vma_heap *heap,
 				*offset += pad;
 			}
 
-			simple_vma_hole_alloc(hole, *offset, size);
-			simple_vma_heap_validate(heap);
+			simple_vma_hole_alloc(heap, hole, *offset, size);
 			return true;
 		}
 	}
@@ -373,7 +685,7 @@ static bool simple_vma_heap_alloc_addr(struct intel_allocator_simple *ials,
 				       uint64_t offset, uint64_t size)
 {
 	struct simple_vma_heap *heap = &ials->heap;
-	struct simple_vma_hole *hole, *tmp;
+	struct simple_vma_hole *hole;
 
 	/* Allocating something with a size of 0 is not valid. */
 	igt_assert(size > 0);
@@ -384,21 +696,18 @@ static bool simple_vma_heap_alloc_addr(struct intel_allocator_simple *ials,
 	 */
 	igt_assert(offset + size == 0 || offset + size > offset);
 
-	/* Find the hole if one exists. */
-	simple_vma_foreach_hole_safe(hole, heap, tmp) {
-		if (hole->offset > offset)
-			continue;
-
-		/*
-		 * Holes are ordered high-to-low so the first hole we find with
-		 * hole->offset <= is our hole.  If it's not big enough to contain the
-		 * requested range, then the allocation fails.
-		 */
+	/*
+	 * Find the hole if one exists. It's the highest one with
+	 * hole->offset <= offset.  If it's not big enough to contain the
+	 * requested range, then the allocation fails.
+	 */
+	hole = simple_vma_tree_floor(heap, offset);
+	if (hole) {
 		igt_assert(hole->offset <= offset);
 		if (hole->size < offset - hole->offset + size)
 			return false;
 
-		simple_vma_hole_alloc(hole, offset, size);
+		simple_vma_hole_alloc(heap, hole, offset, size);
 		return true;
 	}
 
@@ -650,6 +959,29 @@ static bool intel_allocator_simple_is_empty(struct intel_allocator *ial)
 	return !ials->allocated_objects && !ials->reserved_areas;
 }
 
+/*
+ * Checks the whole heap, and that the holes add up to the space which is
+ * neither allocated nor reserved. For the library tests, which can't reach
+ * the heap otherwise.
+ */
+void intel_allocator_simple_validate(struct intel_allocator *ial)
+{
+	struct intel_allocator_simple *ials;
+	struct simple_vma_hole *hole;
+	uint64_t total_free = 0;
+
+	igt_assert(ial);
+	ials = (struct intel_allocator_simple *) ial->priv;
+	igt_assert(ials);
+
+	simple_vma_heap_validate(&ials->heap);
+
+	simple_vma_foreach_hole(hole, &ials->heap)
+		total_free += hole->size;
+	igt_assert_eq_u64(total_free, ials->total_size -
+			  ials->allocated_size - ials->reserved_size);
+}
+
 static void intel_allocator_simple_print(struct intel_allocator *ial, bool full)
 {
 	struct intel_allocator_simple *ials;
@@ -669,6 +1001,8 @@ static void intel_allocator_simple_print(struct intel_allocator *ial, bool full)
 		 ials->start, ials->end);
 
 	if (full) {
+		simple_vma_heap_validate(heap);
+
 		igt_info("holes:\n");
 		simple_vma_foreach_hole(hole, heap) {
 			igt_info("offset = %"PRIu64" (0x%"PRIx64", "
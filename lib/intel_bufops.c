@@ -27,6 +27,7 @@
 
 #include "i915/gem_create.h"
 #include "igt.h"
+#include "igt_workers.h"
 #include "igt_x86.h"
 #include "intel_bufops.h"
 
@@ -115,6 +116,7 @@ struct buf_ops {
 	bo_copy y_to_linear;
 	bo_copy yf_to_linear;
 	bo_copy ys_to_linear;
+	unsigned int tiling_threads;
 };
 
 static const char *tiling_str(uint32_t tiling)
@@ -148,7 +150,8 @@ static uint32_t get_stride(uint32_t devid, uint32_t tiling)
 {
 	uint32_t stride = 128;
 
-	if (IS_915G(devid) || IS_915GM(devid) || tiling == I915_TILING_X)
+	if (IS_915G(devid) || IS_915GM(devid) ||
+	    tiling == I915_TILING_X || tiling == I915_TILING_Ys)
 		stride = 512;
 
 	return stride;
@@ -349,6 +352,39 @@ static void *yf_ptr(void *ptr,
 		(((y & ~0x1f) >> 5) * row_size);
 }
 
+static void *ys_ptr(void *ptr,
+		    unsigned int x, unsigned int y,
+		    unsigned int stride, unsigned int cpp)
+{
+	const int tile_size = 64 * 1024;
+	const int tile_width = 512;
+	int row_size = stride / tile_width * tile_size;
+
+	x *= cpp; /* convert to Byte offset */
+
+	/*
+	 * A 64k Ys tile is a 4x4 grid of 4k blocks, each swizzled like
+	 * a Yf tile, and the pattern continues alternating y and x:
+	 * msb............lsb
+	 * xyxyxyxyxyyyxxxx
+	 */
+	return ptr +
+		((x & 0xf) * 1) + /* 4x1 pixels(32bpp) = 16B */
+		((y & 0x3) * 16) + /* 4x4 pixels = 64B */
+		(((y & 0x4) >> 2) * 64) + /* 1x2 64B blocks */
+		(((x & 0x10) >> 4) * 128) + /* 2x2 64B blocks = 256B block */
+		(((y & 0x8) >> 3) * 256) + /* 2x1 256B blocks */
+		(((x & 0x20) >> 5) * 512) + /* 2x2 256B blocks */
+		(((y & 0x10) >> 4) * 1024) + /* 4x2 256 blocks */
+		(((x & 0x40) >> 6) * 2048) + /* 4x4 256B blocks = 4k block */
+		(((y & 0x20) >> 5) * 4096) + /* 1x2 4k blocks */
+		(((x & 0x80) >> 7) * 8192) + /* 2x2 4k blocks */
+		(((y & 0x40) >> 6) * 16384) + /* 2x4 4k blocks */
+		(((x & 0x100) >> 8) * 32768) + /* 4x4 4k blocks = 64k tile */
+		(((x & ~0x1ff) >> 9) * tile_size) + /* row of tiles */
+		(((y & ~0x7f) >> 7) * row_size);
+}
+
 typedef void *(*tile_fn)(void *, unsigned int, unsigned int,
 			unsigned int, unsigned int);
 static tile_fn __get_tile_fn_ptr(int tiling)
@@ -366,7 +402,7 @@ static tile_fn __get_tile_fn_ptr(int tiling)
 		fn = yf_ptr;
 		break;
 	case I915_TILING_Ys:
-		/* To be implemented */
+		fn = ys_ptr;
 		break;
 	}
 
@@ -374,6 +410,381 @@ static tile_fn __get_tile_fn_ptr(int tiling)
 	return fn;
 }
 
+/*
+ * Tile-at-a-time (de)tiling of 32bpp surfaces.
+ *
+ * Each tile is handled as a sequence of 64B cache lines. A cache line
+ * of an X tile is 64 contiguous bytes of a single row, for Y, Yf and
+ * Ys tiles it is a 16B OWORD column spanning four consecutive rows.
+ * The position of every cache line within the tile is looked up from
+ * the per-pixel tile functions, so both paths share one definition of
+ * the layout, and bit 6 swizzling is applied per cache line.
+ */
+#define TILE_LINE_SIZE 64
+#define MAX_TILE_LINES (64 * 1024 / TILE_LINE_SIZE)
+
+struct tile_layout {
+	unsigned int width;	/* bytes */
+	unsigned int height;	/* rows */
+	unsigned int span;	/* bytes of a row within a cache line */
+	unsigned int lines;
+	struct {
+		uint16_t x, y;
+	} line[MAX_TILE_LINES];
+};
+
+static void get_tile_layout(struct tile_layout *layout, int tiling)
+{
+	const tile_fn fn = __get_tile_fn_ptr(tiling);
+	const unsigned int cpp = 4;
+	unsigned int x, y;
+
+	switch (tiling) {
+	case I915_TILING_X:
+		layout->width = 512;
+		layout->height = 8;
+		layout->span = TILE_LINE_SIZE;
+		break;
+	case I915_TILING_Y:
+	case I915_TILING_Yf:
+		layout->width = 128;
+		layout->height = 32;
+		layout->span = 16;
+		break;
+	case I915_TILING_Ys:
+		layout->width = 512;
+		layout->height = 128;
+		layout->span = 16;
+		break;
+	}
+
+	layout->lines = layout->width * layout->height / TILE_LINE_SIZE;
+
+	for (y = 0; y < layout->height; y += TILE_LINE_SIZE / layout->span) {
+		for (x = 0; x < layout->width; x += layout->span) {
+			unsigned long offset =
+				to_user_pointer(fn(NULL, x / cpp, y,
+						   layout->width, cpp));
+
+			igt_assert(offset % TILE_LINE_SIZE == 0);
+			layout->line[offset / TILE_LINE_SIZE].x = x;
+			layout->line[offset / TILE_LINE_SIZE].y = y;
+		}
+	}
+}
+
+typedef void (*line_copy_fn)(void *tiled, void *linear,
+			     unsigned int stride, unsigned int span,
+			     unsigned int rows);
+
+static void line_to_tiled(void *tiled, void *linear,
+			  unsigned int stride, unsigned int span,
+			  unsigned int rows)
+{
+	for (; rows--; tiled += span, linear += stride)
+		memcpy(tiled, linear, span);
+}
+
+static void line_to_linear(void *tiled, void *linear,
+			   unsigned int stride, unsigned int span,
+			   unsigned int rows)
+{
+	for (; rows--; tiled += span, linear += stride)
+		memcpy(linear, tiled, span);
+}
+
+#if defined(__x86_64__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+
+#include <smmintrin.h>
+
+/*
+ * The tiled side is usually a WC mapping, so write it with streaming
+ * stores and read it with streaming loads. Cache lines are 64B aligned
+ * as long as the mapping is.
+ */
+static void line_to_tiled_sse41(void *tiled, void *linear,
+				unsigned int stride, unsigned int span,
+				unsigned int rows)
+{
+	__m128i *D = tiled;
+
+	for (; rows--; linear += stride) {
+		__m128i *S = linear;
+		unsigned int i;
+
+		for (i = 0; i < span / 16; i++)
+			_mm_stream_si128(D++, _mm_loadu_si128(S + i));
+	}
+}
+
+static void line_to_linear_sse41(void *tiled, void *linear,
+				 unsigned int stride, unsigned int span,
+				 unsigned int rows)
+{
+	__m128i *S = tiled;
+
+	for (; rows--; linear += stride) {
+		__m128i *D = linear;
+		unsigned int i;
+
+		for (i = 0; i < span / 16; i++)
+			_mm_storeu_si128(D + i, _mm_stream_load_si128(S++));
+	}
+}
+
+static void line_copy_done_sse41(void)
+{
+	_mm_sfence();
+}
+
+#pragma GCC pop_options
+
+static bool use_sse41(void)
+{
+	return igt_x86_features() & SSE4_1;
+}
+#else
+#define line_to_tiled_sse41 line_to_tiled
+#define line_to_linear_sse41 line_to_linear
+#define line_copy_done_sse41() do { } while (0)
+
+static bool use_sse41(void)
+{
+	return false;
+}
+#endif
+
+static void __copy_tiles(const struct intel_buf *buf, void *map,
+			 void *linear, int tiling, uint32_t swizzle,
+			 bool to_tiled,
+			 unsigned int first_row, unsigned int last_row)
+{
+	struct tile_layout layout;
+	unsigned int stride = buf->surface[0].stride;
+	unsigned int row_size, tiles_x;
+	line_copy_fn copy;
+	unsigned int tx, ty, l;
+
+	get_tile_layout(&layout, tiling);
+	igt_assert(stride % layout.width == 0);
+	igt_assert((to_user_pointer(map) & (TILE_LINE_SIZE - 1)) == 0);
+
+	if (use_sse41())
+		copy = to_tiled ? line_to_tiled_sse41 : line_to_linear_sse41;
+	else
+		copy = to_tiled ? line_to_tiled : line_to_linear;
+
+	igt_assert(first_row % layout.height == 0);
+
+	row_size = stride * layout.height;
+	tiles_x = stride / layout.width;
+
+	for (ty = first_row / layout.height; ty * layout.height < last_row; ty++) {
+		for (tx = 0; tx < tiles_x; tx++) {
+			void *tile = map + ty * row_size +
+				tx * layout.width * layout.height;
+
+			for (l = 0; l < layout.lines; l++) {
+				unsigned int y = ty * layout.height + layout.line[l].y;
+				unsigned int rows = TILE_LINE_SIZE / layout.span;
+				void *tiled = tile + l * TILE_LINE_SIZE;
+
+				if (y >= last_row)
+					continue;
+
+				rows = min(rows, last_row - y);
+
+				if (swizzle)
+					tiled = from_user_pointer(swizzle_addr(tiled,
+									       swizzle));
+
+				copy(tiled,
+				     linear + y * stride + tx * layout.width + layout.line[l].x,
+				     stride, layout.span, rows);
+			}
+		}
+	}
+
+	if (use_sse41())
+		line_copy_done_sse41();
+}
+
+static void __copy_pixels_to_tiled(const struct intel_buf *buf, void *map,
+				   const uint32_t *linear, int tiling,
+				   uint32_t swizzle,
+				   int first_row, int last_row)
+{
+	const tile_fn fn = __get_tile_fn_ptr(tiling);
+	int width = intel_buf_width(buf);
+
+	for (int y = first_row; y < last_row; y++) {
+		for (int x = 0; x < width; x++) {
+			uint32_t *ptr = fn(map, x, y, buf->surface[0].stride, buf->bpp/8);
+
+			if (swizzle)
+				ptr = from_user_pointer(swizzle_addr(ptr,
+								     swizzle));
+			*ptr = linear[y * width + x];
+		}
+	}
+}
+
+static void __copy_pixels_to_linear(const struct intel_buf *buf,
+				    const void *map, uint32_t *linear,
+				    int tiling, uint32_t swizzle,
+				    int first_row, int last_row)
+{
+	const tile_fn fn = __get_tile_fn_ptr(tiling);
+	int width = intel_buf_width(buf);
+
+	for (int y = first_row; y < last_row; y++) {
+		for (int x = 0; x < width; x++) {
+			uint32_t *ptr = fn((void *)map, x, y, buf->surface[0].stride, buf->bpp/8);
+
+			if (swizzle)
+				ptr = from_user_pointer(swizzle_addr(ptr,
+								     swizzle));
+			linear[y * width + x] = *ptr;
+		}
+	}
+}
+
+/* Copies the rows [first_row, last_row), aligned to the tile height */
+static void __copy_rows(const struct intel_buf *buf, void *map, void *linear,
+			uint32_t swizzle, bool to_tiled, bool per_pixel,
+			unsigned int first_row, unsigned int last_row)
+{
+	if (per_pixel || buf->bpp != 32) {
+		if (to_tiled)
+			__copy_pixels_to_tiled(buf, map, linear, buf->tiling,
+					       swizzle, first_row, last_row);
+		else
+			__copy_pixels_to_linear(buf, map, linear, buf->tiling,
+						swizzle, first_row, last_row);
+	} else {
+		__copy_tiles(buf, map, linear, buf->tiling, swizzle, to_tiled,
+			     first_row, last_row);
+	}
+}
+
+static unsigned int tile_height(uint32_t tiling)
+{
+	switch (tiling) {
+	case I915_TILING_X:
+		return 8;
+	case I915_TILING_Ys:
+		return 128;
+	default:
+		return 32;
+	}
+}
+
+/*
+ * Software (de)tiling split into bands of whole tile rows, copied by the
+ * igt_workers pool, see buf_ops_set_tiling_threads(). Bands never share
+ * a tile, so the result is the same as with a single thread. The state
+ * lives with the call, so concurrent callers don't get in each other's
+ * way: when the pool is already busy, igt_workers_run() copies the bands
+ * in the calling thread.
+ */
+struct tiling_bands {
+	const struct intel_buf *buf;
+	void *map;
+	void *linear;
+	uint32_t swizzle;
+	bool to_tiled;
+	unsigned int rows;
+	unsigned int height;
+};
+
+static void tiling_band(void *data, unsigned int job)
+{
+	struct tiling_bands *bands = data;
+	unsigned int first = job * bands->rows;
+	unsigned int last = min(first + bands->rows, bands->height);
+
+	__copy_rows(bands->buf, bands->map, bands->linear, bands->swizzle,
+		    bands->to_tiled, false, first, last);
+}
+
+static void __copy_surface(struct buf_ops *bops, struct intel_buf *buf,
+			   void *map, void *linear, uint32_t swizzle,
+			   bool to_tiled)
+{
+	unsigned int threads = bops->tiling_threads;
+	unsigned int height = intel_buf_height(buf);
+	unsigned int th = tile_height(buf->tiling);
+	struct tiling_bands bands = {
+		.buf = buf,
+		.map = map,
+		.linear = linear,
+		.swizzle = swizzle,
+		.to_tiled = to_tiled,
+		.height = height,
+	};
+
+	if (threads <= 1 || height <= th) {
+		__copy_rows(buf, map, linear, swizzle, to_tiled, false,
+			    0, height);
+		return;
+	}
+
+	/* A few bands per thread to even out the load */
+	bands.rows = ALIGN(DIV_ROUND_UP(height, 4 * threads), th);
+
+	igt_workers_run(threads, DIV_ROUND_UP(height, bands.rows),
+			tiling_band, &bands);
+
+	/* Streaming stores from the other threads are fenced there */
+}
+
+/**
+ * __intel_buf_linear_to_tiled
+ * @buf: pointer to intel_buf structure describing the surface
+ * @map: CPU mapping of the surface, aligned to at least 64 bytes
+ * @linear: linear image data, with the same stride as the surface
+ * @swizzle: bit 6 swizzling mode of @map
+ * @per_pixel: use the reference per-pixel implementation
+ *
+ * Function tiles @linear into @map according to the @buf tiling, which
+ * must not be I915_TILING_NONE. 32bpp surfaces are copied a tile cache
+ * line at a time, other bpps and @per_pixel go pixel by pixel.
+ * This is the software tiling behind linear_to_intel_buf(), exported
+ * for selftests and benchmarks.
+ */
+void __intel_buf_linear_to_tiled(const struct intel_buf *buf, void *map,
+				 const uint32_t *linear, uint32_t swizzle,
+				 bool per_pixel)
+{
+	igt_assert(buf->tiling != I915_TILING_NONE);
+
+	__copy_rows(buf, map, (void *)linear, swizzle, true, per_pixel,
+		    0, intel_buf_height(buf));
+}
+
+/**
+ * __intel_buf_tiled_to_linear
+ * @buf: pointer to intel_buf structure describing the surface
+ * @map: CPU mapping of the surface, aligned to at least 64 bytes
+ * @linear: destination for the linear image data
+ * @swizzle: bit 6 swizzling mode of @map
+ * @per_pixel: use the reference per-pixel implementation
+ *
+ * Function detiles @map into @linear, the counterpart of
+ * __intel_buf_linear_to_tiled().
+ */
+void __intel_buf_tiled_to_linear(const struct intel_buf *buf, const void *map,
+				 uint32_t *linear, uint32_t swizzle,
+				 bool per_pixel)
+{
+	igt_assert(buf->tiling != I915_TILING_NONE);
+
+	__copy_rows(buf, (void *)map, linear, swizzle, false, per_pixel,
+		    0, intel_buf_height(buf));
+}
+
 static bool is_cache_coherent(int fd, uint32_t handle)
 {
 	return gem_get_caching(fd, handle) != I915_CACHING_NONE;
@@ -479,25 +890,14 @@ static void *mmap_read(int fd, struct intel_buf *buf)
 	return map;
 }
 
-static void __copy_linear_to(int fd, struct intel_buf *buf,
+static void __copy_linear_to(struct buf_ops *bops, struct intel_buf *buf,
 			     const uint32_t *linear,
 			     int tiling, uint32_t swizzle)
 {
-	const tile_fn fn = __get_tile_fn_ptr(tiling);
-	int height = intel_buf_height(buf);
-	int width = intel_buf_width(buf);
-	void *map = mmap_write(fd, buf);
+	void *map = mmap_write(bops->fd, buf);
 
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			uint32_t *ptr = fn(map, x, y, buf->surface[0].stride, buf->bpp/8);
-
-			if (swizzle)
-				ptr = from_user_pointer(swizzle_addr(ptr,
-								     swizzle));
-			*ptr = linear[y * width + x];
-		}
-	}
+	igt_assert(tiling == buf->tiling);
+	__copy_surface(bops, buf, map, (void *)linear, swizzle, true);
 
 	munmap(map, buf->surface[0].size);
 }
@@ -506,48 +906,37 @@ static void copy_linear_to_x(struct buf_ops *bops, struct intel_buf *buf,
 			     uint32_t *linear)
 {
 	DEBUGFN();
-	__copy_linear_to(bops->fd, buf, linear, I915_TILING_X, bops->swizzle_x);
+	__copy_linear_to(bops, buf, linear, I915_TILING_X, bops->swizzle_x);
 }
 
 static void copy_linear_to_y(struct buf_ops *bops, struct intel_buf *buf,
 			     uint32_t *linear)
 {
 	DEBUGFN();
-	__copy_linear_to(bops->fd, buf, linear, I915_TILING_Y, bops->swizzle_y);
+	__copy_linear_to(bops, buf, linear, I915_TILING_Y, bops->swizzle_y);
 }
 
 static void copy_linear_to_yf(struct buf_ops *bops, struct intel_buf *buf,
 			      uint32_t *linear)
 {
 	DEBUGFN();
-	__copy_linear_to(bops->fd, buf, linear, I915_TILING_Yf, 0);
+	__copy_linear_to(bops, buf, linear, I915_TILING_Yf, 0);
 }
 
 static void copy_linear_to_ys(struct buf_ops *bops, struct intel_buf *buf,
 			      uint32_t *linear)
 {
 	DEBUGFN();
-	__copy_linear_to(bops->fd, buf, linear, I915_TILING_Ys, 0);
+	__copy_linear_to(bops, buf, linear, I915_TILING_Ys, 0);
 }
 
-static void __copy_to_linear(int fd, struct intel_buf *buf,
+static void __copy_to_linear(struct buf_ops *bops, struct intel_buf *buf,
 			     uint32_t *linear, int tiling, uint32_t swizzle)
 {
-	const tile_fn fn = __get_tile_fn_ptr(tiling);
-	int height = intel_buf_height(buf);
-	int width = intel_buf_width(buf);
-	void *map = mmap_write(fd, buf);
-
-	for (int y = 0; y < height; y++) {
-		for (int x = 0; x < width; x++) {
-			uint32_t *ptr = fn(map, x, y, buf->surface[0].stride, buf->bpp/8);
+	void *map = mmap_write(bops->fd, buf);
 
-			if (swizzle)
-				ptr = from_user_pointer(swizzle_addr(ptr,
-								     swizzle));
-			linear[y * width + x] = *ptr;
-		}
-	}
+	igt_assert(tiling == buf->tiling);
+	__copy_surface(bops, buf, map, linear, swizzle, false);
 
 	munmap(map, buf->surface[0].size);
 }
@@ -556,28 +945,28 @@ static void copy_x_to_linear(struct buf_ops *bops, struct intel_buf *buf,
 			     uint32_t *linear)
 {
 	DEBUGFN();
-	__copy_to_linear(bops->fd, buf, linear, I915_TILING_X, bops->swizzle_x);
+	__copy_to_linear(bops, buf, linear, I915_TILING_X, bops->swizzle_x);
 }
 
 static void copy_y_to_linear(struct buf_ops *bops, struct intel_buf *buf,
 			     uint32_t *linear)
 {
 	DEBUGFN();
-	__copy_to_linear(bops->fd, buf, linear, I915_TILING_Y, bops->swizzle_y);
+	__copy_to_linear(bops, buf, linear, I915_TILING_Y, bops->swizzle_y);
 }
 
 static void copy_yf_to_linear(struct buf_ops *bops, struct intel_buf *buf,
 			      uint32_t *linear)
 {
 	DEBUGFN();
-	__copy_to_linear(bops->fd, buf, linear, I915_TILING_Yf, 0);
+	__copy_to_linear(bops, buf, linear, I915_TILING_Yf, 0);
 }
 
 static void copy_ys_to_linear(struct buf_ops *bops, struct intel_buf *buf,
 			      uint32_t *linear)
 {
 	DEBUGFN();
-	__copy_to_linear(bops->fd, buf, linear, I915_TILING_Ys, 0);
+	__copy_to_linear(bops, buf, linear, I915_TILING_Ys, 0);
 }
 
 static void copy_linear_to_gtt(struct buf_ops *bops, struct intel_buf *buf,
@@ -771,7 +1160,12 @@ static void __intel_buf_init(struct buf_ops *bops,
 				buf->surface[0].stride = bo_stride;
 			else
 				buf->surface[0].stride = ALIGN(width * (bpp / 8), tile_width);
-			align_h = tiling == I915_TILING_X ? 8 : 32;
+			if (tiling == I915_TILING_X)
+				align_h = 8;
+			else if (tiling == I915_TILING_Ys)
+				align_h = 128;
+			else
+				align_h = 32;
 		} else {
 			if (bo_stride)
 				buf->surface[0].stride = bo_stride;
@@ -1208,7 +1602,7 @@ static void *alloc_aligned(uint64_t size)
 /*
  * Simple idempotency test between HW -> SW and SW -> HW BO.
  */
-static void idempotency_selftest(struct buf_ops *bops, uint32_t tiling)
+static void __idempotency_selftest(struct buf_ops *bops, uint32_t tiling)
 {
 	struct intel_buf buf;
 	uint8_t *linear_in, *linear_out, *map;
@@ -1255,10 +1649,28 @@ static void idempotency_selftest(struct buf_ops *bops, uint32_t tiling)
 		software_tiling = !software_tiling;
 	} while (software_tiling);
 
-	igt_debug("Idempotency for %s tiling OK\n", tiling_str(tiling));
+	igt_debug("Idempotency for %s tiling, %u threads OK\n",
+		  tiling_str(tiling), buf_ops_get_tiling_threads(bops));
 	buf_ops_set_software_tiling(bops, tiling, false);
 }
 
+static void idempotency_selftest(struct buf_ops *bops, uint32_t tiling)
+{
+	unsigned int threads = buf_ops_get_tiling_threads(bops);
+
+	if (!is_hw_tiling_supported(bops, tiling))
+		return;
+
+	/* Software (de)tiling split in bands has to match the serial one */
+	buf_ops_set_tiling_threads(bops, 1);
+	__idempotency_selftest(bops, tiling);
+
+	buf_ops_set_tiling_threads(bops, 4);
+	__idempotency_selftest(bops, tiling);
+
+	buf_ops_set_tiling_threads(bops, threads);
+}
+
 uint64_t intel_buf_bo_size(const struct intel_buf *buf)
 {
 	return buf->size;
@@ -1495,6 +1907,41 @@ bool buf_ops_set_software_tiling(struct buf_ops *bops,
 	return was_changed;
 }
 
+/**
+ * buf_ops_set_tiling_threads
+ * @bops: pointer to buf_ops
+ * @threads: number of threads doing software (de)tiling
+ *
+ * Function allows splitting software (de)tiling in intel_buf_to_linear()
+ * and linear_to_intel_buf() into bands of tile rows which are copied
+ * in parallel by the igt_workers pool. Result is the same as with the
+ * default, single threaded, copy. Pass 0 to use all online cpus.
+ */
+void buf_ops_set_tiling_threads(struct buf_ops *bops, unsigned int threads)
+{
+	igt_assert(bops);
+
+	if (!threads)
+		threads = max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+
+	bops->tiling_threads = threads;
+
+	igt_debug("Software tiling threads: %u\n", threads);
+}
+
+/**
+ * buf_ops_get_tiling_threads
+ * @bops: pointer to buf_ops
+ *
+ * Returns: number of threads doing software (de)tiling
+ */
+unsigned int buf_ops_get_tiling_threads(struct buf_ops *bops)
+{
+	igt_assert(bops);
+
+	return max(bops->tiling_threads, 1u);
+}
+
 /**
  * buf_ops_has_hw_fence
  * @bops: pointer to buf_ops
@@ -107,6 +107,8 @@ int buf_ops_get_fd(struct buf_ops *bops);
 bool buf_ops_set_software_tiling(struct buf_ops *bops,
 				 uint32_t tiling,
 				 bool use_software_tiling);
+void buf_ops_set_tiling_threads(struct buf_ops *bops, unsigned int threads);
+unsigned int buf_ops_get_tiling_threads(struct buf_ops *bops);
 
 void intel_buf_to_linear(struct buf_ops *bops, struct intel_buf *buf,
 			 uint32_t *linear);
@@ -114,6 +116,13 @@ void intel_buf_to_linear(struct buf_ops *bops, struct intel_buf *buf,
 void linear_to_intel_buf(struct buf_ops *bops, struct intel_buf *buf,
 			 uint32_t *linear);
 
+void __intel_buf_linear_to_tiled(const struct intel_buf *buf, void *map,
+				 const uint32_t *linear, uint32_t swizzle,
+				 bool per_pixel);
+void __intel_buf_tiled_to_linear(const struct intel_buf *buf, const void *map,
+				 uint32_t *linear, uint32_t swizzle,
+				 bool per_pixel);
+
 bool buf_ops_has_hw_fence(struct buf_ops *bops, uint32_t tiling);
 bool buf_ops_has_tiling_support(struct buf_ops *bops, uint32_t tiling);
 
@@ -0,0 +1,179 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <i915_drm.h>
+
+#include "igt_core.h"
+#include "igt_rand.h"
+
+#include "i915/perf.h"
+
+/*
+ * Check the OA report accumulation, whichever of the scalar or vector
+ * paths gets picked on this CPU, against a straightforward reading of the
+ * report layouts on synthetic reports.
+ */
+
+struct oa_record {
+	struct drm_i915_perf_record_header header;
+	uint32_t report[64];
+};
+
+#define MASK40 ((1ULL << 40) - 1)
+
+static uint64_t read_uint40(const uint32_t *report, int a)
+{
+	const uint8_t *high = (const uint8_t *)(report + 40);
+
+	return (uint64_t)high[a] << 32 | report[4 + a];
+}
+
+static void reference_accumulate(int oa_format,
+				 const uint32_t *r0, const uint32_t *r1,
+				 uint64_t *deltas)
+{
+	int idx = 0;
+
+	/* timestamp */
+	deltas[idx++] += (uint32_t)(r1[1] - r0[1]);
+
+	switch (oa_format) {
+	case I915_OA_FORMAT_A32u40_A4u32_B8_C8:
+		/* clock */
+		deltas[idx++] += (uint32_t)(r1[3] - r0[3]);
+		for (int a = 0; a < 32; a++)
+			deltas[idx++] += (read_uint40(r1, a) - read_uint40(r0, a)) & MASK40;
+		for (int i = 36; i < 40; i++)
+			deltas[idx++] += (uint32_t)(r1[i] - r0[i]);
+		for (int i = 48; i < 64; i++)
+			deltas[idx++] += (uint32_t)(r1[i] - r0[i]);
+		break;
+	case I915_OA_FORMAT_A45_B8_C8:
+		for (int i = 3; i < 64; i++)
+			deltas[idx++] += (uint32_t)(r1[i] - r0[i]);
+		break;
+	default:
+		igt_assert(0);
+	}
+}
+
+/*
+ * Advance every counter of @prev into @next by a random amount, biased
+ * towards small steps and the edges where the 32 and 40bit counters wrap.
+ */
+static void next_report(uint32_t *seed, const uint32_t *prev, uint32_t *next)
+{
+	uint8_t *high = (uint8_t *)(next + 40);
+
+	for (int i = 0; i < 64; i++) {
+		switch (hars_petruska_f54_1_random(seed) % 4) {
+		case 0:
+			next[i] = prev[i];
+			break;
+		case 1:
+			next[i] = prev[i] + hars_petruska_f54_1_random(seed) % 1024;
+			break;
+		case 2:
+			next[i] = 0xffffffff - hars_petruska_f54_1_random(seed) % 16;
+			break;
+		default:
+			next[i] = hars_petruska_f54_1_random(seed);
+			break;
+		}
+	}
+
+	/* A couple of 40bit counters sitting on the edge of wrapping */
+	for (int a = 0; a < 4; a++) {
+		int idx = hars_petruska_f54_1_random(seed) % 32;
+
+		high[idx] = hars_petruska_f54_1_random(seed) & 1 ? 0xff : 0;
+	}
+}
+
+static void check_format(int oa_format)
+{
+	const int n_records = 257;
+	const struct drm_i915_perf_record_header **records;
+	struct intel_perf_accumulator acc, batch;
+	uint64_t expected[64], total[64];
+	struct oa_record *data;
+	uint32_t seed = 0x8086;
+
+	data = calloc(n_records, sizeof(*data));
+	records = calloc(n_records, sizeof(*records));
+	igt_assert(data && records);
+
+	for (int i = 0; i < n_records; i++) {
+		data[i].header.type = DRM_I915_PERF_RECORD_SAMPLE;
+		data[i].header.size = sizeof(data[i]);
+		if (i)
+			next_report(&seed, data[i - 1].report, data[i].report);
+		records[i] = &data[i].header;
+	}
+
+	memset(total, 0, sizeof(total));
+	for (int i = 1; i < n_records; i++) {
+		memset(expected, 0, sizeof(expected));
+		reference_accumulate(oa_format, data[i - 1].report,
+				     data[i].report, expected);
+		reference_accumulate(oa_format, data[i - 1].report,
+				     data[i].report, total);
+
+		intel_perf_accumulate_reports(&acc, oa_format,
+					      records[i - 1], records[i]);
+		igt_assert(memcmp(acc.deltas, expected, sizeof(expected)) == 0);
+	}
+
+	/* Reports accumulated in reverse wrap every counter that went up */
+	memset(expected, 0, sizeof(expected));
+	reference_accumulate(oa_format, data[n_records - 1].report,
+			     data[0].report, expected);
+	intel_perf_accumulate_reports(&acc, oa_format,
+				      records[n_records - 1], records[0]);
+	igt_assert(memcmp(acc.deltas, expected, sizeof(expected)) == 0);
+
+	intel_perf_accumulate_reports_batch(&batch, oa_format,
+					    records, n_records);
+	igt_assert(memcmp(batch.deltas, total, sizeof(total)) == 0);
+
+	/* A single record has nothing to accumulate */
+	intel_perf_accumulate_reports_batch(&batch, oa_format, records, 1);
+	for (int i = 0; i < 64; i++)
+		igt_assert_eq_u64(batch.deltas[i], 0);
+
+	free(records);
+	free(data);
+}
+
+igt_main
+{
+	igt_subtest("a32u40-a4u32-b8-c8")
+		check_format(I915_OA_FORMAT_A32u40_A4u32_B8_C8);
+
+	igt_subtest("a45-b8-c8")
+		check_format(I915_OA_FORMAT_A45_B8_C8);
+}
@@ -0,0 +1,375 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <i915_drm.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+
+#include "i915/perf_data_reader.h"
+
+/*
+ * Decode synthetic i915-perf recordings, as written by i915-perf-recorder,
+ * long enough for the 32bit OA report timestamps and the 36bit timestamps
+ * of the correlations to wrap around many times.
+ */
+
+#define TGL_GT2_DEVICE_ID 0x9a49
+#define TIMESTAMP_FREQUENCY 19200000ull
+
+/* One GPU tick plus rounding */
+#define CPU_TS_TOLERANCE 100
+
+struct recording {
+	/* Time of the first report relative to the first correlation */
+	int64_t reports_start_ns;
+	int64_t report_period_ns;
+	uint32_t n_reports;
+	/* Context switch every reports_per_context reports */
+	uint32_t reports_per_context;
+
+	int64_t correlation_period_ns;
+	/* -1 to bracket all the reports */
+	int n_correlations;
+
+	uint64_t gpu_ts_base;
+	uint64_t cpu_ts_base;
+	int64_t drift_ppm;
+};
+
+static int64_t report_time(const struct recording *rec, uint32_t idx)
+{
+	return rec->reports_start_ns + idx * rec->report_period_ns;
+}
+
+static uint64_t gpu_time(const struct recording *rec, int64_t t)
+{
+	return rec->gpu_ts_base + t * (int64_t)(TIMESTAMP_FREQUENCY / 100000) / 10000;
+}
+
+static uint64_t cpu_time(const struct recording *rec, int64_t t)
+{
+	return rec->cpu_ts_base + t + t * rec->drift_ppm / 1000000;
+}
+
+static void write_record(FILE *f, uint32_t type, const void *data, size_t size)
+{
+	struct drm_i915_perf_record_header header = {
+		.type = type,
+		.size = sizeof(header) + size,
+	};
+
+	igt_assert_eq(fwrite(&header, sizeof(header), 1, f), 1);
+	igt_assert_eq(fwrite(data, size, 1, f), 1);
+}
+
+static void write_device_info(FILE *f)
+{
+	struct intel_perf_record_version version = {
+		.version = INTEL_PERF_RECORD_VERSION,
+	};
+	struct intel_perf_record_device_info info = {
+		.timestamp_frequency = TIMESTAMP_FREQUENCY,
+		.device_id = TGL_GT2_DEVICE_ID,
+		.gt_min_frequency = 300000000,
+		.gt_max_frequency = 1300000000,
+		.engine_class = I915_ENGINE_CLASS_RENDER,
+		.oa_format = I915_OA_FORMAT_A32u40_A4u32_B8_C8,
+		.metric_set_name = "RenderBasic",
+	};
+	/* 1 slice, 6 subslices of 16 EUs, padded to 8 bytes */
+	union {
+		struct drm_i915_query_topology_info info;
+		uint8_t data[40];
+	} topology = {
+		.info = {
+			.max_slices = 1,
+			.max_subslices = 6,
+			.max_eus_per_subslice = 16,
+			.subslice_offset = 1,
+			.subslice_stride = 1,
+			.eu_offset = 2,
+			.eu_stride = 2,
+		},
+	};
+
+	topology.info.data[0] = 0x1;
+	topology.info.data[1] = 0x3f;
+	memset(&topology.info.data[2], 0xff, 6 * 2);
+
+	write_record(f, INTEL_PERF_RECORD_TYPE_VERSION, &version, sizeof(version));
+	write_record(f, INTEL_PERF_RECORD_TYPE_DEVICE_INFO, &info, sizeof(info));
+	write_record(f, INTEL_PERF_RECORD_TYPE_DEVICE_TOPOLOGY,
+		     &topology, sizeof(topology));
+}
+
+/*
+ * Write the reports and correlations of @rec in time order, the way the
+ * recorder interleaves them. Correlations carry 36bits of GPU timestamp,
+ * reports only 32bits.
+ */
+static FILE *generate_recording(const struct recording *rec)
+{
+	int64_t reports_end = report_time(rec, rec->n_reports);
+	uint32_t report_idx = 0;
+	int corr_idx = 0;
+	FILE *f = tmpfile();
+
+	igt_assert(f);
+
+	write_device_info(f);
+
+	for (;;) {
+		int64_t corr_t = corr_idx * rec->correlation_period_ns;
+		bool more_correlations = rec->n_correlations < 0 ?
+			corr_t < reports_end + rec->correlation_period_ns :
+			corr_idx < rec->n_correlations;
+
+		if (report_idx < rec->n_reports &&
+		    (!more_correlations || report_time(rec, report_idx) < corr_t)) {
+			int64_t t = report_time(rec, report_idx);
+			uint32_t report[64] = {};
+
+			for (int i = 3; i < 64; i++)
+				report[i] = report_idx * (i * 2654435761u);
+			report[0] = 1 << 16; /* context valid */
+			report[1] = gpu_time(rec, t);
+			report[2] = report_idx / rec->reports_per_context;
+
+			write_record(f, DRM_I915_PERF_RECORD_SAMPLE,
+				     report, sizeof(report));
+			report_idx++;
+		} else if (more_correlations) {
+			struct intel_perf_record_timestamp_correlation corr = {
+				.cpu_timestamp = cpu_time(rec, corr_t),
+				.gpu_timestamp = gpu_time(rec, corr_t) & ((1ull << 36) - 1),
+			};
+
+			write_record(f, INTEL_PERF_RECORD_TYPE_TIMESTAMP_CORRELATION,
+				     &corr, sizeof(corr));
+			corr_idx++;
+		} else {
+			break;
+		}
+	}
+
+	fflush(f);
+
+	return f;
+}
+
+static void check_cpu_ts(uint64_t cpu_ts, uint64_t expected)
+{
+	int64_t diff = cpu_ts - expected;
+
+	igt_assert_f(diff >= -CPU_TS_TOLERANCE && diff <= CPU_TS_TOLERANCE,
+		     "cpu timestamp %"PRIu64", expected %"PRIu64"\n",
+		     cpu_ts, expected);
+}
+
+/*
+ * Check every timeline item against the generated timestamps. Without
+ * correlations the CPU timestamps can only be checked relative to each
+ * other.
+ */
+static void check_recording(const struct recording *rec)
+{
+	struct intel_perf_data_reader reader;
+	uint32_t n_timelines = (rec->n_reports + rec->reports_per_context - 1) /
+		rec->reports_per_context;
+	FILE *f = generate_recording(rec);
+
+	igt_assert_f(intel_perf_data_reader_init(&reader, fileno(f)),
+		     "%s\n", reader.error_msg);
+
+	igt_assert_eq(reader.n_records, rec->n_reports);
+	igt_assert_eq(reader.n_timelines, n_timelines);
+
+	for (uint32_t i = 0; i < reader.n_timelines; i++) {
+		const struct intel_perf_timeline_item *item = &reader.timelines[i];
+		int64_t t_start = report_time(rec, item->record_start);
+		int64_t t_end = report_time(rec, item->record_end);
+
+		igt_assert_eq(item->record_start, i * rec->reports_per_context);
+		igt_assert_eq(item->hw_id, i);
+
+		if (!reader.n_correlations) {
+			check_cpu_ts(item->cpu_ts_end - item->cpu_ts_start,
+				     t_end - t_start);
+			continue;
+		}
+
+		igt_assert_eq_u64(item->ts_start, gpu_time(rec, t_start));
+		igt_assert_eq_u64(item->ts_end, gpu_time(rec, t_end));
+		check_cpu_ts(item->cpu_ts_start, cpu_time(rec, t_start));
+		check_cpu_ts(item->cpu_ts_end, cpu_time(rec, t_end));
+	}
+
+	intel_perf_data_reader_fini(&reader);
+	fclose(f);
+}
+
+/*
+ * The stream reader must give the same timeline items as the batch one,
+ * with the counters accumulated over all the reports of each item.
+ */
+static void check_stream(const struct recording *rec, bool use_pipe)
+{
+	struct intel_perf_data_reader reader;
+	struct intel_perf_data_stream stream;
+	struct intel_perf_timeline_item item;
+	struct intel_perf_accumulator accu, expected;
+	FILE *f = generate_recording(rec);
+	uint32_t n_timelines = 0;
+	int fd = fileno(f);
+	int fds[2];
+
+	igt_assert(intel_perf_data_reader_init(&reader, fd));
+
+	lseek(fd, 0, SEEK_SET);
+	if (use_pipe) {
+		igt_assert_eq(pipe(fds), 0);
+
+		igt_fork(child, 1) {
+			char buf[4096];
+			ssize_t len;
+
+			close(fds[0]);
+			while ((len = read(fd, buf, sizeof(buf))) > 0)
+				igt_assert_eq(write(fds[1], buf, len), len);
+		}
+
+		close(fds[1]);
+		fd = fds[0];
+	}
+
+	igt_assert_f(intel_perf_data_stream_init(&stream, fd),
+		     "%s\n", stream.error_msg);
+
+	while (intel_perf_data_stream_next(&stream, &item, &accu)) {
+		const struct intel_perf_timeline_item *batch_item =
+			&reader.timelines[n_timelines++];
+
+		igt_assert(n_timelines <= reader.n_timelines);
+		igt_assert_eq(item.record_start, batch_item->record_start);
+		igt_assert_eq(item.record_end, batch_item->record_end);
+		igt_assert_eq(item.hw_id, batch_item->hw_id);
+		igt_assert_eq_u64(item.ts_start, batch_item->ts_start);
+		igt_assert_eq_u64(item.ts_end, batch_item->ts_end);
+		igt_assert_eq_u64(item.cpu_ts_start, batch_item->cpu_ts_start);
+		igt_assert_eq_u64(item.cpu_ts_end, batch_item->cpu_ts_end);
+
+		intel_perf_accumulate_reports_batch(&expected,
+						    I915_OA_FORMAT_A32u40_A4u32_B8_C8,
+						    &reader.records[item.record_start],
+						    item.record_end - item.record_start + 1);
+		igt_assert(memcmp(&accu, &expected, sizeof(accu)) == 0);
+	}
+
+	igt_assert_f(!stream.error_msg[0], "%s\n", stream.error_msg);
+	igt_assert_eq(n_timelines, reader.n_timelines);
+	igt_assert_eq(stream.n_records, reader.n_records);
+	igt_assert_eq(stream.n_correlations, reader.n_correlations);
+
+	/* Only the items between two correlations are held back */
+	if (rec->n_correlations < 0)
+		igt_assert_lte(stream.n_allocated_pending, 16);
+
+	intel_perf_data_stream_fini(&stream);
+	intel_perf_data_reader_fini(&reader);
+
+	if (use_pipe) {
+		close(fds[0]);
+		igt_waitchildren();
+	}
+	fclose(f);
+}
+
+static const struct {
+	const char *name;
+	struct recording rec;
+} recordings[] = {
+	/* 3 hours, ~50 wraps of the reports, 2 of the correlations */
+	{ "multi-hour", {
+		.reports_start_ns = NSEC_PER_SEC / 3,
+		.report_period_ns = NSEC_PER_SEC / 5,
+		.n_reports = 3 * 3600 * 5,
+		.reports_per_context = 7,
+		.correlation_period_ns = NSEC_PER_SEC,
+		.n_correlations = -1,
+		.gpu_ts_base = (1ull << 36) - 10 * TIMESTAMP_FREQUENCY,
+		.cpu_ts_base = 1000ull * NSEC_PER_SEC,
+		.drift_ppm = 50,
+	} },
+	/* Extrapolated from the first and last pairs of correlations */
+	{ "reports-outside-correlations", {
+		.reports_start_ns = -2 * NSEC_PER_SEC,
+		.report_period_ns = NSEC_PER_SEC / 10,
+		.n_reports = 100,
+		.reports_per_context = 4,
+		.correlation_period_ns = NSEC_PER_SEC,
+		.n_correlations = 4,
+		.gpu_ts_base = 0xfff00000,
+		.cpu_ts_base = 1000ull * NSEC_PER_SEC,
+		.drift_ppm = -20,
+	} },
+	{ "single-correlation", {
+		.reports_start_ns = -NSEC_PER_SEC,
+		.report_period_ns = NSEC_PER_SEC / 10,
+		.n_reports = 1000,
+		.reports_per_context = 10,
+		.correlation_period_ns = NSEC_PER_SEC,
+		.n_correlations = 1,
+		.gpu_ts_base = 1ull << 35,
+		.cpu_ts_base = 1000ull * NSEC_PER_SEC,
+	} },
+	{ "no-correlation", {
+		.report_period_ns = NSEC_PER_SEC / 10,
+		.n_reports = 1000,
+		.reports_per_context = 10,
+		.correlation_period_ns = NSEC_PER_SEC,
+		.n_correlations = 0,
+		.gpu_ts_base = 1ull << 35,
+	} },
+};
+
+igt_main
+{
+	for (int i = 0; i < ARRAY_SIZE(recordings); i++) {
+		igt_subtest_f("%s", recordings[i].name)
+			check_recording(&recordings[i].rec);
+
+		igt_subtest_f("stream-%s", recordings[i].name)
+			check_stream(&recordings[i].rec, false);
+
+		igt_subtest_f("stream-pipe-%s", recordings[i].name)
+			check_stream(&recordings[i].rec, true);
+	}
+}
@@ -26,13 +26,17 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
+#include "drmtest.h"
 #include "igt_core.h"
 #include "igt_audio.h"
 
 #define SAMPLING_RATE 44100
 #define CHANNELS 1
 #define BUFFER_LEN 2048
+/** STREAM_LEN: how many samples the streaming detector is fed */
+#define STREAM_LEN (16 * BUFFER_LEN)
 /** PHASESHIFT_LEN: how many samples will be truncated from the signal */
 #define PHASESHIFT_LEN 8
 
@@ -174,6 +178,112 @@ static void test_signal_detect_phaseshift(struct audio_signal *signal)
 	igt_assert(!ok);
 }
 
+static void feed_chunks(struct audio_signal_detector *det,
+			const double *buf, size_t len)
+{
+	size_t i, n;
+
+	/* Chunks of all sizes, smaller and larger than the window */
+	for (i = 0, n = 1; i < len; i += n, n = n * 3 + 1) {
+		if (n > len - i)
+			n = len - i;
+		audio_signal_detector_feed(det, buf + i, n);
+	}
+}
+
+static void test_signal_detector(struct audio_signal *signal)
+{
+	struct audio_signal_detector *det;
+	struct audio_signal *extra;
+	double *buf;
+	size_t i;
+
+	buf = malloc(STREAM_LEN * sizeof(double));
+	audio_signal_fill(signal, buf, STREAM_LEN / CHANNELS);
+
+	det = audio_signal_detector_init(signal, SAMPLING_RATE, 0, BUFFER_LEN);
+
+	/* Nothing to look at until a whole window got in */
+	audio_signal_detector_feed(det, buf, BUFFER_LEN - 1);
+	igt_assert(!audio_signal_detector_check(det));
+	audio_signal_detector_reset(det);
+
+	feed_chunks(det, buf, STREAM_LEN);
+	igt_assert(audio_signal_detector_check(det));
+
+	/* The windows overlap, and keep on accumulating */
+	audio_signal_detector_feed(det, buf, STREAM_LEN);
+	igt_assert(audio_signal_detector_check(det));
+
+	extra = audio_signal_init(CHANNELS, SAMPLING_RATE);
+	for (i = 0; i < test_freqs_len; i++)
+		audio_signal_add_frequency(extra, test_freqs[i], 0);
+	audio_signal_add_frequency(extra, TEST_EXTRA_FREQ, 0);
+	audio_signal_synthesize(extra);
+	audio_signal_fill(extra, buf, STREAM_LEN / CHANNELS);
+	audio_signal_fini(extra);
+
+	audio_signal_detector_reset(det);
+	feed_chunks(det, buf, STREAM_LEN);
+	igt_assert(!audio_signal_detector_check(det));
+
+	audio_signal_detector_fini(det);
+	free(buf);
+}
+
+static void test_signal_detector_s32(void)
+{
+	static const int freqs[] = { 300, 1000, 3000, 8000 };
+	const int channels = ARRAY_SIZE(freqs);
+	struct audio_signal_detector *det[ARRAY_SIZE(freqs)];
+	struct audio_signal_detector *wrong;
+	struct audio_signal *signal;
+	double *buf;
+	int32_t *s32;
+	int i, j;
+
+	signal = audio_signal_init(channels, SAMPLING_RATE);
+	for (i = 0; i < channels; i++)
+		igt_assert(audio_signal_add_frequency(signal, freqs[i], i) == 0);
+	audio_signal_synthesize(signal);
+
+	buf = malloc(STREAM_LEN * channels * sizeof(double));
+	s32 = malloc(STREAM_LEN * channels * sizeof(int32_t));
+	audio_signal_fill(signal, buf, STREAM_LEN);
+	for (i = 0; i < STREAM_LEN * channels; i++)
+		s32[i] = buf[i] * INT32_MAX;
+
+	for (i = 0; i < channels; i++)
+		det[i] = audio_signal_detector_init(signal, SAMPLING_RATE, i,
+						    BUFFER_LEN);
+	/* Expects channel 0, fed with channel 1 */
+	wrong = audio_signal_detector_init(signal, SAMPLING_RATE, 0,
+					   BUFFER_LEN);
+
+	/* The way audio comes in from the Chamelium, 128 frames at a time */
+	for (j = 0; j < STREAM_LEN; j += 128) {
+		for (i = 0; i < channels; i++)
+			audio_signal_detector_feed_s32_le(det[i],
+							  s32 + j * channels,
+							  128 * channels,
+							  channels, i);
+		audio_signal_detector_feed_s32_le(wrong, s32 + j * channels,
+						  128 * channels, channels, 1);
+	}
+
+	for (i = 0; i < channels; i++) {
+		igt_assert_f(audio_signal_detector_check(det[i]),
+			     "Channel %d not detected\n", i);
+		audio_signal_detector_fini(det[i]);
+	}
+	igt_assert(!audio_signal_detector_check(wrong));
+	audio_signal_detector_fini(wrong);
+
+	free(s32);
+	free(buf);
+	audio_signal_fini(signal);
+}
+
 igt_main
 {
 	struct audio_signal *signal = NULL;
@@ -215,8 +325,14 @@ igt_main
 		igt_subtest("signal-detect-phaseshift")
 			test_signal_detect_phaseshift(signal);
 
+		igt_subtest("signal-detector")
+			test_signal_detector(signal);
+
 		igt_fixture {
 			audio_signal_fini(signal);
 		}
 	}
+
+	igt_subtest("signal-detector-s32")
+		test_signal_detector_s32();
 }
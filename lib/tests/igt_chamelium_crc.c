@@ -0,0 +1,131 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_chamelium.h"
+#include "igt_rand.h"
+
+/*
+ * Check the single pass, lane split Chamelium CRC, on one thread and split
+ * across several, against the four pass hash it replaced, on random pixels
+ * in system memory. No device or board is needed.
+ */
+
+/* The hash of the pixels i with i % m == k, as it was computed before */
+static uint32_t reference_xrgb_hash16(const unsigned char *buffer, int width,
+				      int height, int k, int m)
+{
+	unsigned char r, g, b;
+	uint64_t sum = 0;
+	uint64_t count = 0;
+	uint64_t value;
+	uint32_t hash;
+	int index;
+	int i;
+
+	for (i=0; i < width * height; i++) {
+		if ((i % m) != k)
+			continue;
+
+		index = i * 4;
+
+		r = buffer[index + 2];
+		g = buffer[index + 1];
+		b = buffer[index + 0];
+
+		value = r | (g << 8) | (b << 16);
+		sum += ++count * value;
+	}
+
+	hash = ((sum >> 0) ^ (sum >> 16) ^ (sum >> 32) ^ (sum >> 48)) & 0xffff;
+
+	return hash;
+}
+
+static void reference_crc(const unsigned char *buffer, int width, int height,
+			  igt_crc_t *out)
+{
+	for (int i = 0; i < 4; i++)
+		out->crc[i] = reference_xrgb_hash16(buffer, width, height,
+						    4 - i - 1, 4);
+
+	out->n_words = 4;
+}
+
+static void check_crc(int width, int height, uint32_t *seed)
+{
+	static const int threads[] = { 1, 2, 3, 5, 8, 64 };
+	uint32_t *pixels = malloc(sizeof(*pixels) * width * height);
+	igt_crc_t expected;
+
+	igt_assert(pixels);
+	for (int i = 0; i < width * height; i++)
+		pixels[i] = hars_petruska_f54_1_random(seed);
+
+	reference_crc((const unsigned char *) pixels, width, height, &expected);
+
+	for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+		igt_crc_t crc;
+
+		memset(&crc, 0xff, sizeof(crc));
+		chamelium_calculate_crc_pixels(pixels, width, height,
+					       threads[i], &crc);
+
+		igt_assert_eq(crc.n_words, expected.n_words);
+		for (int c = 0; c < expected.n_words; c++)
+			igt_assert_f(crc.crc[c] == expected.crc[c],
+				     "%dx%d, %d threads: CRC %d is 0x%04x, expected 0x%04x\n",
+				     width, height, threads[i], c,
+				     crc.crc[c], expected.crc[c]);
+	}
+
+	free(pixels);
+}
+
+igt_main
+{
+	/* Pixel counts which aren't a multiple of the lanes, or of the parts */
+	static const int widths[] = { 1, 3, 4, 7, 33, 641 };
+	static const int heights[] = { 1, 2, 5, 17, 479 };
+	uint32_t seed = 0x8086;
+
+	igt_subtest("single-pass-and-split") {
+		for (int w = 0; w < ARRAY_SIZE(widths); w++)
+			for (int h = 0; h < ARRAY_SIZE(heights); h++)
+				check_crc(widths[w], heights[h], &seed);
+	}
+
+	igt_subtest("large-frame") {
+		/* Large enough for the async CRC to split it on its own */
+		check_crc(1921, 1081, &seed);
+	}
+}
@@ -0,0 +1,338 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "igt_chamelium.h"
+#include "igt_chamelium_emulator.h"
+#include "igt_chamelium_stream.h"
+
+/*
+ * Talk to emulated boards over loopback, one reading frames over the stream
+ * server and one over XML-RPC only, and check both against the frames they
+ * were given. No device or board is needed.
+ */
+
+/* Frame dumps are converted with pixman, which needs 4 byte aligned rows */
+#define WIDTH 64
+#define HEIGHT 36
+#define FRAMES 3
+
+static cairo_surface_t *frames[FRAMES];
+
+static void fill_frame(cairo_surface_t *surface, uint32_t seed)
+{
+	uint32_t *data = (uint32_t *) cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface) / sizeof(*data);
+
+	for (int y = 0; y < HEIGHT; y++) {
+		for (int x = 0; x < WIDTH; x++) {
+			seed = seed * 1103515245 + 12345;
+			data[y * stride + x] = seed >> 8 & 0xffffff;
+		}
+	}
+
+	cairo_surface_mark_dirty(surface);
+}
+
+static void check_pixels(const unsigned char *rgb, int frame,
+			 int x, int y, int w, int h)
+{
+	cairo_surface_t *surface = frames[frame];
+	const uint32_t *data =
+		(const uint32_t *) cairo_image_surface_get_data(surface);
+	int stride = cairo_image_surface_get_stride(surface) / sizeof(*data);
+
+	for (int j = 0; j < h; j++) {
+		for (int i = 0; i < w; i++) {
+			uint32_t pixel = data[(y + j) * stride + x + i];
+			const unsigned char *p = rgb + (j * w + i) * 3;
+
+			igt_assert_eq(p[0], pixel >> 16 & 0xff);
+			igt_assert_eq(p[1], pixel >> 8 & 0xff);
+			igt_assert_eq(p[2], pixel & 0xff);
+		}
+	}
+}
+
+/* Whether @surface is the area of @frame from @x, @y */
+static bool surface_matches(cairo_surface_t *surface, int frame, int x, int y)
+{
+	const uint32_t *data =
+		(const uint32_t *) cairo_image_surface_get_data(surface);
+	const uint32_t *expected =
+		(const uint32_t *) cairo_image_surface_get_data(frames[frame]);
+	int stride = cairo_image_surface_get_stride(surface) / sizeof(*data);
+	int expected_stride = cairo_image_surface_get_stride(frames[frame]) /
+			      sizeof(*expected);
+	int w = cairo_image_surface_get_width(surface);
+	int h = cairo_image_surface_get_height(surface);
+
+	for (int j = 0; j < h; j++)
+		for (int i = 0; i < w; i++)
+			if ((data[j * stride + i] & 0xffffff) !=
+			    expected[(y + j) * expected_stride + x + i])
+				return false;
+
+	return true;
+}
+
+static void check_surface(cairo_surface_t *surface, int frame)
+{
+	igt_assert_eq(cairo_image_surface_get_width(surface), WIDTH);
+	igt_assert_eq(cairo_image_surface_get_height(surface), HEIGHT);
+	igt_assert(surface_matches(surface, frame, 0, 0));
+}
+
+/* The board's checksum, written out independently of the emulator's */
+static void reference_crc(int frame, igt_crc_t *crc)
+{
+	const uint32_t *data =
+		(const uint32_t *) cairo_image_surface_get_data(frames[frame]);
+	int stride = cairo_image_surface_get_stride(frames[frame]) /
+		     sizeof(*data);
+
+	crc->n_words = 4;
+
+	for (int k = 0; k < 4; k++) {
+		uint64_t sum = 0, count = 0;
+
+		for (int i = k; i < WIDTH * HEIGHT; i += 4) {
+			uint32_t pixel = data[i / WIDTH * stride + i % WIDTH];
+			uint64_t value = (pixel >> 16 & 0xff) |
+					 (pixel & 0xff00) |
+					 (pixel & 0xff) << 16;
+
+			sum += ++count * value;
+		}
+
+		crc->crc[3 - k] = (sum ^ sum >> 16 ^ sum >> 32 ^ sum >> 48) &
+				  0xffff;
+	}
+}
+
+static struct chamelium_emulator *start_emulator(bool frame_stream)
+{
+	struct chamelium_emulator *emu;
+
+	emu = chamelium_emulator_create(WIDTH, HEIGHT);
+	for (int i = 0; i < FRAMES; i++)
+		igt_assert(chamelium_emulator_add_frame(emu, frames[i]));
+	chamelium_emulator_set_frame_streaming(emu, frame_stream);
+	igt_assert(chamelium_emulator_start(emu, NULL, 0, 0));
+
+	return emu;
+}
+
+static struct chamelium *connect_emulator(struct chamelium_emulator *emu)
+{
+	struct chamelium *chamelium;
+
+	chamelium_emulator_set_config(emu);
+	chamelium = chamelium_init_rpc_only();
+	igt_assert(chamelium);
+
+	return chamelium;
+}
+
+static void test_read_frames(struct chamelium *streamed,
+			     struct chamelium *rpc_only)
+{
+	struct chamelium_frame_dump *a[FRAMES], *b[FRAMES];
+
+	igt_assert_eq(chamelium_get_captured_frame_count(streamed), FRAMES);
+	igt_assert_eq(chamelium_get_captured_frame_count(rpc_only), FRAMES);
+
+	for (int i = 0; i < FRAMES; i++) {
+		a[i] = chamelium_read_captured_frame(streamed, i);
+		b[i] = chamelium_read_captured_frame(rpc_only, i);
+	}
+
+	for (int i = 0; i < FRAMES; i++) {
+		cairo_surface_t *streamed_frame, *rpc_frame;
+
+		streamed_frame = chamelium_frame_dump_to_surface(a[i]);
+		rpc_frame = chamelium_frame_dump_to_surface(b[i]);
+		check_surface(streamed_frame, i);
+		check_surface(rpc_frame, i);
+
+		cairo_surface_destroy(streamed_frame);
+		cairo_surface_destroy(rpc_frame);
+		chamelium_destroy_frame_dump(a[i]);
+		chamelium_destroy_frame_dump(b[i]);
+	}
+}
+
+static void test_checksums(struct chamelium *chamelium)
+{
+	igt_crc_t *crcs, expected;
+	int count;
+
+	crcs = chamelium_read_captured_crcs(chamelium, &count);
+	igt_assert_eq(count, FRAMES);
+
+	for (int i = 0; i < FRAMES; i++) {
+		reference_crc(i, &expected);
+		igt_assert_eq(crcs[i].n_words, expected.n_words);
+		for (int j = 0; j < expected.n_words; j++)
+			igt_assert_eq_u32(crcs[i].crc[j], expected.crc[j]);
+	}
+
+	free(crcs);
+}
+
+static void test_dump_pixels(struct chamelium_emulator *emu)
+{
+	struct chamelium_stream *stream;
+	unsigned char *buf;
+	size_t len;
+	int w, h;
+
+	chamelium_emulator_set_config(emu);
+	stream = chamelium_stream_init();
+	igt_assert(stream);
+	igt_assert(chamelium_stream_supports_frames(stream));
+
+	/* The first frame is shown until a capture moves on */
+	igt_assert(chamelium_stream_dump_pixels(stream, 3, 5, 6, 10, 7,
+						&w, &h, &buf, &len));
+	igt_assert_eq(w, 10);
+	igt_assert_eq(h, 7);
+	igt_assert_eq(len, 10 * 7 * 3);
+	check_pixels(buf, 0, 5, 6, 10, 7);
+	free(buf);
+
+	/* Clipped to the display, and from the next frame */
+	igt_assert(chamelium_stream_dump_pixels(stream, 1, WIDTH - 4, 0, 10, 2,
+						&w, &h, &buf, &len));
+	igt_assert_eq(w, 4);
+	igt_assert_eq(h, 2);
+	check_pixels(buf, 1, WIDTH - 4, 0, 4, 2);
+	free(buf);
+
+	/* An invalid port fails without breaking the connection */
+	igt_assert(!chamelium_stream_dump_pixels(stream, 42, 0, 0, 0, 0,
+						 &w, &h, &buf, &len));
+
+	/* The last dump is the captured frame */
+	igt_assert(chamelium_stream_read_captured_frame(stream, 0,
+							&w, &h, &buf, &len));
+	igt_assert_eq(w, 4);
+	igt_assert_eq(h, 2);
+	check_pixels(buf, 1, WIDTH - 4, 0, 4, 2);
+	free(buf);
+
+	igt_assert(!chamelium_stream_read_captured_frame(stream, 1,
+							 &w, &h, &buf, &len));
+
+	chamelium_stream_deinit(stream);
+}
+
+static void test_port_dump_pixels(struct chamelium *chamelium)
+{
+	struct chamelium_port *port = chamelium_get_unmapped_port(chamelium, 3);
+	struct chamelium_frame_dump *dump;
+	cairo_surface_t *surface;
+	int frame;
+
+	igt_assert(port);
+	igt_assert(!chamelium_get_unmapped_port(chamelium, 42));
+
+	/* The frame shown depends on the subtests run before */
+	dump = chamelium_port_dump_pixels(chamelium, port, 4, 6, 8, 5);
+	surface = chamelium_frame_dump_to_surface(dump);
+	igt_assert_eq(cairo_image_surface_get_width(surface), 8);
+	igt_assert_eq(cairo_image_surface_get_height(surface), 5);
+	for (frame = 0; frame < FRAMES; frame++)
+		if (surface_matches(surface, frame, 4, 6))
+			break;
+	igt_assert(frame < FRAMES);
+	cairo_surface_destroy(surface);
+	chamelium_destroy_frame_dump(dump);
+
+	/* Each dump captures a frame, so the next one shows the next frame */
+	frame = (frame + 1) % FRAMES;
+	dump = chamelium_port_dump_pixels(chamelium, port, 0, 0, 0, 0);
+	surface = chamelium_frame_dump_to_surface(dump);
+	check_surface(surface, frame);
+	cairo_surface_destroy(surface);
+	chamelium_destroy_frame_dump(dump);
+
+	igt_assert_eq(chamelium_get_captured_frame_count(chamelium), 1);
+	dump = chamelium_read_captured_frame(chamelium, 0);
+	surface = chamelium_frame_dump_to_surface(dump);
+	check_surface(surface, frame);
+	cairo_surface_destroy(surface);
+	chamelium_destroy_frame_dump(dump);
+}
+
+igt_main
+{
+	struct chamelium_emulator *streamed_emu, *rpc_emu;
+	struct chamelium *streamed, *rpc_only;
+
+	igt_fixture {
+		for (int i = 0; i < FRAMES; i++) {
+			frames[i] = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+							       WIDTH, HEIGHT);
+			fill_frame(frames[i], i + 1);
+		}
+
+		streamed_emu = start_emulator(true);
+		rpc_emu = start_emulator(false);
+		streamed = connect_emulator(streamed_emu);
+		rpc_only = connect_emulator(rpc_emu);
+	}
+
+	igt_subtest("read-frames")
+		test_read_frames(streamed, rpc_only);
+
+	igt_subtest("checksums")
+		test_checksums(streamed);
+
+	igt_subtest("dump-pixels")
+		test_dump_pixels(streamed_emu);
+
+	igt_subtest("port-dump-pixels") {
+		test_port_dump_pixels(streamed);
+		test_port_dump_pixels(rpc_only);
+	}
+
+	igt_subtest("unsupported-method")
+		igt_assert(!chamelium_supports_get_last_infoframe(streamed));
+
+	igt_fixture {
+		chamelium_deinit_rpc_only(streamed);
+		chamelium_deinit_rpc_only(rpc_only);
+		chamelium_emulator_destroy(streamed_emu);
+		chamelium_emulator_destroy(rpc_emu);
+
+		for (int i = 0; i < FRAMES; i++)
+			cairo_surface_destroy(frames[i]);
+	}
+}
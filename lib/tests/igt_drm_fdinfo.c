@@ -0,0 +1,275 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "igt_core.h"
+#include "igt_drm_fdinfo.h"
+
+/*
+ * Parse fdinfo text, then track clients in a fake procfs tree made of plain
+ * directories, symlinks and files in a temporary directory. No device is
+ * needed.
+ */
+
+static const char *fdinfo_text =
+	"pos:\t0\n"
+	"flags:\t02100002\n"
+	"mnt_id:\t24\n"
+	"drm-driver:\ti915\n"
+	"drm-pdev:\t0000:00:02.0\n"
+	"drm-client-id:\t42\n"
+	"drm-engine-render:\t1000 ns\n"
+	"drm-engine-copy:\t20 ns\n"
+	"drm-engine-video:\t0 ns\n"
+	"drm-engine-video-enhance:\t3 ns\n"
+	"drm-engine-made-up:\t99 ns\n";
+
+static char root[PATH_MAX];
+
+static void write_file(const char *path, const char *text)
+{
+	FILE *f;
+
+	/* Rewrite in place, as tracked files are kept open. */
+	f = fopen(path, "w");
+	igt_assert(f);
+	igt_assert(fputs(text, f) >= 0);
+	igt_assert_eq(fclose(f), 0);
+}
+
+static void add_process(unsigned int pid, const char *comm)
+{
+	char path[PATH_MAX * 2];
+
+	snprintf(path, sizeof(path), "%s/%u", root, pid);
+	igt_assert_eq(mkdir(path, 0700), 0);
+	snprintf(path, sizeof(path), "%s/%u/fd", root, pid);
+	igt_assert_eq(mkdir(path, 0700), 0);
+	snprintf(path, sizeof(path), "%s/%u/fdinfo", root, pid);
+	igt_assert_eq(mkdir(path, 0700), 0);
+
+	snprintf(path, sizeof(path), "%s/%u/comm", root, pid);
+	write_file(path, comm);
+}
+
+static void remove_process(unsigned int pid)
+{
+	char cmd[PATH_MAX * 2];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s/%u", root, pid);
+	igt_assert_eq(system(cmd), 0);
+}
+
+static void set_fd(unsigned int pid, unsigned int fd, const char *driver,
+		   const char *pdev, unsigned long id,
+		   uint64_t render, uint64_t copy)
+{
+	char path[PATH_MAX * 2], text[512];
+
+	snprintf(text, sizeof(text),
+		 "pos:\t0\n"
+		 "drm-driver:\t%s\n"
+		 "drm-pdev:\t%s\n"
+		 "drm-client-id:\t%lu\n"
+		 "drm-engine-render:\t%"PRIu64" ns\n"
+		 "drm-engine-copy:\t%"PRIu64" ns\n",
+		 driver, pdev, id, render, copy);
+
+	snprintf(path, sizeof(path), "%s/%u/fdinfo/%u", root, pid, fd);
+	write_file(path, text);
+}
+
+static void add_fd(unsigned int pid, unsigned int fd, const char *target)
+{
+	char path[PATH_MAX * 2];
+
+	snprintf(path, sizeof(path), "%s/%u/fd/%u", root, pid, fd);
+	igt_assert_eq(symlink(target, path), 0);
+
+	snprintf(path, sizeof(path), "%s/%u/fdinfo/%u", root, pid, fd);
+	write_file(path, "pos:\t0\nflags:\t02\n");
+}
+
+static void add_drm_fd(unsigned int pid, unsigned int fd, unsigned long id,
+		       uint64_t render, uint64_t copy)
+{
+	add_fd(pid, fd, "/dev/dri/renderD128");
+	set_fd(pid, fd, "i915", "0000:00:02.0", id, render, copy);
+}
+
+static struct igt_drm_client *
+find(struct igt_drm_clients *clients, unsigned long id)
+{
+	return igt_map_search(clients->clients, &id);
+}
+
+static void make_root(void)
+{
+	snprintf(root, sizeof(root), "%s/igt_drm_fdinfo.XXXXXX",
+		 getenv("TMPDIR") ?: "/tmp");
+	igt_assert(mkdtemp(root));
+}
+
+static void remove_root(void)
+{
+	char cmd[PATH_MAX + 16];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+	igt_assert_eq(system(cmd), 0);
+}
+
+static void test_parse(void)
+{
+	struct drm_client_fdinfo info;
+
+	igt_assert_eq(__igt_parse_drm_fdinfo(fdinfo_text, &info), 7);
+	igt_assert_eq(strcmp(info.driver, "i915"), 0);
+	igt_assert_eq(strcmp(info.pdev, "0000:00:02.0"), 0);
+	igt_assert_eq(info.id, 42);
+	igt_assert_eq(info.num_engines, 4);
+	igt_assert_eq_u64(info.busy[0], 1000);
+	igt_assert_eq_u64(info.busy[1], 20);
+	igt_assert_eq_u64(info.busy[2], 0);
+	igt_assert_eq_u64(info.busy[3], 3);
+	igt_assert_eq_u64(info.busy[4], 0);
+
+	/* Not a DRM client without a driver and an id. */
+	igt_assert_eq(__igt_parse_drm_fdinfo("pos:\t0\nflags:\t02\n", &info),
+		      0);
+	igt_assert_eq(__igt_parse_drm_fdinfo("drm-driver:\ti915\n", &info),
+		      0);
+	igt_assert_eq(__igt_parse_drm_fdinfo("drm-client-id:\t1", &info), 0);
+	igt_assert_eq(__igt_parse_drm_fdinfo("drm-driver:\ti915\n"
+					     "drm-client-id:\t7", &info), 2);
+	igt_assert_eq(info.id, 7);
+}
+
+static void test_scan(void)
+{
+	struct igt_drm_clients *clients;
+	struct igt_drm_client *c;
+
+	make_root();
+
+	add_process(100, "app\n");
+	add_drm_fd(100, 3, 1, 1000, 10);
+	add_drm_fd(100, 4, 2, 2000, 20);
+	add_fd(100, 5, "/dev/null");
+	add_fd(100, 6, "/dev/dri/card1");
+	set_fd(100, 6, "i915", "0000:03:00.0", 3, 0, 0);
+
+	clients = igt_drm_clients_init(root, "i915", "0000:00:02.0");
+	igt_assert(clients);
+
+	igt_assert_eq(igt_drm_clients_scan(clients), 2);
+	igt_assert_eq(clients->rescans, 1);
+
+	c = find(clients, 1);
+	igt_assert(c);
+	igt_assert_eq(c->pid, 100);
+	igt_assert_eq(strcmp(c->name, "app"), 0);
+	igt_assert_eq_u64(c->info.busy[0], 1000);
+	igt_assert_eq_u64(c->info.busy[1], 10);
+
+	c = find(clients, 2);
+	igt_assert(c);
+	igt_assert_eq_u64(c->info.busy[0], 2000);
+
+	/* Only the kept open files are reread. */
+	set_fd(100, 4, "i915", "0000:00:02.0", 2, 2500, 25);
+	igt_assert_eq(igt_drm_clients_scan(clients), 2);
+	igt_assert_eq(clients->rescans, 1);
+	igt_assert_eq_u64(find(clients, 2)->info.busy[0], 2500);
+	igt_assert_eq_u64(find(clients, 2)->info.busy[1], 25);
+
+	/* New processes are noticed straight away, here a child sharing 1. */
+	add_process(101, "child\n");
+	add_drm_fd(101, 3, 1, 1000, 10);
+	igt_assert_eq(igt_drm_clients_scan(clients), 2);
+	igt_assert_eq(clients->rescans, 2);
+	igt_assert_eq(find(clients, 1)->pid, 100);
+
+	/* Files opened by known processes wait for the periodic rescan. */
+	add_drm_fd(101, 4, 4, 1, 1);
+	igt_assert_eq(igt_drm_clients_scan(clients), 2);
+	clients->ticks = clients->rescan_period;
+	igt_assert_eq(igt_drm_clients_scan(clients), 3);
+	igt_assert_eq(clients->rescans, 3);
+
+	add_process(200, "new\n");
+	add_drm_fd(200, 3, 5, 0, 0);
+	igt_assert_eq(igt_drm_clients_scan(clients), 4);
+	igt_assert_eq(clients->rescans, 4);
+	igt_assert_eq(strcmp(find(clients, 5)->name, "new"), 0);
+
+	/* And so are the ones which went away. */
+	remove_process(200);
+	igt_assert_eq(igt_drm_clients_scan(clients), 3);
+	igt_assert(!find(clients, 5));
+
+	/* A reused fd number does not carry the client over. */
+	set_fd(100, 4, "i915", "0000:00:02.0", 6, 0, 0);
+	igt_assert_eq(igt_drm_clients_scan(clients), 3);
+	igt_assert(!find(clients, 2));
+	igt_assert(find(clients, 6));
+
+	/*
+	 * With its first process gone, a client is found again in the
+	 * process still holding it.
+	 */
+	remove_process(100);
+	igt_assert_eq(igt_drm_clients_scan(clients), 1);
+	igt_assert_eq(igt_drm_clients_scan(clients), 2);
+	c = find(clients, 1);
+	igt_assert(c);
+	igt_assert_eq(c->pid, 101);
+	igt_assert_eq(strcmp(c->name, "child"), 0);
+
+	igt_drm_clients_free(clients);
+
+	/* Without a device filter, all DRM files are clients. */
+	clients = igt_drm_clients_init(root, NULL, NULL);
+	igt_assert(clients);
+	igt_assert_eq(igt_drm_clients_scan(clients), 2);
+	igt_drm_clients_free(clients);
+
+	remove_root();
+}
+
+igt_main
+{
+	igt_subtest("parse")
+		test_parse();
+
+	igt_subtest("scan")
+		test_scan();
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_core.h"
+#include "igt_fb.h"
+#include "igt_rand.h"
+
+/*
+ * Check the table driven, banded DP CRC against a bit at a time CRC-16
+ * (x^16 + x^15 + x^2 + 1, MSB first) of every component, for any number
+ * of threads, and the lane hashing of igt_fb_get_fnv1a_crc_pixels(),
+ * whichever of the scalar or vector paths gets picked on this CPU,
+ * against a plain C reading of it. The pixels live in system memory, no
+ * device is needed.
+ */
+
+#define FNV1A_OFFSET_BIAS	2166136261u
+#define FNV1A_PRIME		16777619u
+#define FNV1A_LANES		32
+
+static uint16_t reference_crc16(uint16_t crc, uint16_t d)
+{
+	for (int i = 15; i >= 0; i--) {
+		bool bit = ((crc >> 15) ^ (d >> i)) & 1;
+
+		crc <<= 1;
+		if (bit)
+			crc ^= 0x8005;
+	}
+
+	return crc;
+}
+
+static uint32_t reference_fnv1a(const struct igt_fb *fb, const uint8_t *ptr)
+{
+	unsigned int bytes = fb->width * fb->plane_bpp[0] / 8;
+	uint32_t lanes[FNV1A_LANES];
+	uint32_t hash = FNV1A_OFFSET_BIAS;
+
+	for (int i = 0; i < FNV1A_LANES; i++)
+		lanes[i] = FNV1A_OFFSET_BIAS;
+
+	for (int y = 0; y < fb->height; y++) {
+		const uint8_t *row = ptr + fb->offsets[0] + y * fb->strides[0];
+
+		for (unsigned int x = 0; x < bytes; x++) {
+			uint32_t *lane = &lanes[x % FNV1A_LANES];
+
+			*lane = (*lane ^ row[x]) * FNV1A_PRIME;
+		}
+	}
+
+	for (int i = 0; i < FNV1A_LANES; i++) {
+		for (int j = 0; j < 4; j++) {
+			hash ^= (lanes[i] >> (8 * j)) & 0xff;
+			hash *= FNV1A_PRIME;
+		}
+	}
+
+	return hash;
+}
+
+/* Random pixels, in rows padded with more random bytes */
+static uint8_t *create_fb(struct igt_fb *fb, uint32_t format,
+			  int width, int height, uint32_t *seed)
+{
+	uint8_t *ptr;
+
+	igt_init_fb(fb, -1, width, height, format, DRM_FORMAT_MOD_LINEAR,
+		    IGT_COLOR_YCBCR_BT709, IGT_COLOR_YCBCR_LIMITED_RANGE);
+
+	fb->strides[0] = ALIGN(width * fb->plane_bpp[0] / 8 + 1, 64);
+	fb->offsets[0] = 64;
+	fb->size = fb->offsets[0] + (uint64_t)fb->strides[0] * height;
+
+	ptr = malloc(fb->size);
+	igt_assert(ptr);
+
+	for (uint64_t i = 0; i < fb->size; i++)
+		ptr[i] = hars_petruska_f54_1_random(seed);
+
+	return ptr;
+}
+
+static void check_crc(int width, int height, uint32_t *seed)
+{
+	static const int threads[] = { 1, 2, 3, 7, 64 };
+	uint16_t expected[3] = {};
+	struct igt_fb fb;
+	uint8_t *ptr;
+
+	ptr = create_fb(&fb, DRM_FORMAT_XRGB8888, width, height, seed);
+
+	for (int y = 0; y < height; y++) {
+		const uint8_t *px = ptr + fb.offsets[0] + y * fb.strides[0];
+
+		for (int x = 0; x < width; x++, px += 4) {
+			expected[0] = reference_crc16(expected[0], px[2] << 8);
+			expected[1] = reference_crc16(expected[1], px[1] << 8);
+			expected[2] = reference_crc16(expected[2], px[0] << 8);
+		}
+	}
+
+	for (int i = 0; i < ARRAY_SIZE(threads); i++) {
+		igt_crc_t crc;
+		char str[16];
+
+		snprintf(str, sizeof(str), "%d", threads[i]);
+		setenv("IGT_WORKER_THREADS", str, 1);
+
+		memset(&crc, 0xff, sizeof(crc));
+		igt_fb_calc_crc_pixels(&fb, ptr, &crc);
+
+		igt_assert_eq(crc.n_words, 3);
+		for (int c = 0; c < 3; c++)
+			igt_assert_f(crc.crc[c] == expected[c],
+				     "%dx%d, %d threads: CRC %d is 0x%04x, expected 0x%04x\n",
+				     width, height, threads[i], c,
+				     crc.crc[c], expected[c]);
+	}
+
+	unsetenv("IGT_WORKER_THREADS");
+	free(ptr);
+}
+
+static void check_fnv1a(uint32_t format, int width, int height,
+			uint32_t *seed)
+{
+	struct igt_fb fb;
+	igt_crc_t crc;
+	uint8_t *ptr;
+
+	ptr = create_fb(&fb, format, width, height, seed);
+
+	igt_assert_eq(igt_fb_get_fnv1a_crc_pixels(&fb, ptr, &crc), 0);
+	igt_assert_eq(crc.n_words, 1);
+	igt_assert_eq_u32(crc.crc[0], reference_fnv1a(&fb, ptr));
+
+	free(ptr);
+}
+
+igt_main
+{
+	static const int widths[] = { 1, 7, 8, 9, 33, 640 };
+	static const int heights[] = { 1, 2, 5, 64, 131 };
+	uint32_t seed = 0x8086;
+
+	igt_subtest("crc16-dp") {
+		for (int w = 0; w < ARRAY_SIZE(widths); w++)
+			for (int h = 0; h < ARRAY_SIZE(heights); h++)
+				check_crc(widths[w], heights[h], &seed);
+	}
+
+	igt_subtest("fnv1a") {
+		static const uint32_t formats[] = {
+			DRM_FORMAT_C8,
+			DRM_FORMAT_RGB565,
+			DRM_FORMAT_XRGB8888,
+		};
+
+		for (int f = 0; f < ARRAY_SIZE(formats); f++)
+			for (int w = 0; w < ARRAY_SIZE(widths); w++)
+				for (int h = 0; h < ARRAY_SIZE(heights); h++)
+					check_fnv1a(formats[f], widths[w],
+						    heights[h], &seed);
+	}
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+
+/*
+ * The log buffer dumped on failure keeps the last lines logged by every
+ * thread, including the debug ones not printed, in the order they were
+ * logged.
+ */
+
+#define MAX_LINES 512
+
+struct collect {
+	int count;
+	int tags[MAX_LINES];
+	int prefixed[MAX_LINES];
+	size_t len[MAX_LINES];
+};
+
+static bool collect_line(const char *line, void *data)
+{
+	struct collect *c = data;
+	const char *tag = strstr(line, "tag ");
+
+	if (!tag || c->count == MAX_LINES)
+		return false;
+
+	c->tags[c->count] = atoi(tag + 4);
+	c->prefixed[c->count] = strstr(line, "DEBUG: ") != NULL;
+	c->len[c->count] = strlen(line);
+	c->count++;
+
+	return false;
+}
+
+static void check_sequence(int first, int count)
+{
+	struct collect c = {};
+
+	igt_log_buffer_inspect(collect_line, &c);
+
+	igt_assert_eq(c.count, count);
+	for (int i = 0; i < count; i++) {
+		igt_assert_eq(c.tags[i], first + i);
+		igt_assert(c.prefixed[i]);
+	}
+}
+
+static pthread_mutex_t order_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int order_next;
+
+static void *log_in_order(void *data)
+{
+	int lines = (intptr_t)data;
+
+	for (int i = 0; i < lines; i++) {
+		pthread_mutex_lock(&order_mutex);
+		igt_debug("tag %d\n", order_next++);
+		pthread_mutex_unlock(&order_mutex);
+	}
+
+	return NULL;
+}
+
+static void threads(int num_threads, int lines)
+{
+	pthread_t thread[8];
+
+	order_next = 0;
+
+	for (int i = 0; i < num_threads; i++)
+		pthread_create(&thread[i], NULL, log_in_order,
+			       (void *)(intptr_t)lines);
+	for (int i = 0; i < num_threads; i++)
+		pthread_join(thread[i], NULL);
+}
+
+igt_main
+{
+	igt_subtest("empty")
+		check_sequence(0, 0);
+
+	igt_subtest("window") {
+		for (int i = 0; i < 300; i++)
+			igt_debug("tag %d\n", i);
+
+		/* Only the last 256 lines are kept */
+		check_sequence(300 - 256, 256);
+	}
+
+	igt_subtest("threads") {
+		threads(8, 30);
+		check_sequence(0, 240);
+	}
+
+	igt_subtest("thread-exit") {
+		/* Lines of threads that are gone are kept, their rings reused */
+		for (int i = 0; i < 10; i++) {
+			pthread_t thread;
+
+			pthread_create(&thread, NULL, log_in_order,
+				       (void *)(intptr_t)20);
+			pthread_join(thread, NULL);
+		}
+
+		check_sequence(order_next - 200, 200);
+	}
+
+	igt_subtest("long-line") {
+		static char text[4096];
+		struct collect c = {};
+
+		memset(text, 'x', sizeof(text) - 1);
+
+		igt_debug("tag 0 %s\n", text);
+		igt_debug("tag 1 ");
+		igt_debug("tag 2 %s", text);
+		igt_debug("tag 3\n");
+
+		igt_log_buffer_inspect(collect_line, &c);
+
+		igt_assert_eq(c.count, 4);
+		for (int i = 0; i < 4; i++)
+			igt_assert_eq(c.tags[i], i);
+
+		igt_assert(c.prefixed[0] && c.prefixed[1]);
+		igt_assert(c.len[0] > sizeof(text));
+
+		/* Continuations of a line don't get a prefix of their own */
+		igt_assert(!c.prefixed[2] && !c.prefixed[3]);
+		igt_assert_eq(c.len[2], strlen("tag 2 ") + strlen(text));
+	}
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_workers.h"
+
+/*
+ * Every job must run exactly once whatever the number of threads, calls
+ * made while the pool is busy must still complete, and the pool must keep
+ * working in forked children.
+ */
+
+#define MAX_JOBS 1024
+
+struct jobs {
+	unsigned int runs[MAX_JOBS];
+	pthread_t thread[MAX_JOBS];
+	unsigned int nested;
+};
+
+static void count_job(void *data, unsigned int job)
+{
+	struct jobs *jobs = data;
+
+	__atomic_fetch_add(&jobs->runs[job], 1, __ATOMIC_RELAXED);
+	jobs->thread[job] = pthread_self();
+}
+
+static void check_jobs(unsigned int threads, unsigned int n)
+{
+	struct jobs jobs;
+
+	memset(&jobs, 0, sizeof(jobs));
+	igt_workers_run(threads, n, count_job, &jobs);
+
+	for (unsigned int i = 0; i < MAX_JOBS; i++)
+		igt_assert_eq(jobs.runs[i], i < n);
+}
+
+static void nested_job(void *data, unsigned int job)
+{
+	struct jobs *jobs = data;
+	struct jobs inner;
+
+	memset(&inner, 0, sizeof(inner));
+	igt_workers_run(4, 8, count_job, &inner);
+
+	/* The pool is busy with us, so everything ran right here */
+	for (unsigned int i = 0; i < 8; i++) {
+		igt_assert_eq(inner.runs[i], 1);
+		igt_assert(pthread_equal(inner.thread[i], pthread_self()));
+	}
+
+	__atomic_fetch_add(&jobs->nested, 1, __ATOMIC_RELAXED);
+}
+
+igt_main
+{
+	igt_subtest("run") {
+		for (unsigned int threads = 1; threads <= 8; threads++) {
+			check_jobs(threads, 0);
+			check_jobs(threads, 1);
+			check_jobs(threads, threads);
+			check_jobs(threads, MAX_JOBS);
+		}
+	}
+
+	igt_subtest("nested") {
+		struct jobs jobs;
+
+		memset(&jobs, 0, sizeof(jobs));
+		igt_workers_run(4, 16, nested_job, &jobs);
+		igt_assert_eq(jobs.nested, 16);
+	}
+
+	igt_subtest("fork") {
+		/* Start the workers, which the children don't inherit */
+		check_jobs(4, MAX_JOBS);
+
+		igt_fork(child, 2)
+			check_jobs(4, MAX_JOBS);
+		igt_waitchildren();
+
+		check_jobs(4, MAX_JOBS);
+	}
+}
@@ -0,0 +1,430 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "drmtest.h"
+#include "igt_aux.h"
+#include "igt_color_encoding.h"
+#include "igt_core.h"
+#include "igt_rand.h"
+#include "igt_yuv.h"
+
+/*
+ * Check the fixed point YCbCr conversions, whichever of the scalar or
+ * vector paths gets picked on this CPU, against transforming every pixel
+ * through the float matrix the way igt_fb used to: first over every
+ * possible pixel value, then over the layout of each format.
+ */
+
+static int clamprgb(float val)
+{
+	return clamp((int)(val + 0.5f), 0, 255);
+}
+
+static bool close_enough(int a, int b)
+{
+	return abs(a - b) <= 1;
+}
+
+static struct igt_mat4 yuv_to_rgb(enum igt_color_encoding encoding,
+				  enum igt_color_range range)
+{
+	return igt_ycbcr_to_rgb_matrix(DRM_FORMAT_NV12, DRM_FORMAT_XRGB8888,
+				       encoding, range);
+}
+
+static struct igt_mat4 rgb_to_yuv(enum igt_color_encoding encoding,
+				  enum igt_color_range range)
+{
+	return igt_rgb_to_ycbcr_matrix(DRM_FORMAT_XRGB8888, DRM_FORMAT_NV12,
+				       encoding, range);
+}
+
+static void exhaustive_yuv_to_rgb(enum igt_color_encoding encoding,
+				  enum igt_color_range range)
+{
+	struct igt_mat4 m = yuv_to_rgb(encoding, range);
+	struct igt_yuv_matrix fixed;
+	uint8_t y[256], u[256], v[256];
+	uint32_t rgb[256];
+	struct igt_yuv_planes planes = {
+		.y = y, .u = u, .v = v,
+		.ay_inc = 1, .uv_inc = 1,
+		.hsub = 1, .vsub = 1,
+	};
+
+	igt_yuv_matrix_init(&fixed, &m);
+
+	for (int i = 0; i < 256; i++)
+		v[i] = i;
+
+	for (int Y = 0; Y < 256; Y++) {
+		memset(y, Y, sizeof(y));
+
+		for (int U = 0; U < 256; U++) {
+			memset(u, U, sizeof(u));
+			memset(rgb, 0x5a, sizeof(rgb));
+
+			igt_yuv_to_xrgb8888(&fixed, &planes, (uint8_t *)rgb,
+					    sizeof(rgb), 256, 1);
+
+			for (int V = 0; V < 256; V++) {
+				struct igt_vec4 yuv = { { Y, U, V, 1.0f } };
+				struct igt_vec4 ref = igt_matrix_transform(&m, &yuv);
+
+				igt_assert_f(close_enough(rgb[V] >> 16 & 0xff, clamprgb(ref.d[0])) &&
+					     close_enough(rgb[V] >> 8 & 0xff, clamprgb(ref.d[1])) &&
+					     close_enough(rgb[V] & 0xff, clamprgb(ref.d[2])) &&
+					     rgb[V] >> 24 == 0x5a,
+					     "YCbCr %d,%d,%d: got 0x%08x, expected %.2f,%.2f,%.2f\n",
+					     Y, U, V, rgb[V],
+					     ref.d[0], ref.d[1], ref.d[2]);
+			}
+		}
+	}
+}
+
+static void exhaustive_rgb_to_yuv(enum igt_color_encoding encoding,
+				  enum igt_color_range range)
+{
+	struct igt_mat4 m = rgb_to_yuv(encoding, range);
+	struct igt_yuv_matrix fixed;
+	uint8_t y[256], u[256], v[256];
+	uint32_t rgb[256];
+	struct igt_yuv_planes planes = {
+		.y = y, .u = u, .v = v,
+		.ay_inc = 1, .uv_inc = 1,
+		.hsub = 1, .vsub = 1,
+	};
+
+	igt_yuv_matrix_init(&fixed, &m);
+
+	for (int r = 0; r < 256; r++) {
+		for (int g = 0; g < 256; g++) {
+			for (int b = 0; b < 256; b++)
+				rgb[b] = r << 16 | g << 8 | b;
+
+			igt_xrgb8888_to_yuv(&fixed, (uint8_t *)rgb, sizeof(rgb),
+					    &planes, 256, 1);
+
+			for (int b = 0; b < 256; b++) {
+				struct igt_vec4 px = { { r, g, b, 1.0f } };
+				struct igt_vec4 ref = igt_matrix_transform(&m, &px);
+
+				igt_assert_f(close_enough(y[b], ref.d[0]) &&
+					     close_enough(u[b], ref.d[1]) &&
+					     close_enough(v[b], ref.d[2]),
+					     "RGB %d,%d,%d: got %d,%d,%d, expected %.2f,%.2f,%.2f\n",
+					     r, g, b, y[b], u[b], v[b],
+					     ref.d[0], ref.d[1], ref.d[2]);
+			}
+		}
+	}
+}
+
+enum layout_type {
+	PLANAR,
+	SEMI_PLANAR,
+	PACKED,
+};
+
+static const struct format {
+	const char *name;
+	enum layout_type type;
+	unsigned int hsub, vsub;
+	/* bytes per luma sample, and offsets within the first pixels */
+	unsigned int ay_inc, y_offset, u_offset, v_offset;
+} formats[] = {
+	{ "nv12", SEMI_PLANAR, 2, 2, 1, 0, 0, 1 },
+	{ "nv16", SEMI_PLANAR, 2, 1, 1, 0, 0, 1 },
+	{ "nv21", SEMI_PLANAR, 2, 2, 1, 0, 1, 0 },
+	{ "nv61", SEMI_PLANAR, 2, 1, 1, 0, 1, 0 },
+	{ "yuv420", PLANAR, 2, 2, 1, 0, 0, 0 },
+	{ "yuv422", PLANAR, 2, 1, 1, 0, 0, 0 },
+	{ "yuyv", PACKED, 2, 1, 2, 0, 1, 3 },
+	{ "yvyu", PACKED, 2, 1, 2, 0, 3, 1 },
+	{ "uyvy", PACKED, 2, 1, 2, 1, 0, 2 },
+	{ "vyuy", PACKED, 2, 1, 2, 1, 2, 0 },
+	{ "xyuv8888", PACKED, 1, 1, 4, 2, 1, 0 },
+};
+
+struct image {
+	uint8_t *data;
+	size_t size;
+	struct igt_yuv_planes planes;
+};
+
+static void image_init(struct image *img, const struct format *f,
+		       unsigned int width, unsigned int height)
+{
+	unsigned int cw = DIV_ROUND_UP(width, f->hsub);
+	unsigned int ch = DIV_ROUND_UP(height, f->vsub);
+	struct igt_yuv_planes *p = &img->planes;
+	size_t y_size, uv_size;
+
+	memset(p, 0, sizeof(*p));
+	p->hsub = f->hsub;
+	p->vsub = f->vsub;
+	p->ay_inc = f->ay_inc;
+
+	switch (f->type) {
+	case PLANAR:
+		p->uv_inc = 1;
+		/* Some padding at the end of the rows */
+		p->ay_stride = width + 3;
+		p->uv_stride = cw + 5;
+		y_size = p->ay_stride * height;
+		uv_size = p->uv_stride * ch;
+		img->size = y_size + 2 * uv_size;
+		img->data = malloc(img->size);
+		p->y = img->data;
+		p->u = img->data + y_size;
+		p->v = img->data + y_size + uv_size;
+		break;
+	case SEMI_PLANAR:
+		p->uv_inc = 2;
+		p->ay_stride = width + 3;
+		p->uv_stride = 2 * cw + 6;
+		y_size = p->ay_stride * height;
+		img->size = y_size + p->uv_stride * ch;
+		img->data = malloc(img->size);
+		p->y = img->data;
+		p->u = img->data + y_size + f->u_offset;
+		p->v = img->data + y_size + f->v_offset;
+		break;
+	case PACKED:
+		p->uv_inc = f->ay_inc * f->hsub;
+		p->ay_stride = p->uv_stride = cw * p->uv_inc + 8;
+		img->size = p->ay_stride * height;
+		img->data = malloc(img->size);
+		p->y = img->data + f->y_offset;
+		p->u = img->data + f->u_offset;
+		p->v = img->data + f->v_offset;
+		break;
+	}
+
+	igt_assert(img->data);
+	memset(img->data, 0xa5, img->size);
+}
+
+/* The per pixel float conversions igt_fb used to do */
+static void reference_yuv_to_rgb(const struct igt_mat4 *m,
+				 const struct igt_yuv_planes *p,
+				 uint8_t *rgb24, unsigned int rgb24_stride,
+				 unsigned int width, unsigned int height)
+{
+	const uint8_t *y = p->y, *u = p->u, *v = p->v;
+
+	for (int i = 0; i < height; i++) {
+		const uint8_t *y_tmp = y;
+		const uint8_t *u_tmp = u;
+		const uint8_t *v_tmp = v;
+		uint8_t *rgb_tmp = rgb24;
+
+		for (int j = 0; j < width; j++) {
+			struct igt_vec4 rgb, yuv = { { *y_tmp, *u_tmp, *v_tmp, 1.0f } };
+
+			rgb = igt_matrix_transform(m, &yuv);
+			rgb_tmp[2] = clamprgb(rgb.d[0]);
+			rgb_tmp[1] = clamprgb(rgb.d[1]);
+			rgb_tmp[0] = clamprgb(rgb.d[2]);
+
+			rgb_tmp += 4;
+			y_tmp += p->ay_inc;
+
+			if ((p->hsub == 1) || (j % p->hsub)) {
+				u_tmp += p->uv_inc;
+				v_tmp += p->uv_inc;
+			}
+		}
+
+		rgb24 += rgb24_stride;
+		y += p->ay_stride;
+
+		if ((p->vsub == 1) || (i % p->vsub)) {
+			u += p->uv_stride;
+			v += p->uv_stride;
+		}
+	}
+}
+
+static void read_rgb(struct igt_vec4 *rgb, const uint8_t *rgb24)
+{
+	rgb->d[0] = rgb24[2];
+	rgb->d[1] = rgb24[1];
+	rgb->d[2] = rgb24[0];
+	rgb->d[3] = 1.0f;
+}
+
+static void reference_rgb_to_yuv(const struct igt_mat4 *m,
+				 const uint8_t *rgb24, unsigned int rgb24_stride,
+				 const struct igt_yuv_planes *p,
+				 unsigned int width, unsigned int height)
+{
+	uint8_t *y = p->y, *u = p->u, *v = p->v;
+
+	for (int i = 0; i < height; i++) {
+		const uint8_t *rgb_tmp = rgb24;
+		uint8_t *y_tmp = y;
+		uint8_t *u_tmp = u;
+		uint8_t *v_tmp = v;
+
+		for (int j = 0; j < width; j++) {
+			const uint8_t *pair_rgb24 = rgb_tmp;
+			struct igt_vec4 pair_rgb, rgb;
+			struct igt_vec4 pair_yuv, yuv;
+
+			read_rgb(&rgb, rgb_tmp);
+			yuv = igt_matrix_transform(m, &rgb);
+
+			rgb_tmp += 4;
+
+			*y_tmp = yuv.d[0];
+			y_tmp += p->ay_inc;
+
+			if ((i % p->vsub) || (j % p->hsub))
+				continue;
+
+			if (j != (width - 1))
+				pair_rgb24 += (p->hsub - 1) * 4;
+
+			if (i != (height - 1))
+				pair_rgb24 += rgb24_stride * (p->vsub - 1);
+
+			read_rgb(&pair_rgb, pair_rgb24);
+			pair_yuv = igt_matrix_transform(m, &pair_rgb);
+
+			*u_tmp = (yuv.d[1] + pair_yuv.d[1]) / 2.0f;
+			*v_tmp = (yuv.d[2] + pair_yuv.d[2]) / 2.0f;
+
+			u_tmp += p->uv_inc;
+			v_tmp += p->uv_inc;
+		}
+
+		rgb24 += rgb24_stride;
+		y += p->ay_stride;
+
+		if ((i % p->vsub) == (p->vsub - 1)) {
+			u += p->uv_stride;
+			v += p->uv_stride;
+		}
+	}
+}
+
+static void check_buffers(const uint8_t *a, const uint8_t *b, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		igt_assert_f(close_enough(a[i], b[i]),
+			     "byte %zd: got 0x%02x, expected 0x%02x\n",
+			     i, a[i], b[i]);
+}
+
+static void check_format(const struct format *f,
+			 enum igt_color_encoding encoding,
+			 enum igt_color_range range,
+			 unsigned int width, unsigned int height)
+{
+	struct igt_mat4 to_rgb = yuv_to_rgb(encoding, range);
+	struct igt_mat4 to_yuv = rgb_to_yuv(encoding, range);
+	struct igt_yuv_matrix fixed;
+	unsigned int rgb_stride = width * 4 + 4;
+	size_t rgb_size = rgb_stride * height;
+	uint8_t *rgb, *rgb_ref;
+	struct image yuv, yuv_ref;
+	uint32_t seed = width * 7 + height;
+
+	rgb = malloc(rgb_size);
+	rgb_ref = malloc(rgb_size);
+	igt_assert(rgb && rgb_ref);
+
+	image_init(&yuv, f, width, height);
+	image_init(&yuv_ref, f, width, height);
+
+	for (size_t i = 0; i < rgb_size; i++)
+		rgb[i] = hars_petruska_f54_1_random(&seed);
+
+	igt_yuv_matrix_init(&fixed, &to_yuv);
+	igt_xrgb8888_to_yuv(&fixed, rgb, rgb_stride, &yuv.planes,
+			    width, height);
+	reference_rgb_to_yuv(&to_yuv, rgb, rgb_stride, &yuv_ref.planes,
+			     width, height);
+	check_buffers(yuv.data, yuv_ref.data, yuv.size);
+
+	/* Convert back from the reference, and random data */
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass) {
+			for (size_t i = 0; i < yuv.size; i++)
+				yuv_ref.data[i] = hars_petruska_f54_1_random(&seed);
+		}
+
+		memcpy(rgb_ref, rgb, rgb_size);
+
+		igt_yuv_matrix_init(&fixed, &to_rgb);
+		igt_yuv_to_xrgb8888(&fixed, &yuv_ref.planes, rgb, rgb_stride,
+				    width, height);
+		reference_yuv_to_rgb(&to_rgb, &yuv_ref.planes, rgb_ref,
+				     rgb_stride, width, height);
+		check_buffers(rgb, rgb_ref, rgb_size);
+	}
+
+	free(yuv_ref.data);
+	free(yuv.data);
+	free(rgb_ref);
+	free(rgb);
+}
+
+igt_main
+{
+	static const unsigned int sizes[][2] = {
+		{ 1, 1 }, { 2, 2 }, { 7, 5 }, { 64, 33 }, { 257, 3 },
+	};
+
+	for (int e = 0; e < IGT_NUM_COLOR_ENCODINGS; e++) {
+		for (int r = 0; r < IGT_NUM_COLOR_RANGES; r++) {
+			igt_subtest_f("exhaustive-%s-%s",
+				      e == IGT_COLOR_YCBCR_BT601 ? "bt601" :
+				      e == IGT_COLOR_YCBCR_BT709 ? "bt709" : "bt2020",
+				      r == IGT_COLOR_YCBCR_LIMITED_RANGE ?
+				      "limited" : "full") {
+				exhaustive_yuv_to_rgb(e, r);
+				exhaustive_rgb_to_yuv(e, r);
+			}
+		}
+	}
+
+	for (int f = 0; f < ARRAY_SIZE(formats); f++) {
+		igt_subtest_f("format-%s", formats[f].name) {
+			for (int e = 0; e < IGT_NUM_COLOR_ENCODINGS; e++)
+				for (int r = 0; r < IGT_NUM_COLOR_RANGES; r++)
+					for (int s = 0; s < ARRAY_SIZE(sizes); s++)
+						check_format(&formats[f], e, r,
+							     sizes[s][0],
+							     sizes[s][1]);
+		}
+	}
+}
@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2021 Intel Corporation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "intel_allocator.h"
+
+/*
+ * Runs the allocator in multiprocess mode over the shared memory channel,
+ * with forked children allocating one object per request and in batches.
+ * No device is needed, the allocator is opened for an explicit range under
+ * a made up fd.
+ */
+
+/* The allocator never touches the device when opened for a range */
+#define FAKE_FD 1000
+#define RANGE_END (1ull << 32)
+
+#define NUM_CHILDREN 8
+/* More than fit in a single batch request */
+#define NUM_OBJECTS 100
+
+struct object {
+	uint32_t handle;
+	uint64_t offset;
+	uint64_t size;
+};
+
+static uint64_t open_allocator(void)
+{
+	return intel_allocator_open_full(FAKE_FD, 0, 0, RANGE_END,
+					 INTEL_ALLOCATOR_SIMPLE,
+					 ALLOC_STRATEGY_HIGH_TO_LOW);
+}
+
+/*
+ * Shared anonymous mappings show up as /dev/zero. Besides the objects
+ * of the test, only the ring of the channel is one.
+ */
+static int count_shared_mappings(void)
+{
+	char line[512];
+	int count = 0;
+	FILE *maps;
+
+	maps = fopen("/proc/self/maps", "r");
+	igt_assert(maps);
+
+	while (fgets(line, sizeof(line), maps))
+		if (strstr(line, "/dev/zero"))
+			count++;
+
+	fclose(maps);
+
+	return count;
+}
+
+static void child_allocs(int child, struct object *objects)
+{
+	uint32_t handles[NUM_OBJECTS], again_handles[NUM_OBJECTS];
+	uint64_t sizes[NUM_OBJECTS], again_sizes[NUM_OBJECTS];
+	uint64_t offsets[NUM_OBJECTS], again_offsets[NUM_OBJECTS];
+	uint64_t ahnd = open_allocator();
+	int i, n;
+
+	for (i = 0; i < NUM_OBJECTS; i++) {
+		handles[i] = 1 + child * NUM_OBJECTS + i;
+		sizes[i] = 4096 * (1 + i % 4);
+	}
+
+	/* First half in batches, the rest one by one */
+	intel_allocator_alloc_batch(ahnd, NUM_OBJECTS / 2, handles, sizes,
+				    0, offsets);
+	for (i = NUM_OBJECTS / 2; i < NUM_OBJECTS; i++)
+		offsets[i] = intel_allocator_alloc(ahnd, handles[i],
+						   sizes[i], 0);
+
+	/* Free every third object and get them back in one batch */
+	for (i = 0, n = 0; i < NUM_OBJECTS; i += 3, n++) {
+		igt_assert(intel_allocator_free(ahnd, handles[i]));
+		again_handles[n] = handles[i];
+		again_sizes[n] = sizes[i];
+	}
+	intel_allocator_alloc_batch(ahnd, n, again_handles, again_sizes,
+				    0, again_offsets);
+	for (i = 0, n = 0; i < NUM_OBJECTS; i += 3, n++)
+		offsets[i] = again_offsets[n];
+
+	for (i = 0; i < NUM_OBJECTS; i++) {
+		igt_assert(intel_allocator_is_allocated(ahnd, handles[i],
+							sizes[i], offsets[i]));
+		objects[i].handle = handles[i];
+		objects[i].offset = offsets[i];
+		objects[i].size = sizes[i];
+	}
+
+	/* The parent keeps the allocator open, with the objects */
+	intel_allocator_close(ahnd);
+}
+
+static int cmp_offsets(const void *a, const void *b)
+{
+	const struct object *oa = a, *ob = b;
+
+	return oa->offset < ob->offset ? -1 : oa->offset > ob->offset;
+}
+
+static void check_objects(struct object *objects, int count)
+{
+	qsort(objects, count, sizeof(*objects), cmp_offsets);
+
+	for (int i = 0; i < count; i++) {
+		igt_assert_eq_u64(objects[i].offset % 4096, 0);
+		igt_assert(objects[i].offset + objects[i].size <= RANGE_END);
+		if (i)
+			igt_assert_f(objects[i - 1].offset + objects[i - 1].size <=
+				     objects[i].offset,
+				     "handles %u and %u overlap\n",
+				     objects[i - 1].handle, objects[i].handle);
+	}
+}
+
+static void multiprocess_shm(int rounds)
+{
+	const int count = NUM_CHILDREN * NUM_OBJECTS;
+	struct object *objects;
+	int shared;
+
+	objects = mmap(NULL, sizeof(*objects) * count, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	igt_assert(objects != MAP_FAILED);
+	shared = count_shared_mappings();
+
+	setenv("IGT_ALLOCATOR_CHANNEL", "shm", 1);
+
+	for (int r = 0; r < rounds; r++) {
+		uint64_t ahnd;
+
+		intel_allocator_multiprocess_start();
+		ahnd = open_allocator();
+
+		igt_fork(child, NUM_CHILDREN)
+			child_allocs(child, objects + child * NUM_OBJECTS);
+		igt_waitchildren();
+
+		check_objects(objects, count);
+		for (int i = 0; i < count; i++)
+			igt_assert(intel_allocator_free(ahnd,
+							objects[i].handle));
+		igt_assert(intel_allocator_close(ahnd));
+
+		intel_allocator_multiprocess_stop();
+
+		/* Nothing of the channel is left behind */
+		igt_assert_eq(count_shared_mappings(), shared);
+	}
+
+	unsetenv("IGT_ALLOCATOR_CHANNEL");
+	munmap(objects, sizeof(*objects) * count);
+}
+
+igt_main
+{
+	igt_subtest("multiprocess-shm")
+		multiprocess_shm(3);
+}
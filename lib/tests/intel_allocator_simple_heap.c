@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Copyright © 2021 Intel Corporation
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "drmtest.h"
+#include "igt_core.h"
+#include "igt_rand.h"
+#include "intel_allocator.h"
+
+struct intel_allocator *
+intel_allocator_simple_create(int fd, uint64_t start, uint64_t end,
+			      enum allocator_strategy strategy);
+void intel_allocator_simple_validate(struct intel_allocator *ial);
+
+/*
+ * Runs random sequences of alloc, free, reserve and unreserve on the simple
+ * allocator alone, no device needed, checking the heap after every step.
+ * The offsets returned are compared with a reference which tracks every
+ * page and looks for the first fit by brute force, from the top or from
+ * the bottom depending on the strategy.
+ */
+
+#define PAGE_SIZE 4096
+#define NUM_PAGES 512
+/* Neither end of the range is aligned to the larger alignments */
+#define HEAP_START (3 * PAGE_SIZE)
+#define HEAP_END (HEAP_START + NUM_PAGES * PAGE_SIZE)
+
+#define NUM_OBJECTS 96
+#define NUM_RESERVED 16
+
+struct range {
+	uint64_t offset;
+	uint64_t size;
+	bool live;
+};
+
+struct reference {
+	bool used[NUM_PAGES];
+	struct range objects[NUM_OBJECTS];
+	struct range reserved[NUM_RESERVED];
+};
+
+static bool reference_is_free(const struct reference *ref,
+			      uint64_t offset, uint64_t size)
+{
+	uint64_t page = (offset - HEAP_START) / PAGE_SIZE;
+
+	if (offset < HEAP_START || offset + size > HEAP_END)
+		return false;
+
+	for (uint64_t i = 0; i < size / PAGE_SIZE; i++)
+		if (ref->used[page + i])
+			return false;
+
+	return true;
+}
+
+static void reference_mark(struct reference *ref, uint64_t offset,
+			   uint64_t size, bool used)
+{
+	uint64_t page = (offset - HEAP_START) / PAGE_SIZE;
+
+	for (uint64_t i = 0; i < size / PAGE_SIZE; i++) {
+		igt_assert(ref->used[page + i] != used);
+		ref->used[page + i] = used;
+	}
+}
+
+static uint64_t reference_alloc(struct reference *ref, uint64_t size,
+				uint64_t alignment,
+				enum allocator_strategy strategy)
+{
+	uint64_t offset;
+
+	if (size > HEAP_END - HEAP_START)
+		return ALLOC_INVALID_ADDRESS;
+
+	if (strategy == ALLOC_STRATEGY_HIGH_TO_LOW) {
+		for (offset = (HEAP_END - size) / alignment * alignment;
+		     offset >= HEAP_START; offset -= alignment)
+			if (reference_is_free(ref, offset, size))
+				return offset;
+	} else {
+		for (offset = ALIGN(HEAP_START, alignment);
+		     offset + size <= HEAP_END; offset += alignment)
+			if (reference_is_free(ref, offset, size))
+				return offset;
+	}
+
+	return ALLOC_INVALID_ADDRESS;
+}
+
+static void step_object(struct intel_allocator *ial, struct reference *ref,
+			enum allocator_strategy default_strategy,
+			uint32_t *seed)
+{
+	static const enum allocator_strategy strategies[] = {
+		ALLOC_STRATEGY_NONE,
+		ALLOC_STRATEGY_LOW_TO_HIGH,
+		ALLOC_STRATEGY_HIGH_TO_LOW,
+	};
+	int i = hars_petruska_f54_1_random(seed) % NUM_OBJECTS;
+	struct range *obj = &ref->objects[i];
+	enum allocator_strategy strategy;
+	uint64_t size, alignment, offset, expected;
+
+	if (obj->live) {
+		igt_assert(ial->free(ial, i + 1));
+		reference_mark(ref, obj->offset, obj->size, false);
+		obj->live = false;
+		return;
+	}
+
+	size = (1 + hars_petruska_f54_1_random(seed) % 16) * PAGE_SIZE;
+	alignment = PAGE_SIZE << (hars_petruska_f54_1_random(seed) % 5);
+	strategy = strategies[hars_petruska_f54_1_random(seed) % 3];
+
+	offset = ial->alloc(ial, i + 1, size, alignment, strategy);
+	expected = reference_alloc(ref, size, alignment,
+				   strategy == ALLOC_STRATEGY_NONE ?
+				   default_strategy : strategy);
+	igt_assert_f(offset == expected,
+		     "alloc of 0x%" PRIx64 " aligned to 0x%" PRIx64
+		     " got 0x%" PRIx64 ", expected 0x%" PRIx64 "\n",
+		     size, alignment, offset, expected);
+
+	if (offset == ALLOC_INVALID_ADDRESS)
+		return;
+
+	igt_assert(ial->is_allocated(ial, i + 1, size, offset));
+	reference_mark(ref, offset, size, true);
+	obj->offset = offset;
+	obj->size = size;
+	obj->live = true;
+}
+
+static void step_reserved(struct intel_allocator *ial, struct reference *ref,
+			  uint32_t *seed)
+{
+	int i = hars_petruska_f54_1_random(seed) % NUM_RESERVED;
+	struct range *res = &ref->reserved[i];
+	uint64_t start, end;
+	bool expected;
+
+	if (res->live) {
+		igt_assert(ial->unreserve(ial, i + 1, res->offset,
+					  res->offset + res->size));
+		reference_mark(ref, res->offset, res->size, false);
+		res->live = false;
+		return;
+	}
+
+	start = HEAP_START +
+		hars_petruska_f54_1_random(seed) % NUM_PAGES * PAGE_SIZE;
+	end = start + (1 + hars_petruska_f54_1_random(seed) % 8) * PAGE_SIZE;
+	if (end > HEAP_END)
+		end = HEAP_END;
+
+	expected = reference_is_free(ref, start, end - start);
+	igt_assert_eq(ial->reserve(ial, i + 1, start, end), expected);
+
+	if (!expected)
+		return;
+
+	igt_assert(ial->is_reserved(ial, start, end));
+	reference_mark(ref, start, end - start, true);
+	res->offset = start;
+	res->size = end - start;
+	res->live = true;
+}
+
+static void random_sequence(enum allocator_strategy strategy, uint32_t seed)
+{
+	struct intel_allocator *ial;
+	struct reference ref;
+
+	memset(&ref, 0, sizeof(ref));
+	ial = intel_allocator_simple_create(-1, HEAP_START, HEAP_END, strategy);
+
+	for (int step = 0; step < 20000; step++) {
+		if (hars_petruska_f54_1_random(&seed) % 8)
+			step_object(ial, &ref, strategy, &seed);
+		else
+			step_reserved(ial, &ref, &seed);
+
+		intel_allocator_simple_validate(ial);
+	}
+
+	for (int i = 0; i < NUM_OBJECTS; i++)
+		if (ref.objects[i].live)
+			igt_assert(ial->free(ial, i + 1));
+
+	for (int i = 0; i < NUM_RESERVED; i++)
+		if (ref.reserved[i].live)
+			igt_assert(ial->unreserve(ial, i + 1,
+						  ref.reserved[i].offset,
+						  ref.reserved[i].offset +
+						  ref.reserved[i].size));
+
+	intel_allocator_simple_validate(ial);
+	igt_assert(ial->is_empty(ial));
+	ial->destroy(ial);
+}
+
+igt_main
+{
+	igt_subtest("random-high-to-low")
+		random_sequence(ALLOC_STRATEGY_HIGH_TO_LOW, 0x8086);
+
+	igt_subtest("random-low-to-high")
+		random_sequence(ALLOC_STRATEGY_LOW_TO_HIGH, 0x8086);
+}
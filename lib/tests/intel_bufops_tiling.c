@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "igt_core.h"
+#include "intel_bufops.h"
+
+/*
+ * Compare the tile-at-a-time software (de)tiling against the per-pixel
+ * reference implementation. No device is needed, the surfaces live in
+ * plain page aligned memory.
+ */
+
+static const struct {
+	uint32_t tiling;
+	const char *name;
+	unsigned int width;	/* bytes */
+	unsigned int height;	/* rows */
+} tilings[] = {
+	{ I915_TILING_X, "x", 512, 8 },
+	{ I915_TILING_Y, "y", 128, 32 },
+	{ I915_TILING_Yf, "yf", 128, 32 },
+	{ I915_TILING_Ys, "ys", 512, 128 },
+};
+
+static const uint32_t swizzles[] = {
+	I915_BIT_6_SWIZZLE_NONE,
+	I915_BIT_6_SWIZZLE_9,
+	I915_BIT_6_SWIZZLE_9_10,
+	I915_BIT_6_SWIZZLE_9_11,
+	I915_BIT_6_SWIZZLE_9_10_11,
+};
+
+static void check_surface(int t, uint32_t swizzle,
+			  unsigned int width, unsigned int height)
+{
+	struct intel_buf buf = {};
+	unsigned int stride = ALIGN(width * 4, tilings[t].width);
+	size_t size = (size_t)stride * ALIGN(height, tilings[t].height);
+	size_t linear_size = (size_t)stride * height;
+	uint32_t *linear, *out_ref, *out;
+	uint8_t *ref, *tiled;
+	size_t i;
+
+	buf.tiling = tilings[t].tiling;
+	buf.bpp = 32;
+	buf.surface[0].stride = stride;
+	buf.surface[0].size = linear_size;
+
+	linear = malloc(linear_size);
+	out_ref = malloc(linear_size);
+	out = malloc(linear_size);
+	igt_assert_eq(posix_memalign((void **)&ref, 4096, size), 0);
+	igt_assert_eq(posix_memalign((void **)&tiled, 4096, size), 0);
+
+	for (i = 0; i < linear_size / 4; i++)
+		linear[i] = i * 2654435761u;
+
+	/* Whatever is outside of the surface must be left untouched */
+	memset(ref, 0xa5, size);
+	memset(tiled, 0xa5, size);
+
+	__intel_buf_linear_to_tiled(&buf, ref, linear, swizzle, true);
+	__intel_buf_linear_to_tiled(&buf, tiled, linear, swizzle, false);
+	igt_assert(memcmp(ref, tiled, size) == 0);
+
+	__intel_buf_tiled_to_linear(&buf, ref, out_ref, swizzle, true);
+	__intel_buf_tiled_to_linear(&buf, tiled, out, swizzle, false);
+	igt_assert(memcmp(out_ref, linear, linear_size) == 0);
+	igt_assert(memcmp(out, linear, linear_size) == 0);
+
+	free(tiled);
+	free(ref);
+	free(out);
+	free(out_ref);
+	free(linear);
+}
+
+igt_main
+{
+	static const unsigned int widths[] = { 1, 37, 128, 1000 };
+	static const unsigned int heights[] = { 1, 7, 33, 130, 257 };
+
+	for (int t = 0; t < ARRAY_SIZE(tilings); t++) {
+		igt_subtest_f("tiling-%s", tilings[t].name) {
+			/* Only X and Y are swizzled */
+			int num_swizzles = tilings[t].tiling == I915_TILING_X ||
+				tilings[t].tiling == I915_TILING_Y ?
+				ARRAY_SIZE(swizzles) : 1;
+
+			for (int s = 0; s < num_swizzles; s++)
+				for (int w = 0; w < ARRAY_SIZE(widths); w++)
+					for (int h = 0; h < ARRAY_SIZE(heights); h++)
+						check_surface(t, swizzles[s],
+							      widths[w], heights[h]);
+		}
+	}
+}
@@ -89,6 +89,18 @@ static void close_watchdogs_atexit(void)
 	close_watchdogs(NULL);
 }
 
+/*
+ * Drops the watchdogs from this process without stopping them. Used
+ * by parallel job workers, the dispatcher process keeps pinging and
+ * eventually closes the watchdogs on behalf of all of them.
+ */
+static void forget_watchdogs(void)
+{
+	free(watchdogs.fds);
+	watchdogs.num_dogs = 0;
+	watchdogs.fds = NULL;
+}
+
 static void init_watchdogs(struct settings *settings)
 {
 	int i;
@@ -1296,6 +1308,19 @@ static char *entry_display_name(struct job_list_entry *entry)
 	return ret;
 }
 
+/*
+ * Kernel messages can't be told apart by the process causing them.
+ * When executing concurrently, they are attributed to the entries
+ * holding a device or the whole machine, one at a time unless several
+ * devices were given, and entries needing no resources get an empty
+ * dmesg.txt: anything they could cause in the kernel is not theirs to
+ * report.
+ */
+static bool owns_kmsg(struct settings *settings, struct job_list_entry *entry)
+{
+	return settings->jobs <= 1 || entry->resources != RESOURCE_NONE;
+}
+
 /*
  * Returns:
  *  =0 - Success
@@ -1346,7 +1371,9 @@ static int execute_next_entry(struct execute_state *state,
 		goto out_pipe;
 	}
 
-	if ((kmsgfd = open("/dev/kmsg", O_RDONLY | O_CLOEXEC | O_NONBLOCK)) < 0) {
+	if (!owns_kmsg(settings, entry)) {
+		kmsgfd = -1;
+	} else if ((kmsgfd = open("/dev/kmsg", O_RDONLY | O_CLOEXEC | O_NONBLOCK)) < 0) {
 		errf("Warning: Cannot open /dev/kmsg\n");
 	} else {
 		/* TODO: Checking of abort conditions in pre-execute dmesg */
@@ -1394,6 +1421,9 @@ static int execute_next_entry(struct execute_state *state,
 		sigprocmask(SIG_UNBLOCK, sigmask, NULL);
 
 		setenv("IGT_SENTINEL_ON_STDERR", "1", 1);
+		if (state->device >= 0 &&
+		    state->device < (int)settings->num_devices)
+			setenv("IGT_DEVICE", settings->devices[state->device], 1);
 
 		execute_test_process(outfd, errfd, settings, entry);
 		/* unreachable */
@@ -1510,13 +1540,44 @@ static void init_time_left(struct execute_state *state,
 		state->time_left = settings->overall_timeout;
 }
 
+/*
+ * Returns true if the job list entry at idx has already been executed
+ * and should not be started again. Otherwise subtests that already
+ * started are pruned from the entry according to its journal.
+ */
+static bool entry_done_from_journal(int dirfd,
+				    struct job_list_entry *entry,
+				    size_t idx)
+{
+	char name[32];
+	int resdirfd, fd;
+	bool done = false;
+
+	snprintf(name, sizeof(name), "%zd", idx);
+	if ((resdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0)
+		return false;
+
+	if ((fd = openat(resdirfd, filenames[_F_JOURNAL], O_RDONLY)) >= 0) {
+		/*
+		 * If nothing could be pruned, the test does not have
+		 * subtests, or incompleted before the first subtest
+		 * began. Either way, not suitable to re-run. An empty
+		 * binary name means the test is fully completed.
+		 */
+		done = !prune_from_journal(entry, fd) || entry->binary[0] == '\0';
+	}
+
+	close(resdirfd);
+
+	return done;
+}
+
 bool initialize_execute_state_from_resume(int dirfd,
 					  struct execute_state *state,
 					  struct settings *settings,
 					  struct job_list *list)
 {
-	struct job_list_entry *entry;
-	int resdirfd, fd, i;
+	int resdirfd, i;
 
 	free_settings(settings);
 	free_job_list(list);
@@ -1535,35 +1596,40 @@ bool initialize_execute_state_from_resume(int dirfd,
 		char name[32];
 
 		snprintf(name, sizeof(name), "%d", i);
-		if ((resdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) >= 0)
+		if ((resdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) >= 0) {
+			close(resdirfd);
 			break;
+		}
 	}
 
 	if (i < 0)
 		/* Nothing has been executed yet, state is fine as is */
 		goto success;
 
-	entry = &list->entries[i];
-	state->next = i;
-	if ((fd = openat(resdirfd, filenames[_F_JOURNAL], O_RDONLY)) >= 0) {
-		if (!prune_from_journal(entry, fd)) {
-			/*
-			 * The test does not have subtests, or
-			 * incompleted before the first subtest
-			 * began. Either way, not suitable to
-			 * re-run.
-			 */
-			state->next = i + 1;
-		} else if (entry->binary[0] == '\0') {
-			/* This test is fully completed */
-			state->next = i + 1;
+	if (settings->jobs > 1) {
+		size_t k;
+
+		/*
+		 * Parallel execution finishes entries out of order.
+		 * Any result directory up to the last one created may
+		 * belong to an unfinished entry, and entries without
+		 * one have not been started at all. Entries not to be
+		 * executed again get their binary name cleared, the
+		 * same way prune_from_journal() marks completed ones.
+		 */
+		for (k = 0; k <= i && k < list->size; k++) {
+			if (entry_done_from_journal(dirfd, &list->entries[k], k))
+				list->entries[k].binary[0] = '\0';
 		}
 
-		close(fd);
+		goto success;
 	}
 
+	state->next = i;
+	if (entry_done_from_journal(dirfd, &list->entries[i], i))
+		state->next = i + 1;
+
  success:
-	close(resdirfd);
 	close(dirfd);
 
 	return true;
@@ -1682,6 +1748,447 @@ static bool should_die_because_signal(int sigfd)
 	return false;
 }
 
+struct job_slot {
+	pid_t pid;
+	size_t idx;
+	unsigned resources;
+	int device;
+	bool exited;
+	int replyfd;
+	char *reply;
+	size_t replysize;
+};
+
+/*
+ * Resources are claimed per device given with --device, or on the one
+ * device the tests pick by themselves without it. An entry holding the
+ * whole machine claims all of them.
+ */
+static size_t num_claim_devices(struct settings *settings)
+{
+	return settings->num_devices ?: 1;
+}
+
+/*
+ * Returns whether an entry wanting the given resources can be executed
+ * now, and on which device in *device: -1 if it needs none, the first
+ * one if it needs the whole machine.
+ */
+static bool resources_available(unsigned wanted, const unsigned *claimed,
+				size_t num_devices, size_t running,
+				int *device)
+{
+	size_t i;
+
+	for (i = 0; i < num_devices; i++) {
+		if (claimed[i] & RESOURCE_EXCLUSIVE)
+			return false;
+	}
+
+	if (wanted & RESOURCE_EXCLUSIVE) {
+		if (running)
+			return false;
+
+		for (i = 0; i < num_devices; i++) {
+			if (claimed[i])
+				return false;
+		}
+
+		*device = 0;
+		return true;
+	}
+
+	if (wanted == RESOURCE_NONE) {
+		*device = -1;
+		return true;
+	}
+
+	for (i = 0; i < num_devices; i++) {
+		if (!(wanted & claimed[i])) {
+			*device = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void claim_resources(unsigned resources, unsigned *claimed,
+			    size_t num_devices, int device)
+{
+	size_t i;
+
+	if (device >= 0 && !(resources & RESOURCE_EXCLUSIVE)) {
+		claimed[device] |= resources;
+		return;
+	}
+
+	for (i = 0; i < num_devices; i++)
+		claimed[i] |= resources;
+}
+
+/*
+ * Re-reads the job list entry at idx from the results directory and
+ * prunes the subtests already started, like resuming does after a
+ * timeout in serial execution. Returns false if the entry is not to
+ * be executed again.
+ */
+static bool reload_entry_from_journal(int resdirfd, size_t idx,
+				      struct job_list *list)
+{
+	if (!read_job_list(list, resdirfd) || idx >= list->size)
+		return false;
+
+	return !entry_done_from_journal(resdirfd, &list->entries[idx], idx);
+}
+
+/*
+ * Executes the job list entry at idx in a forked worker process and
+ * reports the outcome to the dispatcher through replyfd: the result
+ * of execute_next_entry() as an int, followed by the abort reason, if
+ * any.
+ */
+static void __attribute__((noreturn))
+execute_job_worker(struct execute_state *state,
+		   struct settings *settings,
+		   struct job_list *job_list,
+		   size_t idx, int device,
+		   int testdirfd, int resdirfd,
+		   sigset_t *sigmask,
+		   int replyfd)
+{
+	struct job_list reloaded;
+	struct job_list_entry *entry = &job_list->entries[idx];
+	char *reason = NULL;
+	double time_spent;
+	int result = -1;
+	int sigfd;
+
+	/*
+	 * Signals from the terminal go to the dispatcher only, it
+	 * forwards them to us.
+	 */
+	setpgid(0, 0);
+	forget_watchdogs();
+	init_job_list(&reloaded);
+
+	sigfd = signalfd(-1, sigmask, O_CLOEXEC);
+	if (sigfd < 0) {
+		errf("Cannot mask signals\n");
+		goto out;
+	}
+
+	state->next = idx;
+	state->device = device;
+	while ((result = execute_next_entry(state, job_list->size,
+					    &time_spent, settings, entry,
+					    testdirfd, resdirfd,
+					    sigfd, sigmask,
+					    &reason)) > 0) {
+		if (reason || !reload_entry_from_journal(resdirfd, idx, &reloaded))
+			break;
+
+		entry = &reloaded.entries[idx];
+	}
+
+	close(sigfd);
+
+ out:
+	write(replyfd, &result, sizeof(result));
+	if (reason)
+		write(replyfd, reason, strlen(reason));
+	close(replyfd);
+
+	fflush(stdout);
+	fflush(stderr);
+	_exit(0);
+}
+
+static bool dispatch_job(struct job_slot *slot,
+			 struct execute_state *state,
+			 struct settings *settings,
+			 struct job_list *job_list,
+			 size_t idx, int device,
+			 int testdirfd, int resdirfd,
+			 int sigfd, sigset_t *sigmask)
+{
+	int replypipe[2];
+
+	if (pipe2(replypipe, O_CLOEXEC)) {
+		errf("Error creating pipes: %m\n");
+		return false;
+	}
+
+	/* Same as for tests, don't duplicate our buffered output */
+	fflush(stdout);
+	fflush(stderr);
+
+	slot->pid = fork();
+	if (slot->pid < 0) {
+		errf("Failed to fork: %m\n");
+		close(replypipe[0]);
+		close(replypipe[1]);
+		return false;
+	} else if (slot->pid == 0) {
+		close(replypipe[0]);
+		close(sigfd);
+		execute_job_worker(state, settings, job_list, idx, device,
+				   testdirfd, resdirfd, sigmask,
+				   replypipe[1]);
+		/* unreachable */
+	}
+
+	close(replypipe[1]);
+
+	slot->idx = idx;
+	slot->resources = job_list->entries[idx].resources;
+	slot->device = device;
+	slot->exited = false;
+	slot->replyfd = replypipe[0];
+	slot->reply = NULL;
+	slot->replysize = 0;
+
+	return true;
+}
+
+static void read_job_reply(struct job_slot *slot)
+{
+	char buf[512];
+	ssize_t s;
+
+	s = read(slot->replyfd, buf, sizeof(buf));
+	if (s < 0 && errno == EINTR)
+		return;
+
+	if (s <= 0) {
+		close(slot->replyfd);
+		slot->replyfd = -1;
+		return;
+	}
+
+	slot->reply = realloc(slot->reply, slot->replysize + s + 1);
+	memcpy(slot->reply + slot->replysize, buf, s);
+	slot->replysize += s;
+	slot->reply[slot->replysize] = '\0';
+}
+
+static void reap_job_workers(struct job_slot *slots, size_t num_slots)
+{
+	pid_t pid;
+	size_t i;
+
+	while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+		for (i = 0; i < num_slots; i++) {
+			if (slots[i].pid == pid)
+				slots[i].exited = true;
+		}
+	}
+}
+
+/*
+ * Executes the job list with up to settings->jobs entries running at
+ * the same time, each in its own worker process with the same
+ * monitoring a serially executed test gets. Entries are started in
+ * order, except that an entry whose resources are busy on every device
+ * lets later entries not needing those resources start ahead of it.
+ *
+ * Returns false if the runner got a signal to die, true otherwise.
+ * *status is set to false if execution stopped because of an error
+ * or an abort condition.
+ */
+static bool execute_parallel(struct execute_state *state,
+			     struct settings *settings,
+			     struct job_list *job_list,
+			     int testdirfd, int resdirfd,
+			     int sigfd, sigset_t *sigmask,
+			     bool *status)
+{
+	struct job_slot *slots = calloc(settings->jobs, sizeof(*slots));
+	bool *dispatched = calloc(job_list->size, sizeof(*dispatched));
+	struct pollfd *pfds = calloc(settings->jobs + 1, sizeof(*pfds));
+	size_t num_devices = num_claim_devices(settings);
+	unsigned *claimed = calloc(num_devices, sizeof(*claimed));
+	struct timespec time_last, time_now;
+	bool stopping = false, signalled = false;
+	size_t running = 0;
+	size_t i;
+
+	igt_gettime(&time_last);
+
+	while (true) {
+		size_t npfds = 0;
+		int n;
+
+		memset(claimed, 0, num_devices * sizeof(*claimed));
+		for (i = 0; i < settings->jobs; i++) {
+			if (slots[i].pid)
+				claim_resources(slots[i].resources, claimed,
+						num_devices, slots[i].device);
+		}
+
+		for (i = state->next; !stopping && i < job_list->size &&
+			     running < settings->jobs; i++) {
+			struct job_list_entry *entry = &job_list->entries[i];
+			size_t free_slot = 0;
+			int device;
+
+			if (dispatched[i])
+				continue;
+
+			if (entry->binary[0] == '\0') {
+				/* Already completed before resuming */
+				dispatched[i] = true;
+				continue;
+			}
+
+			if (!resources_available(entry->resources, claimed,
+						 num_devices, running, &device)) {
+				/* Don't let later entries starve this one */
+				claim_resources(entry->resources, claimed,
+						num_devices, -1);
+				continue;
+			}
+
+			while (slots[free_slot].pid)
+				free_slot++;
+
+			if (!dispatch_job(&slots[free_slot], state, settings,
+					  job_list, i, device,
+					  testdirfd, resdirfd,
+					  sigfd, sigmask)) {
+				*status = false;
+				stopping = true;
+				break;
+			}
+
+			dispatched[i] = true;
+			claim_resources(entry->resources, claimed,
+					num_devices, device);
+			running++;
+		}
+
+		while (state->next < job_list->size && dispatched[state->next])
+			state->next++;
+
+		if (running == 0)
+			break;
+
+		pfds[npfds++] = (struct pollfd) { .fd = sigfd, .events = POLLIN };
+		for (i = 0; i < settings->jobs; i++) {
+			if (slots[i].pid && slots[i].replyfd >= 0)
+				pfds[npfds++] = (struct pollfd) { .fd = slots[i].replyfd, .events = POLLIN };
+		}
+
+		n = poll(pfds, npfds, 1000);
+		ping_watchdogs();
+
+		if (n < 0 && errno != EINTR) {
+			errf("Poll on job workers failed with %m\n");
+			*status = false;
+			break;
+		}
+
+		for (i = 0; i < settings->jobs; i++) {
+			struct pollfd *pfd;
+
+			if (!slots[i].pid || slots[i].replyfd < 0)
+				continue;
+
+			for (pfd = &pfds[1]; pfd < &pfds[npfds]; pfd++) {
+				if (pfd->fd == slots[i].replyfd && pfd->revents)
+					read_job_reply(&slots[i]);
+			}
+		}
+
+		if (pfds[0].revents) {
+			struct signalfd_siginfo siginfo;
+
+			if (read(sigfd, &siginfo, sizeof(siginfo)) < 0) {
+				errf("Error reading from signalfd: %m\n");
+			} else if (siginfo.ssi_signo == SIGCHLD) {
+				reap_job_workers(slots, settings->jobs);
+			} else {
+				errf("Runner is being killed by %s, terminating jobs\n",
+				     strsignal(siginfo.ssi_signo));
+
+				for (i = 0; i < settings->jobs; i++) {
+					if (slots[i].pid && !slots[i].exited)
+						kill(slots[i].pid, siginfo.ssi_signo);
+				}
+
+				signalled = true;
+				stopping = true;
+			}
+		}
+
+		igt_gettime(&time_now);
+		reduce_time_left(settings, state, igt_time_elapsed(&time_last, &time_now));
+		time_last = time_now;
+
+		for (i = 0; i < settings->jobs; i++) {
+			struct job_slot *slot = &slots[i];
+			char *reason = NULL;
+			int result = -1;
+
+			if (!slot->pid || !slot->exited || slot->replyfd >= 0)
+				continue;
+
+			if (slot->replysize >= sizeof(result)) {
+				memcpy(&result, slot->reply, sizeof(result));
+				if (slot->replysize > sizeof(result))
+					reason = strdup(slot->reply + sizeof(result));
+			}
+
+			if (!signalled &&
+			    (reason != NULL || (reason = need_to_abort(settings)) != NULL)) {
+				char *prev = entry_display_name(&job_list->entries[slot->idx]);
+				char *next = (state->next < job_list->size ?
+					      entry_display_name(&job_list->entries[state->next]) :
+					      strdup("nothing"));
+
+				write_abort_file(resdirfd, reason, prev, next);
+				free(prev);
+				free(next);
+				*status = false;
+				stopping = true;
+			}
+			free(reason);
+
+			if (result < 0) {
+				*status = false;
+				stopping = true;
+			}
+
+			free(slot->reply);
+			memset(slot, 0, sizeof(*slot));
+			running--;
+		}
+
+		if (!stopping && overall_timeout_exceeded(state)) {
+			if (settings->log_level >= LOG_LEVEL_NORMAL)
+				outf("Overall timeout time exceeded, stopping.\n");
+			stopping = true;
+		}
+	}
+
+	for (i = 0; i < settings->jobs; i++) {
+		if (slots[i].pid) {
+			kill(slots[i].pid, SIGKILL);
+			waitpid(slots[i].pid, NULL, 0);
+			if (slots[i].replyfd >= 0)
+				close(slots[i].replyfd);
+			free(slots[i].reply);
+		}
+	}
+
+	free(claimed);
+	free(pfds);
+	free(dispatched);
+	free(slots);
+
+	return !signalled;
+}
+
 bool execute(struct execute_state *state,
 	     struct settings *settings,
 	     struct job_list *job_list)
@@ -1781,6 +2288,17 @@ bool execute(struct execute_state *state,
 		}
 	}
 
+	if (settings->jobs > 1) {
+		if (!execute_parallel(state, settings, job_list,
+				      testdirfd, resdirfd,
+				      sigfd, &sigmask, &status)) {
+			status = false;
+			goto end;
+		}
+
+		goto endtime;
+	}
+
 	for (; state->next < job_list->size;
 	     state->next++) {
 		char *reason = NULL;
@@ -1846,6 +2364,7 @@ bool execute(struct execute_state *state,
 		}
 	}
 
+ endtime:
 	if ((timefd = openat(resdirfd, "endtime.txt", O_CREAT | O_WRONLY | O_EXCL, 0666)) >= 0) {
 		dprintf(timefd, "%f\n", timeofday_double());
 		close(timefd);
@@ -15,6 +15,11 @@ struct execute_state
 	double time_left;
 	double resuming;
 	bool dry;
+	/*
+	 * Index in settings->devices of the device the next entry gets
+	 * in IGT_DEVICE, < 0 to leave IGT_DEVICE alone.
+	 */
+	int device;
 };
 
 enum {
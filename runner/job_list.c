@@ -24,6 +24,67 @@ static bool matches_any(const char *str, struct regex_list *list)
 	return false;
 }
 
+/*
+ * First match wins, so more specific prefixes need to be listed
+ * before the generic ones. Anything not listed is assumed to need the
+ * whole machine.
+ */
+static const struct {
+	const char *prefix;
+	unsigned resources;
+} resource_map[] = {
+	/* Library self-tests, plain CPU work */
+	{ "igt_", RESOURCE_NONE },
+
+	/* Reload the driver, unbind the device or suspend the machine */
+	{ "core_hotunplug", RESOURCE_EXCLUSIVE },
+	{ "device_reset", RESOURCE_EXCLUSIVE },
+	{ "i915_module_load", RESOURCE_EXCLUSIVE },
+	{ "i915_pm_", RESOURCE_EXCLUSIVE },
+	{ "i915_suspend", RESOURCE_EXCLUSIVE },
+	{ "gem_exec_suspend", RESOURCE_EXCLUSIVE },
+	{ "perf_pmu", RESOURCE_EXCLUSIVE },
+	{ "tools_test", RESOURCE_EXCLUSIVE },
+
+	{ "kms_", RESOURCE_DEVICE | RESOURCE_DISPLAY },
+	{ "prime_mmap_kms", RESOURCE_DEVICE | RESOURCE_DISPLAY },
+	{ "testdisplay", RESOURCE_DEVICE | RESOURCE_DISPLAY },
+
+	{ "api_", RESOURCE_DEVICE },
+	{ "core_", RESOURCE_DEVICE },
+	{ "debugfs_", RESOURCE_DEVICE },
+	{ "drm_", RESOURCE_DEVICE },
+	{ "dumb_buffer", RESOURCE_DEVICE },
+	{ "gem_", RESOURCE_DEVICE },
+	{ "gen3_", RESOURCE_DEVICE },
+	{ "gen7_", RESOURCE_DEVICE },
+	{ "gen9_", RESOURCE_DEVICE },
+	{ "i915_", RESOURCE_DEVICE },
+	{ "perf", RESOURCE_DEVICE },
+	{ "prime_", RESOURCE_DEVICE },
+	{ "syncobj_", RESOURCE_DEVICE },
+	{ "sysfs_", RESOURCE_DEVICE },
+	{ "vgem_", RESOURCE_DEVICE },
+	{ NULL, RESOURCE_EXCLUSIVE },
+};
+
+unsigned (*job_resources_hook)(const char *binary);
+
+unsigned job_resources(const char *binary)
+{
+	typeof(*resource_map) *it;
+
+	if (job_resources_hook)
+		return job_resources_hook(binary);
+
+	for (it = resource_map; it->prefix; it++) {
+		if (!strncmp(binary, it->prefix, strlen(it->prefix)))
+			break;
+	}
+
+	return it->resources;
+}
+
 static void add_job_list_entry(struct job_list *job_list,
 			       char *binary,
 			       char **subtests,
@@ -38,6 +99,7 @@ static void add_job_list_entry(struct job_list *job_list,
 	entry->binary = binary;
 	entry->subtests = subtests;
 	entry->subtest_count = subtest_count;
+	entry->resources = job_resources(binary);
 }
 
 static void add_subtests(struct job_list *job_list, struct settings *settings,
@@ -5,6 +5,22 @@
 
 #include "settings.h"
 
+/*
+ * Resources a test binary needs for itself while executing. Binaries
+ * are only executed concurrently (see --jobs) if their resource masks
+ * don't overlap. RESOURCE_DEVICE and RESOURCE_DISPLAY are held on one
+ * of the devices given with --device, so binaries needing them can run
+ * side by side on different devices. RESOURCE_EXCLUSIVE can't be
+ * shared with anything, while binaries that need no resources at all
+ * can be run alongside anything except RESOURCE_EXCLUSIVE.
+ */
+enum {
+	RESOURCE_NONE = 0,
+	RESOURCE_DEVICE = (1 << 0),
+	RESOURCE_DISPLAY = (1 << 1),
+	RESOURCE_EXCLUSIVE = (1 << 2),
+};
+
 struct job_list_entry {
 	char *binary;
 	char **subtests;
@@ -19,6 +35,8 @@ struct job_list_entry {
 	 * the above array.
 	 */
 	size_t subtest_count;
+	/* RESOURCE_* mask, derived from the binary name */
+	unsigned resources;
 };
 
 struct job_list
@@ -33,6 +51,15 @@ void generate_piglit_name_for_dynamic(const char *base_piglit_name,
 				      const char *dynamic_subtest,
 				      char *namebuf, size_t namebuf_size);
 
+unsigned job_resources(const char *binary);
+
+/*
+ * Classifies binaries instead of job_resources()'s table when set, for
+ * the runner's own tests to give their test data the resources they
+ * need.
+ */
+extern unsigned (*job_resources_hook)(const char *binary);
+
 void init_job_list(struct job_list *job_list);
 void free_job_list(struct job_list *job_list);
 bool create_job_list(struct job_list *job_list, struct settings *settings);
@@ -1,8 +1,11 @@
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -113,23 +116,6 @@ static void free_subtests(struct subtest_list *subtests)
  * mem*() family of functions is used instead of str*().
  */
 
-static char *find_line_starting_with(char *haystack, const char *needle, char *end)
-{
-	while (haystack < end) {
-		char *line_end = memchr(haystack, '\n', end - haystack);
-
-		if (end - haystack < strlen(needle))
-			return NULL;
-		if (!memcmp(haystack, needle, strlen(needle)))
-			return haystack;
-		if (line_end == NULL)
-			return NULL;
-		haystack = line_end + 1;
-	}
-
-	return NULL;
-}
-
 static const char *next_line(const char *line, const char *bufend)
 {
 	char *ret;
@@ -324,46 +310,89 @@ struct matches
 {
 	struct match_item *items;
 	size_t size;
+	size_t capacity;
+
+	/* Subtest name lookup, built by index_matches() */
+	GHashTable *index;
 };
 
 struct match_needle
 {
 	const char *str;
 	bool (*validate)(const char *needle, const char *line, const char *bufend);
+
+	/*
+	 * If set, the first line matching this needle is stored here
+	 * instead of adding matches for it.
+	 */
+	const char **first;
 };
 
 static void match_add(struct matches *matches, const char *where, const char *what)
 {
 	struct match_item newitem = { where, what };
 
-	matches->size++;
-	matches->items = realloc(matches->items, matches->size * sizeof(*matches->items));
-	matches->items[matches->size - 1] = newitem;
+	if (matches->size == matches->capacity) {
+		matches->capacity = matches->capacity ? 2 * matches->capacity : 64;
+		matches->items = realloc(matches->items, matches->capacity * sizeof(*matches->items));
+	}
+
+	matches->items[matches->size++] = newitem;
 }
 
+/*
+ * Finds all lines starting with any of the needles in one pass over
+ * the buffer. Lines are only compared against the needles starting
+ * with the same character, and a line matches the first such needle
+ * in the array that it starts with.
+ */
 static struct matches find_matches(const char *buf, const char *bufend,
 				   const struct match_needle *needles)
 {
 	struct matches ret = {};
+	uint32_t first_char[256] = {};
+	size_t lens[32];
+	int i;
+
+	for (i = 0; needles[i].str; i++) {
+		assert(i < sizeof(lens) / sizeof(lens[0]));
+		lens[i] = strlen(needles[i].str);
+		first_char[(unsigned char)needles[i].str[0]] |= 1u << i;
+
+		if (needles[i].first)
+			*needles[i].first = NULL;
+	}
 
 	while (buf < bufend) {
-		const struct match_needle *needle;
+		uint32_t candidates = first_char[(unsigned char)*buf];
 
-		for (needle = needles; needle->str; needle++) {
-			if (bufend - buf < strlen(needle->str))
+		while (candidates) {
+			const struct match_needle *needle;
+
+			i = ffs(candidates) - 1;
+			candidates &= ~(1u << i);
+			needle = &needles[i];
+
+			if (bufend - buf < lens[i] ||
+			    memcmp(buf, needle->str, lens[i]) ||
+			    (needle->validate && !needle->validate(needle->str, buf, bufend)))
 				continue;
 
-			if (!memcmp(buf, needle->str, strlen(needle->str)) &&
-			    (!needle->validate || needle->validate(needle->str, buf, bufend))) {
+			if (!needle->first) {
 				match_add(&ret, buf, needle->str);
-				goto end_find;
+				break;
 			}
+
+			/* Only the first one is interesting, stop looking */
+			*needle->first = buf;
+			first_char[(unsigned char)needle->str[0]] &= ~(1u << i);
+			break;
 		}
 
-	end_find:
-		buf = next_line(buf, bufend);
+		buf = memchr(buf, '\n', bufend - buf);
 		if (!buf)
 			break;
+		buf++;
 	}
 
 	return ret;
@@ -404,9 +433,59 @@ static bool is_subtest_result_line(const char *needle, const char *line, const c
 
 static void free_matches(struct matches *matches)
 {
+	if (matches->index)
+		g_hash_table_destroy(matches->index);
 	free(matches->items);
 }
 
+static void free_index_entry(gpointer data)
+{
+	g_array_free(data, TRUE);
+}
+
+/*
+ * Indexes the subtest begin lines and the [dynamic] subtest result
+ * lines of the matches by the line prefix up to and including the
+ * subtest name, for example "Subtest foo". Each index entry is the
+ * array of the matching match indices in ascending order.
+ */
+static void index_matches(struct matches *matches, const char *bufend)
+{
+	size_t k;
+
+	matches->index = g_hash_table_new_full(g_str_hash, g_str_equal,
+					       free, free_index_entry);
+
+	for (k = 0; k < matches->size; k++) {
+		const char *what = matches->items[k].what;
+		const char *line = matches->items[k].where;
+		const char *name_end;
+		GArray *indices;
+		char *key;
+		int idx = k;
+
+		if (what == STARTING_SUBTEST) {
+			name_end = memchr(line, '\n', bufend - line) ?: bufend;
+		} else if (what == SUBTEST_RESULT || what == DYNAMIC_SUBTEST_RESULT) {
+			/* Validated by is_subtest_result_line() to have a ':' */
+			name_end = memchr(line, ':', bufend - line);
+		} else {
+			continue;
+		}
+
+		key = strndup(line, name_end - line);
+		indices = g_hash_table_lookup(matches->index, key);
+		if (!indices) {
+			indices = g_array_new(FALSE, FALSE, sizeof(int));
+			g_hash_table_insert(matches->index, key, indices);
+		} else {
+			free(key);
+		}
+
+		g_array_append_val(indices, idx);
+	}
+}
+
 static struct json_object *new_escaped_json_string(const char *buf, size_t len)
 {
 	struct json_object *obj;
@@ -463,37 +542,37 @@ static int find_subtest_idx_limited(struct matches matches,
 				    int first,
 				    int last)
 {
-	char *full_line;
-	int line_len;
-	int k;
+	GArray *indices;
+	char *key;
+	int lo, hi;
 
-	switch (pattern) {
-	case PATTERN_BEGIN:
-		line_len = asprintf(&full_line, "%s%s\n", linekey, subtest_name);
-		break;
-	case PATTERN_RESULT:
-		line_len = asprintf(&full_line, "%s%s: ", linekey, subtest_name);
-		break;
-	default:
-		assert(!"Unknown pattern");
-	}
+	assert(matches.index);
 
-	if (line_len < 0)
+	if (asprintf(&key, "%s%s", linekey, subtest_name) < 0)
 		return -1;
 
-	for (k = first; k < last; k++)
-		if (matches.items[k].what == linekey &&
-		    !memcmp(matches.items[k].where,
-			    full_line,
-			    min(line_len, bufend - matches.items[k].where)))
-			break;
+	indices = g_hash_table_lookup(matches.index, key);
+	free(key);
+
+	if (!indices)
+		return -1;
 
-	free(full_line);
+	/* First index >= first */
+	lo = 0;
+	hi = indices->len;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
 
-	if (k == last)
-		k = -1;
+		if (g_array_index(indices, int, mid) < first)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
 
-	return k;
+	if (lo == indices->len || g_array_index(indices, int, lo) >= last)
+		return -1;
+
+	return g_array_index(indices, int, lo);
 }
 
 static int find_subtest_idx(struct matches matches,
@@ -591,6 +670,30 @@ static const char *find_subtest_end_limit(struct matches matches,
 	return find_subtest_end_limit_limited(matches, begin_idx, result_idx, buf, bufend, 0, matches.size);
 }
 
+/*
+ * Copies the first whitespace-delimited word of the line to name. The
+ * buffer is not null-terminated, so sscanf() can't be used on it.
+ */
+static bool parse_dynamic_subtest_name(const char *line, const char *bufend,
+				       char *name, size_t namesize)
+{
+	size_t len = 0;
+
+	while (line < bufend && isspace(*line))
+		line++;
+
+	while (line + len < bufend && !isspace(line[len]))
+		len++;
+
+	if (len == 0 || len >= namesize)
+		return false;
+
+	memcpy(name, line, len);
+	name[len] = '\0';
+
+	return true;
+}
+
 static void process_dynamic_subtest_output(const char *piglit_name,
 					   const char *igt_version,
 					   size_t igt_version_len,
@@ -626,7 +729,8 @@ static void process_dynamic_subtest_output(const char *piglit_name,
 		if (matches.items[k].what != STARTING_DYNAMIC_SUBTEST)
 			continue;
 
-		if (sscanf(matches.items[k].where + strlen(STARTING_DYNAMIC_SUBTEST), "%s", dynamic_name) != 1) {
+		if (!parse_dynamic_subtest_name(matches.items[k].where + strlen(STARTING_DYNAMIC_SUBTEST),
+						end, dynamic_name, sizeof(dynamic_name))) {
 			/* Cannot parse name, just ignore this one */
 			continue;
 		}
@@ -689,7 +793,7 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 	char *buf, *bufend, *nullchr;
 	struct stat statbuf;
 	char piglit_name[256];
-	char *igt_version = NULL;
+	const char *igt_version = NULL;
 	size_t igt_version_len = 0;
 	struct json_object *current_test = NULL;
 	struct match_needle needles[] = {
@@ -697,14 +801,17 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 		{ SUBTEST_RESULT, is_subtest_result_line },
 		{ STARTING_DYNAMIC_SUBTEST, NULL },
 		{ DYNAMIC_SUBTEST_RESULT, is_subtest_result_line },
+		{ IGT_VERSIONSTRING, NULL, &igt_version },
 		{ NULL, NULL },
 	};
 	struct matches matches = {};
+	size_t mapsize;
 	size_t i;
 
 	if (fstat(fd, &statbuf))
 		return false;
 
+	mapsize = statbuf.st_size;
 	if (statbuf.st_size != 0) {
 		buf = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
 		if (buf == MAP_FAILED)
@@ -723,7 +830,8 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 
 	bufend = buf + statbuf.st_size;
 
-	igt_version = find_line_starting_with(buf, IGT_VERSIONSTRING, bufend);
+	matches = find_matches(buf, bufend, needles);
+
 	if (igt_version) {
 		char *newline = memchr(igt_version, '\n', bufend - igt_version);
 		igt_version_len = newline - igt_version;
@@ -739,10 +847,13 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 				       new_escaped_json_string(buf, statbuf.st_size));
 		add_igt_version(current_test, igt_version, igt_version_len);
 
+		free_matches(&matches);
+		if (buf)
+			munmap(buf, mapsize);
 		return true;
 	}
 
-	matches = find_matches(buf, bufend, needles);
+	index_matches(&matches, bufend);
 
 	for (i = 0; i < subtests->size; i++) {
 		int begin_idx = -1, result_idx = -1;
@@ -785,6 +896,8 @@ static bool fill_from_output(int fd, const char *binary, const char *key,
 	}
 
 	free_matches(&matches);
+	if (buf)
+		munmap(buf, mapsize);
 	return true;
 }
 
@@ -1530,24 +1643,475 @@ static void try_add_notrun_results(const struct job_list_entry *entry,
 	free_subtests(&subtests);
 }
 
-static void create_result_root_nodes(struct json_object *root,
-				     struct results *results)
+static void init_results(struct results *results)
 {
 	results->tests = json_object_new_object();
-	json_object_object_add(root, "tests", results->tests);
 	results->totals = json_object_new_object();
-	json_object_object_add(root, "totals", results->totals);
 	results->runtimes = json_object_new_object();
-	json_object_object_add(root, "runtimes", results->runtimes);
 }
 
-struct json_object *generate_results_json(int dirfd)
+static void free_results(struct results *results)
+{
+	json_object_put(results->tests);
+	json_object_put(results->totals);
+	json_object_put(results->runtimes);
+	memset(results, 0, sizeof(*results));
+}
+
+static bool parse_entry(int dirfd, size_t idx,
+			struct job_list_entry *entry,
+			struct settings *settings,
+			struct results *results)
+{
+	char name[16];
+	int testdirfd;
+	bool status;
+
+	snprintf(name, 16, "%zd", idx);
+	if ((testdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0) {
+		try_add_notrun_results(entry, settings, results);
+		return true;
+	}
+
+	status = parse_test_directory(testdirfd, entry, settings, results);
+	close(testdirfd);
+
+	return status;
+}
+
+/*
+ * Test directories are parsed by a pool of worker threads, each
+ * into its own set of result objects. The results are consumed in
+ * job list order, and workers are kept at most a window's worth of
+ * entries ahead of the consumer to bound memory use.
+ */
+struct parsed_entry {
+	struct results results;
+	bool status;
+	bool done;
+};
+
+struct parse_pool {
+	int dirfd;
+	struct settings *settings;
+	struct job_list *job_list;
+	struct parsed_entry *entries;
+	size_t next;
+	size_t consumed;
+	size_t window;
+	pthread_t *threads;
+	int num_threads;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static void parse_pool_entry(struct parse_pool *pool, size_t idx)
+{
+	struct parsed_entry *parsed = &pool->entries[idx];
+
+	init_results(&parsed->results);
+	parsed->status = parse_entry(pool->dirfd, idx,
+				     &pool->job_list->entries[idx],
+				     pool->settings, &parsed->results);
+}
+
+static void *parse_pool_worker(void *data)
+{
+	struct parse_pool *pool = data;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->next < pool->job_list->size) {
+		size_t idx;
+
+		if (pool->next >= pool->consumed + pool->window) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+			continue;
+		}
+
+		idx = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+
+		parse_pool_entry(pool, idx);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->entries[idx].done = true;
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static int parse_pool_num_threads(size_t num_entries)
+{
+	const char *env = getenv("IGT_WORKER_THREADS");
+	long num = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (num > num_entries)
+		num = num_entries;
+
+	return num > 1 ? num : 0;
+}
+
+static void init_parse_pool(struct parse_pool *pool, int dirfd,
+			    struct settings *settings,
+			    struct job_list *job_list)
+{
+	int i;
+
+	memset(pool, 0, sizeof(*pool));
+	pool->dirfd = dirfd;
+	pool->settings = settings;
+	pool->job_list = job_list;
+	pool->entries = calloc(job_list->size, sizeof(*pool->entries));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+
+	/* With no threads, entries get parsed as they are consumed */
+	pool->num_threads = parse_pool_num_threads(job_list->size);
+	pool->window = 4 * pool->num_threads;
+	pool->threads = calloc(pool->num_threads, sizeof(*pool->threads));
+
+	for (i = 0; i < pool->num_threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL, parse_pool_worker, pool)) {
+			pool->num_threads = i;
+			break;
+		}
+	}
+}
+
+static struct parsed_entry *parse_pool_get(struct parse_pool *pool, size_t idx)
+{
+	struct parsed_entry *parsed = &pool->entries[idx];
+
+	if (pool->num_threads == 0) {
+		parse_pool_entry(pool, idx);
+		return parsed;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while (!parsed->done)
+		pthread_cond_wait(&pool->cond, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	return parsed;
+}
+
+static void parse_pool_put(struct parse_pool *pool, size_t idx)
+{
+	free_results(&pool->entries[idx].results);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->consumed = idx + 1;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void fini_parse_pool(struct parse_pool *pool)
+{
+	size_t i;
+	int t;
+
+	/* Stop handing out work in case we bailed out early */
+	pthread_mutex_lock(&pool->lock);
+	pool->next = pool->job_list->size;
+	pthread_cond_broadcast(&pool->cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (t = 0; t < pool->num_threads; t++)
+		pthread_join(pool->threads[t], NULL);
+
+	for (i = pool->consumed; i < pool->job_list->size; i++) {
+		if (pool->entries[i].results.tests)
+			free_results(&pool->entries[i].results);
+	}
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool->entries);
+}
+
+/*
+ * Collects the per-directory results, either into the root object, or
+ * by writing the tests straight to a stream. Totals and runtimes are
+ * small, they are always collected in memory, as are the tests which
+ * a later result directory may replace.
+ */
+struct results_writer {
+	struct results results;
+	FILE *stream;
+	size_t tests_written;
+	/* Entries from here on are held in memory when streaming */
+	size_t first_held;
+};
+
+#define BINARY_SOME_SUBTESTS GINT_TO_POINTER(1)
+#define BINARY_ALL_SUBTESTS GINT_TO_POINTER(2)
+
+static bool is_subtest_pattern(const char *subtest)
+{
+	return strpbrk(subtest, "*?[,!") != NULL;
+}
+
+/*
+ * Returns the first job list entry whose tests may be repeated by a
+ * later entry, or the size of the job list if no tests are repeated.
+ * Dynamic subtests count as their parent, and an entry executing a
+ * whole binary, or subtests by pattern, may repeat any of its tests.
+ */
+static size_t first_repeated_entry(struct job_list *job_list)
+{
+	GHashTable *binaries = g_hash_table_new(g_str_hash, g_str_equal);
+	GHashTable *subtests = g_hash_table_new_full(g_str_hash, g_str_equal,
+						     free, NULL);
+	size_t first = job_list->size;
+	size_t i = job_list->size;
+
+	while (i--) {
+		struct job_list_entry *entry = &job_list->entries[i];
+		gpointer later = g_hash_table_lookup(binaries, entry->binary);
+		bool all = entry->subtest_count == 0;
+		bool repeated;
+		size_t k;
+
+		for (k = 0; k < entry->subtest_count; k++)
+			all |= is_subtest_pattern(entry->subtests[k]);
+
+		repeated = later && (all || later == BINARY_ALL_SUBTESTS);
+
+		for (k = 0; !all && k < entry->subtest_count; k++) {
+			const char *subtest = entry->subtests[k];
+			char *key;
+
+			if (asprintf(&key, "%s@%.*s", entry->binary,
+				     (int)strcspn(subtest, "@"), subtest) < 0)
+				continue;
+
+			if (g_hash_table_contains(subtests, key)) {
+				repeated = true;
+				free(key);
+			} else {
+				g_hash_table_add(subtests, key);
+			}
+		}
+
+		if (repeated)
+			first = i;
+
+		if (all || !later)
+			g_hash_table_insert(binaries, entry->binary,
+					    all ? BINARY_ALL_SUBTESTS : BINARY_SOME_SUBTESTS);
+	}
+
+	g_hash_table_destroy(subtests);
+	g_hash_table_destroy(binaries);
+
+	return first;
+}
+
+static void merge_totals(struct json_object *totals,
+			 struct json_object *partial)
+{
+	struct json_object_iter iter, resiter;
+
+	json_object_object_foreachC(partial, iter) {
+		struct json_object *total = get_totals_object(totals, iter.key);
+
+		json_object_object_foreachC(iter.val, resiter) {
+			struct json_object *old;
+
+			if (!json_object_object_get_ex(total, resiter.key, &old))
+				continue;
+
+			json_object_object_add(total, resiter.key,
+					       json_object_new_int(json_object_get_int(old) +
+								   json_object_get_int(resiter.val)));
+		}
+	}
+}
+
+static void merge_runtimes(struct json_object *runtimes,
+			   struct json_object *partial)
+{
+	struct json_object_iter iter;
+
+	json_object_object_foreachC(partial, iter) {
+		struct json_object *timeobj, *end;
+
+		if (!json_object_object_get_ex(iter.val, "time", &timeobj) ||
+		    !json_object_object_get_ex(timeobj, "end", &end))
+			continue;
+
+		add_runtime(get_or_create_json_object(runtimes, iter.key),
+			    json_object_get_double(end));
+	}
+}
+
+/*
+ * Writes a member of an object nested at the given level, formatted
+ * the same way as json-c pretty-prints it as part of the whole tree.
+ */
+static bool write_json_member(FILE *stream, int level,
+			      const char *key, struct json_object *val,
+			      bool first)
+{
+	struct json_object *keyobj = json_object_new_string(key);
+	const char *valstr = json_object_to_json_string_ext(val, JSON_C_TO_STRING_PRETTY);
+	const char *nl;
+
+	if (valstr == NULL) {
+		json_object_put(keyobj);
+		return false;
+	}
+
+	fprintf(stream, "%s\n%*s%s:", first ? "" : ",", 2 * level, "",
+		json_object_to_json_string(keyobj));
+	json_object_put(keyobj);
+
+	/* json-c escapes newlines in strings, these are all formatting */
+	while ((nl = strchr(valstr, '\n')) != NULL) {
+		fwrite(valstr, 1, nl - valstr, stream);
+		fprintf(stream, "\n%*s", 2 * level, "");
+		valstr = nl + 1;
+	}
+	fputs(valstr, stream);
+
+	return true;
+}
+
+static void remove_from_totals(struct json_object *totals,
+			       const char *name, const char *result)
+{
+	const char *at = strchr(name, '@');
+	const char *binary_end = at ? strchr(at + 1, '@') : NULL;
+	char *binary = strndup(name, binary_end ? binary_end - name : strlen(name));
+	const char *keys[] = { "", "root", binary };
+	size_t i;
+
+	for (i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		struct json_object *total, *numobj;
+
+		if (!json_object_object_get_ex(totals, keys[i], &total) ||
+		    !json_object_object_get_ex(total, result, &numobj))
+			continue;
+
+		json_object_object_add(total, result,
+				       json_object_new_int(json_object_get_int(numobj) - 1));
+	}
+
+	free(binary);
+}
+
+/*
+ * Multiple result directories with the same test only happen with a
+ * job list listing it multiple times. The last one wins, and only it
+ * is counted in the totals.
+ */
+static void hold_result(struct results_writer *writer,
+			const char *name, struct json_object *test)
+{
+	struct json_object *old, *resultobj;
+
+	if (json_object_object_get_ex(writer->results.tests, name, &old) &&
+	    json_object_object_get_ex(old, "result", &resultobj))
+		remove_from_totals(writer->results.totals, name,
+				   json_object_get_string(resultobj));
+
+	json_object_object_add(writer->results.tests, name,
+			       json_object_get(test));
+}
+
+static bool add_results(struct results_writer *writer,
+			struct results *partial, bool hold)
+{
+	struct json_object_iter iter;
+
+	merge_totals(writer->results.totals, partial->totals);
+	merge_runtimes(writer->results.runtimes, partial->runtimes);
+
+	json_object_object_foreachC(partial->tests, iter) {
+		if (hold || !writer->stream) {
+			hold_result(writer, iter.key, iter.val);
+			continue;
+		}
+
+		if (!write_json_member(writer->stream, 2, iter.key, iter.val,
+				       writer->tests_written == 0))
+			return false;
+
+		writer->tests_written++;
+	}
+
+	return true;
+}
+
+static bool write_held_results(struct results_writer *writer)
+{
+	struct json_object_iter iter;
+
+	json_object_object_foreachC(writer->results.tests, iter) {
+		if (!write_json_member(writer->stream, 2, iter.key, iter.val,
+				       writer->tests_written == 0))
+			return false;
+
+		writer->tests_written++;
+	}
+
+	return true;
+}
+
+static void add_aborted_result(int fd, struct results *results)
+{
+	char buf[4096];
+	char piglit_name[] = "igt@runner@aborted";
+	struct subtest_list abortsub = {};
+	struct json_object *aborttest = get_or_create_json_object(results->tests, piglit_name);
+	ssize_t s;
+
+	add_subtest(&abortsub, strdup("aborted"));
+
+	s = read(fd, buf, sizeof(buf));
+
+	json_object_object_add(aborttest, "out",
+			       new_escaped_json_string(buf, s));
+	json_object_object_add(aborttest, "err",
+			       json_object_new_string(""));
+	json_object_object_add(aborttest, "dmesg",
+			       json_object_new_string(""));
+	json_object_object_add(aborttest, "result",
+			       json_object_new_string("fail"));
+
+	add_to_totals("runner", &abortsub, results);
+
+	free_subtests(&abortsub);
+}
+
+static void print_out_of_memory_help(void)
+{
+	fprintf(stderr, "resultgen: Failed to create json representation of the results.\n");
+	fprintf(stderr, "           This usually means that the results are too big\n");
+	fprintf(stderr, "           to fit in the memory as the text representation\n");
+	fprintf(stderr, "           is being created.\n\n");
+	fprintf(stderr, "           Either something was spamming the logs or your\n");
+	fprintf(stderr, "           system is very low on free mem.\n");
+}
+
+/*
+ * Generates the results for the results directory. Without a stream,
+ * returns the complete results as a json object. With a stream, the
+ * results are written to it as they get parsed, and the returned
+ * object only holds the top level metadata.
+ */
+static struct json_object *__generate_results(int dirfd, FILE *stream)
 {
 	struct settings settings;
 	struct job_list job_list;
 	struct json_object *obj, *elapsed;
-	struct results results;
-	int testdirfd, fd;
+	struct results_writer writer = {};
+	struct parse_pool pool;
+	bool status = true;
+	int fd;
 	size_t i;
 
 	init_settings(&settings);
@@ -1599,7 +2163,25 @@ struct json_object *generate_results_json(int dirfd)
 	}
 	json_object_object_add(obj, "time_elapsed", elapsed);
 
-	create_result_root_nodes(obj, &results);
+	init_results(&writer.results);
+	writer.stream = stream;
+	writer.first_held = stream ? first_repeated_entry(&job_list) : 0;
+
+	if (stream) {
+		struct json_object_iter iter;
+		bool first = true;
+
+		fprintf(stream, "{");
+		json_object_object_foreachC(obj, iter) {
+			write_json_member(stream, 1, iter.key, iter.val, first);
+			first = false;
+		}
+		fprintf(stream, ",\n  \"tests\":{");
+	} else {
+		json_object_object_add(obj, "tests", json_object_get(writer.results.tests));
+		json_object_object_add(obj, "totals", json_object_get(writer.results.totals));
+		json_object_object_add(obj, "runtimes", json_object_get(writer.results.runtimes));
+	}
 
 	/*
 	 * Result fields that won't be added:
@@ -1614,62 +2196,65 @@ struct json_object *generate_results_json(int dirfd)
 	 * - options
 	 */
 
-	for (i = 0; i < job_list.size; i++) {
-		char name[16];
+	init_parse_pool(&pool, dirfd, &settings, &job_list);
 
-		snprintf(name, 16, "%zd", i);
-		if ((testdirfd = openat(dirfd, name, O_DIRECTORY | O_RDONLY)) < 0) {
-			try_add_notrun_results(&job_list.entries[i], &settings, &results);
-			continue;
-		}
+	for (i = 0; status && i < job_list.size; i++) {
+		struct parsed_entry *parsed = parse_pool_get(&pool, i);
 
-		if (!parse_test_directory(testdirfd, &job_list.entries[i], &settings, &results)) {
-			close(testdirfd);
-			return NULL;
-		}
-		close(testdirfd);
+		status = parsed->status &&
+			 add_results(&writer, &parsed->results,
+				     i >= writer.first_held);
+		parse_pool_put(&pool, i);
 	}
 
-	if ((fd = openat(dirfd, "aborted.txt", O_RDONLY)) >= 0) {
-		char buf[4096];
-		char piglit_name[] = "igt@runner@aborted";
-		struct subtest_list abortsub = {};
-		struct json_object *aborttest = get_or_create_json_object(results.tests, piglit_name);
-		ssize_t s;
+	fini_parse_pool(&pool);
 
-		add_subtest(&abortsub, strdup("aborted"));
+	if (status && (fd = openat(dirfd, "aborted.txt", O_RDONLY)) >= 0) {
+		struct results aborted;
 
-		s = read(fd, buf, sizeof(buf));
-
-		json_object_object_add(aborttest, "out",
-				       new_escaped_json_string(buf, s));
-		json_object_object_add(aborttest, "err",
-				       json_object_new_string(""));
-		json_object_object_add(aborttest, "dmesg",
-				       json_object_new_string(""));
-		json_object_object_add(aborttest, "result",
-				       json_object_new_string("fail"));
-
-		add_to_totals("runner", &abortsub, &results);
-
-		free_subtests(&abortsub);
+		init_results(&aborted);
+		add_aborted_result(fd, &aborted);
+		status = add_results(&writer, &aborted,
+				     writer.first_held < job_list.size);
+		free_results(&aborted);
 		close(fd);
 	}
 
+	if (status && stream) {
+		status = write_held_results(&writer);
+		fprintf(stream, "\n  },");
+		status = status &&
+			write_json_member(stream, 1, "totals", writer.results.totals, true) &&
+			write_json_member(stream, 1, "runtimes", writer.results.runtimes, false);
+		fprintf(stream, "\n}");
+	}
+
+	if (!status && stream)
+		print_out_of_memory_help();
+
+	free_results(&writer.results);
 	free_settings(&settings);
 	free_job_list(&job_list);
 
+	if (!status) {
+		json_object_put(obj);
+		return NULL;
+	}
+
 	return obj;
 }
 
+struct json_object *generate_results_json(int dirfd)
+{
+	return __generate_results(dirfd, NULL);
+}
+
 bool generate_results(int dirfd)
 {
-	struct json_object *obj = generate_results_json(dirfd);
-	const char *json_string;
+	struct json_object *obj;
 	int resultsfd;
-
-	if (obj == NULL)
-		return false;
+	FILE *stream;
+	bool status;
 
 	/* TODO: settings.overwrite */
 	if ((resultsfd = openat(dirfd, "results.json", O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
@@ -1677,23 +2262,25 @@ bool generate_results(int dirfd)
 		return false;
 	}
 
-	json_string = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
-
-	if (json_string == NULL) {
-		fprintf(stderr, "resultgen: Failed to create json representation of the results.\n");
-		fprintf(stderr, "           This usually means that the results are too big\n");
-		fprintf(stderr, "           to fit in the memory as the text representation\n");
-		fprintf(stderr, "           is being created.\n\n");
-		fprintf(stderr, "           Either something was spamming the logs or your\n");
-		fprintf(stderr, "           system is very low on free mem.\n");
-
+	stream = fdopen(resultsfd, "w");
+	if (!stream) {
 		close(resultsfd);
 		return false;
 	}
 
-	write(resultsfd, json_string, strlen(json_string));
-	close(resultsfd);
-	return true;
+	obj = __generate_results(dirfd, stream);
+	status = obj != NULL;
+	json_object_put(obj);
+
+	if (fclose(stream)) {
+		fprintf(stderr, "resultgen: Failed writing the results file: %s\n", strerror(errno));
+		status = false;
+	}
+
+	if (!status)
+		unlinkat(dirfd, "results.json", 0);
+
+	return status;
 }
 
 bool generate_results_path(char *resultspath)
@@ -0,0 +1,307 @@
+/*
+ * Benchmark for results.json generation.
+ *
+ * A large results directory is built by replicating the test
+ * directories of a json_tests_data fixture under new binary names,
+ * and results.json is then generated from it both the old way, by
+ * serially building the complete json object before writing it out,
+ * and by parsing in worker threads and streaming the results out.
+ * Each run happens in its own child process so that its peak RSS can
+ * be reported.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <json.h>
+
+#include "job_list.h"
+#include "resultgen.h"
+#include "settings.h"
+
+static const char *test_files[] = {
+	"journal.txt",
+	"out.txt",
+	"err.txt",
+	"dmesg.txt",
+};
+
+static const char *toplevel_files[] = {
+	"metadata.txt",
+	"uname.txt",
+	"starttime.txt",
+	"endtime.txt",
+};
+
+static char *read_file(int dirfd, const char *name, size_t *len)
+{
+	struct stat st;
+	char *buf;
+	int fd;
+
+	if ((fd = openat(dirfd, name, O_RDONLY)) < 0)
+		return NULL;
+
+	if (fstat(fd, &st) || (buf = malloc(st.st_size + 1)) == NULL) {
+		close(fd);
+		return NULL;
+	}
+
+	*len = read(fd, buf, st.st_size);
+	buf[*len] = '\0';
+	close(fd);
+
+	return buf;
+}
+
+static void write_renamed(int dirfd, const char *name,
+			  const char *buf, size_t len,
+			  const char *from, const char *to)
+{
+	FILE *f;
+	int fd;
+
+	if ((fd = openat(dirfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0 ||
+	    (f = fdopen(fd, "w")) == NULL) {
+		fprintf(stderr, "Cannot create %s: %s\n", name, strerror(errno));
+		exit(1);
+	}
+
+	while (from) {
+		const char *p = memmem(buf, len, from, strlen(from));
+
+		if (!p)
+			break;
+
+		fwrite(buf, 1, p - buf, f);
+		fputs(to, f);
+		len -= p - buf + strlen(from);
+		buf = p + strlen(from);
+	}
+	fwrite(buf, 1, len, f);
+
+	fclose(f);
+}
+
+static void copy_file(int srcfd, int dstfd, const char *name,
+		      const char *from, const char *to)
+{
+	size_t len;
+	char *buf = read_file(srcfd, name, &len);
+
+	if (!buf)
+		return;
+
+	write_renamed(dstfd, name, buf, len, from, to);
+	free(buf);
+}
+
+static size_t build_results_dir(const char *fixture, const char *path,
+				int copies)
+{
+	struct job_list job_list;
+	int srcfd, dstfd;
+	FILE *joblist;
+	size_t idx = 0;
+	size_t i, k;
+	int c;
+
+	init_job_list(&job_list);
+
+	if ((srcfd = open(fixture, O_DIRECTORY | O_RDONLY)) < 0 ||
+	    !read_job_list(&job_list, srcfd)) {
+		fprintf(stderr, "Cannot read fixture %s\n", fixture);
+		exit(1);
+	}
+
+	dstfd = open(path, O_DIRECTORY | O_RDONLY);
+	for (i = 0; i < sizeof(toplevel_files) / sizeof(toplevel_files[0]); i++)
+		copy_file(srcfd, dstfd, toplevel_files[i], NULL, NULL);
+
+	joblist = fdopen(openat(dstfd, "joblist.txt", O_WRONLY | O_CREAT | O_TRUNC, 0666), "w");
+
+	for (c = 0; c < copies; c++) {
+		for (i = 0; i < job_list.size; i++, idx++) {
+			struct job_list_entry *entry = &job_list.entries[i];
+			char name[16], srcname[16], binary[256];
+			int srctestfd, dsttestfd;
+
+			snprintf(binary, sizeof(binary), "%s%d", entry->binary, c);
+
+			fprintf(joblist, "%s", binary);
+			for (k = 0; k < entry->subtest_count; k++)
+				fprintf(joblist, "%c%s", k ? ',' : ' ', entry->subtests[k]);
+			fprintf(joblist, "\n");
+
+			snprintf(srcname, sizeof(srcname), "%zd", i);
+			if ((srctestfd = openat(srcfd, srcname, O_DIRECTORY | O_RDONLY)) < 0)
+				continue;
+
+			snprintf(name, sizeof(name), "%zd", idx);
+			mkdirat(dstfd, name, 0777);
+			dsttestfd = openat(dstfd, name, O_DIRECTORY | O_RDONLY);
+
+			for (k = 0; k < sizeof(test_files) / sizeof(test_files[0]); k++)
+				copy_file(srctestfd, dsttestfd, test_files[k],
+					  entry->binary, binary);
+
+			close(dsttestfd);
+			close(srctestfd);
+		}
+	}
+
+	fclose(joblist);
+	close(dstfd);
+	close(srcfd);
+	free_job_list(&job_list);
+
+	return idx;
+}
+
+static bool generate_in_memory(int dirfd)
+{
+	struct json_object *obj = generate_results_json(dirfd);
+	const char *json_string;
+	int fd;
+
+	if (obj == NULL)
+		return false;
+
+	json_string = json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PRETTY);
+	if (json_string == NULL)
+		return false;
+
+	fd = openat(dirfd, "results.json", O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	write(fd, json_string, strlen(json_string));
+	close(fd);
+
+	json_object_put(obj);
+
+	return true;
+}
+
+static void run(const char *path, const char *desc, bool streaming,
+		const char *threads)
+{
+	struct timespec start, end;
+	struct rusage usage;
+	int status;
+	pid_t pid;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pid = fork();
+	if (pid == 0) {
+		int dirfd = open(path, O_DIRECTORY | O_RDONLY);
+		bool ret;
+
+		setenv("IGT_WORKER_THREADS", threads, 1);
+
+		if (streaming)
+			ret = generate_results(dirfd);
+		else
+			ret = generate_in_memory(dirfd);
+
+		_exit(ret ? 0 : 1);
+	}
+
+	if (pid < 0 || wait4(pid, &status, 0, &usage) != pid ||
+	    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s: results generation failed\n", desc);
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("%-36s %8.3f s %10ld KiB\n", desc,
+	       (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9,
+	       usage.ru_maxrss);
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage: %s [options]\n"
+	       "  -f, --fixture <dir>   Results directory to replicate\n"
+	       "                        (default: %s/normal-run)\n"
+	       "  -n, --copies <n>      Number of copies of the fixture (default: 2000)\n"
+	       "  -t, --threads <n>     Worker threads for the streaming run\n"
+	       "                        (default: number of CPUs)\n"
+	       "  -k, --keep            Don't remove the generated directory\n",
+	       argv0, JSON_TESTS_DIRECTORY);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{"fixture", required_argument, NULL, 'f'},
+		{"copies", required_argument, NULL, 'n'},
+		{"threads", required_argument, NULL, 't'},
+		{"keep", no_argument, NULL, 'k'},
+		{"help", no_argument, NULL, 'h'},
+		{ 0, 0, 0, 0},
+	};
+	const char *fixture = JSON_TESTS_DIRECTORY "/normal-run";
+	char threads[16], desc[64];
+	char path[] = "/tmp/resultgen-benchmark-XXXXXX";
+	bool keep = false;
+	int copies = 2000;
+	size_t entries;
+	int c;
+
+	snprintf(threads, sizeof(threads), "%ld", sysconf(_SC_NPROCESSORS_ONLN));
+
+	while ((c = getopt_long(argc, argv, "f:n:t:kh", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'f':
+			fixture = optarg;
+			break;
+		case 'n':
+			copies = atoi(optarg);
+			break;
+		case 't':
+			snprintf(threads, sizeof(threads), "%d", atoi(optarg));
+			break;
+		case 'k':
+			keep = true;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (copies <= 0 || !mkdtemp(path)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	entries = build_results_dir(fixture, path, copies);
+	printf("%zd job list entries in %s\n\n", entries, path);
+
+	run(path, "serial, in-memory tree", false, "1");
+	run(path, "serial, streaming", true, "1");
+	snprintf(desc, sizeof(desc), "%s threads, streaming", threads);
+	run(path, desc, true, threads);
+
+	if (!keep) {
+		char cmd[64];
+
+		snprintf(cmd, sizeof(cmd), "rm -rf %s", path);
+		system(cmd);
+	}
+
+	return 0;
+}
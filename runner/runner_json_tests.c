@@ -167,6 +167,7 @@ static const char *dirnames[] = {
 	"unprintable-characters",
 	"empty-result-files",
 	"graceful-notrun",
+	"duplicate-results",
 };
 
 igt_main
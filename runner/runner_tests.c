@@ -28,10 +28,19 @@ static const char testdatadir[] = TESTDATA_DIRECTORY;
  * that test binaries without subtests should still be counted as one
  * for this macro.
  */
-#define NUM_TESTDATA_SUBTESTS 15
+#define NUM_TESTDATA_SUBTESTS 17
 #define NUM_TESTDATA_ABORT_SUBTESTS 9
 /* The total number of test binaries in runner/testdata/ */
-#define NUM_TESTDATA_BINARIES 8
+#define NUM_TESTDATA_BINARIES 9
+
+/*
+ * The test data is plain CPU work, except for the parallel peers
+ * pretending to need a device.
+ */
+static unsigned testdata_resources(const char *binary)
+{
+	return strcmp(binary, "parallel") ? RESOURCE_NONE : RESOURCE_DEVICE;
+}
 
 static const char *igt_get_result(struct json_object *tests, const char* testname)
 {
@@ -178,6 +187,8 @@ static void clear_directory(char *name)
 
 static void assert_settings_equal(struct settings *one, struct settings *two)
 {
+	size_t i;
+
 	/*
 	 * Regex lists are not serialized, and thus won't be compared
 	 * here.
@@ -198,6 +209,10 @@ static void assert_settings_equal(struct settings *one, struct settings *two)
 	igt_assert_eqstr(one->results_path, two->results_path);
 	igt_assert_eq(one->piglit_style_dmesg, two->piglit_style_dmesg);
 	igt_assert_eq(one->dmesg_warn_level, two->dmesg_warn_level);
+	igt_assert_eq(one->jobs, two->jobs);
+	igt_assert_eq(one->num_devices, two->num_devices);
+	for (i = 0; i < one->num_devices; i++)
+		igt_assert_eqstr(one->devices[i], two->devices[i]);
 }
 
 static void assert_job_list_equal(struct job_list *one, struct job_list *two)
@@ -290,6 +305,7 @@ igt_main
 
 		igt_assert(!settings->piglit_style_dmesg);
 		igt_assert_eq(settings->dmesg_warn_level, 4);
+		igt_assert_eq(settings->jobs, 1);
 	}
 
 	igt_subtest_group {
@@ -437,6 +453,9 @@ igt_main
 				       "--use-watchdog",
 				       "--piglit-style-dmesg",
 				       "--dmesg-warn-level=3",
+				       "--jobs", "4",
+				       "--device", "pci:card=0",
+				       "--device", "pci:card=1",
 				       "test-root-dir",
 				       "path-to-results",
 		};
@@ -472,6 +491,10 @@ igt_main
 
 		igt_assert(settings->piglit_style_dmesg);
 		igt_assert_eq(settings->dmesg_warn_level, 3);
+		igt_assert_eq(settings->jobs, 4);
+		igt_assert_eq(settings->num_devices, 2);
+		igt_assert_eqstr(settings->devices[0], "pci:card=0");
+		igt_assert_eqstr(settings->devices[1], "pci:card=1");
 	}
 	igt_subtest("parse-list-all") {
 		const char *argv[] = { "runner",
@@ -531,6 +554,31 @@ igt_main
 		igt_assert(!parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
 	}
 
+	igt_subtest("invalid-job-count") {
+		const char *argv[] = { "runner",
+				       "--jobs", "0",
+				       "test-root-dir",
+				       "results-path",
+		};
+
+		igt_assert(!parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+	}
+
+	igt_subtest("job-resources") {
+		igt_assert_eq(job_resources("igt_fork"), RESOURCE_NONE);
+		igt_assert_eq(job_resources("gem_exec_basic"), RESOURCE_DEVICE);
+		igt_assert_eq(job_resources("kms_flip"), RESOURCE_DEVICE | RESOURCE_DISPLAY);
+		igt_assert_eq(job_resources("i915_module_load"), RESOURCE_EXCLUSIVE);
+		igt_assert_eq(job_resources("i915_query"), RESOURCE_DEVICE);
+		igt_assert_eq(job_resources("fbdev"), RESOURCE_EXCLUSIVE);
+		igt_assert_eq(job_resources("successtest"), RESOURCE_EXCLUSIVE);
+
+		job_resources_hook = testdata_resources;
+		igt_assert_eq(job_resources("successtest"), RESOURCE_NONE);
+		igt_assert_eq(job_resources("parallel"), RESOURCE_DEVICE);
+		job_resources_hook = NULL;
+	}
+
 	igt_subtest("paths-missing") {
 		const char *argv[] = { "runner",
 				       "-o",
@@ -882,6 +930,9 @@ igt_main
 					       "--overall-timeout", "360",
 					       "--use-watchdog",
 					       "--piglit-style-dmesg",
+					       "-j", "3",
+					       "--device", "pci:card=0",
+					       "--device", "pci:card=1",
 					       testdatadir,
 					       dirname,
 			};
@@ -1327,6 +1378,124 @@ igt_main
 			free(list);
 	}
 
+	igt_subtest_group {
+		struct job_list *list = malloc(sizeof(*list));
+		volatile int dirfd = -1, subdirfd = -1, fd = -1;
+		char dirname[] = "tmpdirXXXXXX";
+
+		igt_fixture {
+			init_job_list(list);
+			igt_require(mkdtemp(dirname) != NULL);
+			rmdir(dirname);
+		}
+
+		igt_subtest("execute-parallel") {
+			struct execute_state state;
+			struct json_object *results, *tests;
+			const char *argv[] = { "runner",
+					       "--jobs", "4",
+					       "--device", "pci:card=0",
+					       "--device", "pci:card=1",
+					       "-t", "successtest",
+					       "-t", "parallel",
+					       testdatadir,
+					       dirname,
+			};
+			char testdirname[16], first[32] = {}, second[32] = {};
+			size_t i;
+
+			job_resources_hook = testdata_resources;
+
+			igt_assert(parse_options(ARRAY_SIZE(argv), (char**)argv, settings));
+			igt_assert(create_job_list(list, settings));
+			igt_assert_eq(list->size, 4);
+			igt_assert(initialize_execute_state(&state, settings, list));
+
+			/*
+			 * The parallel subtests only pass when run side by
+			 * side, which they can only do on different devices.
+			 */
+			setenv("IGT_RUNNER_PARALLEL_DIR", dirname, 1);
+			igt_assert(execute(&state, settings, list));
+			unsetenv("IGT_RUNNER_PARALLEL_DIR");
+
+			igt_assert_eq(state.next, list->size);
+			igt_assert_f((dirfd = open(dirname, O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Execute didn't create the results directory\n");
+
+			for (i = 0; i < list->size; i++) {
+				snprintf(testdirname, 16, "%zd", i);
+
+				igt_assert_f((subdirfd = openat(dirfd, testdirname, O_DIRECTORY | O_RDONLY)) >= 0,
+					     "Execute didn't create result directory '%s'\n", testdirname);
+				assert_execution_results_exist(subdirfd);
+				close(subdirfd);
+				subdirfd = -1;
+			}
+
+			igt_assert_f((fd = openat(dirfd, "endtime.txt", O_RDONLY)) >= 0,
+				     "Execute didn't create endtime.txt\n");
+
+			igt_assert_f((results = generate_results_json(dirfd)) != NULL,
+				     "Results parsing failed\n");
+			igt_assert(json_object_object_get_ex(results, "tests", &tests));
+			igt_assert_eqstr(igt_get_result(tests, "igt@parallel@first-peer"), "pass");
+			igt_assert_eqstr(igt_get_result(tests, "igt@parallel@second-peer"), "pass");
+			igt_assert_eq(json_object_put(results), 1);
+
+			/* Each peer wrote the IGT_DEVICE it got */
+			close(fd);
+			igt_assert((fd = openat(dirfd, "first-peer", O_RDONLY)) >= 0);
+			igt_assert_lt(0, read(fd, first, sizeof(first) - 1));
+			close(fd);
+			igt_assert((fd = openat(dirfd, "second-peer", O_RDONLY)) >= 0);
+			igt_assert_lt(0, read(fd, second, sizeof(second) - 1));
+			close(fd);
+			fd = -1;
+			igt_assert(!strcmp(first, "pci:card=0") || !strcmp(first, "pci:card=1"));
+			igt_assert(!strcmp(second, "pci:card=0") || !strcmp(second, "pci:card=1"));
+			igt_assert_neq(strcmp(first, second), 0);
+
+			/* Everything done already, resuming runs nothing */
+			igt_assert(initialize_execute_state_from_resume(dup(dirfd), &state, settings, list));
+			for (i = 0; i < list->size; i++)
+				igt_assert_eq(list->entries[i].binary[0], '\0');
+
+			/*
+			 * An entry waiting for its resources lets later ones
+			 * start ahead of it. Make it look like the first
+			 * entry never started while the later ones finished:
+			 * resuming only executes the first one again.
+			 */
+			clear_directory_fd(openat(dirfd, "0", O_DIRECTORY | O_RDONLY));
+			igt_assert_eq(unlinkat(dirfd, "0", AT_REMOVEDIR), 0);
+
+			igt_assert(initialize_execute_state_from_resume(dup(dirfd), &state, settings, list));
+			igt_assert_eqstr(list->entries[0].binary, "successtest");
+			for (i = 1; i < list->size; i++)
+				igt_assert_eq(list->entries[i].binary[0], '\0');
+
+			igt_assert(execute(&state, settings, list));
+			igt_assert_f((subdirfd = openat(dirfd, "0", O_DIRECTORY | O_RDONLY)) >= 0,
+				     "Resuming didn't execute the unstarted entry\n");
+			assert_execution_results_exist(subdirfd);
+
+			igt_assert(initialize_execute_state_from_resume(dup(dirfd), &state, settings, list));
+			for (i = 0; i < list->size; i++)
+				igt_assert_eq(list->entries[i].binary[0], '\0');
+		}
+
+		igt_fixture {
+			job_resources_hook = NULL;
+			close(fd);
+			close(subdirfd);
+			close(dirfd);
+			clear_directory(dirname);
+			free_job_list(list);
+			free(list);
+		}
+	}
+
 	igt_subtest_group {
 		igt_subtest("metadata-read-old-style-infer-dmesg-warn-piglit-style") {
 			char metadata[] = "piglit_style_dmesg : 1\n";
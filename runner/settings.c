@@ -24,6 +24,7 @@ enum {
 	OPT_DMESG_WARN_LEVEL,
 	OPT_OVERALL_TIMEOUT,
 	OPT_PER_TEST_TIMEOUT,
+	OPT_DEVICE,
 	OPT_VERSION,
 	OPT_HELP = 'h',
 	OPT_NAME = 'n',
@@ -38,6 +39,7 @@ enum {
 	OPT_WATCHDOG = 'g',
 	OPT_BLACKLIST = 'b',
 	OPT_LIST_ALL = 'L',
+	OPT_JOBS = 'j',
 };
 
 static struct {
@@ -238,11 +240,31 @@ static const char *usage_str =
 	"                        Exclude all test matching to regexes from FILENAME\n"
 	"                        (can be used more than once)\n"
 	"  -L, --list-all        List all matching subtests instead of running\n"
+	"  -j <N>, --jobs <N>    Execute up to N test binaries concurrently. Binaries\n"
+	"                        are only run side by side when the resources they\n"
+	"                        need (DRM device, display, or the whole machine) do\n"
+	"                        not overlap. Binaries not known to be safe to run\n"
+	"                        alongside others are always run alone. Kernel\n"
+	"                        messages are then only captured for the binaries\n"
+	"                        using a DRM device or the whole machine.\n"
+	"                        Defaults to 1.\n"
+	"  --device <filter>     A DRM device to execute tests on, as a device filter\n"
+	"                        passed to the tests in IGT_DEVICE. Can be used more\n"
+	"                        than once: with --jobs, binaries needing a device\n"
+	"                        run side by side on different devices, while those\n"
+	"                        run alone use the first one.\n"
 	"  [test_root]           Directory that contains the IGT tests. The environment\n"
 	"                        variable IGT_TEST_ROOT will be used if set, overriding\n"
 	"                        this option if given.\n"
 	;
 
+static void add_device(struct settings *settings, char *filter)
+{
+	settings->devices = realloc(settings->devices,
+				    (settings->num_devices + 1) * sizeof(*settings->devices));
+	settings->devices[settings->num_devices++] = filter;
+}
+
 static void usage(const char *extra_message, FILE *f)
 {
 	if (extra_message)
@@ -359,11 +381,17 @@ void init_settings(struct settings *settings)
 
 void free_settings(struct settings *settings)
 {
+	size_t i;
+
 	free(settings->test_list);
 	free(settings->name);
 	free(settings->test_root);
 	free(settings->results_path);
 
+	for (i = 0; i < settings->num_devices; i++)
+		free(settings->devices[i]);
+	free(settings->devices);
+
 	free_regexes(&settings->include_regexes);
 	free_regexes(&settings->exclude_regexes);
 
@@ -399,6 +427,8 @@ bool parse_options(int argc, char **argv,
 		{"dmesg-warn-level", required_argument, NULL, OPT_DMESG_WARN_LEVEL},
 		{"blacklist", required_argument, NULL, OPT_BLACKLIST},
 		{"list-all", no_argument, NULL, OPT_LIST_ALL},
+		{"jobs", required_argument, NULL, OPT_JOBS},
+		{"device", required_argument, NULL, OPT_DEVICE},
 		{ 0, 0, 0, 0},
 	};
 
@@ -407,8 +437,9 @@ bool parse_options(int argc, char **argv,
 	optind = 1;
 
 	settings->dmesg_warn_level = -1;
+	settings->jobs = 1;
 
-	while ((c = getopt_long(argc, argv, "hn:dt:x:sl:omb:L",
+	while ((c = getopt_long(argc, argv, "hn:dt:x:sl:omb:Lj:",
 				long_options, NULL)) != -1) {
 		switch (c) {
 		case OPT_VERSION:
@@ -490,6 +521,16 @@ bool parse_options(int argc, char **argv,
 		case OPT_LIST_ALL:
 			settings->list_all = true;
 			break;
+		case OPT_JOBS:
+			settings->jobs = atoi(optarg);
+			if (settings->jobs <= 0) {
+				usage("Cannot parse job count", stderr);
+				goto error;
+			}
+			break;
+		case OPT_DEVICE:
+			add_device(settings, strdup(optarg));
+			break;
 		case '?':
 			usage(NULL, stderr);
 			goto error;
@@ -641,6 +682,7 @@ bool serialize_settings(struct settings *settings)
 
 	int dirfd, fd;
 	FILE *f;
+	size_t i;
 
 	if (!settings->results_path) {
 		usage("No results-path set; this shouldn't happen", stderr);
@@ -703,6 +745,9 @@ bool serialize_settings(struct settings *settings)
 	SERIALIZE_LINE(f, settings, use_watchdog, "%d");
 	SERIALIZE_LINE(f, settings, piglit_style_dmesg, "%d");
 	SERIALIZE_LINE(f, settings, dmesg_warn_level, "%d");
+	SERIALIZE_LINE(f, settings, jobs, "%d");
+	for (i = 0; i < settings->num_devices; i++)
+		fprintf(f, "device : %s\n", settings->devices[i]);
 	SERIALIZE_LINE(f, settings, test_root, "%s");
 	SERIALIZE_LINE(f, settings, results_path, "%s");
 
@@ -750,6 +795,15 @@ bool read_settings_from_file(struct settings *settings, FILE *f)
 		PARSE_LINE(settings, name, val, use_watchdog, numval);
 		PARSE_LINE(settings, name, val, piglit_style_dmesg, numval);
 		PARSE_LINE(settings, name, val, dmesg_warn_level, numval);
+		PARSE_LINE(settings, name, val, jobs, numval);
+
+		if (!strcmp(name, "device")) {
+			add_device(settings, val);
+			free(name);
+			name = val = NULL;
+			continue;
+		}
+
 		PARSE_LINE(settings, name, val, test_root, val ? strdup(val) : NULL);
 		PARSE_LINE(settings, name, val, results_path, val ? strdup(val) : NULL);
 
@@ -760,6 +814,10 @@ bool read_settings_from_file(struct settings *settings, FILE *f)
 		name = val = NULL;
 	}
 
+	/* Metadata from before --jobs existed means serial execution */
+	if (settings->jobs <= 0)
+		settings->jobs = 1;
+
 	if (settings->dmesg_warn_level < 0) {
 		if (settings->piglit_style_dmesg)
 			settings->dmesg_warn_level = 5;
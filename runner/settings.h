@@ -47,6 +47,9 @@ struct settings {
 	bool piglit_style_dmesg;
 	int dmesg_warn_level;
 	bool list_all;
+	int jobs;
+	char **devices;
+	size_t num_devices;
 };
 
 /**
@@ -0,0 +1,47 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "igt.h"
+
+/*
+ * Each subtest waits for the other one to be running, so they only pass
+ * when executed at the same time. They meet in the directory named by
+ * IGT_RUNNER_PARALLEL_DIR, and skip without it. The file each one
+ * leaves there holds the IGT_DEVICE it was executed with.
+ */
+static void meet(const char *self, const char *peer)
+{
+	const char *dir = getenv("IGT_RUNNER_PARALLEL_DIR");
+	const char *device = getenv("IGT_DEVICE") ?: "";
+	char path[PATH_MAX];
+	int fd;
+
+	igt_require(dir);
+
+	snprintf(path, sizeof(path), "%s/%s", dir, self);
+	fd = open(path, O_CREAT | O_WRONLY, 0666);
+	igt_assert_lte(0, fd);
+	igt_assert_eq(write(fd, device, strlen(device)), strlen(device));
+	close(fd);
+
+	snprintf(path, sizeof(path), "%s/%s", dir, peer);
+	igt_until_timeout(10) {
+		if (!access(path, F_OK))
+			return;
+		usleep(1000);
+	}
+
+	igt_assert_f(false, "%s did not run alongside\n", peer);
+}
+
+igt_main
+{
+	igt_subtest("first-peer")
+		meet("first-peer", "second-peer");
+
+	igt_subtest("second-peer")
+		meet("second-peer", "first-peer");
+}
@@ -1503,10 +1503,10 @@ audio_output_frequencies_callback(void *data, void *buffer, int samples)
 static bool test_audio_frequencies(struct audio_state *state)
 {
 	int freq, step;
-	int32_t *recv, *buf;
-	double *channel;
+	int32_t *recv;
+	struct audio_signal_detector **detectors;
 	size_t i, j, streak;
-	size_t recv_len, buf_len, buf_cap, channel_len;
+	size_t recv_len, frames;
 	bool success;
 	int capture_chan;
 
@@ -1554,12 +1554,13 @@ static bool test_audio_frequencies(struct audio_state *state)
 	 * sines. For lower sampling rates, the capture duration will be
 	 * longer.
 	 */
-	channel_len = CAPTURE_SAMPLES;
-	channel = malloc(sizeof(double) * channel_len);
+	detectors = calloc(state->playback.channels, sizeof(*detectors));
+	for (j = 0; j < state->playback.channels; j++)
+		detectors[j] = audio_signal_detector_init(state->signal,
+							  state->capture.rate,
+							  j, CAPTURE_SAMPLES);
 
-	buf_cap = state->capture.channels * channel_len;
-	buf = malloc(sizeof(int32_t) * buf_cap);
-	buf_len = 0;
+	frames = 0;
 
 	recv = NULL;
 	recv_len = 0;
@@ -1569,35 +1570,37 @@ static bool test_audio_frequencies(struct audio_state *state)
 	while (!success && state->msec < AUDIO_TIMEOUT) {
 		audio_state_receive(state, &recv, &recv_len);
 
-		memcpy(&buf[buf_len], recv, recv_len * sizeof(int32_t));
-		buf_len += recv_len;
+		/* The detectors only keep what they need of the capture */
+		for (j = 0; j < state->playback.channels; j++) {
+			capture_chan = state->channel_mapping[j];
+			igt_assert(capture_chan >= 0);
+
+			audio_signal_detector_feed_s32_le(detectors[j],
+							  recv, recv_len,
+							  state->capture.channels,
+							  capture_chan);
+		}
+		frames += recv_len / state->capture.channels;
 
-		if (buf_len < buf_cap)
+		if (frames < CAPTURE_SAMPLES)
 			continue;
-		igt_assert(buf_len == buf_cap);
+		igt_assert(frames == CAPTURE_SAMPLES);
 
 		igt_debug("Detecting audio signal, t=%d msec\n", state->msec);
 
 		for (j = 0; j < state->playback.channels; j++) {
-			capture_chan = state->channel_mapping[j];
-			igt_assert(capture_chan >= 0);
 			igt_debug("Processing channel %zu (captured as "
-				  "channel %d)\n", j, capture_chan);
+				  "channel %d)\n", j, state->channel_mapping[j]);
 
-			audio_extract_channel_s32_le(channel, channel_len,
-						     buf, buf_len,
-						     state->capture.channels,
-						     capture_chan);
-
-			if (audio_signal_detect(state->signal,
-						state->capture.rate, j,
-						channel, channel_len))
+			if (audio_signal_detector_check(detectors[j]))
 				streak++;
 			else
 				streak = 0;
+
+			audio_signal_detector_reset(detectors[j]);
 		}
 
-		buf_len = 0;
+		frames = 0;
 
 		success = streak == MIN_STREAK * state->playback.channels;
 	}
@@ -1605,8 +1608,9 @@ static bool test_audio_frequencies(struct audio_state *state)
 	audio_state_stop(state, success);
 
 	free(recv);
-	free(buf);
-	free(channel);
+	for (j = 0; j < state->playback.channels; j++)
+		audio_signal_detector_fini(detectors[j]);
+	free(detectors);
 	audio_signal_fini(state->signal);
 
 	check_audio_infoframe(state);
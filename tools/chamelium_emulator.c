@@ -0,0 +1,166 @@
+/*
+ * Copyright © 2021 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ */
+
+#include "config.h"
+
+#include <getopt.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "igt_chamelium_emulator.h"
+
+static void __attribute__((noreturn)) usage(const char *prog, int status)
+{
+	printf("Usage: %s [options]\n"
+	       "Serves the Chamelium XML-RPC and stream protocols locally, until interrupted.\n\n"
+	       "Options:\n"
+	       "  -l, --listen=ADDRESS   IPv4 address to listen on (default 127.0.0.1)\n"
+	       "  -p, --rpc-port=PORT    XML-RPC port, 0 for any (default %d)\n"
+	       "  -P, --stream-port=PORT stream port, 0 for any (default %d)\n"
+	       "  -s, --size=WxH         size of the virtual display (default 1920x1080)\n"
+	       "  -f, --frame=PNG        frame to show, may be repeated to show them in turn\n"
+	       "  -a, --audio=RAW        S32_LE audio to play on the DP and HDMI ports\n"
+	       "  -r, --rate=HZ          sampling rate of the audio (default 48000)\n"
+	       "  -c, --channels=N       channels of the audio (default 2)\n"
+	       "  -n, --no-frame-stream  read frames over XML-RPC only, like older boards\n"
+	       "  -h, --help             show this help\n",
+	       prog, CHAMELIUM_EMULATOR_RPC_PORT, CHAMELIUM_EMULATOR_STREAM_PORT);
+
+	exit(status);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{ "listen", required_argument, NULL, 'l' },
+		{ "rpc-port", required_argument, NULL, 'p' },
+		{ "stream-port", required_argument, NULL, 'P' },
+		{ "size", required_argument, NULL, 's' },
+		{ "frame", required_argument, NULL, 'f' },
+		{ "audio", required_argument, NULL, 'a' },
+		{ "rate", required_argument, NULL, 'r' },
+		{ "channels", required_argument, NULL, 'c' },
+		{ "no-frame-stream", no_argument, NULL, 'n' },
+		{ "help", no_argument, NULL, 'h' },
+		{ }
+	};
+	unsigned int rpc_port = CHAMELIUM_EMULATOR_RPC_PORT;
+	unsigned int stream_port = CHAMELIUM_EMULATOR_STREAM_PORT;
+	const char *address = "127.0.0.1", *audio = NULL;
+	int width = 1920, height = 1080, rate = 48000, channels = 2;
+	bool frame_stream = true;
+	const char **frames = NULL;
+	int frame_count = 0;
+	struct chamelium_emulator *emu;
+	sigset_t signals;
+	int c, sig;
+
+	while ((c = getopt_long(argc, argv, "l:p:P:s:f:a:r:c:nh",
+				long_options, NULL)) != -1) {
+		switch (c) {
+		case 'l':
+			address = optarg;
+			break;
+		case 'p':
+			rpc_port = atoi(optarg);
+			break;
+		case 'P':
+			stream_port = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &width, &height) != 2 ||
+			    width <= 0 || height <= 0) {
+				fprintf(stderr, "Invalid size %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'f':
+			frames = realloc(frames,
+					 (frame_count + 1) * sizeof(*frames));
+			if (!frames)
+				return EXIT_FAILURE;
+			frames[frame_count++] = optarg;
+			break;
+		case 'a':
+			audio = optarg;
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'c':
+			channels = atoi(optarg);
+			break;
+		case 'n':
+			frame_stream = false;
+			break;
+		case 'h':
+			usage(argv[0], EXIT_SUCCESS);
+		default:
+			usage(argv[0], EXIT_FAILURE);
+		}
+	}
+
+	if (rate <= 0 || channels <= 0 || channels > 8) {
+		fprintf(stderr, "Invalid audio rate or channel count\n");
+		return EXIT_FAILURE;
+	}
+
+	emu = chamelium_emulator_create(width, height);
+
+	for (int i = 0; i < frame_count; i++)
+		if (!chamelium_emulator_add_frame_png(emu, frames[i]))
+			return EXIT_FAILURE;
+	free(frames);
+
+	if (audio && !chamelium_emulator_set_audio(emu, audio, rate, channels))
+		return EXIT_FAILURE;
+
+	chamelium_emulator_set_frame_streaming(emu, frame_stream);
+
+	/* Blocked before starting, so that only sigwait() gets them */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &signals, NULL);
+
+	if (!chamelium_emulator_start(emu, address, rpc_port, stream_port)) {
+		fprintf(stderr, "Failed to start the Chamelium emulator\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("[Chamelium]\n"
+	       "URL=http://%s:%u\n"
+	       "StreamPort=%u\n",
+	       address, chamelium_emulator_get_rpc_port(emu),
+	       chamelium_emulator_get_stream_port(emu));
+	fflush(stdout);
+
+	sigwait(&signals, &sig);
+
+	chamelium_emulator_destroy(emu);
+
+	return EXIT_SUCCESS;
+}
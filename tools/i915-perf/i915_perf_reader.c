@@ -48,9 +48,12 @@ static void
 usage(void)
 {
 	printf("Usage: i915-perf-reader [options] file\n"
-	       "Reads the content of an i915-perf recording.\n"
+	       "Reads the content of an i915-perf recording, use '-' to read\n"
+	       "from the standard input.\n"
 	       "\n"
 	       "     --help,    -h             Print this screen\n"
+	       "     --stream,  -s             Read the recording incrementally, implied\n"
+	       "                               for pipes.\n"
 	       "     --counters, -c c1,c2,...  List of counters to display values for.\n"
 	       "                               Use 'all' to display all counters.\n"
 	       "                               Use 'list' to list available counters.\n");
@@ -165,22 +168,131 @@ get_logical_counters(struct intel_perf_metric_set *metric_set,
 	return counters;
 }
 
+static void
+print_timeline_item(struct intel_perf *perf,
+		    struct intel_perf_metric_set *metric_set,
+		    struct intel_perf_logical_counter **counters,
+		    int32_t n_counters,
+		    const struct intel_perf_timeline_item *item,
+		    struct intel_perf_accumulator *accu)
+{
+	fprintf(stdout, "Time: CPU=0x%016" PRIx64 "-0x%016" PRIx64
+		" GPU=0x%016" PRIx64 "-0x%016" PRIx64"\n",
+		item->cpu_ts_start, item->cpu_ts_end,
+		item->ts_start, item->ts_end);
+	fprintf(stdout, "hw_id=0x%x %s\n",
+		item->hw_id, item->hw_id == 0xffffffff ? "(idle)" : "");
+
+	for (uint32_t c = 0; c < n_counters; c++) {
+		struct intel_perf_logical_counter *counter = counters[c];
+
+		switch (counter->storage) {
+		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT64:
+		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT32:
+		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_BOOL32:
+			fprintf(stdout, "   %s: %" PRIu64 "\n",
+				counter->symbol_name, counter->read_uint64(perf,
+									   metric_set,
+									   accu->deltas));
+			break;
+		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE:
+		case INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT:
+			fprintf(stdout, "   %s: %f\n",
+				counter->symbol_name, counter->read_float(perf,
+									  metric_set,
+									  accu->deltas));
+			break;
+		}
+	}
+}
+
+static void
+print_device(const struct intel_perf_devinfo *devinfo,
+	     const struct intel_perf_metric_set *metric_set)
+{
+	const struct intel_device_info *info = intel_get_device_info(devinfo->devid);
+
+	fprintf(stdout, "Recorded on device=0x%x(%s) graphics_ver=%i\n",
+		devinfo->devid, info->codename, devinfo->graphics_ver);
+	fprintf(stdout, "Metric used : %s (%s) uuid=%s\n",
+		metric_set->symbol_name, metric_set->name,
+		metric_set->hw_config_guid);
+}
+
+/* Prints the timeline items as they come, the totals are only known at
+ * the end.
+ */
+static int
+read_stream(int fd, const char *name, const char *counter_names)
+{
+	struct intel_perf_data_stream stream;
+	struct intel_perf_logical_counter **counters = NULL;
+	struct intel_perf_timeline_item item;
+	struct intel_perf_accumulator accu;
+	int32_t n_counters;
+	int ret = EXIT_FAILURE;
+
+	if (!intel_perf_data_stream_init(&stream, fd)) {
+		fprintf(stderr, "Unable to parse '%s': %s.\n",
+			name, stream.error_msg);
+		goto exit;
+	}
+
+	counters = get_logical_counters(stream.metric_set, counter_names, &n_counters);
+	if (n_counters < 0) {
+		ret = EXIT_SUCCESS;
+		goto exit;
+	}
+
+	print_device(&stream.devinfo, stream.metric_set);
+
+	if (strcmp(stream.metric_set_uuid, stream.metric_set->hw_config_guid)) {
+		fprintf(stdout,
+			"WARNING: Recording used a different HW configuration.\n"
+			"WARNING: This could lead to inconsistent counter values.\n");
+	}
+
+	while (intel_perf_data_stream_next(&stream, &item, &accu))
+		print_timeline_item(stream.perf, stream.metric_set,
+				    counters, n_counters, &item, &accu);
+
+	if (stream.error_msg[0]) {
+		fprintf(stderr, "Unable to parse '%s': %s.\n",
+			name, stream.error_msg);
+		goto exit;
+	}
+
+	fprintf(stdout, "Reports: %u\n", stream.n_records);
+	fprintf(stdout, "Context switches: %u\n", stream.n_timelines);
+	fprintf(stdout, "Timestamp correlation points: %u\n", stream.n_correlations);
+
+	ret = EXIT_SUCCESS;
+
+ exit:
+	free(counters);
+	intel_perf_data_stream_fini(&stream);
+
+	return ret;
+}
+
 int
 main(int argc, char *argv[])
 {
 	const struct option long_options[] = {
 		{"help",             no_argument, 0, 'h'},
 		{"counters",   required_argument, 0, 'c'},
+		{"stream",           no_argument, 0, 's'},
 		{0, 0, 0, 0}
 	};
 	struct intel_perf_data_reader reader;
 	struct intel_perf_logical_counter **counters;
-	const struct intel_device_info *devinfo;
 	const char *counter_names = NULL;
+	bool stream = false;
 	int32_t n_counters;
-	int fd, opt;
+	struct stat st;
+	int fd, opt, ret;
 
-	while ((opt = getopt_long(argc, argv, "hc:", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "hc:s", long_options, NULL)) != -1) {
 		switch (opt) {
 		case 'h':
 			usage();
@@ -188,6 +300,9 @@ main(int argc, char *argv[])
 		case 'c':
 			counter_names = optarg;
 			break;
+		case 's':
+			stream = true;
+			break;
 		default:
 			fprintf(stderr, "Internal error: "
 				"unexpected getopt value: %d\n", opt);
@@ -201,13 +316,23 @@ main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	fd = open(argv[optind], 0, O_RDONLY);
+	if (!strcmp(argv[optind], "-"))
+		fd = dup(STDIN_FILENO);
+	else
+		fd = open(argv[optind], 0, O_RDONLY);
 	if (fd < 0) {
 		fprintf(stderr, "Cannot open '%s': %s.\n",
 			argv[optind], strerror(errno));
 		return EXIT_FAILURE;
 	}
 
+	/* Pipes can't be mapped */
+	if (stream || fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+		ret = read_stream(fd, argv[optind], counter_names);
+		close(fd);
+		return ret;
+	}
+
 	if (!intel_perf_data_reader_init(&reader, fd)) {
 		fprintf(stderr, "Unable to parse '%s': %s.\n",
 			argv[optind], reader.error_msg);
@@ -218,14 +343,7 @@ main(int argc, char *argv[])
 	if (n_counters < 0)
 		goto exit;
 
-	devinfo = intel_get_device_info(reader.devinfo.devid);
-
-	fprintf(stdout, "Recorded on device=0x%x(%s) graphics_ver=%i\n",
-		reader.devinfo.devid, devinfo->codename,
-		reader.devinfo.graphics_ver);
-	fprintf(stdout, "Metric used : %s (%s) uuid=%s\n",
-		reader.metric_set->symbol_name, reader.metric_set->name,
-		reader.metric_set->hw_config_guid);
+	print_device(&reader.devinfo, reader.metric_set);
 	fprintf(stdout, "Reports: %u\n", reader.n_records);
 	fprintf(stdout, "Context switches: %u\n", reader.n_timelines);
 	fprintf(stdout, "Timestamp correlation points: %u\n", reader.n_correlations);
@@ -238,43 +356,19 @@ main(int argc, char *argv[])
 
 	for (uint32_t i = 0; i < reader.n_timelines; i++) {
 		const struct intel_perf_timeline_item *item = &reader.timelines[i];
-		const struct drm_i915_perf_record_header *i915_report0 =
-			reader.records[item->record_start];
-		const struct drm_i915_perf_record_header *i915_report1 =
-			reader.records[item->record_end];
 		struct intel_perf_accumulator accu;
 
-		fprintf(stdout, "Time: CPU=0x%016" PRIx64 "-0x%016" PRIx64
-			" GPU=0x%016" PRIx64 "-0x%016" PRIx64"\n",
-			item->cpu_ts_start, item->cpu_ts_end,
-			item->ts_start, item->ts_end);
-		fprintf(stdout, "hw_id=0x%x %s\n",
-			item->hw_id, item->hw_id == 0xffffffff ? "(idle)" : "");
-
-		intel_perf_accumulate_reports(&accu, reader.metric_set->perf_oa_format,
-					      i915_report0, i915_report1);
-
-		for (uint32_t c = 0; c < n_counters; c++) {
-			struct intel_perf_logical_counter *counter = counters[c];
-
-			switch (counter->storage) {
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT64:
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_UINT32:
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_BOOL32:
-				fprintf(stdout, "   %s: %" PRIu64 "\n",
-					counter->symbol_name, counter->read_uint64(reader.perf,
-										   reader.metric_set,
-										   accu.deltas));
-				break;
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_DOUBLE:
-			case INTEL_PERF_LOGICAL_COUNTER_STORAGE_FLOAT:
-				fprintf(stdout, "   %s: %f\n",
-					counter->symbol_name, counter->read_float(reader.perf,
-										  reader.metric_set,
-										  accu.deltas));
-				break;
-			}
-		}
+		/*
+		 * Sum the deltas of every consecutive pair of reports, so
+		 * counters wrapping more than once within a timeline item
+		 * are still accounted for.
+		 */
+		intel_perf_accumulate_reports_batch(&accu, reader.metric_set->perf_oa_format,
+						    &reader.records[item->record_start],
+						    item->record_end - item->record_start + 1);
+
+		print_timeline_item(reader.perf, reader.metric_set,
+				    counters, n_counters, item, &accu);
 	}
 
  exit:
@@ -734,6 +734,7 @@ usage(const char *name)
 		"     --command-fifo,       -f <path>   Path to a command fifo, implies circular buffer\n"
 		"                                       (To use with i915-perf-control)\n"
 		"     --output,             -o <path>   Output file (default = i915_perf.record)\n"
+		"                                       Use '-' to write to the standard output\n"
 		"     --cpu-clock,          -k <path>   Cpu clock to use for correlations\n"
 		"                                       Values: boot, mono, mono_raw (default = mono)\n"
 		"     --poll-period         -P <value>  Polling interval in microseconds used by a timer in the driver to query\n"
@@ -973,7 +974,13 @@ main(int argc, char *argv[])
 			"Recoding in internal circular buffer.\n"
 			"Use i915-perf-control to snapshot into file.\n");
 	} else {
-		output = fopen(output_file, "w+");
+		if (!strcmp(output_file, "-")) {
+			/* Keep our messages out of the recording */
+			output = fdopen(dup(STDOUT_FILENO), "w");
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		} else {
+			output = fopen(output_file, "w+");
+		}
 		if (!output) {
 			fprintf(stderr, "Unable to open output file '%s'\n",
 				output_file);
@@ -1057,6 +1064,10 @@ main(int argc, char *argv[])
 		} else {
 			poll_time_ns -= elapsed_ns;
 		}
+
+		/* Let a reader on the other end of a pipe follow along */
+		if (output)
+			fflush(output);
 	}
 
 	fprintf(stdout, "Exiting...\n");
@@ -23,6 +23,7 @@
 
 #include "igt_device_scan.h"
 
+#include <arpa/inet.h>
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
@@ -39,11 +40,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include <termios.h>
 
+#include "igt_drm_fdinfo.h"
 #include "igt_perf.h"
 
 #define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
@@ -660,17 +665,67 @@ struct clients {
 	unsigned int num_classes;
 	struct engine_class *class;
 
+	/* Clients from fdinfo if the kernel has it, sysfs otherwise. */
+	struct igt_drm_clients *fdinfo;
 	char sysfs_root[128];
 
 	struct client *client;
+
+	/* Open addressed client slots + 1 by id, rebuilt when sorting. */
+	unsigned int *index;
+	unsigned int index_size;
+	unsigned int index_used;
 };
 
 #define for_each_client(clients, c, tmp) \
 	for ((tmp) = (clients)->num_clients, c = (clients)->client; \
 	     (tmp > 0); (tmp)--, (c)++)
 
-static struct clients *init_clients(const char *drm_card)
+/*
+ * Use the fdinfo stats if the kernel has them, which we find out from a file
+ * of our own.
+ */
+static struct igt_drm_clients *
+init_fdinfo_clients(const struct igt_device_card *card)
+{
+	struct drm_client_fdinfo info;
+	const char *node = "/dev/dri/card0";
+	unsigned int found;
+	char fdstr[16];
+	int dir, fd;
+
+	if (card->render[0])
+		node = card->render;
+	else if (card->card[0])
+		node = card->card;
+
+	fd = open(node, O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	dir = open("/proc/self/fdinfo", O_DIRECTORY | O_RDONLY);
+	if (dir < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	snprintf(fdstr, sizeof(fdstr), "%d", fd);
+	found = igt_parse_drm_fdinfo(dir, fdstr, &info);
+
+	close(dir);
+	close(fd);
+
+	if (!found || !info.num_engines)
+		return NULL;
+
+	return igt_drm_clients_init(NULL, info.driver,
+				    card->pci_slot_name[0] ?
+				    card->pci_slot_name : NULL);
+}
+
+static struct clients *init_clients(const struct igt_device_card *card)
 {
+	const char *drm_card = card->pci_slot_name[0] ? card->card : NULL;
 	struct clients *clients;
 	const char *slash;
 	ssize_t ret;
@@ -682,6 +737,10 @@ static struct clients *init_clients(const char *drm_card)
 
 	memset(clients, 0, sizeof(*clients));
 
+	clients->fdinfo = init_fdinfo_clients(card);
+	if (clients->fdinfo)
+		return clients;
+
 	if (drm_card) {
 		slash = rindex(drm_card, '/');
 		assert(slash);
@@ -783,27 +842,88 @@ read_client_busy(struct client *client, unsigned int class)
 	return strtoull(b, NULL, 10);
 }
 
+#define GOLDEN_RATIO_PRIME_32 0x9e370001UL
+
+static unsigned int client_hash(unsigned int id)
+{
+	return id * GOLDEN_RATIO_PRIME_32;
+}
+
+static void __index_client(struct clients *clients, unsigned int slot)
+{
+	unsigned int mask = clients->index_size - 1;
+	unsigned int h = client_hash(clients->client[slot].id) & mask;
+
+	while (clients->index[h])
+		h = (h + 1) & mask;
+
+	clients->index[h] = slot + 1;
+	clients->index_used++;
+}
+
+static void reindex_clients(struct clients *clients)
+{
+	unsigned int size = 16, i;
+
+	while (size < 4 * clients->num_clients)
+		size <<= 1;
+
+	free(clients->index);
+	clients->index = calloc(size, sizeof(*clients->index));
+	assert(clients->index);
+	clients->index_size = size;
+	clients->index_used = 0;
+
+	for (i = 0; i < clients->num_clients; i++) {
+		if (clients->client[i].status != FREE)
+			__index_client(clients, i);
+	}
+}
+
+static void index_client(struct clients *clients, struct client *c)
+{
+	/* Slots of freed clients stay behind until the next rebuild. */
+	if (2 * (clients->index_used + 1) > clients->index_size)
+		reindex_clients(clients);
+	else
+		__index_client(clients, c - clients->client);
+}
+
 static struct client *
 find_client(struct clients *clients, enum client_status status, unsigned int id)
 {
-	unsigned int start, num;
+	unsigned int start, num, mask, h;
 	struct client *c;
 
-	start = status == FREE ? clients->active_clients : 0; /* Free block at the end. */
+	if (status != FREE) {
+		if (!clients->index)
+			return NULL;
+
+		mask = clients->index_size - 1;
+		for (h = client_hash(id) & mask;
+		     clients->index[h];
+		     h = (h + 1) & mask) {
+			c = &clients->client[clients->index[h] - 1];
+			if (c->id == id && c->status == status)
+				return c;
+		}
+
+		return NULL;
+	}
+
+	start = clients->active_clients; /* Free block at the end. */
 	num = clients->num_clients - start;
 
 	for (c = &clients->client[start]; num; c++, num--) {
-		if (status != c->status)
-			continue;
-
-		if (status == FREE || c->id == id)
+		if (c->status == FREE)
 			return c;
 	}
 
 	return NULL;
 }
 
-static void update_client(struct client *c, unsigned int pid, char *name)
+static void update_client(struct client *c, unsigned int pid, char *name,
+			  const struct drm_client_fdinfo *info)
 {
 	uint64_t val[c->clients->num_classes];
 	unsigned int i;
@@ -825,8 +945,16 @@ static void update_client(struct client *c, unsigned int pid, char *name)
 		}
 	}
 
-	for (i = 0; i < c->clients->num_classes; i++)
-		val[i] = read_client_busy(c, c->clients->class[i].class);
+	for (i = 0; i < c->clients->num_classes; i++) {
+		unsigned int class = c->clients->class[i].class;
+
+		if (!info)
+			val[i] = read_client_busy(c, class);
+		else if (class < DRM_CLIENT_FDINFO_MAX_ENGINES)
+			val[i] = info->busy[class];
+		else
+			val[i] = 0;
+	}
 
 	c->last_runtime = 0;
 	c->total_runtime = 0;
@@ -847,7 +975,7 @@ static void update_client(struct client *c, unsigned int pid, char *name)
 
 static void
 add_client(struct clients *clients, unsigned int id, unsigned int pid,
-	   char *name, int sysfs_root)
+	   char *name, int sysfs_root, const struct drm_client_fdinfo *info)
 {
 	struct client *c;
 
@@ -874,7 +1002,8 @@ add_client(struct clients *clients, unsigned int id, unsigned int pid,
 	c->last = calloc(clients->num_classes, sizeof(c->last));
 	assert(c->val && c->last);
 
-	update_client(c, pid, name);
+	update_client(c, pid, name, info);
+	index_client(clients, c);
 }
 
 static void free_client(struct client *c)
@@ -1026,6 +1155,9 @@ static struct clients *sort_clients(struct clients *clients,
 		}
 	}
 
+	if (clients->index)
+		reindex_clients(clients);
+
 	return clients;
 }
 
@@ -1112,20 +1244,35 @@ static void free_clients(struct clients *clients)
 		free(c->last);
 	}
 
+	igt_drm_clients_free(clients->fdinfo);
+	free(clients->index);
 	free(clients->client);
 	free(clients);
 }
 
-static struct clients *scan_clients(struct clients *clients)
+static void scan_fdinfo_clients(struct clients *clients)
+{
+	struct igt_map_entry *entry;
+
+	igt_drm_clients_scan(clients->fdinfo);
+
+	igt_map_foreach(clients->fdinfo->clients, entry) {
+		struct igt_drm_client *dc = entry->data;
+		struct client *c;
+
+		c = find_client(clients, PROBE, dc->id);
+		if (!c)
+			add_client(clients, dc->id, dc->pid, dc->name, -1,
+				   &dc->info);
+		else
+			update_client(c, dc->pid, dc->name, &dc->info);
+	}
+}
+
+static void probe_clients(struct clients *clients)
 {
-	struct dirent *dent;
 	struct client *c;
-	unsigned int id;
 	int tmp;
-	DIR *d;
-
-	if (!clients)
-		return clients;
 
 	for_each_client(clients, c, tmp) {
 		assert(c->status != PROBE);
@@ -1134,6 +1281,39 @@ static struct clients *scan_clients(struct clients *clients)
 		else
 			break; /* Free block at the end of array. */
 	}
+}
+
+static struct clients *reap_clients(struct clients *clients)
+{
+	struct client *c;
+	int tmp;
+
+	for_each_client(clients, c, tmp) {
+		if (c->status == PROBE)
+			free_client(c);
+		else if (c->status == FREE)
+			break;
+	}
+
+	return display_clients(clients);
+}
+
+static struct clients *scan_clients(struct clients *clients)
+{
+	struct dirent *dent;
+	struct client *c;
+	unsigned int id;
+	DIR *d;
+
+	if (!clients)
+		return clients;
+
+	probe_clients(clients);
+
+	if (clients->fdinfo) {
+		scan_fdinfo_clients(clients);
+		goto out;
+	}
 
 	d = opendir(clients->sysfs_root);
 	if (!d)
@@ -1163,9 +1343,10 @@ static struct clients *scan_clients(struct clients *clients)
 					id, "pid", pr);
 		if (!ret) {
 			if (!c)
-				add_client(clients, id, atoi(pid), name, root);
+				add_client(clients, id, atoi(pid), name, root,
+					   NULL);
 			else
-				update_client(c, atoi(pid), name);
+				update_client(c, atoi(pid), name, NULL);
 		} else if (c) {
 			c->status = PROBE; /* Will be deleted below. */
 		}
@@ -1173,14 +1354,8 @@ static struct clients *scan_clients(struct clients *clients)
 
 	closedir(d);
 
-	for_each_client(clients, c, tmp) {
-		if (c->status == PROBE)
-			free_client(c);
-		else if (c->status == FREE)
-			break;
-	}
-
-	return display_clients(clients);
+out:
+	return reap_clients(clients);
 }
 
 static const char *bars[] = { " ", "▏", "▎", "▍", "▌", "▋", "▊", "▉", "█" };
@@ -1245,6 +1420,10 @@ usage(const char *appname)
 		"\t[-s <ms>]       Refresh period in milliseconds (default %ums).\n"
 		"\t[-L]            List all cards.\n"
 		"\t[-d <device>]   Device filter, please check manual page for more details.\n"
+		"\t[-R <file>]     Record samples to a file.\n"
+		"\t[-r <file>]     Replay recorded samples.\n"
+		"\t[-w <s>[,<s>]]  Replay window in seconds from the start of the recording.\n"
+		"\t[-p [<ip>:]<port>] Export metrics in Prometheus format over HTTP.\n"
 		"\n",
 		appname, DEFAULT_PERIOD_MS);
 	igt_device_print_filter_types();
@@ -1253,9 +1432,13 @@ usage(const char *appname)
 static enum {
 	INTERACTIVE,
 	STDOUT,
-	JSON
+	JSON,
+	PROMETHEUS
 } output_mode;
 
+/* Only recording or exporting metrics, nothing to show. */
+static bool headless;
+
 struct cnt_item {
 	struct pmu_counter *pmu;
 	unsigned int fmt_width;
@@ -1548,6 +1731,113 @@ static const struct print_operations term_pops = {
 	.print_group = term_print_group,
 };
 
+/*
+ * Prometheus metrics are collected through the same print operations as the
+ * other output modes, named after the top level group and the item, with
+ * nested group names as the name label. They are sorted by name once the
+ * whole sample is in, since all samples of a metric have to be together.
+ */
+struct prom_metric {
+	char name[64];
+	char labels[192];
+	double val;
+	unsigned int seq;
+};
+
+static struct prom_metric *prom_metrics;
+static unsigned int prom_num_metrics, prom_size;
+static const char *prom_struct[8];
+static unsigned int prom_level;
+static const char *prom_device;
+
+static void
+prom_escape(char *buf, unsigned int bufsz, const char *str)
+{
+	unsigned int len = 0;
+
+	for (; *str && len + 2 < bufsz; str++) {
+		if (*str == '"' || *str == '\\')
+			buf[len++] = '\\';
+		buf[len++] = *str;
+	}
+
+	buf[len] = 0;
+}
+
+static void
+prom_add(const char *group, const char *item, const char *labels, double val)
+{
+	struct prom_metric *m;
+	char dev[128];
+	char *p;
+
+	if (prom_num_metrics == prom_size) {
+		prom_size = prom_size ? 2 * prom_size : 64;
+		prom_metrics = realloc(prom_metrics,
+				       prom_size * sizeof(*prom_metrics));
+		assert(prom_metrics);
+	}
+
+	m = &prom_metrics[prom_num_metrics];
+	m->seq = prom_num_metrics++;
+	m->val = val;
+
+	snprintf(m->name, sizeof(m->name), "intel_gpu_top_%s_%s", group, item);
+	for (p = m->name; *p; p++) {
+		if (isalnum(*p))
+			*p = tolower(*p);
+		else
+			*p = '_';
+	}
+
+	prom_escape(dev, sizeof(dev), prom_device);
+	snprintf(m->labels, sizeof(m->labels), "device=\"%s\"%s%s",
+		 dev, labels ? "," : "", labels ?: "");
+}
+
+static void
+prom_open_struct(const char *name)
+{
+	assert(prom_level < ARRAY_SIZE(prom_struct));
+	prom_struct[prom_level++] = name;
+}
+
+static void
+prom_close_struct(void)
+{
+	assert(prom_level > 0);
+	prom_level--;
+}
+
+static unsigned int
+prom_add_member(const struct cnt_group *parent, struct cnt_item *item,
+		unsigned int headers)
+{
+	char labels[160], name[128];
+
+	if (!item->pmu || !item->pmu->present)
+		return 0;
+
+	assert(prom_level >= 2);
+
+	if (prom_level > 2) {
+		prom_escape(name, sizeof(name), prom_struct[prom_level - 1]);
+		snprintf(labels, sizeof(labels), "name=\"%s\"", name);
+	}
+
+	prom_add(prom_struct[1], item->name, prom_level > 2 ? labels : NULL,
+		 pmu_calc(&item->pmu->val, item->d, item->t, item->s));
+
+	return 1;
+}
+
+static const struct print_operations prom_pops = {
+	.open_struct = prom_open_struct,
+	.close_struct = prom_close_struct,
+	.add_member = prom_add_member,
+	.print_group = print_group,
+};
+
 static bool print_groups(struct cnt_group **groups)
 {
 	unsigned int headers = stdout_lines % STDOUT_HEADER_REPEAT + 1;
@@ -2192,6 +2482,30 @@ print_client(struct client *c, struct engines *engines, double t, int lines,
 		}
 
 		pops->close_struct();
+	} else if (output_mode == PROMETHEUS && c->samples > 1) {
+		char name[64], id[32] = "", labels[160];
+
+		/* Individual clients of a pid need telling apart. */
+		if (!aggregate_pids)
+			snprintf(id, sizeof(id), ",client=\"%u\"", c->id);
+
+		prom_escape(name, sizeof(name), c->print_name);
+
+		for (i = 0; i < clients->num_classes; i++) {
+			if (!clients->class[i].num_engines)
+				continue;
+
+			snprintf(labels, sizeof(labels),
+				 "pid=\"%u\"%s,name=\"%s\",class=\"%s\"",
+				 c->pid, id, name, clients->class[i].name);
+			prom_add("clients", "busy", labels,
+				 (double)c->val[i] / period_us / 1e3 * 100);
+		}
+
+		snprintf(labels, sizeof(labels), "pid=\"%u\"%s,name=\"%s\"",
+			 c->pid, id, name);
+		prom_add("clients", "runtime_seconds_total", labels,
+			 c->total_runtime / 1e9);
 	}
 
 	return lines;
@@ -2361,22 +2675,193 @@ static void process_normal_stdin(void)
 	}
 }
 
-static void process_stdin(unsigned int timeout_us)
+static int prometheus_fd = -1;
+static char *prom_text;
+static size_t prom_text_len;
+
+static int prometheus_listen(const char *addr)
 {
-	struct pollfd p = { .fd = 0, .events = POLLIN };
-	int ret;
+	struct sockaddr_in sa = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	const char *port = rindex(addr, ':');
+	unsigned long num;
+	int fd, on = 1;
+	char *end;
 
-	ret = poll(&p, 1, timeout_us / 1000);
-	if (ret <= 0) {
-		if (ret < 0)
-			stop_top = true;
+	if (port) {
+		char host[64];
+
+		snprintf(host, sizeof(host), "%.*s", (int)(port - addr), addr);
+		if (inet_pton(AF_INET, host, &sa.sin_addr) != 1) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		port++;
+	} else {
+		port = addr;
+	}
+
+	num = strtoul(port, &end, 10);
+	if (*end || !num || num > 65535) {
+		errno = EINVAL;
+		return -1;
+	}
+	sa.sin_port = htons(num);
+
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, 16)) {
+		int err = errno;
+
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	return fd;
+}
+
+static void __send_all(int fd, const char *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = send(fd, buf, len, MSG_NOSIGNAL);
+
+		if (ret <= 0)
+			break;
+
+		buf += ret;
+		len -= ret;
+	}
+}
+
+/*
+ * Serve one scrape with the metrics of the last sample. Requests are tiny and
+ * scrapers are local, so this is done inline with a short timeout rather than
+ * keeping connection state around.
+ */
+static void prometheus_serve(void)
+{
+	struct timeval tv = { .tv_usec = 100000 };
+	const char *status = "200 OK";
+	const char *body = prom_text ?: "";
+	size_t len = 0, body_len = prom_text_len;
+	char req[1024], hdr[256];
+	unsigned int path_len;
+	ssize_t ret;
+	int fd;
+
+	fd = accept4(prometheus_fd, NULL, NULL, SOCK_CLOEXEC);
+	if (fd < 0)
 		return;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	/* Only the request line matters, but let the client finish. */
+	while (len < sizeof(req) - 1) {
+		ret = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+		if (ret <= 0)
+			break;
+
+		len += ret;
+		req[len] = 0;
+		if (strstr(req, "\r\n\r\n"))
+			break;
 	}
+	req[len] = 0;
 
-	if (in_help)
-		process_help_stdin();
-	else
-		process_normal_stdin();
+	/* A shorter request ends before the path, don't look past it. */
+	if (strncmp(req, "GET ", 4)) {
+		status = "405 Method Not Allowed";
+	} else {
+		path_len = strcspn(req + 4, " ?");
+		if (!((path_len == 1 && req[4] == '/') ||
+		      (path_len == 8 && !strncmp(req + 4, "/metrics", 8))))
+			status = "404 Not Found";
+	}
+
+	if (strcmp(status, "200 OK")) {
+		body = "";
+		body_len = 0;
+	}
+
+	len = snprintf(hdr, sizeof(hdr),
+		       "HTTP/1.0 %s\r\n"
+		       "Content-Type: text/plain; version=0.0.4\r\n"
+		       "Content-Length: %zu\r\n"
+		       "Connection: close\r\n"
+		       "\r\n",
+		       status, body_len);
+	__send_all(fd, hdr, len);
+	__send_all(fd, body, body_len);
+
+	close(fd);
+}
+
+/*
+ * Wait out the rest of the sampling period, serving metrics scrapes. In
+ * interactive mode a key press ends the wait early to refresh the screen.
+ */
+static void wait_period(unsigned int period_us)
+{
+	struct timespec ts;
+	uint64_t now, deadline;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	deadline = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000 + period_us;
+
+	while (!stop_top) {
+		struct pollfd p[2];
+		unsigned int n = 0, i;
+		int ret;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+		if (now >= deadline)
+			break;
+
+		if (output_mode == INTERACTIVE)
+			p[n++] = (struct pollfd){ .fd = 0, .events = POLLIN };
+		if (prometheus_fd >= 0)
+			p[n++] = (struct pollfd){ .fd = prometheus_fd,
+						  .events = POLLIN };
+
+		if (!n) {
+			usleep(deadline - now);
+			break;
+		}
+
+		ret = poll(p, n, (deadline - now + 999) / 1000);
+		if (ret <= 0) {
+			if (ret < 0 && errno != EINTR)
+				stop_top = true;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (!p[i].revents)
+				continue;
+
+			if (p[i].fd == prometheus_fd) {
+				prometheus_serve();
+				continue;
+			}
+
+			if (in_help)
+				process_help_stdin();
+			else
+				process_normal_stdin();
+
+			return;
+		}
+	}
 }
 
 static void show_help_screen(void)
@@ -2393,25 +2878,753 @@ static void show_help_screen(void)
 "\n");
 }
 
-int main(int argc, char **argv)
+static void update_console_size(int *con_w, int *con_h)
 {
-	unsigned int period_us = DEFAULT_PERIOD_MS * 1000;
-	struct clients *clients = NULL;
-	int con_w = -1, con_h = -1;
-	char *output_path = NULL;
+	struct winsize ws;
+
+	if (output_mode != INTERACTIVE) {
+		*con_w = *con_h = INT_MAX;
+	} else if (ioctl(0, TIOCGWINSZ, &ws) != -1) {
+		*con_w = ws.ws_col;
+		*con_h = ws.ws_row;
+		if (*con_w == 0 && *con_h == 0) {
+			/* Serial console. */
+			*con_w = 80;
+			*con_h = 24;
+		}
+	}
+}
+
+static void
+print_sample(const struct igt_device_card *card, const char *codename,
+	     struct engines *engines, struct clients *disp_clients,
+	     double t, int con_w, int con_h, unsigned int period_us)
+{
+	bool consumed = false;
+	int j, lines = 0;
+	struct client *c;
+
+	while (!consumed) {
+		pops->open_struct(NULL);
+
+		lines = print_header(card, codename, engines,
+				     t, lines, con_w, con_h,
+				     &consumed);
+
+		if (in_help && output_mode == INTERACTIVE) {
+			show_help_screen();
+			break;
+		}
+
+		lines = print_imc(engines, t, lines, con_w, con_h);
+
+		lines = print_engines(engines, t, lines, con_w, con_h);
+
+		if (disp_clients) {
+			int class_w;
+
+			lines = print_clients_header(disp_clients, lines,
+						     con_w, con_h,
+						     &class_w);
+
+			for_each_client(disp_clients, c, j) {
+				assert(c->status != PROBE);
+				if (c->status != ALIVE)
+					break; /* Active clients are first in the array. */
+
+				if (lines >= con_h)
+					break;
+
+				lines = print_client(c, engines, t,
+						     lines, con_w,
+						     con_h, period_us,
+						     &class_w);
+			}
+
+			lines = print_clients_footer(disp_clients, t,
+						     lines, con_w,
+						     con_h);
+		}
+
+		pops->close_struct();
+	}
+}
+
+static int prom_metric_cmp(const void *_a, const void *_b)
+{
+	const struct prom_metric *a = _a;
+	const struct prom_metric *b = _b;
+	int ret;
+
+	ret = strcmp(a->name, b->name);
+	if (ret)
+		return ret;
+
+	return (int)a->seq - (int)b->seq;
+}
+
+/* Render the metrics of the current sample, to be served until the next. */
+static void
+prometheus_update(const struct igt_device_card *card, const char *codename,
+		  struct engines *engines, struct clients *disp_clients,
+		  double t, unsigned int period_us)
+{
+	const struct print_operations *saved_pops = pops;
+	typeof(output_mode) saved_mode = output_mode;
+	bool saved_class_view = class_view;
+	const char *name = NULL;
+	unsigned int i;
+	FILE *f;
+
+	output_mode = PROMETHEUS;
+	pops = &prom_pops;
+	class_view = false; /* Always export physical engines. */
+	prom_device = card->card;
+	prom_num_metrics = 0;
+
+	print_sample(card, codename, engines, disp_clients, t,
+		     INT_MAX, INT_MAX, period_us);
+
+	output_mode = saved_mode;
+	pops = saved_pops;
+	class_view = saved_class_view;
+
+	qsort(prom_metrics, prom_num_metrics, sizeof(*prom_metrics),
+	      prom_metric_cmp);
+
+	free(prom_text);
+	f = open_memstream(&prom_text, &prom_text_len);
+	assert(f);
+
+	for (i = 0; i < prom_num_metrics; i++) {
+		const struct prom_metric *m = &prom_metrics[i];
+		unsigned int len = strlen(m->name);
+
+		if (!name || strcmp(name, m->name)) {
+			name = m->name;
+			fprintf(f, "# TYPE %s %s\n", name,
+				len > 6 && !strcmp(name + len - 6, "_total") ?
+				"counter" : "gauge");
+		}
+
+		fprintf(f, "%s{%s} %f\n", m->name, m->labels, m->val);
+	}
+
+	fclose(f);
+}
+
+/*
+ * Recordings made with -R start with a struct rec_header, followed by
+ * num_engines struct rec_engine and num_counters struct rec_counter, the
+ * latter in the order of rec_counters(). Then comes a sample per period, a
+ * struct rec_sample followed by the raw value of each counter and a struct
+ * rec_client for each client, itself followed by the busy time of the
+ * client on each engine class.
+ *
+ * Raw values are stored, just as read from the PMU and the clients, so a
+ * replay goes through the same calculations as the live session did.
+ *
+ * Every REC_INDEX_STRIDE samples the file offset is noted down, and when
+ * recording stops the notes are appended as the index, followed by a struct
+ * rec_index at the very end of the file. Recordings cut short lack the index,
+ * but it can be rebuilt by walking the samples.
+ */
+#define REC_MAGIC 0x70746769 /* "igtp" */
+#define REC_VERSION 1
+#define REC_SAMPLE_MAGIC 0x6c706d73 /* "smpl" */
+#define REC_INDEX_MAGIC 0x78646e69 /* "indx" */
+#define REC_INDEX_STRIDE 64
+
+#define REC_CLIENTS (1 << 0)
+
+struct rec_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t flags;
+	uint32_t period_us;
+	uint32_t num_engines;
+	uint32_t num_counters;
+	uint32_t num_classes;
+	uint32_t pad;
+	char card[64];
+	char codename[64];
+};
+
+struct rec_engine {
+	uint32_t class;
+	uint32_t instance;
+	char name[32];
+};
+
+struct rec_counter {
+	uint32_t present;
+	uint32_t pad;
+	double scale;
+	char units[16];
+};
+
+struct rec_sample {
+	uint32_t magic;
+	uint32_t size;		/* of the whole sample */
+	uint64_t ts;		/* PMU time in ns */
+	uint32_t num_clients;
+	uint32_t pad;
+};
+
+struct rec_client {
+	uint32_t id;
+	uint32_t pid;
+	char name[24];
+};
+
+struct rec_index_entry {
+	uint64_t offset;	/* of every REC_INDEX_STRIDE-th sample */
+	uint64_t ts;
+};
+
+struct rec_index {
+	uint32_t magic;
+	uint32_t count;
+	uint64_t offset;	/* of the first struct rec_index_entry */
+};
+
+#define rec_num_counters(engines) (8 + 3 * (engines)->num_engines)
+
+static void rec_counters(struct engines *engines, struct pmu_counter **cnt)
+{
+	unsigned int i;
+
+	*cnt++ = &engines->freq_req;
+	*cnt++ = &engines->freq_act;
+	*cnt++ = &engines->irq;
+	*cnt++ = &engines->rc6;
+	*cnt++ = &engines->r_gpu;
+	*cnt++ = &engines->r_pkg;
+	*cnt++ = &engines->imc_reads;
+	*cnt++ = &engines->imc_writes;
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+
+		*cnt++ = &engine->busy;
+		*cnt++ = &engine->wait;
+		*cnt++ = &engine->sema;
+	}
+}
+
+static size_t rec_client_size(unsigned int num_classes)
+{
+	return sizeof(struct rec_client) + num_classes * sizeof(uint64_t);
+}
+
+static size_t
+rec_sample_size(const struct rec_header *hdr, unsigned int num_clients)
+{
+	return sizeof(struct rec_sample) +
+	       hdr->num_counters * sizeof(uint64_t) +
+	       num_clients * rec_client_size(hdr->num_classes);
+}
+
+static struct {
+	FILE *f;
+	struct rec_header hdr;
+	struct pmu_counter **counters;
+	uint64_t num_samples;
+	struct rec_index_entry *index;
+	unsigned int index_count;
+	void *buf;
+	size_t buf_size;
+} rec;
+
+static int
+record_open(const char *path, const struct igt_device_card *card,
+	    const char *codename, struct engines *engines,
+	    struct clients *clients, unsigned int period_us)
+{
+	struct rec_header *hdr = &rec.hdr;
+	unsigned int i;
+
+	rec.f = fopen(path, "w");
+	if (!rec.f)
+		return -1;
+
+	hdr->magic = REC_MAGIC;
+	hdr->version = REC_VERSION;
+	hdr->flags = clients ? REC_CLIENTS : 0;
+	hdr->period_us = period_us;
+	hdr->num_engines = engines->num_engines;
+	hdr->num_counters = rec_num_counters(engines);
+	hdr->num_classes = engines->num_classes;
+	strncpy(hdr->card, card->card, sizeof(hdr->card) - 1);
+	if (codename)
+		strncpy(hdr->codename, codename, sizeof(hdr->codename) - 1);
+
+	rec.counters = calloc(hdr->num_counters, sizeof(*rec.counters));
+	assert(rec.counters);
+	rec_counters(engines, rec.counters);
+
+	fwrite(hdr, sizeof(*hdr), 1, rec.f);
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+		struct rec_engine re = {
+			.class = engine->class,
+			.instance = engine->instance,
+		};
+
+		strncpy(re.name, engine->name, sizeof(re.name) - 1);
+		fwrite(&re, sizeof(re), 1, rec.f);
+	}
+
+	for (i = 0; i < hdr->num_counters; i++) {
+		struct pmu_counter *pmu = rec.counters[i];
+		struct rec_counter rc = {
+			.present = pmu->present,
+			.scale = pmu->scale,
+		};
+
+		if (pmu->units)
+			strncpy(rc.units, pmu->units, sizeof(rc.units) - 1);
+		fwrite(&rc, sizeof(rc), 1, rec.f);
+	}
+
+	return fflush(rec.f);
+}
+
+static int record_sample(struct engines *engines, struct clients *clients)
+{
+	const unsigned int num_classes = rec.hdr.num_classes;
+	unsigned int num_clients = 0, i;
+	struct rec_client *rc;
+	struct rec_sample *s;
+	struct client *c;
+	uint64_t *val;
+	size_t size;
+	int tmp;
+
+	if (clients) {
+		for_each_client(clients, c, tmp)
+			num_clients += c->status == ALIVE;
+	}
+
+	size = rec_sample_size(&rec.hdr, num_clients);
+	if (size > rec.buf_size) {
+		rec.buf_size = 2 * size;
+		rec.buf = realloc(rec.buf, rec.buf_size);
+		assert(rec.buf);
+	}
+
+	s = rec.buf;
+	s->magic = REC_SAMPLE_MAGIC;
+	s->size = size;
+	s->ts = engines->ts.cur;
+	s->num_clients = num_clients;
+	s->pad = 0;
+
+	val = (uint64_t *)(s + 1);
+	for (i = 0; i < rec.hdr.num_counters; i++)
+		*val++ = rec.counters[i]->val.cur;
+
+	rc = (struct rec_client *)val;
+	if (clients) {
+		for_each_client(clients, c, tmp) {
+			uint64_t *busy = (uint64_t *)(rc + 1);
+
+			if (c->status != ALIVE)
+				continue;
+
+			memset(rc, 0, sizeof(*rc));
+			rc->id = c->id;
+			rc->pid = c->pid;
+			strncpy(rc->name, c->name, sizeof(rc->name) - 1);
+
+			for (i = 0; i < num_classes; i++)
+				busy[i] = c->last[i];
+
+			rc = (struct rec_client *)(busy + num_classes);
+		}
+	}
+
+	if (!(rec.num_samples % REC_INDEX_STRIDE)) {
+		struct rec_index_entry *e;
+
+		rec.index = realloc(rec.index,
+				    (rec.index_count + 1) * sizeof(*e));
+		assert(rec.index);
+
+		e = &rec.index[rec.index_count++];
+		e->offset = ftello(rec.f);
+		e->ts = s->ts;
+	}
+	rec.num_samples++;
+
+	fwrite(s, size, 1, rec.f);
+
+	return fflush(rec.f);
+}
+
+static int record_close(void)
+{
+	struct rec_index idx = {
+		.magic = REC_INDEX_MAGIC,
+		.count = rec.index_count,
+	};
+	int ret;
+
+	idx.offset = ftello(rec.f);
+	fwrite(rec.index, sizeof(*rec.index), rec.index_count, rec.f);
+	fwrite(&idx, sizeof(idx), 1, rec.f);
+
+	ret = ferror(rec.f);
+	ret |= fclose(rec.f);
+
+	free(rec.counters);
+	free(rec.index);
+	free(rec.buf);
+
+	return ret;
+}
+
+static const struct rec_sample *
+rec_sample_at(const struct rec_header *hdr, const void *data,
+	      size_t offset, size_t end)
+{
+	const struct rec_sample *s = data + offset;
+
+	if (offset + sizeof(*s) > end)
+		return NULL;
+
+	if (s->magic != REC_SAMPLE_MAGIC ||
+	    s->num_clients > (end - offset) / sizeof(struct rec_client) ||
+	    s->size != rec_sample_size(hdr, s->num_clients) ||
+	    s->size > end - offset)
+		return NULL;
+
+	return s;
+}
+
+static unsigned int
+rec_load_index(const struct rec_header *hdr, const void *data, size_t size,
+	       size_t first, size_t *end, struct rec_index_entry **index)
+{
+	const struct rec_index *idx = data + size - sizeof(*idx);
+	const struct rec_sample *s;
+	unsigned int count = 0;
+	size_t offset;
+
+	if (size >= first + sizeof(*idx) &&
+	    idx->magic == REC_INDEX_MAGIC &&
+	    idx->offset >= first &&
+	    idx->offset + idx->count * sizeof(**index) ==
+	    size - sizeof(*idx)) {
+		*index = malloc(idx->count * sizeof(**index) + 1);
+		assert(*index);
+		memcpy(*index, data + idx->offset,
+		       idx->count * sizeof(**index));
+		*end = idx->offset;
+
+		return idx->count;
+	}
+
+	*index = NULL;
+	for (offset = first;
+	     (s = rec_sample_at(hdr, data, offset, size));
+	     offset += s->size, count++) {
+		if (!(count % REC_INDEX_STRIDE)) {
+			unsigned int n = count / REC_INDEX_STRIDE;
+
+			*index = realloc(*index, (n + 1) * sizeof(**index));
+			assert(*index);
+			(*index)[n].offset = offset;
+			(*index)[n].ts = s->ts;
+		}
+	}
+	*end = offset;
+
+	fprintf(stderr, "Recording has no index, rebuilt from %u samples.\n",
+		count);
+
+	return (count + REC_INDEX_STRIDE - 1) / REC_INDEX_STRIDE;
+}
+
+static struct engines *
+replay_engines(const struct rec_header *hdr, const struct rec_engine *re,
+	       const struct rec_counter *rc, struct pmu_counter **counters)
+{
+	struct engines *engines;
+	unsigned int i;
+	int ret;
+
+	engines = calloc(1, sizeof(struct engines) +
+			    hdr->num_engines * sizeof(struct engine));
+	assert(engines);
+
+	engines->num_engines = hdr->num_engines;
+	engines->fd = engines->rapl_fd = engines->imc_fd = -1;
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+
+		engine->class = re[i].class;
+		engine->instance = re[i].instance;
+		engine->name = strndup(re[i].name, sizeof(re[i].name));
+
+		ret = asprintf(&engine->display_name, "%s/%u",
+			       class_display_name(engine->class),
+			       engine->instance);
+		assert(ret > 0);
+
+		ret = asprintf(&engine->short_name, "%s/%u",
+			       class_short_name(engine->class),
+			       engine->instance);
+		assert(ret > 0);
+	}
+
+	rec_counters(engines, counters);
+
+	for (i = 0; i < hdr->num_counters; i++) {
+		counters[i]->present = rc[i].present;
+		counters[i]->scale = rc[i].scale;
+		counters[i]->units = strndup(rc[i].units, sizeof(rc[i].units));
+	}
+
+	for (i = 0; i < engines->num_engines; i++) {
+		struct engine *engine = engine_ptr(engines, i);
+
+		engine->num_counters = engine->busy.present +
+				       engine->wait.present +
+				       engine->sema.present;
+	}
+
+	engines->num_rapl = engines->r_gpu.present + engines->r_pkg.present;
+	engines->num_imc = engines->imc_reads.present +
+			   engines->imc_writes.present;
+
+	return engines;
+}
+
+static struct clients *
+replay_sample(const struct rec_header *hdr, const struct rec_sample *s,
+	      struct engines *engines, struct pmu_counter **counters,
+	      struct clients *clients)
+{
+	const uint64_t *val = (const uint64_t *)(s + 1);
+	const struct rec_client *rc;
+	unsigned int i, j;
+
+	engines->ts.prev = engines->ts.cur;
+	engines->ts.cur = s->ts;
+
+	for (i = 0; i < hdr->num_counters; i++) {
+		if (counters[i]->present)
+			__update_sample(counters[i], val[i]);
+	}
+
+	if (!clients)
+		return NULL;
+
+	probe_clients(clients);
+
+	rc = (const struct rec_client *)(val + hdr->num_counters);
+	for (i = 0; i < s->num_clients; i++) {
+		const uint64_t *busy = (const uint64_t *)(rc + 1);
+		struct drm_client_fdinfo info = { };
+		struct client *c;
+		char name[24];
+
+		for (j = 0; j < hdr->num_classes; j++)
+			info.busy[j] = busy[j];
+		info.num_engines = hdr->num_classes;
+
+		snprintf(name, sizeof(name), "%.*s",
+			 (int)sizeof(rc->name), rc->name);
+
+		c = find_client(clients, PROBE, rc->id);
+		if (!c)
+			add_client(clients, rc->id, rc->pid, name, -1, &info);
+		else
+			update_client(c, rc->pid, name, &info);
+
+		rc = (const struct rec_client *)(busy + hdr->num_classes);
+	}
+
+	return reap_clients(clients);
+}
+
+/*
+ * Show the samples of a recording between @from and @to seconds from its
+ * start, through the same output paths as a live session.
+ */
+static int replay(const char *path, double from, double to)
+{
+	struct rec_index_entry *index = NULL;
+	struct clients *clients = NULL;
+	struct pmu_counter **counters;
+	struct igt_device_card card = { };
+	const struct rec_sample *s;
+	int con_w = -1, con_h = -1;
+	struct engines *engines;
+	struct rec_header hdr;
+	unsigned int count, k;
+	bool primed = false;
+	size_t first, end, offset;
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		fprintf(stderr, "Failed to open recording '%s'! (%s)\n",
+			path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (st.st_size < sizeof(hdr) || data == MAP_FAILED) {
+		fprintf(stderr, "Failed to read recording '%s'!\n", path);
+		return EXIT_FAILURE;
+	}
+
+	memcpy(&hdr, data, sizeof(hdr));
+	hdr.card[sizeof(hdr.card) - 1] = 0;
+	hdr.codename[sizeof(hdr.codename) - 1] = 0;
+
+	first = sizeof(hdr) + hdr.num_engines * sizeof(struct rec_engine) +
+		hdr.num_counters * sizeof(struct rec_counter);
+
+	if (hdr.magic != REC_MAGIC || hdr.version != REC_VERSION ||
+	    hdr.num_engines > 256 || hdr.num_classes >= 64 ||
+	    hdr.num_counters != rec_num_counters(&hdr) ||
+	    first > st.st_size) {
+		fprintf(stderr, "'%s' is not a recording from this version of intel_gpu_top!\n",
+			path);
+		munmap(data, st.st_size);
+		return EXIT_FAILURE;
+	}
+
+	counters = calloc(hdr.num_counters, sizeof(*counters));
+	assert(counters);
+
+	engines = replay_engines(&hdr, data + sizeof(hdr),
+				 data + sizeof(hdr) +
+				 hdr.num_engines * sizeof(struct rec_engine),
+				 counters);
+
+	if (engines->num_engines)
+		init_engine_classes(engines);
+
+	if (engines->num_classes != hdr.num_classes) {
+		fprintf(stderr, "Corrupt recording '%s'!\n", path);
+		munmap(data, st.st_size);
+		return EXIT_FAILURE;
+	}
+
+	if (hdr.flags & REC_CLIENTS) {
+		clients = calloc(1, sizeof(*clients));
+		assert(clients);
+		clients->num_classes = engines->num_classes;
+		clients->class = engines->class;
+	}
+
+	strcpy(card.card, hdr.card);
+
+	count = rec_load_index(&hdr, data, st.st_size, first, &end, &index);
+	if (!count) {
+		fprintf(stderr, "No samples in '%s'!\n", path);
+		munmap(data, st.st_size);
+		return EXIT_FAILURE;
+	}
+
+	/*
+	 * Start from the last indexed sample before the window, so there is
+	 * a previous sample to calculate the first one shown against.
+	 */
+	for (k = 0; k + 1 < count; k++) {
+		if ((index[k + 1].ts - index[0].ts) / 1e9 >= from)
+			break;
+	}
+
+	for (offset = index[k].offset;
+	     !stop_top && (s = rec_sample_at(&hdr, data, offset, end));
+	     offset += s->size) {
+		double ts = (s->ts - index[0].ts) / 1e9;
+		struct clients *disp_clients;
+
+		if (ts > to)
+			break;
+
+		disp_clients = replay_sample(&hdr, s, engines, counters,
+					     clients);
+
+		if (primed && ts >= from) {
+			update_console_size(&con_w, &con_h);
+			print_sample(&card, hdr.codename, engines, disp_clients,
+				     (double)(engines->ts.cur -
+					      engines->ts.prev) / 1e9,
+				     con_w, con_h, hdr.period_us);
+
+			if (output_mode == INTERACTIVE)
+				wait_period(hdr.period_us);
+		}
+		primed = true;
+
+		if (disp_clients != clients)
+			free_clients(disp_clients);
+	}
+
+	if (clients)
+		free_clients(clients);
+	free(index);
+	free(counters);
+	free(engines);
+	munmap(data, st.st_size);
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int period_us = DEFAULT_PERIOD_MS * 1000;
+	struct clients *clients = NULL;
+	int con_w = -1, con_h = -1;
+	char *output_path = NULL;
 	struct engines *engines;
 	int ret = 0, ch;
 	bool list_device = false;
 	char *pmu_device, *opt_device = NULL;
 	struct igt_device_card card;
 	char *codename = NULL;
+	char *record_path = NULL, *replay_path = NULL;
+	char *prometheus_addr = NULL;
+	double window_from = 0, window_to = INFINITY;
+	char *end;
 
 	/* Parse options */
-	while ((ch = getopt(argc, argv, "o:s:d:JLlh")) != -1) {
+	while ((ch = getopt(argc, argv, "o:s:d:JLlhR:r:w:p:")) != -1) {
 		switch (ch) {
 		case 'o':
 			output_path = optarg;
 			break;
+		case 'R':
+			record_path = optarg;
+			break;
+		case 'r':
+			replay_path = optarg;
+			break;
+		case 'w':
+			window_from = strtod(optarg, &end);
+			if (*end == ',')
+				window_to = strtod(end + 1, &end);
+			if (*end || window_from < 0 || window_to < window_from) {
+				fprintf(stderr, "Invalid replay window '%s'!\n",
+					optarg);
+				exit(1);
+			}
+			break;
+		case 'p':
+			prometheus_addr = optarg;
+			break;
 		case 's':
 			period_us = atoi(optarg) * 1000;
 			break;
@@ -2437,6 +3650,18 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (replay_path && (record_path || prometheus_addr)) {
+		fprintf(stderr,
+			"Replay can not be combined with recording or metrics export!\n");
+		exit(1);
+	}
+
+	/* Run headless unless an output format was asked for. */
+	if ((record_path || prometheus_addr) && output_mode == INTERACTIVE) {
+		headless = true;
+		output_mode = STDOUT;
+	}
+
 	if (output_mode == INTERACTIVE && (output_path || isatty(1) != 1))
 		output_mode = STDOUT;
 
@@ -2457,6 +3682,9 @@ int main(int argc, char **argv)
 
 		if (sig == SIG_ERR)
 			fprintf(stderr, "Failed to install signal handler!\n");
+
+		if (headless && signal(SIGTERM, sigint_handler) == SIG_ERR)
+			fprintf(stderr, "Failed to install signal handler!\n");
 	}
 
 	switch (output_mode) {
@@ -2476,6 +3704,9 @@ int main(int argc, char **argv)
 		break;
 	};
 
+	if (replay_path)
+		return replay(replay_path, window_from, window_to);
+
 	igt_devices_scan(false);
 
 	if (list_device) {
@@ -2530,90 +3761,68 @@ int main(int argc, char **argv)
 
 	ret = EXIT_SUCCESS;
 
-	clients = init_clients(card.pci_slot_name[0] ? card.card : NULL);
+	clients = init_clients(&card);
 	init_engine_classes(engines);
 	if (clients) {
 		clients->num_classes = engines->num_classes;
 		clients->class = engines->class;
 	}
 
+	codename = igt_device_get_pretty_name(&card, false);
+
+	if (prometheus_addr) {
+		prometheus_fd = prometheus_listen(prometheus_addr);
+		if (prometheus_fd < 0) {
+			fprintf(stderr,
+				"Failed to listen on '%s' for metrics! (%s)\n",
+				prometheus_addr, strerror(errno));
+			ret = EXIT_FAILURE;
+			goto err;
+		}
+	}
+
+	if (record_path &&
+	    record_open(record_path, &card, codename, engines, clients,
+			period_us)) {
+		fprintf(stderr, "Failed to open recording '%s'! (%s)\n",
+			record_path, strerror(errno));
+		ret = EXIT_FAILURE;
+		goto err;
+	}
+
 	pmu_sample(engines);
 	scan_clients(clients);
-	codename = igt_device_get_pretty_name(&card, false);
+	if (record_path)
+		record_sample(engines, clients);
 
 	while (!stop_top) {
 		struct clients *disp_clients;
-		bool consumed = false;
-		int j, lines = 0;
-		struct winsize ws;
-		struct client *c;
 		double t;
 
-		/* Update terminal size. */
-		if (output_mode != INTERACTIVE) {
-			con_w = con_h = INT_MAX;
-		} else if (ioctl(0, TIOCGWINSZ, &ws) != -1) {
-			con_w = ws.ws_col;
-			con_h = ws.ws_row;
-			if (con_w == 0 && con_h == 0) {
-				/* Serial console. */
-				con_w = 80;
-				con_h = 24;
-			}
-		}
+		update_console_size(&con_w, &con_h);
 
 		pmu_sample(engines);
 		t = (double)(engines->ts.cur - engines->ts.prev) / 1e9;
 
 		disp_clients = scan_clients(clients);
 
-		if (stop_top)
-			break;
-
-		while (!consumed) {
-			pops->open_struct(NULL);
-
-			lines = print_header(&card, codename, engines,
-					     t, lines, con_w, con_h,
-					     &consumed);
-
-			if (in_help) {
-				show_help_screen();
-				break;
-			}
-
-			lines = print_imc(engines, t, lines, con_w, con_h);
-
-			lines = print_engines(engines, t, lines, con_w, con_h);
-
-			if (disp_clients) {
-				int class_w;
-
-				lines = print_clients_header(disp_clients, lines,
-							     con_w, con_h,
-							     &class_w);
-
-				for_each_client(disp_clients, c, j) {
-					assert(c->status != PROBE);
-					if (c->status != ALIVE)
-						break; /* Active clients are first in the array. */
-
-					if (lines >= con_h)
-						break;
+		if (record_path && record_sample(engines, clients)) {
+			fprintf(stderr, "Failed to write recording! (%s)\n",
+				strerror(errno));
+			ret = EXIT_FAILURE;
+			stop_top = true;
+		}
 
-					lines = print_client(c, engines, t,
-							     lines, con_w,
-							     con_h, period_us,
-							     &class_w);
-				}
+		if (prometheus_fd >= 0)
+			prometheus_update(&card, codename, engines,
+					  disp_clients, t, period_us);
 
-				lines = print_clients_footer(disp_clients, t,
-							     lines, con_w,
-							     con_h);
-			}
+		if (stop_top)
+			break;
 
-			pops->close_struct();
-		}
+		if (!headless)
+			print_sample(&card, codename, engines, disp_clients, t,
+				     con_w, con_h, period_us);
 
 		if (stop_top)
 			break;
@@ -2621,14 +3830,19 @@ int main(int argc, char **argv)
 		if (disp_clients != clients)
 			free_clients(disp_clients);
 
-		if (output_mode == INTERACTIVE)
-			process_stdin(period_us);
-		else
-			usleep(period_us);
+		wait_period(period_us);
 	}
 
-	free(codename);
+	if (record_path && record_close() && ret == EXIT_SUCCESS) {
+		fprintf(stderr, "Failed to write recording! (%s)\n",
+			strerror(errno));
+		ret = EXIT_FAILURE;
+	}
+
+	if (prometheus_fd >= 0)
+		close(prometheus_fd);
 err:
+	free(codename);
 	free(engines);
 	free(pmu_device);
 exit:
@@ -21,13 +21,16 @@
  * SOFTWARE.
  */
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -35,6 +38,7 @@
 #include "i915/gem_create.h"
 #include "igt.h"
 #include "igt_gt.h"
+#include "igt_map.h"
 #include "intel_io.h"
 #include "intel_chipset.h"
 
@@ -83,35 +87,107 @@ struct config {
 	struct reg *regs;
 	ssize_t regcount;
 
+	/* lookup of regs by (port, address) and by (port, name) */
+	struct igt_map *addr_index;
+	struct igt_map *name_index;
+
 	int verbosity;
 };
 
+#define GOLDEN_RATIO_PRIME_32 0x9e370001UL
+
+/* ->mmio_offset should be 0 for non-MMIO ports. */
+static uint32_t hash_reg_addr(const void *key)
+{
+	const struct reg *reg = key;
+	uint32_t hash = reg->addr + reg->mmio_offset;
+
+	hash ^= (uint32_t)reg->port_desc.port << 24;
+
+	return hash * GOLDEN_RATIO_PRIME_32;
+}
+
+static int equal_reg_addr(const void *a, const void *b)
+{
+	const struct reg *ra = a, *rb = b;
+
+	return ra->port_desc.port == rb->port_desc.port &&
+		ra->addr + ra->mmio_offset == rb->addr + rb->mmio_offset;
+}
+
+/* Register names are matched case insensitively. */
+static uint32_t hash_reg_name(const void *key)
+{
+	const struct reg *reg = key;
+	uint32_t hash = 2166136261u ^ (uint32_t)reg->port_desc.port;
+	const char *c;
+
+	for (c = reg->name; *c; c++)
+		hash = (hash ^ tolower(*c)) * 16777619u;
+
+	return hash;
+}
+
+static int equal_reg_name(const void *a, const void *b)
+{
+	const struct reg *ra = a, *rb = b;
+
+	return ra->port_desc.port == rb->port_desc.port &&
+		strcasecmp(ra->name, rb->name) == 0;
+}
+
+/*
+ * Index the register spec by address and by name. Like a walk of the spec,
+ * lookups find the first of any duplicate definitions.
+ */
+static int build_reg_index(struct config *config)
+{
+	int i;
+
+	config->addr_index = igt_map_create(hash_reg_addr, equal_reg_addr);
+	config->name_index = igt_map_create(hash_reg_name, equal_reg_name);
+	if (!config->addr_index || !config->name_index)
+		return -ENOMEM;
+
+	for (i = 0; i < config->regcount; i++) {
+		struct reg *r = &config->regs[i];
+
+		if (!igt_map_search(config->addr_index, r))
+			igt_map_insert(config->addr_index, r, r);
+
+		if (r->name && !igt_map_search(config->name_index, r))
+			igt_map_insert(config->name_index, r, r);
+	}
+
+	return 0;
+}
+
+static void free_reg_index(struct config *config)
+{
+	if (config->addr_index)
+		igt_map_destroy(config->addr_index, NULL);
+	if (config->name_index)
+		igt_map_destroy(config->name_index, NULL);
+}
+
 /* port desc must have been set */
 static int set_reg_by_addr(struct config *config, struct reg *reg,
 			   uint32_t addr)
 {
-	int i;
+	const struct reg *r;
 
 	reg->addr = addr;
 	if (reg->name)
 		free(reg->name);
 	reg->name = NULL;
 
-	for (i = 0; i < config->regcount; i++) {
-		struct reg *r = &config->regs[i];
-
-		if (reg->port_desc.port != r->port_desc.port)
-			continue;
-
-		/* ->mmio_offset should be 0 for non-MMIO ports. */
-		if (addr + reg->mmio_offset == r->addr + r->mmio_offset) {
-			/* Always output the "normalized" offset+addr. */
-			reg->mmio_offset = r->mmio_offset;
-			reg->addr = r->addr;
+	r = igt_map_search(config->addr_index, reg);
+	if (r) {
+		/* Always output the "normalized" offset+addr. */
+		reg->mmio_offset = r->mmio_offset;
+		reg->addr = r->addr;
 
-			reg->name = r->name ? strdup(r->name) : NULL;
-			break;
-		}
+		reg->name = r->name ? strdup(r->name) : NULL;
 	}
 
 	return 0;
@@ -121,32 +197,22 @@ static int set_reg_by_addr(struct config *config, struct reg *reg,
 static int set_reg_by_name(struct config *config, struct reg *reg,
 			   const char *name)
 {
-	int i;
+	const struct reg *r;
 
 	reg->name = strdup(name);
 	reg->addr = 0;
 
-	for (i = 0; i < config->regcount; i++) {
-		struct reg *r = &config->regs[i];
-
-		if (reg->port_desc.port != r->port_desc.port)
-			continue;
-
-		if (!r->name)
-			continue;
+	r = igt_map_search(config->name_index, reg);
+	if (!r)
+		return -1;
 
-		if (strcasecmp(name, r->name) == 0) {
-			reg->addr = r->addr;
+	reg->addr = r->addr;
 
-			/* Also get MMIO offset if not already specified. */
-			if (!reg->mmio_offset && r->mmio_offset)
-				reg->mmio_offset = r->mmio_offset;
+	/* Also get MMIO offset if not already specified. */
+	if (!reg->mmio_offset && r->mmio_offset)
+		reg->mmio_offset = r->mmio_offset;
 
-			return 0;
-		}
-	}
-
-	return -1;
+	return 0;
 }
 
 static void to_binary(char *buf, size_t buflen, uint32_t val)
@@ -180,6 +246,41 @@ static void to_binary(char *buf, size_t buflen, uint32_t val)
 	snprintf(buf, buflen, "\n");
 }
 
+static void print_reg(const struct reg *reg)
+{
+	if (reg->port_desc.port == PORT_MMIO) {
+		/* Omit port name for MMIO, optionally include MMIO offset. */
+		if (reg->mmio_offset)
+			printf("%24s (0x%08x:0x%08x): ",
+			       reg->name ?: "",
+			       reg->mmio_offset, reg->addr);
+		else
+			printf("%35s (0x%08x): ",
+			       reg->name ?: "",
+			       reg->addr);
+	} else {
+		char name[100], addr[100];
+
+		/* If no name, use addr as name for easier copy pasting. */
+		if (reg->name)
+			snprintf(name, sizeof(name), "%s:%s",
+				 reg->port_desc.name, reg->name);
+		else
+			snprintf(name, sizeof(name), "%s:0x%08x",
+				 reg->port_desc.name, reg->addr);
+
+		/* Negative port numbers are not real sideband ports. */
+		if (reg->port_desc.port > PORT_NONE)
+			snprintf(addr, sizeof(addr), "0x%02x:0x%08x",
+				 reg->port_desc.port, reg->addr);
+		else
+			snprintf(addr, sizeof(addr), "%s:0x%08x",
+				 reg->port_desc.name, reg->addr);
+
+		printf("%24s (%s): ", name, addr);
+	}
+}
+
 static void dump_decode(struct config *config, struct reg *reg, uint32_t val)
 {
 	char decode[1300];
@@ -208,39 +309,8 @@ static void dump_decode(struct config *config, struct reg *reg, uint32_t val)
 		snprintf(decode, sizeof(decode), "\n");
 	}
 
-	if (reg->port_desc.port == PORT_MMIO) {
-		/* Omit port name for MMIO, optionally include MMIO offset. */
-		if (reg->mmio_offset)
-			printf("%24s (0x%08x:0x%08x): 0x%08x%s",
-			       reg->name ?: "",
-			       reg->mmio_offset, reg->addr,
-			       val, decode);
-		else
-			printf("%35s (0x%08x): 0x%08x%s",
-			       reg->name ?: "",
-			       reg->addr,
-			       val, decode);
-	} else {
-		char name[100], addr[100];
-
-		/* If no name, use addr as name for easier copy pasting. */
-		if (reg->name)
-			snprintf(name, sizeof(name), "%s:%s",
-				 reg->port_desc.name, reg->name);
-		else
-			snprintf(name, sizeof(name), "%s:0x%08x",
-				 reg->port_desc.name, reg->addr);
-
-		/* Negative port numbers are not real sideband ports. */
-		if (reg->port_desc.port > PORT_NONE)
-			snprintf(addr, sizeof(addr), "0x%02x:0x%08x",
-				 reg->port_desc.port, reg->addr);
-		else
-			snprintf(addr, sizeof(addr), "%s:0x%08x",
-				 reg->port_desc.name, reg->addr);
-
-		printf("%24s (%s): 0x%08x%s", name, addr, val, decode);
-	}
+	print_reg(reg);
+	printf("0x%08x%s", val, decode);
 }
 
 static const struct intel_execution_engine2 *find_engine(const char *name)
@@ -663,7 +733,147 @@ static int intel_reg_snapshot(struct config *config, int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
-/* XXX: add support for reading and re-decoding a previously done dump */
+static void *map_snapshot(const char *filename, size_t *size)
+{
+	struct stat st;
+	void *ptr;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "diff: opening '%s' failed: %s\n",
+			filename, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) || !st.st_size) {
+		fprintf(stderr, "diff: '%s' is empty\n", filename);
+		close(fd);
+		return NULL;
+	}
+
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+		fprintf(stderr, "diff: mapping '%s' failed: %s\n",
+			filename, strerror(errno));
+		return NULL;
+	}
+
+	*size = st.st_size;
+
+	return ptr;
+}
+
+static void print_decode_lines(const char *prefix, const char *decode)
+{
+	while (*decode) {
+		int len = strcspn(decode, "\n");
+
+		printf("%s%.*s\n", prefix, len, decode);
+		decode += len;
+		if (*decode)
+			decode++;
+	}
+}
+
+static void dump_diff(struct config *config, struct reg *reg,
+		      uint32_t old, uint32_t new)
+{
+	uint32_t devid = config->all_platforms ? 0 : config->devid;
+	char old_decode[1024], new_decode[1024];
+	char bin[200];
+
+	intel_reg_spec_decode(old_decode, sizeof(old_decode), reg, old, devid);
+	intel_reg_spec_decode(new_decode, sizeof(new_decode), reg, new, devid);
+
+	print_reg(reg);
+	printf("0x%08x -> 0x%08x\n", old, new);
+
+	print_decode_lines("\t- ", old_decode);
+	print_decode_lines("\t+ ", new_decode);
+
+	if (config->binary) {
+		/* Spread out the bits that changed. */
+		to_binary(bin, sizeof(bin), old ^ new);
+		printf("%s", bin);
+	}
+}
+
+/*
+ * Compare two MMIO snapshots, printing the registers that differ. Identical
+ * pages are skipped with a memcmp, and the changed dwords are looked up in the
+ * register spec index, so that full snapshots can be compared offline.
+ */
+static int intel_reg_diff(struct config *config, int argc, char *argv[])
+{
+	const char *old_file, *new_file;
+	const uint8_t *old, *new;
+	size_t old_size, new_size, size, page, offset;
+	int ret = EXIT_FAILURE;
+
+	if (config->mmiofile && argc == 2) {
+		old_file = config->mmiofile;
+		new_file = argv[1];
+	} else if (!config->mmiofile && argc == 3) {
+		old_file = argv[1];
+		new_file = argv[2];
+	} else {
+		fprintf(stderr, "diff: two snapshots required\n");
+		return EXIT_FAILURE;
+	}
+
+	old = map_snapshot(old_file, &old_size);
+	if (!old)
+		return EXIT_FAILURE;
+
+	new = map_snapshot(new_file, &new_size);
+	if (!new)
+		goto out_old;
+
+	size = min(old_size, new_size) & ~3ul;
+	if (old_size != new_size)
+		fprintf(stderr, "Warning: snapshot sizes differ, "
+			"comparing the first 0x%zx bytes\n", size);
+
+	for (page = 0; page < size; page += 4096) {
+		size_t end = min(page + 4096, size);
+
+		if (!memcmp(old + page, new + page, end - page))
+			continue;
+
+		for (offset = page; offset < end; offset += 4) {
+			uint32_t old_val = *(const uint32_t *)(old + offset);
+			uint32_t new_val = *(const uint32_t *)(new + offset);
+			struct reg reg = {};
+
+			if (old_val == new_val)
+				continue;
+
+			parse_port_desc(&reg, NULL);
+			set_reg_by_addr(config, &reg, offset);
+
+			/* Unknown registers are only shown when verbose. */
+			if (reg.name || config->verbosity > 0)
+				dump_diff(config, &reg, old_val, new_val);
+
+			free(reg.name);
+		}
+	}
+
+	ret = EXIT_SUCCESS;
+
+	munmap((void *)new, new_size);
+out_old:
+	munmap((void *)old, old_size);
+
+	return ret;
+}
+
+/*
+ * XXX: add support for reading and re-decoding a previously done dump. diff
+ * only reads binary snapshots, not the text output of dump.
+ */
 static int intel_reg_decode(struct config *config, int argc, char *argv[])
 {
 	int i;
@@ -717,6 +927,8 @@ struct command {
 	const char *description;
 	const char *synopsis;
 	int (*function)(struct config *config, int argc, char *argv[]);
+	/* runs without a device, given --devid */
+	bool offline;
 };
 
 static const struct command commands[] = {
@@ -748,6 +960,13 @@ static const struct command commands[] = {
 		.function = intel_reg_snapshot,
 		.description = "create a snapshot of the MMIO bar to stdout",
 	},
+	{
+		.name = "diff",
+		.function = intel_reg_diff,
+		.synopsis = "SNAPSHOT [SNAPSHOT]",
+		.description = "decode registers that differ between snapshots",
+		.offline = true,
+	},
 	{
 		.name = "list",
 		.function = intel_reg_list,
@@ -791,7 +1010,7 @@ static int intel_reg_help(struct config *config, int argc, char *argv[])
 	printf("OPTIONS common to most COMMANDS:\n");
 	printf(" --spec=PATH    Read register spec from directory or file\n");
 	printf(" --mmio=FILE    Use an MMIO snapshot\n");
-	printf(" --devid=DEVID  Specify PCI device ID for --mmio=FILE\n");
+	printf(" --devid=DEVID  Specify PCI device ID for --mmio=FILE or diff\n");
 	printf(" --all          Decode registers for all known platforms\n");
 	printf(" --binary       Binary dump registers\n");
 	printf(" --verbose      Increase verbosity\n");
@@ -1015,7 +1234,19 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	if (config.mmiofile) {
+	for (i = 0; i < ARRAY_SIZE(commands); i++) {
+		if (strcmp(argv[0], commands[i].name) == 0) {
+			command = &commands[i];
+			break;
+		}
+	}
+
+	if (!command) {
+		fprintf(stderr, "'%s' is not an intel-reg command\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (config.mmiofile || (command->offline && config.devid)) {
 		if (!config.devid) {
 			fprintf(stderr, "--mmio requires --devid\n");
 			return EXIT_FAILURE;
@@ -1034,20 +1265,15 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	for (i = 0; i < ARRAY_SIZE(commands); i++) {
-		if (strcmp(argv[0], commands[i].name) == 0) {
-			command = &commands[i];
-			break;
-		}
-	}
-
-	if (!command) {
-		fprintf(stderr, "'%s' is not an intel-reg command\n", argv[0]);
+	if (build_reg_index(&config)) {
+		fprintf(stderr, "Error: %s\n", strerror(ENOMEM));
 		return EXIT_FAILURE;
 	}
 
 	ret = command->function(&config, argc, argv);
 
+	free_reg_index(&config);
+
 	free(config.mmiofile);
 
 	if (config.fd >= 0)
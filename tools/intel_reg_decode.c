@@ -2673,6 +2673,76 @@ static struct {
 };
 #undef DECLARE_REGS
 
+/*
+ * All known register decoders sorted by address, then by the order in
+ * known_registers, so that decoding a register does not need to walk every
+ * table. Built on first use.
+ */
+struct decode_entry {
+	uint32_t addr;
+	uint16_t table;
+	uint16_t index;
+};
+
+static struct decode_entry *decode_index;
+static int decode_count;
+
+static int decode_entry_cmp(const void *A, const void *B)
+{
+	const struct decode_entry *a = A, *b = B;
+
+	if (a->addr != b->addr)
+		return a->addr < b->addr ? -1 : 1;
+	if (a->table != b->table)
+		return a->table < b->table ? -1 : 1;
+
+	return (int)a->index - (int)b->index;
+}
+
+static int build_decode_index(void)
+{
+	int i, j, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(known_registers); i++)
+		n += known_registers[i].count;
+
+	decode_index = calloc(n, sizeof(*decode_index));
+	if (!decode_index)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(known_registers); i++) {
+		for (j = 0; j < known_registers[i].count; j++) {
+			struct decode_entry *e = &decode_index[decode_count++];
+
+			e->addr = known_registers[i].regs[j].reg;
+			e->table = i;
+			e->index = j;
+		}
+	}
+
+	qsort(decode_index, decode_count, sizeof(*decode_index),
+	      decode_entry_cmp);
+
+	return 0;
+}
+
+/* Index of the first decoder for addr, or decode_count if there is none. */
+static int find_decode_entry(uint32_t addr)
+{
+	int lo = 0, hi = decode_count;
+
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if (decode_index[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
 /*
  * Decode register value into buffer for devid.
  *
@@ -2683,15 +2753,23 @@ int intel_reg_spec_decode(char *buf, size_t bufsize, const struct reg *reg,
 			  uint32_t val, uint32_t devid)
 {
 	char tmp[1024];
-	int i, j;
+	int i, n;
 
 	if (!bufsize)
 		return -1;
 
 	*buf = 0;
 
-	for (i = 0; i < ARRAY_SIZE(known_registers); i++) {
-		const struct reg_debug *regs = known_registers[i].regs;
+	if (!decode_index && build_decode_index())
+		return -1;
+
+	for (n = find_decode_entry(reg->addr);
+	     n < decode_count && decode_index[n].addr == reg->addr;
+	     n++) {
+		const struct reg_debug *r;
+
+		i = decode_index[n].table;
+		r = &known_registers[i].regs[decode_index[n].index];
 
 		if (devid) {
 			if (known_registers[i].match &&
@@ -2699,31 +2777,25 @@ int intel_reg_spec_decode(char *buf, size_t bufsize, const struct reg *reg,
 				continue;
 		}
 
-		for (j = 0; j < known_registers[i].count; j++) {
-			const struct reg_debug *r = &regs[j];
-			if (reg->addr != r->reg)
-				continue;
-
-			if (r->debug_output) {
-				if (r->debug_output(tmp, sizeof(tmp), r->reg,
-						    val, devid) == 0)
-					continue;
-			} else if (devid) {
-				return 0;
-			} else {
+		if (r->debug_output) {
+			if (r->debug_output(tmp, sizeof(tmp), r->reg,
+					    val, devid) == 0)
 				continue;
-			}
-
-			if (devid) {
-				strncpy(buf, tmp, bufsize);
-				return 0;
-			}
+		} else if (devid) {
+			return 0;
+		} else {
+			continue;
+		}
 
-			strncat(buf, known_registers[i].description, bufsize);
-			strncat(buf, "\t", bufsize);
-			strncat(buf, tmp, bufsize);
-			strncat(buf, "\n", bufsize);
+		if (devid) {
+			strncpy(buf, tmp, bufsize);
+			return 0;
 		}
+
+		strncat(buf, known_registers[i].description, bufsize);
+		strncat(buf, "\t", bufsize);
+		strncat(buf, tmp, bufsize);
+		strncat(buf, "\n", bufsize);
 	}
 
 	return 0;